@@ -0,0 +1,59 @@
+dnl
+dnl AM_PATH_PCRE2(MINIMUM-VERSION, [ACTION-IF-FOUND [, ACTION-IF-NOT-FOUND]])
+dnl
+dnl like AM_PATH_PCRE, but for the 8 bit libpcre2 (found with pcre2-config).
+dnl PREG_USE_PCRE2 is added to PCRE_CFLAGS so that preg_pcre2.h is used 
+dnl instead of pcre.h
+dnl
+AC_DEFUN([AM_PATH_PCRE2],
+[
+
+  if test x$pcre2_config_prefix != x ; then
+     if test x${PCRE2_CONFIG+set} != xset ; then
+        PCRE2_CONFIG=$pcre2_config_prefix/bin/pcre2-config
+     fi
+  fi
+
+  AC_PATH_PROG(PCRE2_CONFIG, pcre2-config, no)
+  pcre2_version_min=$1
+
+  AC_MSG_CHECKING(for PCRE2 - version >= $pcre2_version_min)
+  no_pcre2=""
+  if test "$PCRE2_CONFIG" = "no" ; then
+    AC_MSG_RESULT(no)
+    no_pcre2=yes
+  else
+    PCRE_CFLAGS="`$PCRE2_CONFIG --cflags` -DPREG_USE_PCRE2"
+    PCRE_LIBS=`$PCRE2_CONFIG --libs8`
+    pcre2_version=`$PCRE2_CONFIG --version`
+
+    pcre2_major_version=`echo $pcre2_version | cut -d. -f1`
+    pcre2_minor_version=`echo $pcre2_version | cut -d. -f2`
+
+    pcre2_major_min=`echo $pcre2_version_min | cut -d. -f1`
+    pcre2_minor_min=`echo $pcre2_version_min | cut -d. -f2`
+
+    pcre2_version_proper=`expr \
+        $pcre2_major_version \> $pcre2_major_min \| \
+        $pcre2_major_version \= $pcre2_major_min \& \
+        $pcre2_minor_version \>= $pcre2_minor_min`
+
+    if test "$pcre2_version_proper" = "1" ; then
+      AC_MSG_RESULT([$pcre2_major_version.$pcre2_minor_version])
+    else
+      AC_MSG_RESULT(no)
+      no_pcre2=yes
+    fi
+  fi
+
+  if test "x$no_pcre2" = x ; then
+     ifelse([$2], , :, [$2])
+  else
+     PCRE_CFLAGS=""
+     PCRE_LIBS=""
+     ifelse([$3], , :, [$3])
+  fi
+
+  AC_SUBST(PCRE_CFLAGS)
+  AC_SUBST(PCRE_LIBS)
+])
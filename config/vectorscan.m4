@@ -0,0 +1,50 @@
+dnl
+dnl AM_PATH_VECTORSCAN([ACTION-IF-FOUND [, ACTION-IF-NOT-FOUND]])
+dnl
+dnl looks for libhs from vectorscan (or hyperscan), with pkg-config unless
+dnl vectorscan_prefix is set, and sets HS_CFLAGS and HS_LIBS.
+dnl PREG_USE_VECTORSCAN is added to HS_CFLAGS so that preg_hs.c is 
+dnl compiled in.
+dnl
+AC_DEFUN([AM_PATH_VECTORSCAN],
+[
+
+  if test x$vectorscan_prefix != x ; then
+    HS_CFLAGS="-I$vectorscan_prefix/include/hs"
+    HS_LIBS="-L$vectorscan_prefix/lib -lhs"
+  else
+    AC_PATH_PROG(PKG_CONFIG, pkg-config, no)
+    if test "$PKG_CONFIG" != "no" && $PKG_CONFIG --exists libhs ; then
+      HS_CFLAGS=`$PKG_CONFIG --cflags libhs`
+      HS_LIBS=`$PKG_CONFIG --libs libhs`
+    else
+      HS_CFLAGS="-I/usr/include/hs"
+      HS_LIBS="-lhs"
+    fi
+  fi
+
+  AC_MSG_CHECKING(for libhs)
+  ac_save_CFLAGS="$CFLAGS"
+  ac_save_LIBS="$LIBS"
+  CFLAGS="$CFLAGS $HS_CFLAGS"
+  LIBS="$HS_LIBS $LIBS"
+  AC_TRY_LINK([#include <hs.h>],
+              [ hs_free_database( 0 ) ; ],
+              no_hs="", no_hs=yes)
+  CFLAGS="$ac_save_CFLAGS"
+  LIBS="$ac_save_LIBS"
+
+  if test "x$no_hs" = x ; then
+     AC_MSG_RESULT(yes)
+     HS_CFLAGS="$HS_CFLAGS -DPREG_USE_VECTORSCAN"
+     ifelse([$1], , :, [$1])
+  else
+     AC_MSG_RESULT(no)
+     HS_CFLAGS=""
+     HS_LIBS=""
+     ifelse([$2], , :, [$2])
+  fi
+
+  AC_SUBST(HS_CFLAGS)
+  AC_SUBST(HS_LIBS)
+])
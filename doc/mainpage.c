@@ -118,15 +118,28 @@
  * @li @ref PREG_CHECK_SECTION "preg_check" 
  * check if a string is a valid perl-compatible regular expression
  *
+ * @li @ref PREG_CLASSIFY_SECTION "preg_classify"
+ * get the label of the first of many patterns that matches
+ *
+ * @li @ref PREG_COMPILE_SET_SECTION "preg_compile_set"
+ * put the patterns of a group of rows into a BLOB, for preg_set_match
+ *
  * @li @ref PREG_POSITION_SECTION "preg_position"
  * get position of the of a regular expression capture group in a string
 
  * @li @ref PREG_REPLACE_SECTION "preg_replace"
  * perform regular expression search & replace using PCRE.
  *
+ * @li @ref PREG_REPLACE_MAP_SECTION "preg_replace_map"
+ * replace many literal strings in one pass
+ *
  * @li @ref PREG_RLIKE_SECTION "preg_rlike"
  * test if a string matches a perl-compatible regular expression
  *
+ * @li @ref PREG_SET_MATCH_SECTION "preg_set_match"
+ * get the label of the first pattern of a set from preg_compile_set that 
+ * matches
+ *
  * @li @ref LIB_MYSQLUDF_PREG_INFO_SECTION "lib_mysqludf_preg_info"
  * get information about the installed lib_mysqludf_preg library
  *
@@ -140,6 +153,14 @@
  * @copydoc PREG_CHECK
  *
  * @n
+ * @section PREG_CLASSIFY_SECTION preg_classify
+ * @copydoc PREG_CLASSIFY
+ *
+ * @n
+ * @section PREG_COMPILE_SET_SECTION preg_compile_set
+ * @copydoc PREG_COMPILE_SET
+ *
+ * @n
  * @section PREG_POSITION_SECTION preg_position 
  * @copydoc PREG_POSITION
  *
@@ -148,10 +169,18 @@
  * @copydoc PREG_REPLACE
  *
  * @n
+ * @section PREG_REPLACE_MAP_SECTION preg_replace_map 
+ * @copydoc PREG_REPLACE_MAP
+ *
+ * @n
  * @section PREG_RLIKE_SECTION preg_rlike 
  * @copydoc PREG_RLIKE
  *
  * @n
+ * @section PREG_SET_MATCH_SECTION preg_set_match
+ * @copydoc PREG_SET_MATCH
+ *
+ * @n
  * @section LIB_MYSQLUDF_PREG_INFO_SECTION lib_mysqludf_preg_info 
  * @copydoc LIB_MYSQLUDF_PREG_INFO
  *
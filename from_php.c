@@ -51,7 +51,11 @@ POSSIBILITY OF SUCH DAMAGE.
  * with a mysql udf and elsewhere.
  */
 
+#ifdef PREG_USE_PCRE2
+#include "preg_pcre2.h"
+#else
 #include "pcre.h"
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -62,6 +66,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "ghfcns.h"
 #include "preg_utils.h"
+#include "preg_cache.h"
+#include "from_php.h"
 
 #undef HAVE_SETLOCALE   // R.A.W
 
@@ -77,12 +83,30 @@ POSSIBILITY OF SUCH DAMAGE.
 
 
 
- /** @fn pcre *compileRegex( char *regex,int regex_len,char *msg, int msglen ) 
+ /** @fn static pcre *compilePattern( const char *regex , int regex_len ,
+  *                                    char **pattern_out , int *options ,
+  *                                    pcre_extra **extra ,
+  *                                    preg_nfa **nfa , int *longest ,
+  *                                    preg_literal **literal , 
+  *                                    char *msg , int msglen )
   * 
   * @brief Compile a pcre regular expression
   * 
   *    @param regex - a STRING pcre regular expression to be compiled
-  *    @param regex_len - the length of the passed in regex
+  *    @param regex_len - the length of regex
+  *    @param pattern_out - put regex without its delimiters and modifiers 
+  *    here, for building the other matchers later (see pregCacheDfa).
+  *    This is NULL if the compile failed.
+  *    @param options - put the pcre options of the modifiers here
+  *    @param extra - put the results of studying the pattern here.  This
+  *    is NULL unless the S modifier was used.
+  *    @param nfa - put the pattern compiled for the linear-time matcher
+  *    (preg_nfa.c) here.  This is NULL unless the L modifier was used.
+  *    @param longest - set to 1 if the F modifier was used (the pattern
+  *    is to be run by pcre_dfa_exec), else 0
+  *    @param literal - put the pattern compiled for the substring search
+  *    (preg_literal.c) here.  This is NULL unless the pattern has no 
+  *    metacharacters.
   *    @param msg - a buffer to store potential error an info messages
   *    @param msglen  - size of the message buffer
   *
@@ -91,29 +115,36 @@ POSSIBILITY OF SUCH DAMAGE.
   *    NULL - on error - some errors will copy a more detailed info into msg
   *
   * @details
+  *    This does the actual work for compileRegex, which checks the pattern
+  * cache before calling this.
   *
   * @note
-  *    This function requires a NULL terminated string as the regex parameter.
-  * This is a limitation to the original php function from which this was
-  * copied.
+  *    regex does not need to be null terminated.  It ends at regex_len
+  * bytes or at a null byte, whichever comes first.
   *    
   */
 
 //PHPAPI pcre_cache_entry* pcre_get_compiled_regex_cache(char *regex, int regex_len TSRMLS_DC)
-pcre *compileRegex( char *regex , int regex_len , char *msg , int msglen ) 
+static pcre *compilePattern( const char *regex , int regex_len ,
+                              char **pattern_out , int *options ,
+                              pcre_extra **extra ,
+                              preg_nfa **nfa , int *longest ,
+                              preg_literal **literal ,
+                              char *msg , int msglen ) 
 {
 	pcre				*re = NULL;
-	pcre_extra			*extra;
 	int					 coptions = 0;
-	int					 soptions = 0;
 	const char			*error;
 	int					 erroffset;
 	char				 delimiter;
 	char				 start_delimiter;
 	char				 end_delimiter;
-	char				*p, *pp;
+	const char			*p, *pp;
+	const char			*end;
 	char				*pattern;
 	int					 do_study = 0;
+	int					 do_linear = 0;
+	int					 do_longest = 0;
 	//int					 poptions = 0;
 	unsigned const char *tables = NULL;
     char buf[ 1024 ] ;
@@ -122,45 +153,24 @@ pcre *compileRegex( char *regex , int regex_len , char *msg , int msglen )
 	char				*locale = setlocale(LC_CTYPE, NULL);
 #endif
 
-    //R.A.W.
-	//pcre_cache_entry	*pce;
-	//pcre_cache_entry	 new_entry;
     if( msglen )
     {
         *msg = '\0';
     }
 
-	/* Try to lookup the cached regex entry, and if successful, just pass
-	   back the compiled pattern, otherwise go on and compile it. */
-	//regex_len = strlen(regex);
-
-//R.A.W.
-#if 0  
-
-	if (zend_hash_find(&PCRE_G(pcre_cache), regex, regex_len+1, (void **)&pce) == SUCCESS) {
-		/*
-		 * We use a quick pcre_info() check to see whether cache is corrupted, and if it
-		 * is, we flush it and compile the pattern from scratch.
-		 */
-		if (pcre_info(pce->re, NULL, NULL) == PCRE_ERROR_BADMAGIC) {
-			zend_hash_clean(&PCRE_G(pcre_cache));
-		} else {
-#if HAVE_SETLOCALE
-			if (!strcmp(pce->locale, locale)) {
-#endif
-				return pce;
-#if HAVE_SETLOCALE
-			}
-#endif
-		}
-	}
-#endif
 	p = regex;
+
+    // R.A.W.  The pattern is parsed by length, straight from the mysql
+    // argument, instead of from a null terminated copy of it.  A null
+    // byte still ends it, as it did when it was copied.
+	end = memchr(regex, 0, regex_len);
+	if (end == NULL)
+		end = regex + regex_len;
 	
 	/* Parse through the leading whitespace, and display a warning if we
 	   get to the end without encountering a delimiter. */
-	while (isspace((int)*(unsigned char *)p)) p++;
-	if (*p == 0) {
+	while (p < end && isspace((int)*(unsigned char *)p)) p++;
+	if (p == end) {
 
         // R.A.W.
 		//php_error_docref(NULL TSRMLS_CC, E_WARNING, "Empty regular expression");
@@ -188,13 +198,13 @@ pcre *compileRegex( char *regex , int regex_len , char *msg , int msglen )
 		   but skipping the backslashed delimiters.  If the ending delimiter is not
 		   found, display a warning. */
 		pp = p;
-		while (*pp != 0) {
-			if (*pp == '\\' && pp[1] != 0) pp++;
+		while (pp < end) {
+			if (*pp == '\\' && pp + 1 < end) pp++;
 			else if (*pp == delimiter)
 				break;
 			pp++;
 		}
-		if (*pp == 0) {
+		if (pp >= end) {
 			//php_error_docref(NULL TSRMLS_CC,E_WARNING, "No ending delimiter '%c' found", delimiter);
 
             //R.A.W.
@@ -209,15 +219,15 @@ pcre *compileRegex( char *regex , int regex_len , char *msg , int msglen )
 		 */
 		int brackets = 1; 	/* brackets nesting level */
 		pp = p;
-		while (*pp != 0) {
-			if (*pp == '\\' && pp[1] != 0) pp++;
+		while (pp < end) {
+			if (*pp == '\\' && pp + 1 < end) pp++;
 			else if (*pp == end_delimiter && --brackets <= 0)
 				break;
 			else if (*pp == start_delimiter)
 				brackets++;
 			pp++;
 		}
-		if (*pp == 0) {
+		if (pp >= end) {
 			//php_error_docref(NULL TSRMLS_CC,E_WARNING, "No ending matching delimiter '%c' found", end_delimiter);
 			strncpy( msg,"No ending matching delimiter found",msglen ) ;
 			return NULL;
@@ -230,7 +240,7 @@ pcre *compileRegex( char *regex , int regex_len , char *msg , int msglen )
     // osx compile is complaining about strndup and since I have te
     // other function anyway and since I'll someday rewrite this fn, just
     // call that other function now :>)
-    pattern = ghstrndup( p,pp-p) ;
+    pattern = ghstrndup( (char *)p,pp-p) ;
 
 
 	/* Move on to the options */
@@ -238,7 +248,7 @@ pcre *compileRegex( char *regex , int regex_len , char *msg , int msglen )
 
 	/* Parse through the options, setting appropriate flags.  Display
 	   a warning if we encounter an unknown modifier. */	
-	while (*pp != 0) {
+	while (pp < end) {
 		switch (*pp++) {
 			/* Perl compatible options */
 			case 'i':	coptions |= PCRE_CASELESS;		break;
@@ -256,6 +266,8 @@ pcre *compileRegex( char *regex , int regex_len , char *msg , int msglen )
 
                 // R.A.W.
 			/* Custom preg options */
+			case 'L':	do_linear = 1;					break;
+			case 'F':	do_longest = 1;					break;
                 //case 'e':	poptions |= PREG_REPLACE_EVAL;	break;
 			
 			case ' ':
@@ -301,63 +313,138 @@ pcre *compileRegex( char *regex , int regex_len , char *msg , int msglen )
 		return NULL;
 	}
 
+    // R.A.W.  The L modifier matches with the linear-time matcher.  The
+    // pcre compiled pattern is still kept for the group count & names.
+    // Studying is pointless since pcre_exec is never called.  Nothing else
+    // is done here: the other matchers are built from pattern when they
+    // are first used (see preg_cache.c), so that a pattern that is only 
+    // seen once costs little more than pcre_compile.
+	*extra = NULL;
+	*nfa = NULL;
+	*longest = do_longest;
+	*literal = pregLiteralCompile(pattern, coptions);
+	if (do_linear) {
+		*nfa = pregNfaCompile(pattern, coptions, buf, sizeof(buf));
+		if (*nfa == NULL) {
+			snprintf(msg, msglen, "Compilation of /%s/ failed: %s", pattern, buf);
+			free(pattern);
+			pregLiteralFree(*literal);
+			*literal = NULL;
+			pcre_free(re);
+			return NULL;
+		}
+	}
+
 	/* If study option was specified, study the pattern and
 	   store the result in extra for passing to pcre_exec. */
-	if (do_study) {
-		extra = pcre_study(re, soptions, &error);
-		if (extra) {
-			extra->flags |= PCRE_EXTRA_MATCH_LIMIT | PCRE_EXTRA_MATCH_LIMIT_RECURSION;
-		}
+	else if (do_study) {
+        // R.A.W.  The limits are set by pregInitExtra for each call to
+        // pcre_exec, since the study results are shared by all threads.
+		*extra = pregStudy(re, 1, &error);
 		if (error != NULL) {
 			strncpy( msg, "Error while studying pattern",msglen);
 		}
-	} else {
-		extra = NULL;
 	}
 
-	free(pattern);
+	*pattern_out = pattern;
+	*options = coptions;
 
 
-//R.A.W.
-#if 0 
-	/*
-	 * If we reached cache limit, clean out the items from the head of the list;
-	 * these are supposedly the oldest ones (but not necessarily the least used
-	 * ones).
-	 */
-	if (zend_hash_num_elements(&PCRE_G(pcre_cache)) == PCRE_CACHE_SIZE) {
-		int num_clean = PCRE_CACHE_SIZE / 8;
-		zend_hash_apply_with_argument(&PCRE_G(pcre_cache), pcre_clean_cache, &num_clean TSRMLS_CC);
-	}
-
-	/* Store the compiled pattern and extra info in the cache. */
-	new_entry.re = re;
-	new_entry.extra = extra;
-	new_entry.preg_options = poptions;
-	new_entry.compile_options = coptions;
-#if HAVE_SETLOCALE
-	new_entry.locale = pestrdup(locale, 1);
-	new_entry.tables = tables;
-#endif
-	zend_hash_update(&PCRE_G(pcre_cache), regex, regex_len+1, (void *)&new_entry,
-						sizeof(pcre_cache_entry), (void**)&pce);
-
-#endif
-
     //	return pce;
     //R.A.W.
     return re ;
 }
 
 
+ /** @fn preg_cache_entry *compileRegex( const char *regex , int regex_len ,
+  *                                      char *msg , int msglen )
+  * 
+  * @brief Compile a pcre regular expression, using the pattern cache
+  * 
+  *    @param regex - a STRING pcre regular expression to be compiled
+  *    @param regex_len - the length of the passed in regex
+  *    @param msg - a buffer to store potential error an info messages
+  *    @param msglen  - size of the message buffer
+  *
+  * @returns
+  *    the cache entry holding the compiled regular expression - on success
+  *    NULL - on error - some errors will copy a more detailed info into msg
+  *
+  * @details
+  *    Patterns are looked up in the process-wide cache (preg_cache.c) first
+  * and are only compiled if they are not found there.  Patterns that fail
+  * to compile are cached too, along with the error message, so that they
+  * are not recompiled every time they are seen.  If the pattern has the S
+  * modifier, the results of studying it are kept in the entry as well, and
+  * if it has the L modifier, so is the program for the linear-time matcher.
+  *
+  * @note
+  *    regex does not need to be null terminated, so it can be a mysql
+  * argument.  Call pregCacheRelease to release the returned entry.
+  */
+preg_cache_entry *compileRegex( const char *regex , int regex_len , 
+                                char *msg , int msglen ) 
+{
+    preg_cache_entry *pce ;
+    pcre *re ;
+    char *pattern ;
+    int options ;
+    pcre_extra *extra ;
+    preg_nfa *nfa ;
+    int longest ;
+    preg_literal *literal ;
+
+    if( msglen )
+    {
+        *msg = '\0';
+    }
+
+	/* Try to lookup the cached regex entry, and if successful, just pass
+	   back the compiled pattern, otherwise go on and compile it. */
+    pce = pregCacheFind( regex , regex_len ) ;
+    if( !pce )
+    {
+        pattern = NULL ;
+        options = 0 ;
+        extra = NULL ;
+        nfa = NULL ;
+        longest = 0 ;
+        literal = NULL ;
+        re = compilePattern( regex , regex_len , &pattern , &options , 
+                             &extra , &nfa , &longest , &literal ,
+                             msg , msglen ) ;
+        pce = pregCacheAdd( regex , regex_len , re , pattern , options ,
+                            extra , nfa , longest , literal , msg ) ;
+        if( !pce )
+        {
+            if( re )
+            {
+                strncpy( msg , "Out of memory" , msglen ) ;
+            }
+            return NULL ;
+        }
+    }
+
+    if( !pce->re )
+    {
+        strncpy( msg , pce->error , msglen ) ;
+        pregCacheRelease( pce ) ;
+        return NULL ;
+    }
+
+    return pce ;
+}
+
+
 /* {{{ preg_get_backref
  */
-static int preg_get_backref(char **str, int *backref)
+static int preg_get_backref(char **str, const char *end, int *backref)
 {
 	register char in_brace = 0;
 	register char *walk = *str;
 
-	if (walk[1] == 0)
+    // R.A.W.  The replacement isn't null terminated, so end is checked
+	if (walk + 1 >= end)
 		return 0;
 
 	if (*walk == '$' && walk[1] == '{') {
@@ -366,19 +453,19 @@ static int preg_get_backref(char **str, int *backref)
 	}
 	walk++;
 
-	if (*walk >= '0' && *walk <= '9') {
+	if (walk < end && *walk >= '0' && *walk <= '9') {
 		*backref = *walk - '0';
 		walk++;
 	} else
 		return 0;
 	
-	if (*walk && *walk >= '0' && *walk <= '9') {
+	if (walk < end && *walk >= '0' && *walk <= '9') {
 		*backref = *backref * 10 + *walk - '0';
 		walk++;
 	}
 
 	if (in_brace) {
-		if (*walk == 0 || *walk != '}')
+		if (walk >= end || *walk != '}')
 			return 0;
 		else
 			walk++;
@@ -389,13 +476,133 @@ static int preg_get_backref(char **str, int *backref)
 }
 
 
+ /** @fn preg_template *pregTemplateCompile( const char *replace , 
+  *                                         int replace_len )
+  * 
+  * @brief Parse a replacement string into literal text and backreferences
+  * 
+  *    @param replace - the replacement string (not null terminated)
+  *    @param replace_len - the length of replace
+  *
+  * @returns
+  *    the parsed replacement - on success.  Free with pregTemplateFree.
+  *    NULL - if out of memory
+  *
+  * @details
+  *    The replacement is parsed the same way that php's preg_replace did
+  * it for every match: $n, ${n} and \\n are backreferences to group n, and
+  * a backslash before a \\ or $ makes it literal.  Runs of literal text
+  * are kept, with the escapes removed, in template->text.  pregReplace 
+  * then only has to copy the segments for each match.
+  */
+preg_template *pregTemplateCompile( const char *replace , int replace_len )
+{
+	preg_template		*template;		/* Template being built */
+	preg_template_seg	*seg;			/* Segments, as they are grown */
+	const char			*replace_end;	/* End of replacement string */
+	char				*walk,			/* Used to walk the replacement string */
+						 walk_last;		/* Last walked character */
+	int					 backref;		/* Backreference number */
+	int					 nsegs_alloc;	/* Number of segments allocated */
+	int					 lit_start;		/* Start of current literal run */
+
+	template = malloc(sizeof(preg_template) + replace_len + 1);
+	if (!template)
+		return NULL;
+	template->text = (char *)(template + 1);
+	template->text_len = 0;
+	template->nsegs = 0;
+	template->nbackrefs = 0;
+	nsegs_alloc = 8;
+	template->segs = malloc(nsegs_alloc * sizeof(preg_template_seg));
+	if (!template->segs) {
+		free(template);
+		return NULL;
+	}
+
+	replace_end = replace + replace_len;
+	walk = (char *)replace;
+	walk_last = 0;
+	lit_start = 0;
+	while (1) {
+		// R.A.W.  A segment is added for the literal text before each 
+		// backreference (if there is any), and for the backreference
+		if (walk < replace_end && ('\\' == *walk || '$' == *walk) && 
+			walk_last != '\\' && preg_get_backref(&walk, replace_end, &backref))
+			;
+		else if (walk < replace_end) {
+			if (('\\' == *walk || '$' == *walk) && walk_last == '\\') {
+				template->text[template->text_len - 1] = *walk++;
+				walk_last = 0;
+			} else {
+				template->text[template->text_len++] = *walk++;
+				walk_last = walk[-1];
+			}
+			continue;
+		} else
+			backref = -1;
+
+		if (template->nsegs + 2 > nsegs_alloc) {
+			nsegs_alloc *= 2;
+			seg = realloc(template->segs, nsegs_alloc * sizeof(preg_template_seg));
+			if (!seg) {
+				pregTemplateFree(template);
+				return NULL;
+			}
+			template->segs = seg;
+		}
+
+		if (template->text_len > lit_start) {
+			seg = &template->segs[template->nsegs++];
+			seg->backref = -1;
+			seg->offset = lit_start;
+			seg->len = template->text_len - lit_start;
+			lit_start = template->text_len;
+		}
+
+		if (backref < 0)
+			break;
+
+		seg = &template->segs[template->nsegs++];
+		seg->backref = backref;
+		seg->offset = 0;
+		seg->len = 0;
+		template->nbackrefs++;
+	}
+	template->text[template->text_len] = '\0';
+
+	return template;
+}
+
+
+ /** @fn void pregTemplateFree( preg_template *template )
+  * 
+  * @brief Free a replacement parsed by pregTemplateCompile
+  * 
+  *    @param template - the parsed replacement.  May be NULL.
+  */
+void pregTemplateFree( preg_template *template )
+{
+	if (template) {
+		free(template->segs);
+		free(template);
+	}
+}
+
 
 /* {{{ php_pcre_replace_impl() */
 //char *php_pcre_replace_impl(pcre_cache_entry *pce, char *subject, int subject_len, zval *replace_val, 
-char *pregReplace(pcre *re , pcre_extra *extra , 
-                     char *subject, int subject_len, char *replace, 
-                     int replace_len , 
-                     int is_callable_replace, int *result_len, int limit, 
+char *pregReplace(pcre *re , pcre_extra *extra , const preg_nfa *nfa ,
+                     const preg_literal *literal ,
+                     const preg_literal *required ,
+                     const preg_start *start ,
+                     const preg_class *cls ,
+                     int *workspace , int wscount ,
+                     int *offsets , int size_offsets ,
+                     const char *subject, int subject_len, 
+                     const preg_template *template ,
+                     int is_callable_replace, preg_buffer *result_buf ,
+                     int *result_len, int limit, 
                      int *replace_count, char *msg , int msglen )
 {
     // R.A.W.
@@ -403,40 +610,29 @@ char *pregReplace(pcre *re , pcre_extra *extra ,
 	pcre_extra		 extra_data;		/* Used locally for exec options */
 	int				 exoptions = 0;		/* Execution options */
 	int				 count = 0;			/* Count of matched subpatterns */
-	int				*offsets;			/* Array of subpattern offsets */
-	int				 size_offsets;		/* Size of the offsets array */
 	int				 new_len;			/* Length of needed storage */
-	int				 alloc_len;			/* Actual allocated length */
 	//int				 eval_result_len=0;	/* Length of the eval'ed or
     //function-returned string */
 	int				 match_len;			/* Length of the current match */
 	int				 backref;			/* Backreference number */
+	const preg_template_seg *seg;		/* Segment of the replacement */
+	const preg_template_seg *segs_end;	/* End of the segments */
 	int				 eval;				/* If the replacement string should be eval'ed */
 	int				 start_offset;		/* Where the new search starts */
 	int				 g_notempty=0;		/* If the match should not be empty */
 	//int				 replace_len=0;		/* Length of replacement string */
-	char			*result,			/* Result of replacement */
+	char			*walkbuf;			/* Location of current replacement in the result */
     //*replace=NULL,		/* Replacement string */  R.A.W.
-					*new_buf,			/* Temporary buffer for re-allocation */
-					*walkbuf,			/* Location of current replacement in the result */
-					*walk,				/* Used to walk the replacement string */
-					*match,				/* The current match */
-					*piece,				/* The current piece of subject */
-					*replace_end=NULL,	/* End of replacement string */
-					 walk_last;			/* Last walked character */
+	const char		*match,				/* The current match */
+					*piece;				/* The current piece of subject */
     //*eval_result,		/* Result of eval or custom function */
-	int				 rc;
-
-	if (extra == NULL) {
-        // R.A.W.
-        memset( &extra_data , 0 , sizeof( extra_data ) ) ;
-		extra_data.flags = PCRE_EXTRA_MATCH_LIMIT | PCRE_EXTRA_MATCH_LIMIT_RECURSION;
-		extra = &extra_data;
-	}
 
     // R.A.W.  -- from php.ini-reccommended
     // These might be too big. Crashes can occur with this large recursion_limit
-    pregSetLimits(extra);
+    // The study data passed in belongs to the caller (and may be used for 
+    // other rows), so the limits are set on a local copy.
+    pregInitExtra(&extra_data, extra);
+    extra = &extra_data;
 	//extra->match_limit = PCRE_G(backtrack_limit);
 	//extra->match_limit_recursion = PCRE_G(recursion_limit);
 
@@ -455,41 +651,39 @@ char *pregReplace(pcre *re , pcre_extra *extra ,
 			return NULL;
 		}
 	} else {
-        // R.A.W.
+        // R.A.W.  The replacement has already been parsed into template
 		//replace = Z_STRVAL_P(replace_val);
 		//replace_len = Z_STRLEN_P(replace_val);
-		replace_end = replace + replace_len;
+		segs_end = template->segs + template->nsegs;
+	}
+
+    // R.A.W.  A single character class that is replaced by text is done
+    // without libpcre (see preg_class.c).  Limits below -1 are left to 
+    // the loop below, which fails on the first match for them.
+	if (cls && !template->nbackrefs && limit >= -1) {
+		count = pregClassReplace(cls, subject, subject_len, template->text,
+								 template->text_len, limit, result_buf,
+								 result_len);
+		if (count < 0) {
+			strncpy( msg , "Out of memory for new_buf" , msglen ) ;
+			return NULL;
+		}
+		if (replace_count) {
+			*replace_count += count;
+		}
+		return result_buf->data;
 	}
 
 	/* Calculate the size of the offsets array, and allocate memory for it. */
+	// R.A.W.  The offsets array is the caller's, so that it's allocated 
+	// once instead of for every row.  It has room for all of the groups.
 	//rc = pcre_fullinfo(pce->re, extra, PCRE_INFO_CAPTURECOUNT, &size_offsets);
-	rc = pcre_fullinfo(re, extra, PCRE_INFO_CAPTURECOUNT, &size_offsets);
-	if (rc < 0) {
-		//php_error_docref(NULL TSRMLS_CC, E_WARNING, "Internal pcre_fullinfo() error %d", rc);
-        strncpy( msg , "Internal pcre_fullinfo() error" , msglen ) ;
-		return NULL;
-	}
-	size_offsets = (size_offsets + 1) * 3;
 	//offsets = (int *)safe_emalloc(size_offsets, sizeof(int), 0);
-    // R.A.W.
-	offsets = (int *)calloc(size_offsets, sizeof(int));
-    if( !offsets ) {
-        strncpy( msg , "Out of memory for offsets" , msglen ) ;
-		return NULL;
-    }
-                            
-	
+
 	//alloc_len = 2 * subject_len + 1;
-	alloc_len = 2 * subject_len + 1;
 	//result = safe_emalloc(alloc_len, sizeof(char), 0);
-    // R.A.W.
-	result = calloc(alloc_len, sizeof(char));
-    if( !result )
-    {
-        strncpy( msg , "Out of memory for result" , msglen ) ;
-        free( offsets ) ;
-		return NULL;
-    }
+    // R.A.W.  The result is built in the caller's buffer, which is grown
+    // as it's needed (see preg_pool.c)
     
 
 	/* Initialize */
@@ -507,8 +701,14 @@ char *pregReplace(pcre *re , pcre_extra *extra ,
 		count = pcre_exec(pce->re, extra, subject, subject_len, start_offset,
 						  exoptions|g_notempty, offsets, size_offsets);
         */
-		count = pcre_exec(re, extra, subject, subject_len, start_offset,
-						  exoptions|g_notempty, offsets, size_offsets);
+        // R.A.W.  No need to run the pattern past the last place the
+        // string that every match contains is found.
+		if (pregRequiredMissing(required, subject, subject_len, start_offset))
+			count = PCRE_ERROR_NOMATCH;
+		else
+			count = pregMatch(re, extra, nfa, literal, start,
+							  workspace, wscount, subject, subject_len, start_offset,
+							  exoptions|g_notempty, offsets, size_offsets);
 		
 		/* Check for too many substrings condition. */
 		if (count == 0) {
@@ -547,52 +747,29 @@ char *pregReplace(pcre *re , pcre_extra *extra ,
 #endif
 
             { /* do regular substitution */
-				walk = replace;
-				walk_last = 0;
-				while (walk < replace_end) {
-					if ('\\' == *walk || '$' == *walk) {
-						if (walk_last == '\\') {
-							walk++;
-							walk_last = 0;
-							continue;
-						}
-						if (preg_get_backref(&walk, &backref)) {
-							if (backref < count)
-								new_len += offsets[(backref<<1)+1] - offsets[backref<<1];
-							continue;
-						}
+				// R.A.W.  The literal text's length is known from the template
+				new_len += template->text_len;
+				if (template->nbackrefs) {
+					for (seg = template->segs; seg < segs_end; seg++) {
+						backref = seg->backref;
+						if (backref >= 0 && backref < count)
+							new_len += offsets[(backref<<1)+1] - offsets[backref<<1];
 					}
-					new_len++;
-					walk++;
-					walk_last = walk[-1];
 				}
 			}
 
-			if (new_len + 1 > alloc_len) {
-				alloc_len = 1 + alloc_len + 2 * new_len;
-
-                // R.A.W. 
-				//new_buf = emalloc(alloc_len);
-                new_buf = malloc( alloc_len ) ;
-                if( !new_buf )
-                {
-                    strncpy( msg , "Out of memory for new_buf " , msglen ) ;
-                    free( offsets ) ;
-                    free( result ) ;
-                    return NULL;
-                }
-                    
-				memcpy(new_buf, result, *result_len);
-				//efree(result);
-                free( result ) ;
-				result = new_buf;
+			// R.A.W. 
+			//new_buf = emalloc(alloc_len);
+			if (!pregBufferGrow(result_buf, new_len + 1, *result_len)) {
+				strncpy( msg , "Out of memory for new_buf " , msglen ) ;
+				return NULL;
 			}
 			/* copy the part of the string before the match */
-			memcpy(&result[*result_len], piece, match-piece);
+			memcpy(&result_buf->data[*result_len], piece, match-piece);
 			*result_len += match-piece;
 
 			/* copy replacement and backrefs */
-			walkbuf = result + *result_len;
+			walkbuf = result_buf->data + *result_len;
 			
             // R.A.W.  Don't link in the eval stuff
 #if 0            
@@ -605,30 +782,20 @@ char *pregReplace(pcre *re , pcre_extra *extra ,
 			} else 
 #endif
 { /* do regular backreference copying */
-				walk = replace;
-				walk_last = 0;
-				while (walk < replace_end) {
-					if ('\\' == *walk || '$' == *walk) {
-						if (walk_last == '\\') {
-							*(walkbuf-1) = *walk++;
-							walk_last = 0;
-							continue;
-						}
-						if (preg_get_backref(&walk, &backref)) {
-							if (backref < count) {
-								match_len = offsets[(backref<<1)+1] - offsets[backref<<1];
-								memcpy(walkbuf, subject + offsets[backref<<1], match_len);
-								walkbuf += match_len;
-							}
-							continue;
-						}
+				for (seg = template->segs; seg < segs_end; seg++) {
+					backref = seg->backref;
+					if (backref < 0) {
+						memcpy(walkbuf, template->text + seg->offset, seg->len);
+						walkbuf += seg->len;
+					} else if (backref < count) {
+						match_len = offsets[(backref<<1)+1] - offsets[backref<<1];
+						memcpy(walkbuf, subject + offsets[backref<<1], match_len);
+						walkbuf += match_len;
 					}
-					*walkbuf++ = *walk++;
-					walk_last = walk[-1];
 				}
 				*walkbuf = '\0';
 				/* increment the result length by how much we've added to the string */
-				*result_len += walkbuf - (result + *result_len);
+				*result_len += walkbuf - (result_buf->data + *result_len);
 			}
 
 			if (limit != -1)
@@ -642,31 +809,24 @@ char *pregReplace(pcre *re , pcre_extra *extra ,
 			if (g_notempty != 0 && start_offset < subject_len) {
 				offsets[0] = start_offset;
 				offsets[1] = start_offset + 1;
-				memcpy(&result[*result_len], piece, 1);
+				// R.A.W.  The result can be longer than the subject by now
+				if (!pregBufferGrow(result_buf, *result_len + 2, *result_len)) {
+					strncpy( msg , "Out of memory for new_buf" , msglen ) ;
+					return NULL;
+				}
+				memcpy(&result_buf->data[*result_len], piece, 1);
 				(*result_len)++;
 			} else {
 				new_len = *result_len + subject_len - start_offset;
-				if (new_len + 1 > alloc_len) {
-					alloc_len = new_len + 1; /* now we know exactly how long it is */
-					//new_buf = safe_emalloc(alloc_len, sizeof(char), 0);
-                    new_buf = calloc(alloc_len, sizeof(char));
-                    if( !new_buf )
-                    {
-                        strncpy( msg , "Out of memory for new_buf" , msglen ) ;
-                        free( offsets ) ;
-                        free( result ) ;
-                        return NULL;
-                    }
-                        
-					memcpy(new_buf, result, *result_len);
-					free(result);
-					//efree(result);
-					result = new_buf;
+				//new_buf = safe_emalloc(alloc_len, sizeof(char), 0);
+				if (!pregBufferGrow(result_buf, new_len + 1, *result_len)) {
+					strncpy( msg , "Out of memory for new_buf" , msglen ) ;
+					return NULL;
 				}
 				/* stick that last bit of string on our output */
-				memcpy(&result[*result_len], piece, subject_len - start_offset);
+				memcpy(&result_buf->data[*result_len], piece, subject_len - start_offset);
 				*result_len += subject_len - start_offset;
-				result[*result_len] = '\0';
+				result_buf->data[*result_len] = '\0';
 				break;
 			}
 		} else {
@@ -675,10 +835,8 @@ char *pregReplace(pcre *re , pcre_extra *extra ,
 			//pcre_handle_exec_error(count);
 			snprintf(msg, msglen, "Exec failed with error %d (%s)", count, pregExecErrorString(count));
 			*result_len = count;
-			free( result ) ;
 			//efree(result);
-			result = NULL;
-			break;
+			return NULL;
 		}
 			
 
@@ -691,10 +849,9 @@ char *pregReplace(pcre *re , pcre_extra *extra ,
 		start_offset = offsets[1];
 	}
 	
-    free( offsets ) ;
 	//efree(offsets);
 
-	return result;
+	return result_buf->data;
 }
 /* }}} */
 
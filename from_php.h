@@ -7,10 +7,46 @@
  *
  */
 
-char *pregReplace(pcre *re , pcre_extra *extra , 
-                  const char *subject, int subject_len, const char *replace, 
-                  int replace_len , 
-                  int is_callable_replace, int *result_len, int limit, 
+#ifndef FROM_PHP_H
+#define FROM_PHP_H
+
+#include "preg_pool.h"
+
+/*
+ * A replacement string, parsed by pregTemplateCompile into runs of literal
+ * text and backreferences
+ */
+typedef struct preg_template_seg_s {
+    int backref ;               /* group number, or -1 for literal text */
+    int offset ;                /* literal text is template->text + offset */
+    int len ;                   /* length of the literal text */
+} preg_template_seg ;
+
+typedef struct preg_template_s {
+    char *text ;                /* the literal text with escapes removed */
+    int text_len ;              /* total length of the literal text */
+    int nbackrefs ;             /* number of backreference segments */
+    int nsegs ;                 /* number of segments */
+    preg_template_seg *segs ;   /* the segments, in order */
+} preg_template ;
+
+preg_template *pregTemplateCompile( const char *replace , int replace_len ) ;
+void pregTemplateFree( preg_template *template ) ;
+
+char *pregReplace(pcre *re , pcre_extra *extra , const preg_nfa *nfa ,
+                  const preg_literal *literal ,
+                  const preg_literal *required ,
+                  const preg_start *start ,
+                  const preg_class *cls ,
+                  int *workspace , int wscount ,
+                  int *offsets , int size_offsets ,
+                  const char *subject, int subject_len, 
+                  const preg_template *template ,
+                  int is_callable_replace, preg_buffer *result_buf ,
+                  int *result_len, int limit, 
                   int *replace_count, char *msg , int msglen );
 
-pcre *compileRegex( const char *regex , int regex_len , char *msg , int msglen ) ;
+preg_cache_entry *compileRegex( const char *regex , int regex_len , 
+                                char *msg , int msglen ) ;
+
+#endif
@@ -3,8 +3,12 @@ USE mysql;
 CREATE FUNCTION lib_mysqludf_preg_info RETURNS STRING SONAME 'lib_mysqludf_preg.so';
 CREATE FUNCTION preg_capture RETURNS STRING SONAME 'lib_mysqludf_preg.so';
 CREATE FUNCTION preg_check RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_classify RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+CREATE AGGREGATE FUNCTION preg_compile_set RETURNS STRING SONAME 'lib_mysqludf_preg.so';
 CREATE FUNCTION preg_replace RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_replace_map RETURNS STRING SONAME 'lib_mysqludf_preg.so';
 CREATE FUNCTION preg_rlike RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
 CREATE FUNCTION preg_position RETURNS INTEGER SONAME 'lib_mysqludf_preg.so';
+CREATE FUNCTION preg_set_match RETURNS STRING SONAME 'lib_mysqludf_preg.so';
 
 
@@ -148,10 +148,13 @@ void preg_capture_deinit( UDF_INIT* initid );
  *
  * @details This function calls pregInit to handle the common init taskes.
  * It also checks to make sure there are at least arguments, and checks
- * the type of the 'group'  and 'occurence' arguments.
+ * the type of the 'group'  and 'occurence' arguments.  max_length is
+ * set to the longest string the group can match (see pregMaxLength).
  */
 bool preg_capture_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
 {
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+
     if (args->arg_count < 2)
     {
         strncpy(message,"PREG_CAPTURE: requires at least 2 arguments", MYSQL_ERRMSG_SIZE);
@@ -170,9 +173,26 @@ bool preg_capture_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
     // preg_capture can return NULL
     initid->maybe_null=1;	
 
-    // Default value of max_length should be sufficient
+    if( pregInit( initid , args , message ) )
+        return 1 ;
+    ptr = (struct preg_s *)initid->ptr ;
+
+    // Only the offsets of a constant group are needed
+    pregNeedGroups( ptr , pregGroupsUsed( args , 2 ) );
+
+    // The result is part of the subject, and no longer than the group can
+    // be when the pattern & group are constant.  max_length of -1 means no
+    // limit ; don't change it if that.
+    if( ((int)initid->max_length) > 0 && ptr->re.pce &&
+        ( args->arg_count < 3 || args->args[2] ) )
+    {
+        initid->max_length = pregMaxLength( ptr->re.pce , 
+                                            pregGetGroupNum( ptr->re.pce->re ,
+                                                             args , 2 ) ,
+                                            args->lengths[1] ) ;
+    }
 
-    return ( pregInit( initid , args , message ) ) ;
+    return 0 ;
 }
 
 
@@ -199,9 +219,8 @@ bool preg_capture_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
  *
  * @details This function uses the pregSkipToOccurence function to call
  * pcre_ex repeatedly until the requested occurence is found.
- * It then uses pcre_get_substring (or copy) to retrieve any 
- * capture groups from the pattern.  It then returns the appropriate 
- * string or NULL.
+ * It then returns a pointer to the requested capture group inside of
+ * the subject argument, or NULL.
  */
 char *preg_capture(UDF_INIT *initid , UDF_ARGS *args, char *result, 
                    unsigned long *length, char *is_null , char *error )
@@ -211,19 +230,16 @@ char *preg_capture(UDF_INIT *initid , UDF_ARGS *args, char *result,
     int l ;                     /* length of captured info */
     char msg[255] ;             /* to store errors from regex compile */
     int occurence ;             /* occurence of the pattern to capture from */
-    int oveccount ;             /* number of items captures */
-    int *ovector;               /* for offsets of captures */
     struct preg_s *ptr ;        /* local holder of initid->ptr */
     int rc ;                    /* number of regex's matched by pattern  */
-    pcre *re ;                  /* the compiled pattern */
-    const char *res2 ;          /* for pcre_get_substring to alloc */
+    struct preg_regex_s *pre ;  /* the compiled pattern */
+    int start ;                 /* offset of captured info in ex_subject */
     char *subject ;             /* args[1] */
 
     ptr = (struct preg_s *) initid->ptr ;
 
     *is_null = 1 ;              /* default to NULL return */
     *error = 0 ;                /* default to no error */
-    *ptr->return_buffer = '\0'; /* clear return value */
     *length = 0 ;               /* just to be safe  */
 
 #ifndef GH_1_0_NULL_HANDLING
@@ -237,28 +253,13 @@ char *preg_capture(UDF_INIT *initid , UDF_ARGS *args, char *result,
 #endif
 
     // compile the regex if necessary
-    if( ptr->constant_pattern )
-        re = ptr->re ;
-    else
+    pre = pregGetRegex( ptr , args , msg , sizeof(msg)) ;
+    if( !pre )
     {
-        re = pregCompileRegexArg( args , msg , sizeof(msg)) ;
-        if( !re )
-        {
+        if( !ptr->compile_errors++ )
             ghlogprintf( "PREG_CAPTURE: compile failed: %s\n", msg );
-            *error = 1 ;
-            return  NULL ;
-        }
-    }
-
-    // create vector to hold offsets for pcre
-    ovector = pregCreateOffsetsVector( re,NULL, &oveccount ,msg,sizeof(msg)) ;
-    if( !ovector )
-    {
-        ghlogprintf( "PREG_CAPTURE: can't create offset vector :%s\n", msg );
         *error = 1 ;
-        if( !ptr->constant_pattern ) 
-            pcre_free( re ) ;
-        return NULL ;
+        return  NULL ;
     }
 
     if( args->arg_count > 3 ) 
@@ -266,32 +267,47 @@ char *preg_capture(UDF_INIT *initid , UDF_ARGS *args, char *result,
     else 
         occurence = 1 ;
 
-    subject = ghargdup( args , 1 ) ;
+    // The subject is used where it is, since pcre_exec takes its length
+    subject = args->lengths[1] ? args->args[1] : NULL ;
 
     if( subject )
     {
-        ex_subject = pregSkipToOccurence( re , subject , args->lengths[1] , 
-                                          ovector , oveccount , occurence,&rc);
-        groupnum = -1 ;
-        if( rc > 0 )
-            groupnum = pregGetGroupNum( re , args , 2 ) ;
+        // The DFA can find the whole match (group 0) by itself
+        groupnum = pregGetGroupNum( pre->pce->re , args , 2 ) ;
+        ex_subject = pregSkipToOccurence( ptr , pre , subject , 
+                                          args->lengths[1] , occurence , 
+                                          groupnum == 0 , &rc ) ;
+        if( rc <= 0 )
+            groupnum = -1 ;
 
-        // If groupnum found, get the substring and prepare for return
-        if( groupnum >= 0 && groupnum < (oveccount/3) )
+        // If groupnum found, return the captured part of the subject 
+        // where it is.  mysql doesn't change the argument until it has 
+        // used the result, so nothing has to be copied.  An unset group 
+        // is an empty string, as from pcre_get_substring.
+        if( groupnum >= 0 && groupnum < rc && groupnum < (pre->oveccount/3) )
         {
-            l = pcre_get_substring( ex_subject, ovector,rc,groupnum, &res2 ) ;
+            start = pre->ovector[ 2 * groupnum ] ;
+            l = pre->ovector[ 2 * groupnum + 1 ] - start ;
+            if( start < 0 )
+            {
+                start = 0 ;
+                l = 0 ;
+            }
 
-            result = pregMoveToReturnValues( initid,length,is_null , error, 
-                                             (char *)res2 , l  );
+            result = ex_subject + start ;
+            *length = l ;
+            *is_null = 0 ;
+        }
+        else if( groupnum >= 0 && groupnum < (pre->oveccount/3) )
+        {
+            // pcre_exec didn't set the group -- same error as 
+            // pcre_get_substring gives
+            result = pregMoveToReturnValues( initid , result , length , 
+                                             is_null , error , NULL ,
+                                             PCRE_ERROR_NOSUBSTRING );
         }
-        free( subject ) ;
     }
 
-    free( ovector ) ;
-
-    if( !ptr->constant_pattern ) 
-        pcre_free( re ) ;
-
     return result ;
 }
 
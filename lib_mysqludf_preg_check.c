@@ -164,7 +164,7 @@ longlong preg_check( UDF_INIT *initid ,  UDF_ARGS *args, char *is_null,
 {
     char msg [ 255 ] ;
     struct preg_s *ptr ;
-    pcre *re ;                  /* the compiled regex */
+    preg_cache_entry *pce ;     /* the compiled regex */
 
 
 #ifndef GH_1_0_NULL_HANDLING
@@ -178,13 +178,13 @@ longlong preg_check( UDF_INIT *initid ,  UDF_ARGS *args, char *is_null,
     ptr = (struct preg_s *) initid->ptr ;
     if( args->args[0] && args->lengths[0] )
     {
-        re = pregCompileRegexArg( args , msg , sizeof(msg)) ;
-        if( !re )
+        pce = pregCompileRegexArg( args , msg , sizeof(msg)) ;
+        if( !pce )
         {
             return 0;
         }
 
-        pcre_free( re ) ;
+        pregCacheRelease( pce ) ;
         return 1 ;
     }
 
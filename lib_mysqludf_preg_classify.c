@@ -0,0 +1,346 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/**
+ * @file lib_mysqludf_preg_classify.c
+ *
+ * @brief Implements the PREG_CLASSIFY mysql udf
+ *
+ */
+
+
+/**
+ * @page PREG_CLASSIFY  PREG_CLASSIFY
+ *
+ * @brief returns the label of the first of many patterns that matches
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_classify RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_CLASSIFY( subject , pattern1 , label1 [ , pattern2 , label2 ... ] )
+ * 
+ * @par
+ *     @param subject - is the data to match the patterns against
+ *
+ *     @param pattern - is a perl compatible regular expression as 
+ * documented at: http://us2.php.net/manual/en/ref.pcre.php  This regex 
+ * must include delimiters.  A NULL pattern never matches.
+ *
+ *     @param label - is what to return if its pattern is the first one that
+ * matches
+ *
+ *     @return - string - the label of the first pattern that matches
+ *     @return - NULL - if no pattern matches, or the subject is NULL
+ *
+ * @details
+ *    preg_classify does the work of a CASE with a PREG_RLIKE for each WHEN,
+ * without a UDF instance for each of the patterns and without running 
+ * each of them on every row.  Most patterns have a string that every 
+ * match contains.  These are all looked for in one pass over the subject,
+ * and only the patterns whose string was found (and those that don't have
+ * one) are run, in order, until one of them matches.  See preg_set.c.
+ *
+ * Constant patterns are compiled, and the pass over the subject is set 
+ * up, once, when the query starts.  When any of the patterns isn't 
+ * constant, this is done for each row.  The labels don't need to be 
+ * constant.
+ *
+ * @par Examples:
+ *
+ * SELECT PREG_CLASSIFY( 'GET /index.html HTTP/1.1' , 
+ *                       '/^POST /' , 'write' , '/^(GET|HEAD) /' , 'read' );
+ *
+ * @b Yields:
+ * @verbatim
++----------------------------------------------------------------------------------------------------+
+| PREG_CLASSIFY( 'GET /index.html HTTP/1.1' , '/^POST /' , 'write' , '/^(GET|HEAD) /' , 'read' ) |
++----------------------------------------------------------------------------------------------------+
+| read                                                                                               |
++----------------------------------------------------------------------------------------------------+
+@endverbatim
+ *
+ * SELECT PREG_CLASSIFY( message , '/timed? ?out/i' , 'timeout' , 
+ *                       '/denied|forbidden/i' , 'auth' , 
+ *                       '//' , 'other' ) FROM log;
+ *
+ * Yields: The category of each log message.  The last pattern matches
+ * everything, like the ELSE of a CASE.
+ */
+
+
+#include "ghmysql.h"
+#include "ghfcns.h"
+#include "preg.h"
+
+/*
+ * Public function declarations:
+ */
+bool preg_classify_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+char *preg_classify( UDF_INIT *initid __attribute__((unused)),
+                     UDF_ARGS *args, char *result, unsigned long *length,
+                     char *is_null __attribute__((unused)),
+                     char *error __attribute__((unused)));
+void preg_classify_deinit( UDF_INIT* initid );
+
+
+/**
+ * @fn static preg_set *pregClassifyCompile( UDF_ARGS *args , int jit ,
+ *                                           char *msg , int msglen )
+ *
+ * @brief compile the patterns of the args into a set
+ *
+ * @param args - the args supplied by mysql.  The patterns are args[1],
+ * args[3] ...
+ * @param jit - passed to pregSetCompile
+ * @param msg - put the error here
+ * @param msglen - size of msg
+ *
+ * @return the set, which is freed with pregSetFree
+ * @return NULL - if a pattern failed to compile or out of memory (an 
+ * error is in msg)
+ */
+static preg_set *pregClassifyCompile( UDF_ARGS *args , int jit , 
+                                      char *msg , int msglen )
+{
+    preg_cache_entry **pces ;   /* the compiled patterns */
+    char error[ 255 ] ;         /* from compileRegex */
+    int count ;                 /* number of patterns */
+    int i , j ;
+    preg_set *set ;
+
+    count = ( args->arg_count - 1 ) / 2 ;
+    pces = calloc( count , sizeof( preg_cache_entry * ) ) ;
+    if( !pces )
+    {
+        snprintf( msg , msglen , "not enough memory" ) ;
+        return NULL ;
+    }
+
+    for( i = 0 ; i < count ; i++ )
+    {
+        j = 1 + 2 * i ;
+        if( !args->args[ j ] )
+            continue ;          // NULL never matches
+
+        *error = '\0' ;
+        if( !args->lengths[ j ] )
+            strcpy( error , "Empty pattern" ) ;
+        else
+            pces[ i ] = compileRegex( args->args[ j ] , args->lengths[ j ] , 
+                                      error , sizeof( error ) ) ;
+        if( !pces[ i ] )
+        {
+            snprintf( msg , msglen , "pattern %d: %s" , i + 1 , error ) ;
+            while( i-- )
+            {
+                if( pces[ i ] )
+                    pregCacheRelease( pces[ i ] ) ;
+            }
+            free( pces ) ;
+            return NULL ;
+        }
+    }
+
+    set = pregSetCompile( pces , count , jit , msg , msglen ) ;
+    free( pces ) ;
+    return set ;
+}
+
+/**
+ * @fn bool preg_classify_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                             char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_CLASSIFY
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be up to
+ * MYSQL_ERRMSG_SIZE.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ *
+ * @details The first argument is the subject rather than a pattern, so
+ * pregInit isn't used, but the same struct preg_s is, so that pregDeInit 
+ * can clean up.  When all of the patterns are constant, they are compiled
+ * into a set here, and errors in them are reported now.  max_length is 
+ * the longest label.
+ */
+bool preg_classify_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+    char msg[ 255 ] ;           /* errors from pregClassifyCompile */
+    int constant ;              /* are all of the patterns constant? */
+    unsigned long max ;         /* longest label */
+    unsigned int i ;
+
+    if( args->arg_count < 3 || !( args->arg_count % 2 ) )
+    {
+        strncpy(message,"PREG_CLASSIFY: requires a subject, then patterns & labels", MYSQL_ERRMSG_SIZE);
+        return 1;
+    }
+
+    constant = 1 ;
+    max = 0 ;
+    for( i = 0 ; i < args->arg_count ; i++ )
+    {
+        args->arg_type[ i ] = STRING_RESULT ;
+        if( i % 2 && !args->args[ i ] && !ghargIsNullConstant( args , i ) )
+            constant = 0 ;
+        if( i && !( i % 2 ) && args->lengths[ i ] > max )
+            max = args->lengths[ i ] ;
+    }
+
+    initid->maybe_null = 1 ;
+
+    // use calloc so deInit can check for NULL's before freeing
+    initid->ptr = (char *)calloc( 1 , sizeof( struct preg_s ) ) ;
+    ptr = (struct preg_s *)initid->ptr ;
+    if( !ptr )
+    {
+        strcpy( message , "not enough memory" ) ;
+        return 1 ;
+    }
+    pregBufferInit( &ptr->return_buffer , NULL , 0 ) ;
+
+    // For patterns with the F modifier, and those that hit the pcre_exec
+    // limits
+    ptr->workspace = malloc( sizeof( int ) * PREG_WORKSPACE_SIZE ) ;
+    if( !ptr->workspace )
+    {
+        strcpy( message , "not enough memory" ) ;
+        pregDeInit( initid ) ;
+        return 1 ;
+    }
+
+    if( constant )
+    {
+        ptr->set = pregClassifyCompile( args , 1 , msg , sizeof( msg ) ) ;
+        if( !ptr->set )
+        {
+            snprintf( message , MYSQL_ERRMSG_SIZE , "PREG_CLASSIFY: %s" ,
+                      msg ) ;
+            pregDeInit( initid ) ;
+            return 1 ;
+        }
+    }
+
+    // max_length of -1 means no limit ; don't change if that.  
+    if( ((int)initid->max_length) > 0 )
+        initid->max_length = max ;
+
+    return 0;
+}
+
+/**
+ * @fn char *preg_classify( UDF_INIT *initid , UDF_ARGS *args, 
+ *                          char *result, unsigned long *length, 
+ *                          char *is_null, char *error )
+ *
+ * @brief
+ *     The main routine that implements the PREG_CLASSIFY function.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param result - not used
+ * @param length - put the length of the label here.
+ * @param is_null - set this if return value is null
+ * @param error - set if an error occurs
+ *
+ * @return - string - the label of the first pattern that matches
+ *
+ * @details The label is returned where it is, without copying it.
+ */
+char *preg_classify( UDF_INIT *initid , UDF_ARGS *args, 
+                     char *result __attribute__((unused)),
+                     unsigned long *length, char *is_null, char *error )
+{
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+    char msg[ 255 ] ;           /* errors from pregClassifyCompile */
+    preg_set *set ;             /* the constant set or this row's */
+    int i ;                     /* the pattern that matched */
+
+    ptr = (struct preg_s *) initid->ptr ;
+
+    *is_null = 0 ;
+    *error = 0 ;
+
+    if( !args->args[0] )
+    {
+        *is_null = 1 ;
+        return NULL ;
+    }
+
+    // Patterns that aren't constant are compiled for each row (from the
+    // pattern cache)
+    if( ptr->set )
+        set = ptr->set ;
+    else
+    {
+        set = pregClassifyCompile( args , 0 , msg , sizeof( msg ) ) ;
+        if( !set )
+        {
+            if( !ptr->compile_errors++ )
+                ghlogprintf( "PREG_CLASSIFY: %s\n" , msg ) ;
+            *error = 1 ;
+            return NULL ;
+        }
+    }
+
+    i = pregSetMatch( set , args->args[0] , (int)args->lengths[0] , 
+                      ptr->workspace , PREG_WORKSPACE_SIZE ) ;
+
+    if( set != ptr->set )
+        pregSetFree( set ) ;
+
+    if( i < 0 || !args->args[ 2 + 2 * i ] )
+    {
+        *is_null = 1 ;
+        return NULL ;
+    }
+
+    *length = args->lengths[ 2 + 2 * i ] ;
+    return args->args[ 2 + 2 * i ] ;
+}
+
+/** 
+ * @fn void preg_classify_deinit(UDF_INIT *initid)
+ *
+ *      @brief cleanup after PREG_CLASSIFY
+ *
+ *      @param initid - pointer to struct to be cleaned.
+ */
+void preg_classify_deinit(UDF_INIT *initid)
+{
+    pregDeInit(initid);
+}
@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/**
+ * @file lib_mysqludf_preg_compile_set.c
+ *
+ * @brief Implements the PREG_COMPILE_SET mysql udf
+ *
+ */
+
+
+/**
+ * @page PREG_COMPILE_SET  PREG_COMPILE_SET
+ *
+ * @brief aggregate that puts the patterns of a group of rows into a BLOB,
+ * for PREG_SET_MATCH
+ *
+ * @par Function Installation
+ *    CREATE AGGREGATE FUNCTION preg_compile_set RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_COMPILE_SET( pattern [ , label ] )
+ * 
+ * @par
+ *     @param pattern - is a perl compatible regular expression as 
+ * documented at: http://us2.php.net/manual/en/ref.pcre.php  This regex 
+ * must include delimiters.  Rows with a NULL pattern are skipped.
+ *
+ *     @param label - is what PREG_SET_MATCH returns if this pattern is the
+ * first one that matches.  The pattern itself if this is left out.
+ *
+ *     @return - BLOB - the patterns & labels of the group, in the order 
+ * the rows were added
+ *     @return - NULL - if a pattern doesn't compile
+ *
+ * @details
+ *    preg_compile_set is for rules that are kept in a table and are used
+ * many times.  The set is built once, stored, and then matched with 
+ * PREG_SET_MATCH, which is what PREG_CLASSIFY does with patterns that are
+ * arguments.  The order of the patterns is the order in which the rows
+ * reach the aggregate, so use an ORDER BY in a subquery if it matters.
+ *
+ * Each pattern is compiled as it is added, so that a bad one is found 
+ * now rather than by PREG_SET_MATCH.  The BLOB has the patterns, not what
+ * they are compiled to, which depends on the version of libpcre.  It can
+ * be used by another server, and PREG_SET_MATCH compiles the patterns 
+ * again once per query.  See preg_set.c for its format.
+ *
+ * @par Examples:
+ *
+ * INSERT INTO rule_sets SELECT 'log' , PREG_COMPILE_SET( pattern , label ) 
+ * FROM ( SELECT pattern , label FROM rules ORDER BY priority ) r;
+ *
+ * Yields: a row with the rules in a BLOB, for PREG_SET_MATCH.
+ */
+
+
+#include "ghmysql.h"
+#include "ghfcns.h"
+#include "preg.h"
+
+/*
+ * Public function declarations:
+ */
+bool preg_compile_set_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void preg_compile_set_clear( UDF_INIT *initid , char *is_null , 
+                             char *error ) ;
+void preg_compile_set_add( UDF_INIT *initid , UDF_ARGS *args , 
+                           char *is_null , char *error ) ;
+char *preg_compile_set( UDF_INIT *initid __attribute__((unused)),
+                        UDF_ARGS *args, char *result, unsigned long *length,
+                        char *is_null __attribute__((unused)),
+                        char *error __attribute__((unused)));
+void preg_compile_set_deinit( UDF_INIT* initid );
+
+
+/**
+ * @fn bool preg_compile_set_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                                char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_COMPILE_SET
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be up to
+ * MYSQL_ERRMSG_SIZE.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ *
+ * @details The argument is not the pattern of a row, so pregInit isn't 
+ * used, but the same struct preg_s is, so that pregDeInit can clean up.
+ * The BLOB is built in its blob.
+ */
+bool preg_compile_set_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+    unsigned int i ;
+
+    if( args->arg_count < 1 || args->arg_count > 2 )
+    {
+        strncpy(message,"PREG_COMPILE_SET: requires a pattern, and optionally a label", MYSQL_ERRMSG_SIZE);
+        return 1;
+    }
+
+    for( i = 0 ; i < args->arg_count ; i++ )
+        args->arg_type[ i ] = STRING_RESULT ;
+
+    initid->maybe_null = 1 ;
+
+    // use calloc so deInit can check for NULL's before freeing
+    initid->ptr = (char *)calloc( 1 , sizeof( struct preg_s ) ) ;
+    ptr = (struct preg_s *)initid->ptr ;
+    if( !ptr )
+    {
+        strcpy( message , "not enough memory" ) ;
+        return 1 ;
+    }
+    pregBufferInit( &ptr->return_buffer , NULL , 0 ) ;
+    pregSetBlobInit( &ptr->blob ) ;
+
+    // The number of rows isn't known, so the BLOB may be as big as any
+    initid->max_length = PREG_MAX_LENGTH ;
+
+    return 0;
+}
+
+/**
+ * @fn void preg_compile_set_clear( UDF_INIT *initid , char *is_null ,
+ *                                  char *error )
+ *
+ * @brief start the BLOB of a new group
+ *
+ * @param initid - various info supplied by mysql api
+ * @param is_null - not used
+ * @param error - not used
+ */
+void preg_compile_set_clear( UDF_INIT *initid , 
+                             char *is_null __attribute__((unused)) , 
+                             char *error __attribute__((unused)) )
+{
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+
+    ptr = (struct preg_s *) initid->ptr ;
+    pregSetBlobRelease( &ptr->blob ) ;
+}
+
+/**
+ * @fn void preg_compile_set_add( UDF_INIT *initid , UDF_ARGS *args ,
+ *                                char *is_null , char *error )
+ *
+ * @brief add the pattern & label of a row to the BLOB
+ *
+ * @param initid - various info supplied by mysql api
+ * @param args - the pattern & label of the row
+ * @param is_null - not used
+ * @param error - set if the pattern doesn't compile or out of memory.  
+ * The result of the group is then NULL.
+ *
+ * @details The pattern is compiled (into the pattern cache) only to check
+ * it.  It is in the cache when PREG_SET_MATCH loads the BLOB in this 
+ * process.
+ */
+void preg_compile_set_add( UDF_INIT *initid , UDF_ARGS *args , 
+                           char *is_null __attribute__((unused)) , 
+                           char *error )
+{
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+    preg_cache_entry *pce ;
+    char msg[ 255 ] ;           /* from compileRegex */
+    const char *label ;
+    int label_len ;
+
+    ptr = (struct preg_s *) initid->ptr ;
+
+    if( *error || !args->args[0] )
+        return ;
+
+    *msg = '\0' ;
+    pce = NULL ;
+    if( !args->lengths[0] )
+        strcpy( msg , "Empty pattern" ) ;
+    else
+        pce = compileRegex( args->args[0] , args->lengths[0] , 
+                            msg , sizeof( msg ) ) ;
+    if( !pce )
+    {
+        if( !ptr->compile_errors++ )
+            ghlogprintf( "PREG_COMPILE_SET: %s\n" , msg ) ;
+        *error = 1 ;
+        return ;
+    }
+    pregCacheRelease( pce ) ;
+
+    if( args->arg_count > 1 )
+    {
+        label = args->args[1] ;
+        label_len = label ? (int)args->lengths[1] : 0 ;
+    }
+    else
+    {
+        label = args->args[0] ;
+        label_len = (int)args->lengths[0] ;
+    }
+
+    if( !pregSetBlobAdd( &ptr->blob , args->args[0] , 
+                         (int)args->lengths[0] , label , label_len ) )
+    {
+        ghlogprintf( "PREG_COMPILE_SET: not enough memory\n" ) ;
+        *error = 1 ;
+    }
+}
+
+/**
+ * @fn char *preg_compile_set( UDF_INIT *initid , UDF_ARGS *args, 
+ *                             char *result, unsigned long *length, 
+ *                             char *is_null, char *error )
+ *
+ * @brief
+ *     The main routine that implements the PREG_COMPILE_SET function.  It
+ * returns the BLOB of the group.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - not used
+ * @param result - not used
+ * @param length - put the length of the BLOB here.
+ * @param is_null - set this if return value is null
+ * @param error - set if an error occurs
+ *
+ * @return - string - the BLOB
+ */
+char *preg_compile_set( UDF_INIT *initid , 
+                        UDF_ARGS *args __attribute__((unused)) , 
+                        char *result __attribute__((unused)),
+                        unsigned long *length, char *is_null, char *error )
+{
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+    const char *blob ;
+
+    ptr = (struct preg_s *) initid->ptr ;
+
+    *is_null = 0 ;
+    if( *error )
+    {
+        *is_null = 1 ;
+        return NULL ;
+    }
+
+    blob = pregSetBlobFinish( &ptr->blob , length ) ;
+    if( !blob )
+    {
+        ghlogprintf( "PREG_COMPILE_SET: not enough memory\n" ) ;
+        *error = 1 ;
+        return NULL ;
+    }
+
+    return (char *)blob ;
+}
+
+/** 
+ * @fn void preg_compile_set_deinit(UDF_INIT *initid)
+ *
+ *      @brief cleanup after PREG_COMPILE_SET
+ *
+ *      @param initid - pointer to struct to be cleaned.
+ */
+void preg_compile_set_deinit(UDF_INIT *initid)
+{
+    pregDeInit(initid);
+}
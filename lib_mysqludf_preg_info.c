@@ -33,15 +33,23 @@
 /**
  * @page LIB_MYSQLUDF_PREG_INFO LIB_MYSQLUDF_PREG_INFO
  *
- * @brief Return version information for lib_mysqludf_preg package
+ * @brief Return version information for lib_mysqludf_preg package, or
+ * the counters of its buffer pools
  *
  * @par Function Installation
  *    CREATE FUNCTION lib_mysqludf_preg_info RETURNS STRING SONAME 'lib_mysqludf_preg.so' ;
  *
  * @par Synopsis
- *    LIB_MYSQLUDF_PREG_INFO()
+ *    LIB_MYSQLUDF_PREG_INFO( [ 'pool' ] )
  * 
  *     @return string - version information for the lib_mysqludf_preg package
+ *     @return string - with 'pool', the counters of the per-thread pools 
+ * of return buffers, summed over all threads since the library was 
+ * loaded: "gets=N hits=N puts=N drops=N pooled_bytes=N".  gets are the 
+ * buffers that were asked for and hits those that came from a pool, puts
+ * are the buffers that were given back and drops those that were freed 
+ * because a pool was full, and pooled_bytes is what the pools hold now.
+ *     @return NULL - if the argument is NULL or not 'pool'
  *
  * @par Examples:
  *    SELECT LIB_MYSQLUDF_PREG_INFO();
@@ -54,12 +62,23 @@
 | lib_mysqludf_preg 0.6.1  | 
 +--------------------------+
   @endverbatim
+ *
+ *    SELECT LIB_MYSQLUDF_PREG_INFO( 'pool' );
+ *
+ * @b Yields: something like
+ * @verbatim
+gets=1520 hits=1498 puts=1520 drops=3 pooled_bytes=49152
+  @endverbatim
  */
 
 
 #include "ghmysql.h"
+#include "preg_pool.h"
 //#include "preg.h"
 
+// The argument that asks for the pool counters
+#define PREG_INFO_POOL "pool"
+
 
 /**
  * Public function declarations:
@@ -96,17 +115,32 @@ void lib_mysqludf_info_deinit( UDF_INIT* initid );
  * @return 0 - on success
  * @return 1 - on error
  *
- * @details This function checks to make sure there are no arguments.
+ * @details This function checks that there is no argument, or one that 
+ * is 'pool' when it is constant.
  */
 bool lib_mysqludf_preg_info_init(UDF_INIT *initid, UDF_ARGS *args, 
                                     char *message)
 {
-    if (args->arg_count != 0)
+    if (args->arg_count > 1)
     {
-        strncpy(message, "lib_mysqludf_preg_info: does not accept arguments", MYSQL_ERRMSG_SIZE) ;
+        strncpy(message, "lib_mysqludf_preg_info: accepts only 'pool'", MYSQL_ERRMSG_SIZE) ;
         return 1;
     }
 
+    if( args->arg_count )
+    {
+        args->arg_type[0] = STRING_RESULT ;
+        if( args->args[0] && 
+            ( args->lengths[0] != strlen( PREG_INFO_POOL ) ||
+              strncmp( args->args[0] , PREG_INFO_POOL , 
+                       args->lengths[0] ) ) )
+        {
+            strncpy(message, "lib_mysqludf_preg_info: accepts only 'pool'", MYSQL_ERRMSG_SIZE) ;
+            return 1;
+        }
+        initid->maybe_null = 1 ;
+    }
+
     return 0;
 }
 
@@ -138,10 +172,30 @@ char *lib_mysqludf_preg_info( UDF_INIT *initid , UDF_ARGS *args,
                               char *result, unsigned long *length,
                               char *is_null , char *error )
 {
-    strcpy( result , PACKAGE_STRING );
-    *length = strlen( result ) ;
+    preg_pool_stats stats ;
+
     *is_null = 0 ; 
     *error = 0 ;
+
+    if( !args->arg_count )
+    {
+        strcpy( result , PACKAGE_STRING );
+        *length = strlen( result ) ;
+        return result ;
+    }
+
+    if( !args->args[0] || args->lengths[0] != strlen( PREG_INFO_POOL ) ||
+        strncmp( args->args[0] , PREG_INFO_POOL , args->lengths[0] ) )
+    {
+        *is_null = 1 ;
+        return NULL ;
+    }
+
+    pregPoolStats( &stats ) ;
+    *length = snprintf( result , 255 , 
+                        "gets=%lu hits=%lu puts=%lu drops=%lu "
+                        "pooled_bytes=%lu" , stats.gets , stats.hits , 
+                        stats.puts , stats.drops , stats.pooled_bytes ) ;
     return result ;
 }
 
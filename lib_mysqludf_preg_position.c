@@ -160,7 +160,13 @@ bool preg_position_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
     // preg_position can return NULL
     initid->maybe_null=1;	
 
-    return ( pregInit( initid , args , message ) ) ;
+    if( pregInit( initid , args , message ) )
+        return 1 ;
+
+    // Only the offsets of a constant group are needed
+    pregNeedGroups( (struct preg_s *)initid->ptr , pregGroupsUsed( args , 2 ) );
+
+    return 0 ;
 }
 
 
@@ -196,11 +202,9 @@ longlong preg_position( UDF_INIT *initid, UDF_ARGS *args, char *is_null,
     int groupnum ;              /* numeric group - found or from args */
     char msg[255] ;             /* to store errors from regex compile */
     int occurence ;             /* perform capture on this occurence of match */
-    int oveccount ;             /* number of items captures */
-    int *ovector;               /* for offsets of captures */
     struct preg_s *ptr ;        /* local holder of initid->ptr */
     int rc ;                    /* number of regex's matched by pattern  */
-    pcre *re ;                  /* the compiled pattern */
+    struct preg_regex_s *pre ;  /* the compiled pattern */
     char *subject ;             /* args[1] */
     int ret = -1 ;              /* position that will be returned */
 
@@ -208,7 +212,6 @@ longlong preg_position( UDF_INIT *initid, UDF_ARGS *args, char *is_null,
 
     *is_null = 1 ;              /* default to NULL return */
     *error = 0 ;                /* default to no error */
-    *ptr->return_buffer = '\0'; /* clear return value */
 
 #ifndef GH_1_0_NULL_HANDLING
     if( ghargIsNullConstant( args , 0 ) || ghargIsNullConstant( args , 1 ) 
@@ -220,28 +223,13 @@ longlong preg_position( UDF_INIT *initid, UDF_ARGS *args, char *is_null,
 #endif
 
     // compile the regex if necessary
-    if( ptr->constant_pattern )
-        re = ptr->re ;
-    else
+    pre = pregGetRegex( ptr , args , msg , sizeof(msg)) ;
+    if( !pre )
     {
-        re = pregCompileRegexArg( args , msg , sizeof(msg)) ;
-        if( !re )
-        {
+        if( !ptr->compile_errors++ )
             ghlogprintf( "PREG_POSITION: compile failed: %s\n", msg );
-            *error = 1 ;
-            return  -1 ;
-        }
-    }
-    
-    // create vector to hold offsets for pcre
-    ovector = pregCreateOffsetsVector( re,NULL, &oveccount ,msg,sizeof(msg)) ;
-    if( !ovector )
-    {
-        ghlogprintf( "PREG_POSITION: can't create offset vector :%s\n", msg );
         *error = 1 ;
-        if( !ptr->constant_pattern ) 
-            pcre_free( re ) ;
-        return -1 ;
+        return  -1 ;
     }
 
     if( args->arg_count > 3 ) 
@@ -249,35 +237,32 @@ longlong preg_position( UDF_INIT *initid, UDF_ARGS *args, char *is_null,
     else 
         occurence = 1 ;
 
-    subject = ghargdup( args , 1 ) ;
+    // The subject is used where it is, since pcre_exec takes its length
+    subject = args->lengths[1] ? args->args[1] : NULL ;
     if( subject )
     {
-        ex_subject = pregSkipToOccurence( re , subject , args->lengths[1] , 
-                                          ovector , oveccount , occurence,&rc);
-
-        groupnum = -1 ;
-        if( rc > 0 )
-            groupnum = pregGetGroupNum( re , args , 2 ) ;
+        // The DFA can find the whole match (group 0) by itself
+        groupnum = pregGetGroupNum( pre->pce->re , args , 2 ) ;
+        ex_subject = pregSkipToOccurence( ptr , pre , subject , 
+                                          args->lengths[1] , occurence , 
+                                          groupnum == 0 , &rc ) ;
+        if( rc <= 0 )
+            groupnum = -1 ;
 
         // If groupnum found, get the offset
-        if( groupnum >= 0 && groupnum < (oveccount/3) )
+        if( groupnum >= 0 && groupnum < (pre->oveccount/3) )
         {
             // ovec is in pairs of starting and ending offsets.  (ie. 
             // ovec[0] is start of whole match, ovec[1] is end of whole 
             // match.  ovec[2] is start of 1st capture group
             groupnum *= 2; 
 
-            ret = (long long)ovector[ groupnum ] + (ex_subject - subject) ; 
+            ret = (long long)pre->ovector[ groupnum ] + (ex_subject - subject) ; 
             ++ret ; // mysql strings indexes ala substr start at 1 not 0
             *is_null = 0 ;
         }
     }
 
-    free( ovector ) ;
-
-    if( !ptr->constant_pattern ) 
-        pcre_free( re ) ;
-
     return ret ;
 }
 
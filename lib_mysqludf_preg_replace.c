@@ -41,6 +41,9 @@
  *
  * @par Synopsis
  *    PREG_REPLACE( pattern , replacement , subject [ , limit ] )
+ *
+ *    PREG_REPLACE( pattern1 , replacement1 , pattern2 , replacement2 , ... ,
+ *                  subject [ , limit ] )
  * 
  * @par
  *     @param pattern - is a string that is a perl compatible regular 
@@ -56,7 +59,8 @@
  *     @param subject -is the data to perform the match & replace on
  *
  *     @param limit - optional number that is the maximum replacements to 
- * perform.  Use -1 (or leave empty) for no limit.
+ * perform.  Use -1 (or leave empty) for no limit.  With more than one 
+ * pattern, this is the limit for each of them.
 
  *     @return - string - 'subject' with the instances of pattern replaced 
  *     @return - string - the same as passed in if there were no matches
@@ -68,6 +72,14 @@
  * on all of the ocurrences of the pattern in the subject data.  Otherwise,
  * preg_replace will only replace the first <limit> occurences.
  *
+ *    Like PHP's preg_replace with arrays of patterns & replacements, more
+ * than one pattern & replacement pair can be given.  Each pattern is 
+ * replaced in the result of the pair before it, in order.  This does the 
+ * work of PREG_REPLACE's nested in each other without copying the 
+ * string in and out of each of them: the results of the pairs are built
+ * in two buffers in turn, which are kept from row to row.  An even number
+ * of arguments means that the last one is the limit.
+ *
  * @par Examples:
  *
  * SELECT PREG_REPLACE('/(.*?)(fox)/' , '$1dog' , 'the quick brown fox' );
@@ -86,6 +98,11 @@
  *
  * Yields: The product names with all of the extra whitespace removed
  *
+ * SELECT PREG_REPLACE('/<[^>]*>/', '', '/\\s+/', ' ', '/^ | $/', '' , 
+ *                     products.description ) FROM products;
+ *
+ * Yields: The descriptions without HTML tags or extra whitespace
+ *
  * @note
  *    Remember to add a backslash to escape patterns that use \ notation.
  * Also, using $ notation makes things a little clearer when using 
@@ -107,6 +124,45 @@ char *preg_replace( UDF_INIT *initid __attribute__((unused)),
 void preg_replace_deinit( UDF_INIT* initid );
 
 
+/**
+ * @fn static int pregReplacePairs( UDF_ARGS *args )
+ *
+ * @brief the number of pattern & replacement pairs in args
+ *
+ * @details The arguments are pairs, then the subject, then maybe the 
+ * limit, so there are ( arg_count - 1 ) / 2 pairs.
+ */
+static int pregReplacePairs( UDF_ARGS *args )
+{
+    return ( args->arg_count - 1 ) / 2 ;
+}
+
+/**
+ * @fn static void pregReplacePairArgs( UDF_ARGS *args , int pair , 
+ *                                      UDF_ARGS *pair_args )
+ *
+ * @brief make args for a pattern & replacement pair
+ *
+ * @param args - the args supplied by mysql
+ * @param pair - which pair (0 is the first)
+ * @param pair_args - put the args that start at the pair here.  The 
+ * pattern is pair_args->args[0] and the replacement pair_args->args[1], 
+ * so that the functions in preg.c can be used with them.  They share 
+ * their arrays with args.
+ */
+static void pregReplacePairArgs( UDF_ARGS *args , int pair , 
+                                 UDF_ARGS *pair_args )
+{
+    *pair_args = *args ;
+    pair_args->arg_count -= 2 * pair ;
+    pair_args->arg_type += 2 * pair ;
+    pair_args->args += 2 * pair ;
+    pair_args->lengths += 2 * pair ;
+    pair_args->maybe_null += 2 * pair ;
+    pair_args->attributes += 2 * pair ;
+    pair_args->attribute_lengths += 2 * pair ;
+}
+
 /**
  * @fn bool preg_replace_init(UDF_INIT *initid, UDF_ARGS *args, 
  *                               char *message)
@@ -128,46 +184,114 @@ void preg_replace_deinit( UDF_INIT* initid );
  *
  * @details This function calls pregInit to handle the common init taskes.
  * Then it checks to make sure there are 3 arguments.   The 4th argument
- * must be a number.
+ * must be a number.  A constant replacement is parsed here, so that it
+ * isn't parsed again for every row.  max_length is set to the longest 
+ * result that the arguments can give (see pregReplaceMaxLength), so that
+ * mysql doesn't have to make its temporary tables hold BLOBs.
+ *
+ * With more than one pattern & replacement pair, the first pair uses
+ * initid->ptr and each of the others has a struct preg_s of its own in 
+ * the ptr->next list, which is set up the same way.  Constant patterns
+ * and replacements of all of the pairs are compiled here.
  */
 bool preg_replace_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
 {
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+    struct preg_s *pair ;       /* the struct of a pair */
+    UDF_ARGS pair_args ;        /* args starting at a pair */
+    int pairs ;                 /* number of pattern & replacement pairs */
+    int limit ;                 /* the limit if constant, else -1 */
+    unsigned long max ;         /* longest result of the pairs so far */
+    int i ;
+
     if (args->arg_count < 3)
     {
         strncpy(message,"PREG_REPLACE: requires at least 3 arguments", MYSQL_ERRMSG_SIZE);
         return 1;
     }
+    pairs = pregReplacePairs( args ) ;
 
-    // Require a numeric 4th argument.  (This could possibly be enhanced
-    // to allow for numeric strings.  For now, require an int
-    if( args->arg_count > 3 && args->arg_type[3] != INT_RESULT )
+    // Require a numeric last argument when there is a limit.  (This could
+    // possibly be enhanced to allow for numeric strings.  For now, require
+    // an int
+    if( args->arg_count > 2 * pairs + 1 && 
+        args->arg_type[ 2 * pairs + 1 ] != INT_RESULT )
     {
-        strncpy(message,"PREG_REPLACE: 4th argument (limit) must be a number", MYSQL_ERRMSG_SIZE);
+        strncpy(message, pairs == 1 ? 
+                "PREG_REPLACE: 4th argument (limit) must be a number" :
+                "PREG_REPLACE: last argument (limit) must be a number" , 
+                MYSQL_ERRMSG_SIZE);
         return 1;
     }
 
-    args->arg_type[2] = STRING_RESULT ;  // other 2 are set in common init
+    args->arg_type[ 2 * pairs ] = STRING_RESULT ;  // patterns & replacements
+                                                   // are set in common init
 
     // preg_replace cannot return NULL
     initid->maybe_null=0;	
 
-    // max_length of -1 means no limit ; don't change if that.
-    // replacement length might be 0 -- also don't change for that
-    if( ((int)initid->max_length) > 0 &&
-        ((int)args->lengths[1]) > 0 &&
-        ((int)args->lengths[2]) > 0)
+    if( pregInit( initid , args , message ) )
     {
-        // it's difficult to know the max_length here due to back references
-        // and repeating,...  Set it to
-        // subject * the length of the replacement * the length of the
-        // subject
-        initid->max_length=args->lengths[1]*args->lengths[2]*args->lengths[1] ;
+        return 1 ;
     }
+    ptr = (struct preg_s *)initid->ptr ;
 
-    // Keep this after setting of max_length 
-    if( pregInit( initid , args , message ) )
+    // The other pairs are put on the list before they are set up, so that
+    // pregDeInit frees them if setting them up fails
+    for( pair = ptr , i = 1 ; i < pairs ; i++ )
     {
-        return 1 ;
+        pair->next = calloc( 1 , sizeof( struct preg_s ) ) ;
+        if( !pair->next )
+        {
+            strcpy( message , "not enough memory" ) ;
+            pregDeInit( initid ) ;
+            return 1 ;
+        }
+        pair = pair->next ;
+
+        pregReplacePairArgs( args , i , &pair_args ) ;
+        if( pregInitInfo( pair , &pair_args , message ) )
+        {
+            pregDeInit( initid ) ;
+            return 1 ;
+        }
+    }
+
+    // A constant replacement is only parsed once
+    for( pair = ptr , i = 0 ; pair ; pair = pair->next , i++ )
+    {
+        pregReplacePairArgs( args , i , &pair_args ) ;
+        if( pair_args.args[1] )
+        {
+            pair->replacement = pregTemplateCompile( pair_args.args[1] , 
+                                                     pair_args.lengths[1] ) ;
+            if( !pair->replacement )
+            {
+                strncpy( message , "PREG_REPLACE: not enough memory" , 
+                         MYSQL_ERRMSG_SIZE ) ;
+                pregDeInit( initid ) ;
+                return 1 ;
+            }
+        }
+    }
+
+    // max_length of -1 means no limit ; don't change if that.  Otherwise,
+    // it's worked out from the pattern, the replacement and the limit, 
+    // which are taken to be as bad as they can be if they aren't constant.
+    // Each pair's subject is the result of the pair before it.
+    if( ((int)initid->max_length) > 0 )
+    {
+        limit = ( args->arg_count > 2 * pairs + 1 && 
+                  args->args[ 2 * pairs + 1 ] ) ?
+            (int)( *(longlong *)args->args[ 2 * pairs + 1 ] ) : -1 ;
+        max = args->lengths[ 2 * pairs ] ;
+        for( pair = ptr , i = 0 ; pair ; pair = pair->next , i++ )
+        {
+            max = pregReplaceMaxLength( pair->re.pce , pair->replacement ,
+                                        args->lengths[ 2 * i + 1 ] ,
+                                        max , limit ) ;
+        }
+        initid->max_length = max ;
     }
 
     return 0;
@@ -186,7 +310,7 @@ bool preg_replace_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
  * @param args - array of information about arguments from the SQL call
  * See file documentation for the description of the SQL arguments
  *
- * @param result - small place that the modified string can be placed (not used)
+ * @param result - small place that the modified string can be placed
  * @param length - put the length of the modified string here.
  * @param is_null - set this if return value is null (not used)
  * @param error - set if an error occurs
@@ -196,9 +320,12 @@ bool preg_replace_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
  * @details Most of the difficult work here is done by the pregReplace
  * functions, which was derived from the php extension and is in the
  * from_php.c file.  The function below mostly prepares the arguments
- * for the call to the pregReplace function and it then calls
- * pregMoveToReturnValues to adapt the return from pregReplace to be 
- * compatible with the MySQL UDF api.
+ * for the call to the pregReplace function, which builds the result in
+ * mysql's result buffer, or in a buffer from the pool (ptr->return_buffer)
+ * if it doesn't fit.  On error, pregMoveToReturnValues sets the return 
+ * values for the MySQL UDF api.  With more than one pattern & replacement
+ * pair, pregReplace is called for each of them with the result of the 
+ * one before.
  */
 char *preg_replace( UDF_INIT *initid , UDF_ARGS *args, char *result, 
                     unsigned long *length, char *is_null, char *error )
@@ -206,109 +333,150 @@ char *preg_replace( UDF_INIT *initid , UDF_ARGS *args, char *result,
     int count ;                 /* number of matches */
     char msg[255] ;             /* to store errors from regex compile */
     struct preg_s *ptr ;        /* local holder of initid->ptr */
-    pcre *re ;                  /* the compiled pattern */
-    char *subject ;             /* args[1] */
+    struct preg_s *pair ;       /* the struct of this pair */
+    UDF_ARGS pair_args ;        /* args starting at this pair */
+    int pairs ;                 /* number of pattern & replacement pairs */
+    int i ;                     /* which pair */
+    preg_buffer *buffer ;       /* where this pair's result is built */
+    struct preg_regex_s *pre ;  /* the compiled pattern */
+    char *subject ;             /* the subject, then each pair's result */
     unsigned long subject_len;  /* length of subject */
-    char *replacement ;         /* args[2] */
+    char *replacement ;         /* this pair's replacement */
     unsigned long repl_len ;    /* length of replacement */
+    preg_template *template ;   /* the parsed replacement */
     char *s  ;                  /* string modified with replacements */
     int s_len ;                 /* length of modified string */
-    int limit ;                 /* args[3] */
+    int limit ;                 /* the last argument, if there's a limit */
 
     ptr = (struct preg_s *) initid->ptr ;
+    pairs = pregReplacePairs( args ) ;
 
     *is_null = 0 ;
     *error = 0 ;                /* default to no error */
 
 #ifndef GH_1_0_NULL_HANDLING
-    if( ghargIsNullConstant( args , 2 ) || ghargIsNullConstant( args , 0 ) ) 
+    if( ghargIsNullConstant( args , 2 * pairs ) ) 
     {
         *is_null = 1 ; 
         return NULL ; 
     }
+    for( i = 0 ; i < pairs ; i++ )
+    {
+        if( ghargIsNullConstant( args , 2 * i ) ) 
+        {
+            *is_null = 1 ; 
+            return NULL ; 
+        }
+    }
 #endif
 
-    if( ptr->constant_pattern )
+    // The subject is used where it is, since pregReplace takes its 
+    // length.  NULLs are treated as empty strings.
+    subject_len = args->args[ 2 * pairs ] ? args->lengths[ 2 * pairs ] : 0 ;
+    subject = args->args[ 2 * pairs ] ? args->args[ 2 * pairs ] : (char *)"" ;
+
+    if( args->arg_count > 2 * pairs + 1 )
     {
-        re = ptr->re ;
+        limit = (int)( *(longlong *)args->args[ 2 * pairs + 1 ]) ;
     }
     else
     {
-        re = pregCompileRegexArg( args , msg , sizeof(msg)) ;
-        if( !re )
+        limit = -1 ;
+    }
+
+    // The result is built in mysql's result buffer, and moved to a buffer
+    // from the pool if it doesn't fit.  mysql is done with the last row's.
+    pregBufferRelease( &ptr->return_buffer ) ;
+    pregBufferInit( &ptr->return_buffer , result , PREG_RESULT_SIZE ) ;
+
+    s = NULL ;
+    s_len = 0 ;
+    for( pair = ptr , i = 0 ; pair ; pair = pair->next , i++ )
+    {
+        pregReplacePairArgs( args , i , &pair_args ) ;
+
+        pre = pregGetRegex( pair , &pair_args , msg , sizeof(msg)) ;
+        if( !pre )
         {
-            ghlogprintf( "PREG_REPLACE: compile failed: %s\n", msg );
+            if( !pair->compile_errors++ )
+                ghlogprintf( "PREG_REPLACE: compile failed: %s\n", msg );
             *error = 1 ;
             return  NULL ;
         }
-    }
 
-    int nullReplacement ; 
-    nullReplacement = 0 ; 
-    if( ghargIsNullConstant( args , 1 ) ) 
-    {
-        nullReplacement = 1 ; 
-    }
+        // The replacement is used where it is, like the subject
+        repl_len = pair_args.args[1] ? pair_args.lengths[1] : 0 ;
+        replacement = pair_args.args[1] ? pair_args.args[1] : (char *)"" ;
 
-    replacement = ghargdups( args , 1 , &repl_len ) ;
-    if( !replacement )
-    {
-        ghlogprintf( "PREG_REPLACE: out of memory\n" );
-        *error = 1 ;
-        if( !ptr->constant_pattern ) 
-            pcre_free( re ) ;
+        // Replacements that aren't constant are parsed for each row
+        if( pair->replacement )
+            template = pair->replacement ;
+        else
+        {
+            template = pregTemplateCompile( replacement , repl_len ) ;
+            if( !template )
+            {
+                ghlogprintf( "PREG_REPLACE: out of memory\n" );
+                *error = 1 ;
+                return  NULL ;
+            }
+        }
 
-        return  NULL ;
-    }
+        memset(&msg, 0, sizeof(msg));
 
-    subject = ghargdups( args , 2 , &subject_len ) ;
-    if( !subject )
-    {
-        ghlogprintf( "PREG_REPLACE: can't allocate for subject\n", msg );
-        *error = 1 ;
-        if( !ptr->constant_pattern ) 
-            pcre_free( re ) ;
-        free( replacement );
-        return  NULL ;
-    }
+        // Each pair's result is the subject of the next one, so the pairs
+        // take turns with the return buffer and ptr->pair_buffer (which is
+        // kept from row to row).  The last pair gets the return buffer.
+        buffer = ( ( pairs - 1 - i ) % 2 ) ? &ptr->pair_buffer : 
+                                             &ptr->return_buffer ;
 
-    if( args->arg_count > 3 )
-    {
-        limit = (int)( *(longlong *)args->args[3]) ;
-    }
-    else
-    {
-        limit = -1 ;
-    }
+        s = pregReplace( pre->pce->re , pre->extra , pre->pce->nfa , 
+                         pre->pce->literal , pregCacheRequired( pre->pce ) , 
+                         pregCacheStart( pre->pce ) , 
+                         pregCacheClass( pre->pce ) ,
+                         pre->pce->longest ? pair->workspace : NULL , 
+                         PREG_WORKSPACE_SIZE , pre->ovector , pre->oveccount ,
+                         subject, subject_len , template , 
+                         0 , buffer , &s_len , limit , &count , 
+                         msg ,  sizeof(msg) ) ;
 
-    memset(&msg, 0, sizeof(msg));
+        if( template != pair->replacement )
+            pregTemplateFree( template ) ;
 
-    s = pregReplace( re , NULL , subject, subject_len , replacement , 
-                     repl_len , 0 , &s_len , limit , &count , 
-                     msg ,  sizeof(msg) ) ;
+        if( !s )
+            break ;
 
 #ifndef GH_1_0_NULL_HANDLING
-    if( nullReplacement && s && subject && strcmp( s , subject ) ) {
-        result = NULL  ;
-        *is_null = 1 ; 
-    }
-    else 
+        // A NULL replacement makes the result NULL if it replaces anything
+        if( ghargIsNullConstant( &pair_args , 1 ) && 
+            ( s_len != (int)subject_len || memcmp( s , subject , s_len ) ) ) 
+        {
+            *is_null = 1 ; 
+            return NULL ;
+        }
 #endif
+
+        subject = s ;
+        subject_len = s_len ;
+    }
+
+    if( s )
     {
-        if (!s && msg[0] != NULL) {
+        // s is the return buffer, so it's returned as it is
+        result = s ;
+        *length = s_len ;
+    }
+    else
+    {
+        if (msg[0] != NULL) {
             *error = 1;
             ghlogprintf( "PREG_REPLACE: %s\n", msg );
         }
         
-        result = pregMoveToReturnValues( initid ,length,is_null , error,s,s_len  );
+        result = pregMoveToReturnValues( initid , result , length , is_null ,
+                                         error , s , s_len  );
     }
 
-    free( subject );
-    free( replacement ) ;
-        
-    if( !ptr->constant_pattern ) 
-        pcre_free( re ) ;
-
     return result ;
 }
 
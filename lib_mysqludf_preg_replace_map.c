@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/**
+ * @file lib_mysqludf_preg_replace_map.c
+ *
+ * @brief Implements the PREG_REPLACE_MAP mysql udf
+ *
+ */
+
+
+/**
+ * @page PREG_REPLACE_MAP  PREG_REPLACE_MAP
+ *
+ * @brief replaces many literal strings in one pass
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_replace_map RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_REPLACE_MAP( subject , map )
+ * 
+ * @par
+ *     @param subject - is the data to perform the replacements on
+ *
+ *     @param map - is a JSON object whose keys are the strings to find and
+ * whose values are what to replace them with.  Both must be strings.  \\u
+ * escapes are written as UTF-8.
+ *
+ *     @return - string - 'subject' with the keys of map replaced 
+ *     @return - string - the same as passed in if no keys were found
+ *     @return - NULL - if subject or map is NULL
+ *
+ * @details
+ *    preg_replace_map does the work of a chain of nested preg_replace 
+ * calls that each replace one literal string (abbreviations, HTML 
+ * entities), in one pass over the subject.  The subject is read from left
+ * to right.  Where more than one key matches at the same place, the 
+ * longest is replaced.  The replacements are not looked at again, so a
+ * value never has keys replaced in it, whatever order the keys are in.
+ * If a key is in the map more than once, the last value is used.
+ *
+ * A constant map is turned into an automaton (see preg_map.c) once, when 
+ * the query starts.  A map that isn't constant is turned into one for 
+ * each row.
+ *
+ * @par Examples:
+ *
+ * SELECT PREG_REPLACE_MAP( 'fish &amp; chips &lt;b&gt;' , 
+ *                          '{"&amp;":"&","&lt;":"<","&gt;":">"}' );
+ *
+ * @b Yields:
+ * @verbatim
++--------------------------------------------------------------------------------------------+
+| PREG_REPLACE_MAP( 'fish &amp; chips &lt;b&gt;' , '{"&amp;":"&","&lt;":"<","&gt;":">"}' ) |
++--------------------------------------------------------------------------------------------+
+| fish & chips <b>                                                                           |
++--------------------------------------------------------------------------------------------+
+@endverbatim
+ *
+ * SELECT PREG_REPLACE_MAP( address , '{"St.":"Street","Ave.":"Avenue"}' ) 
+ *     FROM customers;
+ *
+ * Yields: The addresses with the abbreviations spelled out
+ */
+
+
+#include "ghmysql.h"
+#include "ghfcns.h"
+#include "preg.h"
+
+/*
+ * Public function declarations:
+ */
+bool preg_replace_map_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+char *preg_replace_map( UDF_INIT *initid __attribute__((unused)),
+                        UDF_ARGS *args, char *result, unsigned long *length,
+                        char *is_null __attribute__((unused)),
+                        char *error __attribute__((unused)));
+void preg_replace_map_deinit( UDF_INIT* initid );
+
+
+/**
+ * @fn bool preg_replace_map_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                                char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_REPLACE_MAP
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be up to
+ * MYSQL_ERRMSG_SIZE.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ *
+ * @details There is no pattern, so pregInit isn't used, but the same 
+ * struct preg_s is, so that pregDeInit can clean up.  A constant map is 
+ * compiled here, and errors in it are reported now.  max_length is set
+ * to the longest result that the map can give (see pregMapMaxLength).
+ */
+bool preg_replace_map_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+    char msg[ 255 ] ;           /* errors from pregMapCompile */
+    double max ;                /* longest result with a non-constant map */
+
+    if( args->arg_count != 2 )
+    {
+        strncpy(message,"PREG_REPLACE_MAP: requires 2 arguments", MYSQL_ERRMSG_SIZE);
+        return 1;
+    }
+
+    args->arg_type[0] = STRING_RESULT ;
+    args->arg_type[1] = STRING_RESULT ;
+
+    initid->maybe_null = 1 ;
+
+    // use calloc so deInit can check for NULL's before freeing
+    initid->ptr = (char *)calloc( 1 , sizeof( struct preg_s ) ) ;
+    ptr = (struct preg_s *)initid->ptr ;
+    if( !ptr )
+    {
+        strcpy( message , "not enough memory" ) ;
+        return 1 ;
+    }
+    pregBufferInit( &ptr->return_buffer , NULL , 0 ) ;
+
+    if( args->args[1] )
+    {
+        ptr->map = pregMapCompile( args->args[1] , args->lengths[1] , 
+                                   msg , sizeof( msg ) ) ;
+        if( !ptr->map )
+        {
+            snprintf( message , MYSQL_ERRMSG_SIZE , "PREG_REPLACE_MAP: %s" ,
+                      msg ) ;
+            pregDeInit( initid ) ;
+            return 1 ;
+        }
+    }
+
+    // max_length of -1 means no limit ; don't change if that.  A map that
+    // isn't constant could replace every byte with all of itself.
+    if( ((int)initid->max_length) > 0 )
+    {
+        if( ptr->map )
+            initid->max_length = pregMapMaxLength( ptr->map , 
+                                                   args->lengths[0] , 
+                                                   PREG_MAX_LENGTH ) ;
+        else
+        {
+            max = (double)args->lengths[0] * 
+                ( args->lengths[1] > 1 ? args->lengths[1] : 1 ) ;
+            initid->max_length = max < PREG_MAX_LENGTH ? 
+                (unsigned long)max : PREG_MAX_LENGTH ;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @fn char *preg_replace_map( UDF_INIT *initid , UDF_ARGS *args, 
+ *                             char *result, unsigned long *length, 
+ *                             char *is_null, char *error )
+ *
+ * @brief
+ *     The main routine that implements the PREG_REPLACE_MAP function.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param result - small place that the modified string can be placed
+ * @param length - put the length of the modified string here.
+ * @param is_null - set this if return value is null
+ * @param error - set if an error occurs
+ *
+ * @return - string - with the replacements applied if there were any
+ *
+ * @details The result is built in mysql's result buffer, or in a buffer
+ * from the pool (ptr->return_buffer) if it doesn't fit.  When no key is 
+ * found, the subject is returned where it is.
+ */
+char *preg_replace_map( UDF_INIT *initid , UDF_ARGS *args, char *result, 
+                        unsigned long *length, char *is_null, char *error )
+{
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+    char msg[ 255 ] ;           /* errors from pregMapCompile */
+    preg_map *map ;             /* the constant map or this row's */
+    int count ;                 /* number of keys replaced */
+    int s_len ;                 /* length of the result */
+
+    ptr = (struct preg_s *) initid->ptr ;
+
+    *is_null = 0 ;
+    *error = 0 ;
+
+    if( !args->args[0] || !args->args[1] )
+    {
+        *is_null = 1 ;
+        return NULL ;
+    }
+
+    // Maps that aren't constant are compiled for each row
+    if( ptr->map )
+        map = ptr->map ;
+    else
+    {
+        map = pregMapCompile( args->args[1] , args->lengths[1] , 
+                              msg , sizeof( msg ) ) ;
+        if( !map )
+        {
+            if( !ptr->compile_errors++ )
+                ghlogprintf( "PREG_REPLACE_MAP: %s\n" , msg ) ;
+            *error = 1 ;
+            return NULL ;
+        }
+    }
+
+    // mysql is done with the last row's result
+    pregBufferRelease( &ptr->return_buffer ) ;
+    pregBufferInit( &ptr->return_buffer , result , PREG_RESULT_SIZE ) ;
+
+    count = pregMapReplace( map , args->args[0] , args->lengths[0] , 
+                            &ptr->return_buffer , &s_len ) ;
+
+    if( map != ptr->map )
+        pregMapFree( map ) ;
+
+    if( count < 0 )
+    {
+        ghlogprintf( "PREG_REPLACE_MAP: out of memory\n" ) ;
+        *error = 1 ;
+        return NULL ;
+    }
+    if( !count )
+    {
+        *length = args->lengths[0] ;
+        return args->args[0] ;
+    }
+
+    *length = s_len ;
+    return ptr->return_buffer.data ;
+}
+
+/** 
+ * @fn void preg_replace_map_deinit(UDF_INIT *initid)
+ *
+ *      @brief cleanup after PREG_REPLACE_MAP
+ *
+ *      @param initid - pointer to struct to be cleaned.
+ */
+void preg_replace_map_deinit(UDF_INIT *initid)
+{
+    pregDeInit(initid);
+}
@@ -160,7 +160,9 @@ bool preg_rlike_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
  * @details This function calls pcre_ex from the pcre library to execute
  * the compiled pattern (which is either precompiled by ..._init
  * or compiled here for non-constant pattern arguments).  It then
- * does the appropriate thing with the returns :>)
+ * does the appropriate thing with the returns :>)  When configured
+ * --with-vectorscan, patterns that vectorscan supports are scanned by it
+ * instead.
  */
 longlong preg_rlike( UDF_INIT *initid ,  UDF_ARGS *args, char *is_null,
                      char *error )
@@ -169,7 +171,7 @@ longlong preg_rlike( UDF_INIT *initid ,  UDF_ARGS *args, char *is_null,
     char msg [ 255 ] ;
     int ovector[OVECCOUNT];     /* for use by pcre_exex */
     int rc ;
-    pcre *re ;                  /* the compiled regex */
+    struct preg_regex_s *pre ;  /* the compiled regex */
     pcre_extra extra;
 
 #ifndef GH_1_0_NULL_HANDLING
@@ -185,30 +187,60 @@ longlong preg_rlike( UDF_INIT *initid ,  UDF_ARGS *args, char *is_null,
     // Need to leave out the length check here because some patterns can return true against an empty string
     if( args->args[1] /*&& args->lengths[1]*/ )
     {
-        if( ptr->constant_pattern )
+        pre = pregGetRegex( ptr , args , msg , sizeof(msg)) ;
+        if( !pre )
         {
-            re = ptr->re ;
+            if( !ptr->compile_errors++ )
+                fprintf( stderr,"preg: compile failed: %s\n",msg);
+            *error = 1 ;
+            return 0;
         }
-        else
+
+        // Subjects without the string every match contains can't match
+        if( pregRequiredMissing( pregCacheRequired( pre->pce ) , 
+                                 args->args[1] , (int)args->lengths[1] , 0 ) )
         {
-            re = pregCompileRegexArg( args , msg , sizeof(msg)) ;
-            if( !re )
-            {
-                fprintf( stderr,"preg: compile failed: %s\n",msg);
-                *error = 1 ;
-                return 0;
-            }
+            return 0 ;
+        }
+
+        // Only match/no-match is needed, so vectorscan can be used when 
+        // it was able to compile the pattern.  libpcre is used if it fails.
+        if( pregCacheHs( pre->pce ) &&
+            ( rc = pregHsMatch( pre->pce->hs , args->args[1] ,
+                                (int)args->lengths[1] ) ) >= 0 )
+        {
+            return rc ;
+        }
+
+        // Next best is the DFA, unless it has run out of memory
+        if( pregCacheDfa( pre->pce ) )
+        {
+            rc = pregDfaExec( pre->pce->dfa , args->args[1] ,
+                              (int)args->lengths[1] , NULL ) ;
+            if( rc >= 0 || rc == PCRE_ERROR_NOMATCH )
+                return rc > 0 ;
         }
 
-        memset(&extra, 0, sizeof(extra));
-        pregSetLimits(&extra);
+        pregInitExtra(&extra, pre->extra);
         
-        rc = pcre_exec(re, &extra,  args->args[1] , (int)args->lengths[1],
+        rc = pregMatch(pre->pce->re, &extra, pre->pce->nfa,
+                       pre->pce->literal , pregCacheStart( pre->pce ) ,
+                       pre->pce->longest ? ptr->workspace : NULL ,
+                       PREG_WORKSPACE_SIZE ,
+                       args->args[1] , (int)args->lengths[1],
                        0,0,ovector, OVECCOUNT); 
 
-        if( !ptr->constant_pattern ) 
+        // pcre_exec ran out of stack or gave up backtracking.  Whether
+        // there is a match doesn't depend on which match is found, so try
+        // pcre_dfa_exec, which doesn't recurse or backtrack.
+        if( ( rc == PCRE_ERROR_RECURSIONLIMIT || 
+              rc == PCRE_ERROR_MATCHLIMIT ) && 
+            !pre->pce->nfa && !pre->pce->longest )
         {
-            pcre_free( re ) ;
+            rc = pregExecLongest(pre->pce->re, &extra, 
+                                 args->args[1] , (int)args->lengths[1],
+                                 0,0,ovector, OVECCOUNT,
+                                 ptr->workspace, PREG_WORKSPACE_SIZE);
         }
 
         if( rc > 0 )
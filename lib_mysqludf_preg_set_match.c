@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/**
+ * @file lib_mysqludf_preg_set_match.c
+ *
+ * @brief Implements the PREG_SET_MATCH mysql udf
+ *
+ */
+
+
+/**
+ * @page PREG_SET_MATCH  PREG_SET_MATCH
+ *
+ * @brief returns the label of the first pattern of a set from 
+ * PREG_COMPILE_SET that matches
+ *
+ * @par Function Installation
+ *    CREATE FUNCTION preg_set_match RETURNS STRING SONAME 'lib_mysqludf_preg.so';
+ *
+ * @par Synopsis
+ *    PREG_SET_MATCH( set , subject )
+ * 
+ * @par
+ *     @param set - a BLOB from PREG_COMPILE_SET
+ *
+ *     @param subject - is the data to match the patterns against
+ *
+ *     @return - string - the label of the first pattern that matches
+ *     @return - NULL - if no pattern matches, its label is NULL, or the set
+ * or subject is NULL
+ *
+ * @details
+ *    preg_set_match is PREG_CLASSIFY for patterns that were put in a BLOB 
+ * by PREG_COMPILE_SET.  The patterns are compiled, and the pass over the 
+ * subject that finds which of them can match is set up, when the first 
+ * row is seen.  This is kept for the following rows for as long as they 
+ * have the same set, which is found by comparing the hash in the BLOB 
+ * first.  When the set changes (a join with a table of sets), it is 
+ * loaded again.
+ *
+ * @par Examples:
+ *
+ * SELECT message , PREG_SET_MATCH( rule_sets.data , message ) 
+ * FROM log JOIN rule_sets ON rule_sets.name='log';
+ *
+ * Yields: The label of the first rule that each log message matches.
+ */
+
+
+#include "ghmysql.h"
+#include "ghfcns.h"
+#include "preg.h"
+
+/*
+ * Public function declarations:
+ */
+bool preg_set_match_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+char *preg_set_match( UDF_INIT *initid __attribute__((unused)),
+                      UDF_ARGS *args, char *result, unsigned long *length,
+                      char *is_null __attribute__((unused)),
+                      char *error __attribute__((unused)));
+void preg_set_match_deinit( UDF_INIT* initid );
+
+
+/**
+ * @fn bool preg_set_match_init(UDF_INIT *initid, UDF_ARGS *args, 
+ *                              char *message)
+ *
+ * @brief
+ *     Perform the per-query initializations for PREG_SET_MATCH
+ *
+ * @param initid - various info supplied by mysql api - read mode at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param message - for error messages.  Should be <80 but can be up to
+ * MYSQL_ERRMSG_SIZE.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ *
+ * @details The first argument is not a pattern, so pregInit isn't used, 
+ * but the same struct preg_s is, so that pregDeInit can clean up.  A 
+ * constant set is loaded here, and errors in it are reported now.  A 
+ * label is never longer than the set.
+ */
+bool preg_set_match_init(UDF_INIT *initid, UDF_ARGS *args, char *message)
+{
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+    char msg[ 255 ] ;           /* errors from pregSetLoad */
+
+    if( args->arg_count != 2 )
+    {
+        strncpy(message,"PREG_SET_MATCH: requires a set and a subject", MYSQL_ERRMSG_SIZE);
+        return 1;
+    }
+
+    args->arg_type[0] = STRING_RESULT ;
+    args->arg_type[1] = STRING_RESULT ;
+
+    initid->maybe_null = 1 ;
+
+    // use calloc so deInit can check for NULL's before freeing
+    initid->ptr = (char *)calloc( 1 , sizeof( struct preg_s ) ) ;
+    ptr = (struct preg_s *)initid->ptr ;
+    if( !ptr )
+    {
+        strcpy( message , "not enough memory" ) ;
+        return 1 ;
+    }
+    pregBufferInit( &ptr->return_buffer , NULL , 0 ) ;
+
+    // For patterns with the F modifier, and those that hit the pcre_exec
+    // limits
+    ptr->workspace = malloc( sizeof( int ) * PREG_WORKSPACE_SIZE ) ;
+    if( !ptr->workspace )
+    {
+        strcpy( message , "not enough memory" ) ;
+        pregDeInit( initid ) ;
+        return 1 ;
+    }
+
+    if( args->args[0] )
+    {
+        ptr->set = pregSetLoad( args->args[0] , args->lengths[0] , 1 , 
+                                msg , sizeof( msg ) ) ;
+        if( !ptr->set )
+        {
+            snprintf( message , MYSQL_ERRMSG_SIZE , "PREG_SET_MATCH: %s" ,
+                      msg ) ;
+            pregDeInit( initid ) ;
+            return 1 ;
+        }
+        ptr->constant_pattern = 1 ;
+    }
+
+    // max_length of -1 means no limit ; don't change if that.  
+    if( ((int)initid->max_length) > 0 && args->lengths[0] < PREG_MAX_LENGTH )
+        initid->max_length = args->lengths[0] ;
+
+    return 0;
+}
+
+/**
+ * @fn char *preg_set_match( UDF_INIT *initid , UDF_ARGS *args, 
+ *                           char *result, unsigned long *length, 
+ *                           char *is_null, char *error )
+ *
+ * @brief
+ *     The main routine that implements the PREG_SET_MATCH function.
+ *
+ * @param initid - various info supplied by mysql api - read more at
+ * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
+ *
+ * @param args - array of information about arguments from the SQL call
+ * See file documentation for the description of the SQL arguments
+ *
+ * @param result - not used
+ * @param length - put the length of the label here.
+ * @param is_null - set this if return value is null
+ * @param error - set if an error occurs
+ *
+ * @return - string - the label of the first pattern that matches
+ *
+ * @details The label is returned from the loaded set, without copying 
+ * it.
+ */
+char *preg_set_match( UDF_INIT *initid , UDF_ARGS *args, 
+                      char *result __attribute__((unused)),
+                      unsigned long *length, char *is_null, char *error )
+{
+    struct preg_s *ptr ;        /* local holder of initid->ptr */
+    char msg[ 255 ] ;           /* errors from pregSetLoad */
+    const char *label ;
+    int label_len ;
+    int i ;                     /* the pattern that matched */
+
+    ptr = (struct preg_s *) initid->ptr ;
+
+    *is_null = 0 ;
+    *error = 0 ;
+
+    if( !args->args[0] || !args->args[1] )
+    {
+        *is_null = 1 ;
+        return NULL ;
+    }
+
+    // Keep the set of the last row while the rows have the same one
+    if( !ptr->set || ( !ptr->constant_pattern && 
+        !pregSetLoadedFrom( ptr->set , args->args[0] , args->lengths[0] ) ) )
+    {
+        pregSetFree( ptr->set ) ;
+        ptr->set = pregSetLoad( args->args[0] , args->lengths[0] , 1 ,
+                                msg , sizeof( msg ) ) ;
+        if( !ptr->set )
+        {
+            if( !ptr->compile_errors++ )
+                ghlogprintf( "PREG_SET_MATCH: %s\n" , msg ) ;
+            *error = 1 ;
+            return NULL ;
+        }
+    }
+
+    i = pregSetMatch( ptr->set , args->args[1] , (int)args->lengths[1] , 
+                      ptr->workspace , PREG_WORKSPACE_SIZE ) ;
+
+    label = pregSetLabel( ptr->set , i , &label_len ) ;
+    if( !label )
+    {
+        *is_null = 1 ;
+        return NULL ;
+    }
+
+    *length = label_len ;
+    return (char *)label ;
+}
+
+/** 
+ * @fn void preg_set_match_deinit(UDF_INIT *initid)
+ *
+ *      @brief cleanup after PREG_SET_MATCH
+ *
+ *      @param initid - pointer to struct to be cleaned.
+ */
+void preg_set_match_deinit(UDF_INIT *initid)
+{
+    pregDeInit(initid);
+}
@@ -29,17 +29,209 @@
  */
 
 #include "ghmysql.h"
+#include "ghfcns.h"
 #include "preg.h"
+#include "preg_utils.h"
 
 /* For pthreads */
 #include <pthread.h>
 
+/*
+ * Private Functions:
+ */
+
+/**
+ * @fn static int pregOffsetsCount( preg_cache_entry *pce , int groups )
+ *
+ * @brief the number of ints of the offsets vector that pce needs
+ *
+ * @param pce - compiled pattern
+ * @param groups - capture groups that are used, counting the whole match.
+ * 0 if all of them are.
+ *
+ * @details Groups that aren't used are left out, since libpcre then 
+ * doesn't have to fill them in.  Groups that the pattern refers back to
+ * are always kept, or libpcre would malloc a vector for every match.
+ */
+static int pregOffsetsCount( preg_cache_entry *pce , int groups )
+{
+    int count = pce->capture_count + 1 ;
+
+    if( groups > 0 && groups < count )
+    {
+        count = groups ;
+        if( pce->backref_max >= count )
+            count = pce->backref_max + 1 ;
+    }
+
+    return count * 3 ; // 2 for offset info , 1 for pcre internals
+}
+
+/**
+ * @fn static int pregInitRegex( struct preg_regex_s *pre , 
+ *                              preg_cache_entry *pce , int study ,
+ *                              int groups , char *msg , int msglen )
+ *
+ * @brief set up pre to use the compiled pattern pce
+ *
+ * @param pre - the struct to fill in.  Its ovector is used if it is 
+ * big enough, so it must be zeroed or released with pregReleaseRegex.
+ * @param pce - compiled pattern.  pre takes over the reference to it
+ * @param study - PREG_STUDY to study the pattern with pcre_study,
+ * PREG_STUDY_JIT to also JIT compile it, 0 to leave it as it is
+ * @param groups - capture groups that are used (see pregNeedGroups)
+ * @param msg - buffer where error messages can be placed
+ * @param msglen - size of the error message buffer above
+ *
+ * @return 0 - on success
+ * @return 1 - on error.  pce has been released.
+ *
+ * @details This sizes the offsets vector for the pattern and 
+ * optionally studies it.  Failure to study the pattern is not an error;
+ * the pattern is then run without the study data.  Patterns that were
+ * studied when they were compiled (S modifier) use the study data from
+ * the pattern cache instead.
+ */
+static int pregInitRegex( struct preg_regex_s *pre , preg_cache_entry *pce ,
+                          int study , int groups , char *msg , int msglen )
+{
+    const char *error ;         /* error from pcre_study */
+    int *ovector = pre->ovector ;
+    int ovecsize = pre->ovecsize ;
+
+    memset( pre , 0 , sizeof( *pre ) ) ;
+
+    pre->oveccount = pregOffsetsCount( pce , groups ) ;
+    if( pre->oveccount > ovecsize )
+    {
+        free( ovector ) ;
+        ovecsize = pre->oveccount ;
+        ovector = malloc( sizeof( int ) * ovecsize ) ;
+        if( !ovector )
+        {
+            strncpy( msg , "Out of memory for ovector" , msglen ) ;
+            pregCacheRelease( pce ) ;
+            return 1 ;
+        }
+    }
+    pre->ovector = ovector ;
+    pre->ovecsize = ovecsize ;
+
+    if( pce->extra )
+    {   // studied when compiled (S modifier)
+        pre->extra = pce->extra ;
+    }
+    else if( study && !pce->nfa && !pce->literal )
+    {   // L modifier & literal patterns are never run by pcre_exec
+        pre->extra = pregStudy( pce->re , study == PREG_STUDY_JIT , &error ) ;
+    }
+
+    pre->pce = pce ;
+    return 0 ;
+}
+
+/**
+ * @fn static void pregReleaseRegex( struct preg_regex_s *pre )
+ *
+ * @brief release the pattern of pre, but keep its offsets vector for 
+ * the next pattern
+ */
+static void pregReleaseRegex( struct preg_regex_s *pre )
+{
+    if( pre->extra && pre->extra != pre->pce->extra )
+    {
+        pcre_free_study( pre->extra ) ;
+    }
+    if( pre->pce )
+    {
+        pregCacheRelease( pre->pce ) ;
+    }
+    pre->pce = NULL ;
+    pre->extra = NULL ;
+    pre->oveccount = 0 ;
+}
+
+/**
+ * @fn static void pregFreeRegex( struct preg_regex_s *pre )
+ *
+ * @brief free up the memory used by pre and release its pattern
+ */
+static void pregFreeRegex( struct preg_regex_s *pre )
+{
+    pregReleaseRegex( pre ) ;
+    free( pre->ovector ) ;
+    memset( pre , 0 , sizeof( *pre ) ) ;
+}
+
+/**
+ * @fn static int *pregLengths( preg_cache_entry *pce , int *min_length )
+ *
+ * @brief how long the strings that the groups of a pattern match can be
+ *
+ * @param pce - the compiled pattern or NULL if it isn't known
+ * @param min_length - put the length of the shortest match here (0 if it
+ * isn't known)
+ *
+ * @return the lengths from pregNfaLengths, to be freed by the caller - or 
+ * NULL if they aren't known
+ *
+ * @details They come from the program of the linear-time matcher, which
+ * is compiled here if the L modifier didn't.  This is only done by the 
+ * _init functions, for constant patterns, so the lengths aren't cached.
+ */
+static int *pregLengths( preg_cache_entry *pce , int *min_length )
+{
+    preg_nfa *lin ;
+    int *lengths = NULL ;
+
+    *min_length = 0 ;
+    if( !pce || !pce->re )
+        return NULL ;
+
+    lin = pce->nfa ? pce->nfa : 
+        pregNfaCompile( pce->pattern , pce->options , NULL , 0 ) ;
+    if( lin )
+        lengths = pregNfaLengths( pce->pattern , pce->options , lin , 
+                                  pce->capture_count , min_length ) ;
+    if( lin != pce->nfa )
+        pregNfaFree( lin ) ;
+
+    return lengths ;
+}
+
+/**
+ * @fn static unsigned long pregGroupMaxLength( const int *lengths ,
+ *                                              int groups , int group ,
+ *                                              unsigned long subject_max )
+ *
+ * @brief pregMaxLength, with the lengths from pregLengths
+ */
+static unsigned long pregGroupMaxLength( const int *lengths , int groups ,
+                                         int group , 
+                                         unsigned long subject_max )
+{
+    if( !lengths || group < 0 )
+        return subject_max ;
+
+    // A group that isn't in the pattern is returned as an empty string
+    if( group > groups )
+        return 0 ;
+
+    if( lengths[ group ] < 0 || 
+        (unsigned long)lengths[ group ] > subject_max )
+        return subject_max ;
+
+    return lengths[ group ] ;
+}
+
+
 /*
  * Public Functions:
  */
 
 /**
- * @fn pcre *pregCompileRegexArg( UDF_ARGS *args , char *msg , int msglen ) 
+ * @fn preg_cache_entry *pregCompileRegexArg( UDF_ARGS *args , char *msg , 
+ *                                          int msglen ) 
  *
  * @brief compile the regex (arg[0])
  *
@@ -47,48 +239,146 @@
  * @param msg - buffer where error messages can be placed
  * @param msglen - size of the error message buffer above
  * 
- * @return - if successful - the compiled regular expression
+ * @return - if successful - the cache entry of the compiled regular expression
  * @return - if failure - NULL
  *
  * @details 
  *    This function compiles the pcre regular expression passed in as
  * the first argument.  The argument passed  
  * as args->args[0] is a pattern that needs to include delimiters and
- * may include modifiers.  (ie. /([a-z0-9]*?)(.*)/i ).  This function
- * is necessary because compileRegex (from_php.c) requires a string
- * argument.  This function null terminates the first argument and
- * calls compileRegex.
+ * may include modifiers.  (ie. /([a-z0-9]*?)(.*)/i ).  The argument
+ * is passed to compileRegex (from_php.c) as is, with its length, and
+ * compileRegex looks the pattern up in the pattern cache before 
+ * compiling it.
  *
  * @note 
- *    make sure to call pcre_free to free up the returned result (if not null)
+ *    make sure to call pregCacheRelease to release the returned result 
+ * (if not null)
  * 
  */
-pcre *pregCompileRegexArg( UDF_ARGS *args , char *msg , int msglen ) 
+preg_cache_entry *pregCompileRegexArg( UDF_ARGS *args , char *msg , int msglen ) 
 {
-    pcre *re ;                  /* the compiled pattern */
-    char *val ;                 /* The pattern to compile */
-
     *msg ='\0';
 
-    val = ghargdup( args , 0 ) ;
-    if( !val )
+    if( !args->args[0] || !args->lengths[0] )
     {
-        if( args->lengths[0] && args->args[0] )
+        strncpy( msg , "Empty pattern" , msglen ) ;
+        return NULL ;
+    }
+
+    return compileRegex( args->args[0] , args->lengths[0], msg, msglen ) ;
+}
+
+
+/**
+ * @fn struct preg_regex_s *pregGetRegex( struct preg_s *ptr , 
+ *                                        UDF_ARGS *args ,
+ *                                        char *msg , int msglen )
+ *
+ * @brief get the compiled regex (arg[0]) for the current row
+ *
+ * @param ptr - the info stored in initid->ptr
+ * @param args - the args supplied by mysql udf api (ultimately, the user)
+ * @param msg - buffer where error messages can be placed
+ * @param msglen - size of the error message buffer above
+ * 
+ * @return - if successful - the compiled regular expression
+ * @return - if failure - NULL
+ *
+ * @details
+ *    Constant patterns are compiled by pregInit and are simply returned.
+ * Otherwise, the pattern is looked up in ptr->lru, which holds the 
+ * most recently used patterns of this UDF instance along with their
+ * study data and offset vectors.  No locking is needed for this.
+ * Patterns that are not found there are compiled (or found in the 
+ * process-wide cache) and added to the lru.  When patterns are not found
+ * in the lru PREG_LRU_BYPASS times in a row, the pattern probably changes
+ * every row.  From then on, a pattern is only added to the lru if it is
+ * the same as the previous one, and other patterns are kept in ptr->row
+ * until the next row.  This keeps the lru from being churned.
+ *
+ * @note
+ *    The returned struct belongs to ptr.  It is valid until the next call
+ * to this function and it must not be freed.
+ */
+struct preg_regex_s *pregGetRegex( struct preg_s *ptr , UDF_ARGS *args ,
+                                   char *msg , int msglen )
+{
+    struct preg_regex_s pre ;   /* the newly compiled pattern */
+    preg_cache_entry *pce ;     /* the compiled pattern */
+    unsigned long l ;           /* length of the pattern */
+    int admit ;                 /* should the pattern be added to the lru? */
+    int i ;
+
+    if( ptr->constant_pattern )
+    {
+        return &ptr->re ;
+    }
+
+    // Done with the previous row's pattern.  Its offsets vector is kept,
+    // so that a new one isn't malloc'd for every row.
+    pregReleaseRegex( &ptr->row ) ;
+
+    l = args->lengths[0] ;
+    for( i = 0 ; args->args[0] && i < ptr->lru_count ; i++ )
+    {
+        pce = ptr->lru[ i ].pce ;
+        if( pce->regex_len == l && !memcmp( pce->regex , args->args[0] , l ) )
         {
-            strncpy( msg , "Out of memory" , msglen ) ;
+            if( i )
+            {   // move to the front
+                pre = ptr->lru[ i ] ;
+                memmove( &ptr->lru[ 1 ] , &ptr->lru[ 0 ] , 
+                         i * sizeof( struct preg_regex_s ) ) ;
+                ptr->lru[ 0 ] = pre ;
+            }
+            ptr->lru_misses = 0 ;
+            return &ptr->lru[ 0 ] ;
         }
-        else
+    }
+
+    pce = pregCompileRegexArg( args , msg , msglen ) ;
+    if( !pce )
+    {
+        return NULL ;
+    }
+
+    admit = ( ptr->lru_misses < PREG_LRU_BYPASS || 
+              pce->hash == ptr->lru_last_miss ) ;
+    if( ptr->lru_misses < PREG_LRU_BYPASS )
+        ++ptr->lru_misses ;
+    ptr->lru_last_miss = pce->hash ;
+
+    if( !admit )
+    {
+        if( pregInitRegex( &ptr->row , pce , 0 , ptr->groups , msg , msglen ) )
         {
-            strncpy( msg , "Empty pattern" , msglen ) ;
+            return NULL ;
         }
-        return NULL ;
+        return &ptr->row ;
     }
 
-    re = compileRegex( val , args->lengths[0], msg, msglen ) ;
+    // The offsets vector of the pattern that is dropped from the lru is
+    // used for the new one, if it's big enough
+    memset( &pre , 0 , sizeof( pre ) ) ;
+    if( ptr->lru_count == PREG_LRU_SIZE )
+    {
+        pre = ptr->lru[ --ptr->lru_count ] ;
+        pregReleaseRegex( &pre ) ;
+    }
+
+    if( pregInitRegex( &pre , pce , PREG_STUDY , ptr->groups , msg , msglen ) )
+    {
+        free( pre.ovector ) ;
+        return NULL ;
+    }
 
-    free( val ) ;
+    memmove( &ptr->lru[ 1 ] , &ptr->lru[ 0 ] , 
+             ptr->lru_count * sizeof( struct preg_regex_s ) ) ;
+    ptr->lru[ 0 ] = pre ;
+    ++ptr->lru_count ;
 
-    return re ;
+    return &ptr->lru[ 0 ] ;
 }
 
 
@@ -105,7 +395,8 @@ pcre *pregCompileRegexArg( UDF_ARGS *args , char *msg , int msglen )
  * @return 1 - on error
  *
  * @details 
- *   Compile the regex and save it in ptr->re.  This function should
+ *   Compile the regex, JIT compile it if possible, and save it in 
+ * ptr->re.  This function should
  * normally only be called if the first argument is a constant.
  *
  * @note 
@@ -113,14 +404,42 @@ pcre *pregCompileRegexArg( UDF_ARGS *args , char *msg , int msglen )
  */
 int initPtrInfo( struct preg_s *ptr ,UDF_ARGS *args,char *message )
 {
+    preg_cache_entry *pce ;     /* the compiled pattern */
+
     // 128 is a safe size for mysql, which reccomends 80 chars or less messages
-    ptr->re = pregCompileRegexArg( args, message,128 );
-    if( !ptr->re )
+    pce = pregCompileRegexArg( args, message,128 );
+    if( !pce )
     {
         return 1;
     }
 
-    return 0 ;
+    return pregInitRegex( &ptr->re , pce , PREG_STUDY_JIT , ptr->groups ,
+                          message , 128 ) ;
+}
+
+/**
+ * @fn void pregNeedGroups( struct preg_s *ptr , int groups )
+ *
+ * @brief only keep the offsets of the first groups capture groups 
+ *
+ * @param ptr - the info stored in initid->ptr
+ * @param groups - capture groups that are used, counting the whole match
+ * (so 1 is only the whole match).  0 if all of them are.
+ *
+ * @details This is called by the _init functions after pregInit, when 
+ * the capture group that is asked for is constant.  The offsets vectors
+ * of the patterns are then only that big, so libpcre has less to fill in.
+ * pregSkipToOccurence treats a vector that was too small for all of the
+ * groups as a match.
+ */
+void pregNeedGroups( struct preg_s *ptr , int groups )
+{
+    ptr->groups = groups > 0 ? groups : 0 ;
+
+    // The constant pattern is already compiled.  Its vector can only get 
+    // smaller, so it doesn't need to be reallocated.
+    if( ptr->re.pce )
+        ptr->re.oveccount = pregOffsetsCount( ptr->re.pce , ptr->groups ) ;
 }
 
 /**
@@ -189,7 +508,7 @@ int *pregCreateOffsetsVector( pcre *re , pcre_extra *extra , int *count ,
  */
 int pregGetGroupNum( pcre *re ,  UDF_ARGS *args , int argnum )
 {
-    char *group ;               /* named group - args[argnum] */
+    char group[ PREG_GROUP_NAME_SIZE + 1 ] ; /* named group - args[argnum] */
     int groupnum ;              /* string number of capture group */
     
     // The groupnum was specified as an optional parameter
@@ -201,45 +520,217 @@ int pregGetGroupNum( pcre *re ,  UDF_ARGS *args , int argnum )
     }
     else
     {
-        // This is a named group. The numeric groupnum must be found
-        group = ghargdup( args , 2 ) ;
-        if( !group )  {
+        // This is a named group. The numeric groupnum must be found.
+        // It is copied to null terminate it, which is done on the stack
+        // since names are short.
+        if( !args->args[2] || !args->lengths[2] )  {
             fprintf(stderr,"pregGetGroupNum: error accessing capture group\n");
             return -1 ;
         }
+        if( args->lengths[2] > PREG_GROUP_NAME_SIZE )
+            return PCRE_ERROR_NOSUBSTRING ;
 
+        memcpy( group , args->args[2] , args->lengths[2] ) ;
+        group[ args->lengths[2] ] = '\0' ;
         groupnum =pcre_get_stringnumber(re , group);
-        free( group ) ;
     }
 
     return groupnum ; 
 }
 
 /**
- * @fn int pregSkipToOccurence( pcre *re , char *subject , int subject_len , 
- *                              int *ovector  , int oveccount , int occurence, 
- *                              int *rc)
+ * @fn int pregGroupsUsed( UDF_ARGS *args , int argnum )
+ *
+ * @brief the number of capture groups whose offsets are needed for the 
+ * group argument, for pregNeedGroups
+ *
+ * @param args - the args supplied by mysql udf api (ultimately, the user)
+ * @param argnum - the group argument (see pregGetGroupNum)
+ *
+ * @return 1 - if there is no group argument (the whole match)
+ * @return group + 1 - if the group is a constant number
+ * @return 0 - otherwise (all of them)
+ */
+int pregGroupsUsed( UDF_ARGS *args , int argnum )
+{
+    longlong groupnum ;
+
+    if( argnum >= args->arg_count ) 
+        return 1 ;
+
+    if( args->arg_type[argnum] != INT_RESULT || !args->args[argnum] )
+        return 0 ;
+
+    groupnum = *(longlong *)args->args[argnum] ;
+    if( groupnum < 0 || groupnum >= PREG_GROUP_MAX )
+        return 0 ;
+
+    return (int)groupnum + 1 ;
+}
+
+/**
+ * @fn unsigned long pregMaxLength( preg_cache_entry *pce , int group ,
+ *                                  unsigned long subject_max )
+ *
+ * @brief the longest string that a capture group can match
+ *
+ * @param pce - the compiled pattern or NULL if it isn't known
+ * @param group - the capture group (0 is the whole match)
+ * @param subject_max - the longest subject
+ *
+ * @return the length of the longest string that group can match in a
+ * subject of subject_max bytes
+ *
+ * @details This is for setting max_length in the _init functions.  If the
+ * pattern isn't known, or can't be analyzed (see pregNfaLengths), the
+ * group is assumed to be able to match the whole subject.
+ */
+unsigned long pregMaxLength( preg_cache_entry *pce , int group ,
+                             unsigned long subject_max )
+{
+    unsigned long max ;
+    int *lengths ;
+    int min_length ;
+
+    lengths = pregLengths( pce , &min_length ) ;
+    max = pregGroupMaxLength( lengths , pce ? pce->capture_count : 0 , 
+                              group , subject_max ) ;
+    free( lengths ) ;
+
+    return max ;
+}
+
+/**
+ * @fn unsigned long pregReplaceMaxLength( preg_cache_entry *pce ,
+ *                                         const preg_template *template ,
+ *                                         unsigned long replace_max ,
+ *                                         unsigned long subject_max ,
+ *                                         longlong limit )
+ *
+ * @brief the longest string that pregReplace can return
+ *
+ * @param pce - the compiled pattern or NULL if it isn't known
+ * @param template - the parsed replacement or NULL if it isn't known
+ * @param replace_max - the longest replacement (when template is NULL)
+ * @param subject_max - the longest subject
+ * @param limit - the most replacements that are made, or -1 for no limit
+ *
+ * @return the length of the longest result, at most PREG_MAX_LENGTH
+ *
+ * @details There are two limits, and the smaller one is returned.  Each
+ * match (of at least the shortest match's bytes) is replaced by the text
+ * of the replacement plus the longest strings that its backreferences can
+ * be.  Or, when the groups are known to be inside the match (pregLengths
+ * knows their lengths), what a backreference adds up to over all of
+ * the matches is no more than the subject, since matches don't overlap.
+ * Without a template, every 2 bytes of the replacement might be a 
+ * backreference to the whole match.  A pattern that can match an empty
+ * string can match twice at every position (see pregReplace), so there
+ * can be 2 * subject_max + 1 matches.  This is worked out in doubles,
+ * since it can be far too big for an int.
+ */
+unsigned long pregReplaceMaxLength( preg_cache_entry *pce ,
+                                    const preg_template *template ,
+                                    unsigned long replace_max ,
+                                    unsigned long subject_max ,
+                                    longlong limit )
+{
+    double matches ;            /* most matches in a subject */
+    double text ;               /* text of the replacement */
+    double repl ;               /* longest replacement of one match */
+    double backrefs ;           /* longest backreferences of all matches */
+    double group ;              /* longest string one backreference is */
+    double n ;                  /* backreferences in the replacement */
+    double len , len2 ;         /* the two limits on the result */
+    int *lengths ;              /* longest string each group can match */
+    int groups ;
+    int min_length ;
+    int inside ;                /* the groups are inside the match */
+    int i ;
+
+    lengths = pregLengths( pce , &min_length ) ;
+    groups = pce ? pce->capture_count : 0 ;
+    if( min_length > 0 )
+        matches = (double)( subject_max / min_length ) ;
+    else
+        matches = 2.0 * subject_max + 1 ;
+    if( limit >= 0 && (double)limit < matches )
+        matches = (double)limit ;
+    inside = lengths != NULL ;
+
+    if( template )
+    {
+        text = repl = template->text_len ;
+        backrefs = 0 ;
+        for( i = 0 ; i < template->nsegs ; i++ )
+        {
+            if( template->segs[ i ].backref < 0 )
+                continue ;
+            group = pregGroupMaxLength( lengths , groups ,
+                                        template->segs[ i ].backref ,
+                                        subject_max ) ;
+            repl += group ;
+            if( inside && matches * group > subject_max )
+                backrefs += subject_max ;
+            else
+                backrefs += matches * group ;
+        }
+    }
+    else
+    {
+        group = pregGroupMaxLength( lengths , groups , 0 , subject_max ) ;
+        n = (double)( replace_max / 2 ) ;
+        text = replace_max ;
+        repl = group > 2 ? replace_max * ( ( group + 1 ) / 2 ) : replace_max ;
+        if( inside && matches * group > subject_max )
+            backrefs = n * subject_max ;
+        else
+            backrefs = n * matches * group ;
+    }
+
+    len = (double)subject_max ;
+    if( repl > min_length )
+        len += matches * ( repl - min_length ) ;
+
+    len2 = (double)subject_max + backrefs ;
+    if( text > min_length )
+        len2 += matches * ( text - min_length ) ;
+    if( len2 < len )
+        len = len2 ;
+
+    free( lengths ) ;
+    return len < PREG_MAX_LENGTH ? (unsigned long)len : PREG_MAX_LENGTH ;
+}
+
+/**
+ * @fn char *pregSkipToOccurence( struct preg_s *ptr , 
+ *                                struct preg_regex_s *pre , char *subject , 
+ *                                int subject_len , int occurence, 
+ *                                int whole_match , int *rc)
  *
  * @brief return a pointer to the nth occurence of a pcre in a string
  *
- * @param re - compiled regular expression
+ * @param ptr - the info stored in initid->ptr
+ * @param pre - compiled regular expression
  * @param subject - the string on which to perform matching
  * @param subject_len - length of the subject string
- * @param ovector - vector used by pcre to capture offets of matches
- * @param oveccount - size of ovector
  * @param occurence - match occurence to find
+ * @param whole_match - only the offsets of the whole match (not the capture
+ * groups) are needed, so the DFA can be used
  * @param rc - put result of last pcre_exec call here
  * 
  * @return char * - portion of string which starts with pcre occurence requested
- * @return -1 if group number not found or other error
+ * @return NULL - if the occurence was not found
  *
- * @details This function extract the desired group number from the 
- * given arguments.  If it is a named capture group, it is converted
- * to a number using pcre_get_stringnumber.  This number is then returned.
+ * @details This function runs pcre_exec repeatedly until the 
+ * requested occurence of the pattern is found.  The offsets of the
+ * match (relative to the returned pointer) are left in pre->ovector.
+ * If whole_match, only ovector[0] and ovector[1] are set when the DFA 
+ * found the match (*rc is 1).
  */
-char *pregSkipToOccurence( pcre *re , char *subject , int subject_len , 
-                              int *ovector  , int oveccount , int occurence, 
-                              int *rc)
+char *pregSkipToOccurence( struct preg_s *ptr , struct preg_regex_s *pre ,
+                           char *subject , int subject_len , int occurence, 
+                           int whole_match , int *rc)
 {
     char *ex_subject ;          /* position of last match */
     int subject_offset = 0 ;    /* offset of next match from last one */
@@ -247,26 +738,47 @@ char *pregSkipToOccurence( pcre *re , char *subject , int subject_len ,
     pcre_extra extra;
 
     ex_subject = subject ; 
+    *rc = 0 ;
     
-    memset(&extra, 0, sizeof(extra));
-    pregSetLimits(&extra);
+    pregInitExtra(&extra, pre->extra);
     
     // Skip over the 1st N occurences
 
     while( occurence-- && subject_offset <= subject_len ) {
 
-        // Run the regex and find the groupnum if possible
-        *rc = pcre_exec(re, &extra,  subject + subject_offset , 
-                        subject_len - subject_offset, 0,0,
-                        ovector, oveccount); 
+        // Run the regex and find the groupnum if possible.  libpcre is
+        // used if the DFA can't find the bounds of the match.  The DFA finds
+        // the leftmost-first match, so it can't be used for the longest.
+        // Neither is run if the rest of the subject doesn't have the string
+        // that every match contains.
+        *rc = PCRE_ERROR_NULL ;
+        if( pregRequiredMissing( pregCacheRequired( pre->pce ) , subject , 
+                                 subject_len , subject_offset ) )
+            *rc = PCRE_ERROR_NOMATCH ;
+        else if( whole_match && !pre->pce->longest && 
+                 pregCacheDfa( pre->pce ) )
+            *rc = pregDfaExec( pre->pce->dfa , subject + subject_offset ,
+                               subject_len - subject_offset , pre->ovector ) ;
+        if( *rc < 0 && *rc != PCRE_ERROR_NOMATCH )
+            *rc = pregMatch(pre->pce->re, &extra, pre->pce->nfa, 
+                            pre->pce->literal , pregCacheStart( pre->pce ) ,
+                            pre->pce->longest ? ptr->workspace : NULL ,
+                            PREG_WORKSPACE_SIZE , 
+                            subject + subject_offset , 
+                            subject_len - subject_offset, 0,0,
+                            pre->ovector, pre->oveccount); 
+        // The offsets vector only has room for the groups that are used 
+        // (see pregNeedGroups)
+        if( *rc == 0 )
+            *rc = pre->oveccount / 3 ;
         if( *rc <= 0 )
             break ;
         
         ex_subject = subject + subject_offset ; 
-        subject_offset += ovector[1] ;
+        subject_offset += pre->ovector[1] ;
     }
 
-    if( rc > 0 ) 
+    if( *rc > 0 ) 
         ret = ex_subject ; 
     
     return ret ;
@@ -281,14 +793,38 @@ char *pregSkipToOccurence( pcre *re , char *subject , int subject_len ,
  */
 void destroyPtrInfo( struct preg_s *ptr )
 {
-    if( ptr->re )
+    int i ;
+
+    pregFreeRegex( &ptr->re ) ;
+    pregFreeRegex( &ptr->row ) ;
+    for( i = 0 ; i < ptr->lru_count ; i++ )
     {
-        pcre_free( ptr->re ) ;
-        ptr->re = NULL ;
+        pregFreeRegex( &ptr->lru[ i ] ) ;
     }
-    if( ptr->return_buffer ) {
-        free( ptr->return_buffer ) ;
-        ptr->return_buffer = NULL ;
+    ptr->lru_count = 0 ;
+
+    pregBufferRelease( &ptr->return_buffer ) ;
+
+    free( ptr->workspace ) ;
+    ptr->workspace = NULL ;
+
+    pregTemplateFree( ptr->replacement ) ;
+    ptr->replacement = NULL ;
+
+    pregMapFree( ptr->map ) ;
+    ptr->map = NULL ;
+
+    pregSetFree( ptr->set ) ;
+    ptr->set = NULL ;
+
+    pregSetBlobRelease( &ptr->blob ) ;
+
+    pregBufferRelease( &ptr->pair_buffer ) ;
+    if( ptr->next )
+    {
+        destroyPtrInfo( ptr->next ) ;
+        free( ptr->next ) ;
+        ptr->next = NULL ;
     }
 }
 
@@ -300,8 +836,10 @@ void destroyPtrInfo( struct preg_s *ptr )
  * @param initid - various info supplied by mysql api - read more at
  * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
  *
- * @details - frees the ptr members and then frees the ptr itself.  It
- * can usually be the only thing called by the _deinit functions of the
+ * @details - frees the ptr members and then frees the ptr itself.  Only the
+ * first row whose pattern fails to compile is logged by the main functions.
+ * The number of other such rows is logged here.  This function can 
+ * usually be the only thing called by the _deinit functions of the
  * preg routeines.
  */
 void pregDeInit(UDF_INIT *initid)
@@ -311,6 +849,11 @@ void pregDeInit(UDF_INIT *initid)
     if (initid->ptr)
     {
         ptr = (struct preg_s *)initid->ptr ;
+        if( ptr->compile_errors > 1 )
+        {
+            ghlogprintf( "preg: %d more rows with patterns that failed to compile\n",
+                         ptr->compile_errors - 1 ) ;
+        }
         destroyPtrInfo( ptr ) ;
         free( ptr ) ;
         initid->ptr = NULL ;
@@ -336,26 +879,47 @@ void pregDeInit(UDF_INIT *initid)
  * @return 1 - on error
  *
  * @details This function is called from the _init routines for the preg 
- * functions.  It performs the initializations common to all or most of 
- * those routines.  This includes converting the 1st 2 args to strings,
- * and compiling  the first argument (the pattern) if it 
- * is a constant.
+ * functions.  It allocates initid->ptr and sets it up with pregInitInfo.
  */
 bool pregInit(UDF_INIT *initid, UDF_ARGS *args, char *message)
 {
-    struct preg_s *ptr;       /* temp holder of initid->ptr */
-    int i ;
-
     // use calloc so deInit can check for NULL's before freeing
     initid->ptr = (char *)calloc( 1,sizeof( struct preg_s ) ) ;
-    ptr = (struct preg_s *)initid->ptr ;
 
-    if( !ptr )
+    if( !initid->ptr )
     {
         strcpy(message,"not enough memory");
         return 1;
     }
-    
+
+    return pregInitInfo( (struct preg_s *)initid->ptr , args , message ) ;
+}
+
+/**
+ * @fn int pregInitInfo( struct preg_s *ptr , UDF_ARGS *args , 
+ *                       char *message )
+ *
+ * @brief
+ *     Perform the initializations common to all or most of the preg 
+ * routines on a struct preg_s
+ *
+ * @param ptr - the info to set up.  It must have been calloc'd.
+ * @param args - array of information about arguments from the SQL call.
+ * args[0] is the pattern and args[1] the subject (or replacement).
+ * @param message - for error messages.  Should be <80 but can be 255.
+ *
+ * @return 0 - on success
+ * @return 1 - on error
+ *
+ * @details This includes converting the 1st 2 args to strings, and
+ * compiling the first argument (the pattern) if it is a constant.  
+ * PREG_REPLACE calls this for the struct of each of its pattern & 
+ * replacement pairs after the first, with args starting at the pair.
+ */
+int pregInitInfo( struct preg_s *ptr , UDF_ARGS *args , char *message )
+{
+    int i ;
+
     if( ghargIsNullConstant( args , 0 ) ) 
     {
         ptr->constant_pattern = 1 ;
@@ -388,19 +952,20 @@ bool pregInit(UDF_INIT *initid, UDF_ARGS *args, char *message)
         ptr->constant_pattern = 0 ;
     }
 
-    if( ((int)initid->max_length) > 0 )
-    {
-        ptr->return_buffer_size = initid->max_length + 1 ;
-    }
-    else
+    // The return buffer isn't allocated until a string doesn't fit in 
+    // mysql's result buffer, and then it comes from the pool (preg_pool.c)
+    pregBufferInit( &ptr->return_buffer , NULL , 0 ) ;
+    pregBufferInit( &ptr->pair_buffer , NULL , 0 ) ;
+
+    // Only patterns with the F modifier need this, but the pattern isn't 
+    // known until the first row when it isn't constant
+    ptr->workspace = malloc( sizeof( int ) * PREG_WORKSPACE_SIZE ) ;
+    if( !ptr->workspace )
     {
-        // If there is no limit on max_length.  Start at a fairly big
-        // size.   Re-allocations will occur if necessary.
-        ptr->return_buffer_size = 1024000 ;
+        strcpy( message , "not enough memory" ) ;
+        return 1 ;
     }
 
-    ptr->return_buffer = malloc( ptr->return_buffer_size ) ;
-
     return 0 ;
 }
 
@@ -418,8 +983,8 @@ bool pregInit(UDF_INIT *initid, UDF_ARGS *args, char *message)
  * @return -1  - on error
  *
  * @details This function checks to see if ptr->return_buffer is big
- * enough to hold the given data.  If it isn't, reallocs occur.  
- * Then the data is copied.  
+ * enough to hold the given data.  If it isn't, it is moved to a buffer 
+ * from the pool (see preg_pool.c).  Then the data is copied.  
  *
  * @note
  *     The return buffer is null-terminated, as well.  This shouldn't be
@@ -427,31 +992,21 @@ bool pregInit(UDF_INIT *initid, UDF_ARGS *args, char *message)
  */
 int pregCopyToReturnBuffer( struct preg_s *ptr , char *s  , int l )
 {
-    char *newbuf ; 
-
-    if( (l+1) > ptr->return_buffer_size )
+    if( !pregBufferGrow( &ptr->return_buffer , l + 1 , 0 ) )
     {
-        newbuf = malloc( l + 1 ) ;
-        if( !newbuf )
-        {
-            fprintf( stderr , 
-                     "preg: out of memory reallocing return buffer\n" ) ;
-            return -1 ;
-        }
-
-        free( ptr->return_buffer ) ;
-        ptr->return_buffer = newbuf ; 
-        ptr->return_buffer_size = l + 1 ;
+        fprintf( stderr , 
+                 "preg: out of memory reallocing return buffer\n" ) ;
+        return -1 ;
     }
 
-    memcpy( ptr->return_buffer , s , l ) ;
-    ptr->return_buffer[ l ] = 0 ;
+    memcpy( ptr->return_buffer.data , s , l ) ;
+    ptr->return_buffer.data[ l ] = 0 ;
 
     return l ;
 }
 
 /**
- * @fn char *pregMoveToReturnValues( UDF_INIT *initid ,
+ * @fn char *pregMoveToReturnValues( UDF_INIT *initid , char *result ,
  *                                   unsigned long *length , 
  *                                   char *is_null , char *error ,
  *                                   char *s , int s_len  ) 
@@ -463,13 +1018,15 @@ int pregCopyToReturnBuffer( struct preg_s *ptr , char *s  , int l )
  * @param initid - various info supplied by mysql api - read more at
  * http://dev.mysql.com/doc/refman/5.0/en/adding-udf.html
  *
+ * @param result - the result buffer from mysql (PREG_RESULT_SIZE bytes)
  * @param length - put the length of the returned string here.
  * @param is_null - set this if return value is null and NULL is allowed
  * @param error - set if an error occurs
  * @param s - string to copy into return buffer
  * @param s_len - length of string to copy into return buffer
  *
- * @return - pointer to the string to return (ptr->return_buffer)
+ * @return - pointer to the string to return (in result, or in 
+ * ptr->return_buffer if it doesn't fit)
  * @return - NULL - if error occured and NULL's are allowed
  *
  * @details This function checks the given length and data for 
@@ -478,11 +1035,13 @@ int pregCopyToReturnBuffer( struct preg_s *ptr , char *s  , int l )
  * prints the appropriate error message is the given length is <0.
  * Otherwise, it checks for non-NULL data uses pregCopyToReturnBuffer 
  * to copy given data into ptr->return_buffer.  If this copy is 
- * successful, it frees the passed in string.
+ * successful, it frees the passed in string.  The buffer that was 
+ * returned for the last row is given back to the pool first, since mysql
+ * is done with it.
  *
  * @note.  This function frees the passed in string after copying it.  Careful!
  */
-char *pregMoveToReturnValues( UDF_INIT *initid ,
+char *pregMoveToReturnValues( UDF_INIT *initid , char *result ,
                               unsigned long *length , 
                               char *is_null , char *error ,
                               char *s , int s_len  ) 
@@ -492,10 +1051,15 @@ char *pregMoveToReturnValues( UDF_INIT *initid ,
 
     ptr = (struct preg_s *)initid->ptr ;
 
+    // Strings that fit are returned in mysql's result buffer
+    pregBufferRelease( &ptr->return_buffer ) ;
+    pregBufferInit( &ptr->return_buffer , result , PREG_RESULT_SIZE ) ;
+
     // Set default return info.
     *error = 1 ;
     *length = 0 ;
-    *ptr->return_buffer = '\0';
+    if( ptr->return_buffer.data )
+        *ptr->return_buffer.data = '\0';
     if( initid->maybe_null )
     {
         *is_null = 1 ;
@@ -531,7 +1095,7 @@ char *pregMoveToReturnValues( UDF_INIT *initid ,
     }
     else
     {
-        return ptr->return_buffer ;
+        return ptr->return_buffer.data ;
     }
 }
 
@@ -33,17 +33,80 @@
 
 
 // Include the libpcre headers
+#ifdef PREG_USE_PCRE2
+#include "preg_pcre2.h"
+#else
 #include <pcre.h>
+#endif
+#include "preg_cache.h"
+#include "preg_pool.h"
+#include "preg_map.h"
+#include "preg_set.h"
 #include "from_php.h"
 
+// Number of non-constant patterns kept by each UDF instance
+#define PREG_LRU_SIZE 8
+
+// After this many patterns in a row that were not found in the lru, 
+// patterns are only added to the lru when they are seen twice in a row
+#define PREG_LRU_BYPASS ( 2 * PREG_LRU_SIZE )
+
+// How much work to put into a pattern before using it (see pregInitRegex)
+#define PREG_STUDY 1            /* pcre_study */
+#define PREG_STUDY_JIT 2        /* pcre_study & JIT compile */
+
+// More capture groups than libpcre allows
+#define PREG_GROUP_MAX 65536
+
+// Longest capture group name that libpcre allows
+#define PREG_GROUP_NAME_SIZE 32
+
+// Size of the result buffer that mysql passes to functions that return
+// strings
+#define PREG_RESULT_SIZE 255
+
+// Longest string that mysql can return (a LONGBLOB).  max_length is never
+// set higher than this.
+#define PREG_MAX_LENGTH 4294967295UL
+
+// Number of ints in the workspace for pcre_dfa_exec.  pcre_dfa_exec 
+// returns PCRE_ERROR_DFA_WSSIZE if a pattern needs more.
+#define PREG_WORKSPACE_SIZE 1000
+
 /*
  * PCRE Structures:
  */
+struct preg_regex_s {
+    preg_cache_entry *pce ;     /* the compiled regex (from the cache) */
+    pcre_extra *extra ;         /* pcre_study results - NULL if not studied.
+                                   Belongs to pce if it is pce->extra */
+    int *ovector ;              /* offsets vector for pcre_exec */
+    int oveccount ;             /* number of ints of ovector that are used */
+    int ovecsize ;              /* number of ints allocated at ovector */
+};
+
 struct preg_s {
-    pcre *re ;                  /* the compiled regex */
+    struct preg_regex_s re ;    /* the compiled regex (constant patterns) */
     int constant_pattern ;      /* is the pattern argument constant? */
-    char *return_buffer ;       /* alloc'd memory for returning strings */
-    unsigned long return_buffer_size ;
+    int groups ;                /* capture groups that are used (counting
+                                   the whole match) - 0 if all of them */
+    int compile_errors ;        /* rows whose pattern failed to compile */
+    struct preg_regex_s lru[ PREG_LRU_SIZE ] ; /* most recently used first */
+    int lru_count ;             /* number of lru slots in use */
+    int lru_misses ;            /* lookups in a row not found in lru */
+    unsigned int lru_last_miss ;/* hash of last pattern not found in lru */
+    struct preg_regex_s row ;   /* this row's pattern when not kept in lru */
+    int *workspace ;            /* for pcre_dfa_exec (F modifier) */
+    preg_template *replacement ;/* constant replacement (PREG_REPLACE) */
+    preg_map *map ;             /* constant map (PREG_REPLACE_MAP) */
+    preg_set *set ;             /* constant patterns (PREG_CLASSIFY), or 
+                                   the last set loaded (PREG_SET_MATCH) */
+    preg_set_blob blob ;        /* the set being built (PREG_COMPILE_SET) */
+    struct preg_s *next ;       /* the next pattern & replacement pair 
+                                   (PREG_REPLACE with more than one) */
+    preg_buffer pair_buffer ;   /* where the results of the pairs are built,
+                                   turn about with return_buffer */
+    preg_buffer return_buffer ; /* where strings are returned */
 };
 
 /*
@@ -64,23 +127,51 @@ char *pregReplace(pcre *re , pcre_extra *extra ,
 void destroyPtrInfo( struct preg_s *ghptr );
 int initPtrInfo( struct preg_s *ghptr , UDF_ARGS *args,char*msg );
 bool pregInit(UDF_INIT *initid, UDF_ARGS *args, char *message);
-pcre *pregCompileRegexArg( UDF_ARGS *args , char *msg , int msglen ) ;
+int pregInitInfo( struct preg_s *ptr , UDF_ARGS *args , char *message ) ;
+preg_cache_entry *pregCompileRegexArg( UDF_ARGS *args , char *msg , int msglen ) ;
+struct preg_regex_s *pregGetRegex( struct preg_s *ptr , UDF_ARGS *args ,
+                                   char *msg , int msglen ) ;
 int pregCopyToReturnBuffer( struct preg_s *ptr , char *s  , int l );
 void pregDeInit(UDF_INIT *initid) ;
 
 int *pregCreateOffsetsVector( pcre *re , pcre_extra *extra , int *count ,
                               char *msg , int msglen );
+void pregNeedGroups( struct preg_s *ptr , int groups ) ;
 
-char *pregMoveToReturnValues( UDF_INIT *initid ,
+char *pregMoveToReturnValues( UDF_INIT *initid , char *result ,
                               unsigned long *length , 
                               char *is_null , char *error ,
                               char *s , int s_len  )  ;
 int pregGetGroupNum( pcre *re ,  UDF_ARGS *args , int argnum );
+int pregGroupsUsed( UDF_ARGS *args , int argnum );
+unsigned long pregMaxLength( preg_cache_entry *pce , int group ,
+                             unsigned long subject_max ) ;
+unsigned long pregReplaceMaxLength( preg_cache_entry *pce ,
+                                    const preg_template *template ,
+                                    unsigned long replace_max ,
+                                    unsigned long subject_max ,
+                                    longlong limit ) ;
 
-char *pregSkipToOccurence( pcre *re , char *subject , int subject_len , 
-                           int *ovector  , int oveccount , int occurence, 
-                           int *rc);
+char *pregSkipToOccurence( struct preg_s *ptr , struct preg_regex_s *pre ,
+                           char *subject , int subject_len , int occurence, 
+                           int whole_match , int *rc);
+void pregComputeLimits(pcre_extra *extra);
 void pregSetLimits(pcre_extra *extra);
+void pregInitExtra(pcre_extra *extra, const pcre_extra *study);
+pcre_extra *pregStudy(const pcre *re, int jit, const char **error);
+int pregExec(const pcre *re, pcre_extra *extra, const char *subject,
+             int length, int start_offset, int options, 
+             int *ovector, int ovecsize);
+int pregExecLongest(const pcre *re, pcre_extra *extra, const char *subject,
+                    int length, int start_offset, int options, 
+                    int *ovector, int ovecsize, int *workspace, int wscount);
+int pregMatch(const pcre *re, pcre_extra *extra, const preg_nfa *nfa,
+              const preg_literal *literal, const preg_start *start,
+              int *workspace, int wscount,
+              const char *subject, int length, int start_offset, int options,
+              int *ovector, int ovecsize);
+int pregRequiredMissing(const preg_literal *required, const char *subject,
+                        int length, int start_offset);
 const char *pregExecErrorString(int errno);
 
 
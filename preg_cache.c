@@ -0,0 +1,555 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/** @file preg_cache.c
+ *
+ * @brief A process-wide cache of compiled patterns that is shared by all
+ *        of the connections (threads) of the server.
+ *
+ * @details Patterns are looked up by their bytes, including the
+ * delimiters and modifiers, so the same pattern always maps to
+ * the same entry.  Failed compiles are cached as well (with a NULL re
+ * and the error message) so that a bad pattern stored in a table
+ * is not recompiled for every row.  The cache holds at most
+ * PREG_CACHE_SIZE entries and drops the least recently used one when
+ * it is full.  Entries are reference counted, so an entry that is
+ * dropped from the cache stays valid until its last user releases it.
+ * What the matchers other than libpcre need is built the first time
+ * that it is asked for (see pregCacheDfa), since a pattern that is only
+ * seen once shouldn't pay for all of them.
+ *
+ * @notes This file does not depend on mysql.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "preg_cache.h"
+#include "preg_utils.h"
+
+static pthread_mutex_t preg_cache_lock = PTHREAD_MUTEX_INITIALIZER ;
+static preg_cache_entry *preg_cache_buckets[ PREG_CACHE_SIZE ] ;
+static preg_cache_entry *preg_cache_head = NULL ; /* most recently used */
+static preg_cache_entry *preg_cache_tail = NULL ; /* least recently used */
+static int preg_cache_count = 0 ;
+
+
+/**
+ * @fn static unsigned int pregCacheHash( const char *regex , int regex_len )
+ *
+ * @brief hash the bytes of a pattern
+ */
+static unsigned int pregCacheHash( const char *regex , int regex_len )
+{
+    unsigned int hash = 5381 ;
+    const unsigned char *p = (const unsigned char *)regex ;
+
+    while( regex_len-- > 0 )
+        hash = ( hash << 5 ) + hash + *p++ ;
+
+    return hash ;
+}
+
+/**
+ * @fn static void pregCacheFreeEntry( preg_cache_entry *pce )
+ *
+ * @brief free an entry that is no longer referenced
+ */
+static void pregCacheFreeEntry( preg_cache_entry *pce )
+{
+    if( pce->extra )
+        pcre_free_study( pce->extra ) ;
+    pregNfaFree( pce->nfa ) ;
+    pregHsFree( pce->hs ) ;
+    pregDfaFree( pce->dfa ) ;
+    pregLiteralFree( pce->literal ) ;
+    pregLiteralFree( pce->required ) ;
+    pregStartFree( pce->start ) ;
+    pregClassFree( pce->cls ) ;
+    if( pce->re )
+        pcre_free( pce->re ) ;
+    free( pce->pattern ) ;
+    free( pce->error ) ;
+    free( pce->regex ) ;
+    free( pce ) ;
+}
+
+/*
+ * The functions below operate on the hash table and on the LRU list.
+ * They must be called with preg_cache_lock held.
+ */
+
+static preg_cache_entry *pregCacheLookup( const char *regex , int regex_len ,
+                                          unsigned int hash )
+{
+    preg_cache_entry *pce ;
+
+    pce = preg_cache_buckets[ hash % PREG_CACHE_SIZE ] ;
+    while( pce )
+    {
+        if( pce->hash == hash && pce->regex_len == regex_len &&
+            !memcmp( pce->regex , regex , regex_len ) )
+            break ;
+        pce = pce->hnext ;
+    }
+
+    return pce ;
+}
+
+static void pregCacheUnlinkLRU( preg_cache_entry *pce )
+{
+    if( pce->prev )
+        pce->prev->next = pce->next ;
+    else
+        preg_cache_head = pce->next ;
+
+    if( pce->next )
+        pce->next->prev = pce->prev ;
+    else
+        preg_cache_tail = pce->prev ;
+
+    pce->prev = pce->next = NULL ;
+}
+
+static void pregCachePushLRU( preg_cache_entry *pce )
+{
+    pce->prev = NULL ;
+    pce->next = preg_cache_head ;
+    if( preg_cache_head )
+        preg_cache_head->prev = pce ;
+    else
+        preg_cache_tail = pce ;
+    preg_cache_head = pce ;
+}
+
+/*
+ * Remove pce from the cache and drop the reference held by the cache.
+ * Returns pce if it should now be freed (after unlocking), NULL otherwise.
+ */
+static preg_cache_entry *pregCacheRemove( preg_cache_entry *pce )
+{
+    preg_cache_entry **pp ;
+
+    pp = &preg_cache_buckets[ pce->hash % PREG_CACHE_SIZE ] ;
+    while( *pp != pce )
+        pp = &(*pp)->hnext ;
+    *pp = pce->hnext ;
+    pce->hnext = NULL ;
+
+    pregCacheUnlinkLRU( pce ) ;
+    --preg_cache_count ;
+
+    return ( --pce->refcount == 0 ) ? pce : NULL ;
+}
+
+/**
+ * @fn static int pregCacheBuilt( preg_cache_entry *pce , int part )
+ *
+ * @brief has part (PREG_CACHE_ bit) of pce been built?
+ */
+static int pregCacheBuilt( preg_cache_entry *pce , int part )
+{
+    return ( pce->built & part ) || !pce->re ;
+}
+
+
+/*
+ * Public Functions:
+ */
+
+/**
+ * @fn preg_cache_entry *pregCacheFind( const char *regex , int regex_len )
+ *
+ * @brief look up a compiled pattern in the cache
+ *
+ * @param regex - the pattern, including delimiters and modifiers
+ * @param regex_len - length of regex
+ *
+ * @return the cache entry - if the pattern has been compiled before.
+ * This might be an entry for a pattern that failed to compile (re is NULL).
+ * @return NULL - if the pattern is not in the cache
+ *
+ * @note call pregCacheRelease when done with the returned entry
+ */
+preg_cache_entry *pregCacheFind( const char *regex , int regex_len )
+{
+    preg_cache_entry *pce ;
+    unsigned int hash ;
+
+    hash = pregCacheHash( regex , regex_len ) ;
+
+    pthread_mutex_lock( &preg_cache_lock ) ;
+    pce = pregCacheLookup( regex , regex_len , hash ) ;
+    if( pce )
+    {
+        ++pce->refcount ;
+        if( pce != preg_cache_head )
+        {
+            pregCacheUnlinkLRU( pce ) ;
+            pregCachePushLRU( pce ) ;
+        }
+    }
+    pthread_mutex_unlock( &preg_cache_lock ) ;
+
+    return pce ;
+}
+
+/**
+ * @fn preg_cache_entry *pregCacheAdd( const char *regex , int regex_len ,
+ *                                     pcre *re , char *pattern , 
+ *                                     int options , pcre_extra *extra ,
+ *                                     preg_nfa *nfa , int longest ,
+ *                                     preg_literal *literal , 
+ *                                     const char *error )
+ *
+ * @brief add the result of compiling a pattern to the cache
+ *
+ * @param regex - the pattern, including delimiters and modifiers
+ * @param regex_len - length of regex
+ * @param re - the compiled pattern or NULL if the compile failed.  The
+ * cache takes ownership of re, even when this function fails.
+ * @param pattern - regex without its delimiters and modifiers, as it was
+ * given to pcre_compile, or NULL if the compile failed.  The cache takes 
+ * ownership of pattern, like re.
+ * @param options - the options that pattern was compiled with
+ * @param extra - the results of studying the pattern (S modifier) or NULL.
+ * The cache takes ownership of extra, like re.
+ * @param nfa - the pattern compiled for the linear-time matcher (L modifier) 
+ * or NULL.  The cache takes ownership of nfa, like re.
+ * @param longest - the F modifier was used
+ * @param literal - the pattern compiled by pregLiteralCompile or NULL.  The
+ * cache takes ownership of literal, like re.
+ * @param error - the reason the compile failed (if re is NULL)
+ *
+ * @return the cache entry for the pattern - on success
+ * @return NULL - if out of memory
+ *
+ * @details If another thread has added the same pattern in the meantime,
+ * the entry already in the cache is returned and re, pattern, extra, nfa
+ * and literal are freed.  If the cache is full, the least recently used
+ * entry is removed from it.
+ *
+ * @note call pregCacheRelease when done with the returned entry
+ */
+preg_cache_entry *pregCacheAdd( const char *regex , int regex_len ,
+                                pcre *re , char *pattern , int options ,
+                                pcre_extra *extra , preg_nfa *nfa , 
+                                int longest , preg_literal *literal ,
+                                const char *error )
+{
+    preg_cache_entry *pce ;     /* the new entry */
+    preg_cache_entry *old ;     /* entry already in cache or evicted */
+
+    pce = calloc( 1 , sizeof( preg_cache_entry ) ) ;
+    if( pce )
+    {
+        pce->regex = malloc( regex_len + 1 ) ;
+        if( !re )
+            pce->error = strdup( error ? error : "" ) ;
+    }
+    if( !pce || !pce->regex || (!re && !pce->error) )
+    {
+        if( pce )
+        {
+            pce->re = re ;
+            pce->pattern = pattern ;
+            pce->extra = extra ;
+            pce->nfa = nfa ;
+            pce->literal = literal ;
+            pregCacheFreeEntry( pce ) ;
+        }
+        else
+        {
+            if( extra )
+                pcre_free_study( extra ) ;
+            pregNfaFree( nfa ) ;
+            pregLiteralFree( literal ) ;
+            free( pattern ) ;
+            if( re )
+                pcre_free( re ) ;
+        }
+        return NULL ;
+    }
+
+    memcpy( pce->regex , regex , regex_len ) ;
+    pce->regex[ regex_len ] = '\0' ;
+    pce->regex_len = regex_len ;
+    pce->hash = pregCacheHash( regex , regex_len ) ;
+    pce->re = re ;
+    if( re )
+    {   // for sizing offset vectors without asking for every row
+        if( pcre_fullinfo( re , NULL , PCRE_INFO_CAPTURECOUNT , 
+                           &pce->capture_count ) < 0 )
+            pce->capture_count = 0 ;
+        if( pcre_fullinfo( re , NULL , PCRE_INFO_BACKREFMAX , 
+                           &pce->backref_max ) < 0 )
+            pce->backref_max = pce->capture_count ;
+    }
+    pce->pattern = pattern ;
+    pce->options = options ;
+    pce->extra = extra ;
+    pce->nfa = nfa ;
+    pce->longest = longest ;
+    pce->literal = literal ;
+    pce->refcount = 2 ;         /* one for the cache, one for the caller */
+
+    pthread_mutex_lock( &preg_cache_lock ) ;
+
+    old = pregCacheLookup( regex , regex_len , pce->hash ) ;
+    if( old )
+    {
+        // Lost a race with another thread compiling the same pattern
+        ++old->refcount ;
+        pthread_mutex_unlock( &preg_cache_lock ) ;
+        pregCacheFreeEntry( pce ) ;
+        return old ;
+    }
+
+    if( preg_cache_count >= PREG_CACHE_SIZE )
+        old = pregCacheRemove( preg_cache_tail ) ;
+
+    pce->hnext = preg_cache_buckets[ pce->hash % PREG_CACHE_SIZE ] ;
+    preg_cache_buckets[ pce->hash % PREG_CACHE_SIZE ] = pce ;
+    pregCachePushLRU( pce ) ;
+    ++preg_cache_count ;
+
+    pthread_mutex_unlock( &preg_cache_lock ) ;
+
+    if( old )
+        pregCacheFreeEntry( old ) ;
+
+    return pce ;
+}
+
+/**
+ * @fn void pregCacheRelease( preg_cache_entry *pce )
+ *
+ * @brief give up a reference to a cache entry returned by pregCacheFind or
+ * pregCacheAdd.
+ *
+ * @param pce - the entry to release.  NULL is ignored.
+ */
+void pregCacheRelease( preg_cache_entry *pce )
+{
+    int refcount ;
+
+    if( !pce )
+        return ;
+
+    pthread_mutex_lock( &preg_cache_lock ) ;
+    refcount = --pce->refcount ;
+    pthread_mutex_unlock( &preg_cache_lock ) ;
+
+    if( !refcount )
+        pregCacheFreeEntry( pce ) ;
+}
+
+/*
+ * The functions below build the parts of an entry on first use.  They
+ * don't lock: two threads may both build a part, and the one that loses
+ * the compare & swap frees its copy.  The part is stored before its bit
+ * is set in built, so that NULL with the bit set means that it can't be
+ * built, rather than that it hasn't been.  Only a part that was compiled
+ * can be built, so a failed compile has none.
+ */
+
+/**
+ * @fn preg_hs *pregCacheHs( preg_cache_entry *pce )
+ *
+ * @brief the pattern compiled by vectorscan
+ *
+ * @return the database from pregHsCompile - or NULL if vectorscan can't 
+ * run the pattern or isn't configured, or if the pattern is literal
+ */
+preg_hs *pregCacheHs( preg_cache_entry *pce )
+{
+    preg_hs *hs ;
+
+    if( !pregCacheBuilt( pce , PREG_CACHE_HS ) )
+    {
+        hs = pce->literal ? NULL : 
+            pregHsCompile( pce->pattern , pce->options ) ;
+        if( !__sync_bool_compare_and_swap( &pce->hs , NULL , hs ) )
+            pregHsFree( hs ) ;
+        __sync_fetch_and_or( &pce->built , PREG_CACHE_HS ) ;
+    }
+
+    return pce->hs ;
+}
+
+/**
+ * @fn preg_dfa *pregCacheDfa( preg_cache_entry *pce )
+ *
+ * @brief the pattern compiled for the lazy DFA
+ *
+ * @return the DFA from pregDfaCompile - or NULL if the DFA can't run the
+ * pattern, or if the pattern is literal
+ */
+preg_dfa *pregCacheDfa( preg_cache_entry *pce )
+{
+    preg_dfa *dfa ;
+
+    if( !pregCacheBuilt( pce , PREG_CACHE_DFA ) )
+    {
+        dfa = pce->literal ? NULL : 
+            pregDfaCompile( pce->pattern , pce->options ) ;
+        if( !__sync_bool_compare_and_swap( &pce->dfa , NULL , dfa ) )
+            pregDfaFree( dfa ) ;
+        __sync_fetch_and_or( &pce->built , PREG_CACHE_DFA ) ;
+    }
+
+    return pce->dfa ;
+}
+
+/**
+ * @fn preg_literal *pregCacheRequired( preg_cache_entry *pce )
+ *
+ * @brief the string that every match of the pattern contains
+ *
+ * @return the string from pregLiteralRequired - or NULL if there is none,
+ * or if the pattern is literal
+ */
+preg_literal *pregCacheRequired( preg_cache_entry *pce )
+{
+    preg_literal *required ;
+
+    if( !pregCacheBuilt( pce , PREG_CACHE_REQUIRED ) )
+    {
+        required = pce->literal ? NULL : 
+            pregLiteralRequired( pce->re , pce->pattern , pce->options ) ;
+        if( !__sync_bool_compare_and_swap( &pce->required , NULL , required ) )
+            pregLiteralFree( required ) ;
+        __sync_fetch_and_or( &pce->built , PREG_CACHE_REQUIRED ) ;
+    }
+
+    return pce->required ;
+}
+
+/**
+ * @fn preg_start *pregCacheStart( preg_cache_entry *pce )
+ *
+ * @brief the bytes that a match of the pattern can start with
+ *
+ * @return the table from pregStartCompile - or NULL if libpcre doesn't
+ * know the bytes, or if the pattern is literal
+ */
+preg_start *pregCacheStart( preg_cache_entry *pce )
+{
+    preg_start *start ;
+
+    if( !pregCacheBuilt( pce , PREG_CACHE_START ) )
+    {
+        start = pce->literal ? NULL :
+            pregStartCompile( pce->re , pce->extra , pce->pattern , 
+                              pce->options ) ;
+        if( !__sync_bool_compare_and_swap( &pce->start , NULL , start ) )
+            pregStartFree( start ) ;
+        __sync_fetch_and_or( &pce->built , PREG_CACHE_START ) ;
+    }
+
+    return pce->start ;
+}
+
+/**
+ * @fn preg_class *pregCacheClass( preg_cache_entry *pce )
+ *
+ * @brief the bytes that the pattern matches, if it is a single character
+ * class
+ *
+ * @return the class from pregClassCompile - or NULL if the pattern isn't
+ * a class.  The F modifier makes a lazy + match a run, so it isn't one.
+ *
+ * @details The class comes from the program of the linear-time matcher,
+ * which is compiled here if the L modifier didn't.
+ */
+preg_class *pregCacheClass( preg_cache_entry *pce )
+{
+    preg_class *cls = NULL ;
+    preg_nfa *lin ;
+
+    if( !pregCacheBuilt( pce , PREG_CACHE_CLASS ) )
+    {
+        if( !pce->longest )
+        {
+            lin = pce->nfa ? pce->nfa : 
+                pregNfaCompile( pce->pattern , pce->options , NULL , 0 ) ;
+            if( lin )
+                cls = pregClassCompile( lin ) ;
+            if( lin != pce->nfa )
+                pregNfaFree( lin ) ;
+        }
+        if( !__sync_bool_compare_and_swap( &pce->cls , NULL , cls ) )
+            pregClassFree( cls ) ;
+        __sync_fetch_and_or( &pce->built , PREG_CACHE_CLASS ) ;
+    }
+
+    return pce->cls ;
+}
+
+/**
+ * @fn void pregCacheFlush( void )
+ *
+ * @brief remove all entries from the cache
+ *
+ * @details Entries that are still in use are freed when they are released.
+ * This is called when the library is unloaded.
+ */
+void pregCacheFlush( void )
+{
+    preg_cache_entry *pce ;
+    preg_cache_entry *dead = NULL ; /* entries to free after unlocking */
+
+    pthread_mutex_lock( &preg_cache_lock ) ;
+    while( preg_cache_head )
+    {
+        pce = pregCacheRemove( preg_cache_head ) ;
+        if( pce )
+        {
+            pce->next = dead ;
+            dead = pce ;
+        }
+    }
+    pthread_mutex_unlock( &preg_cache_lock ) ;
+
+    while( dead )
+    {
+        pce = dead ;
+        dead = dead->next ;
+        pregCacheFreeEntry( pce ) ;
+    }
+}
+
+#ifdef __GNUC__
+/*
+ * mysqld unloads the library when the last of its functions is dropped.
+ * Don't leave the cached patterns behind when that happens.
+ */
+static void pregCacheUnload( void ) __attribute__((destructor)) ;
+static void pregCacheUnload( void )
+{
+    pregCacheFlush() ;
+}
+#endif
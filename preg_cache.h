@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PREGCACHE_H
+
+#define PREGCACHE_H
+
+/** @file preg_cache.h
+ *
+ * @brief headers for the process-wide cache of compiled patterns
+ */
+
+// Include the libpcre headers
+#ifdef PREG_USE_PCRE2
+#include "preg_pcre2.h"
+#else
+#include "pcre.h"
+#endif
+#include "preg_nfa.h"
+#include "preg_hs.h"
+#include "preg_dfa.h"
+#include "preg_literal.h"
+#include "preg_start.h"
+#include "preg_class.h"
+
+// Maximum number of patterns held by the cache.  The least recently
+// used pattern is dropped when a new one is added to a full cache.
+#define PREG_CACHE_SIZE 4096
+
+// The parts of a cache entry that are built on first use (see built)
+#define PREG_CACHE_HS           0x01
+#define PREG_CACHE_DFA          0x02
+#define PREG_CACHE_REQUIRED     0x04
+#define PREG_CACHE_START        0x08
+#define PREG_CACHE_CLASS        0x10
+
+/*
+ * A compiled pattern, as held by the cache.  Entries are shared between
+ * threads and are reference counted.  Only pcre_compile, and what the S & 
+ * L modifiers ask for, is done when a pattern is compiled.  hs, dfa, 
+ * required, start and cls are built the first time that they are asked
+ * for, by pregCacheHs & co.  Nothing else but the refcount and the list
+ * pointers may change once an entry has been added to the cache.
+ */
+typedef struct preg_cache_entry {
+    char *regex ;               /* pattern, delimiters & modifiers (the key) */
+    int regex_len ;             /* length of regex */
+    unsigned int hash ;         /* hash of regex */
+    pcre *re ;                  /* the compiled regex - NULL if compile failed*/
+    char *pattern ;             /* regex without delimiters & modifiers */
+    int options ;               /* the pcre options of the modifiers */
+    pcre_extra *extra ;         /* study results if S modifier - else NULL */
+    preg_nfa *nfa ;             /* linear-time matcher if L modifier - else
+                                   NULL.  Used instead of re for matching */
+    preg_hs *hs ;               /* vectorscan database for PREG_RLIKE - NULL
+                                   unless configured --with-vectorscan */
+    preg_dfa *dfa ;             /* lazy DFA for match/no-match and the
+                                   whole match - NULL if it can't be used */
+    int longest ;               /* F modifier: match with pcre_dfa_exec */
+    preg_literal *literal ;     /* substring search if the pattern has no
+                                   metacharacters - else NULL.  Used 
+                                   instead of all of the above */
+    preg_literal *required ;    /* a string every match contains - subjects
+                                   without it can't match.  NULL if there
+                                   is none or literal is set */
+    preg_start *start ;         /* the bytes a match can start with - NULL
+                                   if there is no table or literal is set */
+    int capture_count ;         /* number of capture groups in re */
+    int backref_max ;           /* highest group that re refers back to */
+    preg_class *cls ;           /* the bytes the pattern matches if it is a
+                                   single character class - else NULL */
+    volatile int built ;        /* PREG_CACHE_ bits of the parts that have
+                                   been built */
+    char *error ;               /* why the compile failed if re is NULL */
+    int refcount ;              /* 1 for the cache + 1 for each user */
+    struct preg_cache_entry *hnext ; /* next entry in the same hash bucket */
+    struct preg_cache_entry *prev ;  /* more recently used entry */
+    struct preg_cache_entry *next ;  /* less recently used entry */
+} preg_cache_entry ;
+
+preg_cache_entry *pregCacheFind( const char *regex , int regex_len ) ;
+preg_cache_entry *pregCacheAdd( const char *regex , int regex_len ,
+                                pcre *re , char *pattern , int options ,
+                                pcre_extra *extra , preg_nfa *nfa , 
+                                int longest , preg_literal *literal ,
+                                const char *error ) ;
+void pregCacheRelease( preg_cache_entry *pce ) ;
+preg_hs *pregCacheHs( preg_cache_entry *pce ) ;
+preg_dfa *pregCacheDfa( preg_cache_entry *pce ) ;
+preg_literal *pregCacheRequired( preg_cache_entry *pce ) ;
+preg_start *pregCacheStart( preg_cache_entry *pce ) ;
+preg_class *pregCacheClass( preg_cache_entry *pce ) ;
+void pregCacheFlush( void ) ;
+
+#endif
@@ -0,0 +1,579 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/** @file preg_class.c
+ *
+ * @brief Replace the bytes of a single character class, or runs of them,
+ *        without running libpcre.  This is for the patterns that clean up 
+ *        data: /[^0-9]/ or /\\s+/ replaced with '' or ' '.
+ *
+ * @details pregClassCompile recognizes a pattern that is one byte, class
+ * or . with no quantifier, or with +, in the program compiled by 
+ * pregNfaCompile.  Each match of the first kind is one byte.  Each match
+ * of the second is a run of the bytes (a squeeze), unless the + is lazy.
+ * The replacement must be constant text.
+ *
+ * The subject is looked at 16 (SSSE3) or 32 (AVX2) bytes at a time, with
+ * the shuffle lookup that preg_start.c uses.  When the replacement is 
+ * empty, the bytes that are kept are packed together 8 at a time with a 
+ * shuffle from a table of the 256 ways of picking bytes out of 8.  
+ * Otherwise, the search skips to the next byte in (or, after a run, out of)
+ * the class and the text between is copied.  Other cpus and compilers 
+ * look at one byte at a time.
+ *
+ * @notes This file does not depend on mysql.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "preg_class.h"
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define PREG_CLASS_X86
+#include <immintrin.h>
+#endif
+
+typedef const unsigned char *( *preg_class_span )( const preg_class *cls ,
+                                                   const unsigned char *s ,
+                                                   const unsigned char *end ,
+                                                   int in ) ;
+typedef char *( *preg_class_compact )( const preg_class *cls ,
+                                       const unsigned char **s ,
+                                       const unsigned char *end ,
+                                       char *dst , char *dst_end ,
+                                       int *prev , int *runs ) ;
+
+struct preg_class_s {
+    unsigned char bits[ 32 ] ;  /* bit ( c & 7 ) of bits[ c / 8 ] is set if
+                                   c is in the class */
+    unsigned char lo[ 16 ] ;    /* bit h of lo[ c & 15 ] is set if c is in
+                                   the class, c < 0x80, c >> 4 == h */
+    unsigned char hi[ 16 ] ;    /* the same for c >= 0x80, h = c >> 4 & 7 */
+    int squeeze ;               /* a match is a run of the bytes */
+    preg_class_span span ;      /* search function for this cpu */
+    preg_class_compact compact ;/* deletion function for this cpu */
+} ;
+
+#define CLASS_BIT( cls , c ) ( ( (cls)->bits[ (c) >> 3 ] >> ( (c) & 7 ) ) & 1 )
+
+// The bytes to pick out of 8 for each mask of the ones to keep, for the
+// shuffles in classCompact*
+static unsigned char class_shuffle[ 256 ][ 8 ] ;
+static pthread_once_t class_shuffle_once = PTHREAD_ONCE_INIT ;
+
+/**
+ * @fn static void classShuffleInit( void )
+ *
+ * @brief fill in class_shuffle (once)
+ */
+static void classShuffleInit( void )
+{
+    int mask , i , n ;
+
+    for( mask = 0 ; mask < 256 ; mask++ )
+    {
+        n = 0 ;
+        for( i = 0 ; i < 8 ; i++ )
+        {
+            if( mask & ( 1 << i ) )
+                class_shuffle[ mask ][ n++ ] = i ;
+        }
+        while( n < 8 )
+            class_shuffle[ mask ][ n++ ] = 0x80 ;
+    }
+}
+
+/**
+ * @fn static const unsigned char *classSpanScalar( const preg_class *cls ,
+ *                                                  const unsigned char *s ,
+ *                                                  const unsigned char *end ,
+ *                                                  int in )
+ *
+ * @brief find the first byte from s to end that is in the class (in is 1)
+ * or isn't (in is 0)
+ *
+ * @return the byte or end
+ */
+static const unsigned char *classSpanScalar( const preg_class *cls ,
+                                             const unsigned char *s ,
+                                             const unsigned char *end ,
+                                             int in )
+{
+    while( s < end && CLASS_BIT( cls , *s ) != in )
+        s++ ;
+    return s ;
+}
+
+/**
+ * @fn static char *classCompactScalar( const preg_class *cls ,
+ *                                      const unsigned char **s ,
+ *                                      const unsigned char *end ,
+ *                                      char *dst , char *dst_end ,
+ *                                      int *prev , int *runs )
+ *
+ * @brief copy the bytes from *s to end that aren't in the class to dst
+ *
+ * @param prev - 1 if the byte before *s was in the class.  Updated.
+ * @param runs - add the number of runs of bytes in the class to this
+ *
+ * @return where the next byte goes in dst.  *s is moved past the bytes that
+ * were looked at, which is all of them for this function.  The others 
+ * stop when dst_end is close, and leave the rest to this one.
+ */
+static char *classCompactScalar( const preg_class *cls ,
+                                 const unsigned char **s ,
+                                 const unsigned char *end ,
+                                 char *dst , char *dst_end ,
+                                 int *prev , int *runs )
+{
+    const unsigned char *p ;
+    int in ;
+
+    (void)dst_end ;
+    for( p = *s ; p < end ; p++ )
+    {
+        in = CLASS_BIT( cls , *p ) ;
+        if( !in )
+            *dst++ = *p ;
+        else if( !*prev )
+            ++*runs ;
+        *prev = in ;
+    }
+    *s = p ;
+    return dst ;
+}
+
+#ifdef PREG_CLASS_X86
+
+/**
+ * @fn static unsigned int classMaskSsse3( const preg_class *cls , __m128i v )
+ *
+ * @brief which of 16 bytes are in the class, as a bit mask
+ */
+__attribute__(( target( "ssse3" ) ))
+static inline unsigned int classMaskSsse3( const preg_class *cls , __m128i v )
+{
+    const __m128i lo = _mm_loadu_si128( (const __m128i *)cls->lo ) ;
+    const __m128i hi = _mm_loadu_si128( (const __m128i *)cls->hi ) ;
+    const __m128i pow2 = _mm_setr_epi8( 1 , 2 , 4 , 8 , 16 , 32 , 64 , -128 ,
+                                        1 , 2 , 4 , 8 , 16 , 32 , 64 , -128 ) ;
+    __m128i t , h ;
+
+    // pshufb gives 0 for an index with the top bit set, so each byte is
+    // only looked up in the table for its half (see preg_start.c)
+    t = _mm_or_si128( _mm_shuffle_epi8( lo , v ) ,
+                      _mm_shuffle_epi8( hi , _mm_xor_si128( v , 
+                                                _mm_set1_epi8( -128 ) ) ) ) ;
+    h = _mm_and_si128( _mm_srli_epi16( v , 4 ) , _mm_set1_epi8( 7 ) ) ;
+    t = _mm_and_si128( t , _mm_shuffle_epi8( pow2 , h ) ) ;
+    return ~(unsigned int)_mm_movemask_epi8( 
+        _mm_cmpeq_epi8( t , _mm_setzero_si128() ) ) & 0xffff ;
+}
+
+/**
+ * @fn static const unsigned char *classSpanSsse3( const preg_class *cls ,
+ *                                                 const unsigned char *s ,
+ *                                                 const unsigned char *end ,
+ *                                                 int in )
+ *
+ * @brief classSpanScalar, 16 bytes at a time
+ */
+__attribute__(( target( "ssse3" ) ))
+static const unsigned char *classSpanSsse3( const preg_class *cls ,
+                                            const unsigned char *s ,
+                                            const unsigned char *end ,
+                                            int in )
+{
+    unsigned int bits ;
+
+    for( ; end - s >= 16 ; s += 16 )
+    {
+        bits = classMaskSsse3( cls , _mm_loadu_si128( (const __m128i *)s ) ) ;
+        if( !in )
+            bits ^= 0xffff ;
+        if( bits )
+            return s + __builtin_ctz( bits ) ;
+    }
+
+    return classSpanScalar( cls , s , end , in ) ;
+}
+
+/**
+ * @fn static char *classCompactSsse3( const preg_class *cls ,
+ *                                     const unsigned char **s ,
+ *                                     const unsigned char *end ,
+ *                                     char *dst , char *dst_end ,
+ *                                     int *prev , int *runs )
+ *
+ * @brief classCompactScalar, 16 bytes at a time.  8 bytes are stored for
+ * every 8 that are looked at, so this stops 16 bytes before dst_end.
+ */
+__attribute__(( target( "ssse3" ) ))
+static char *classCompactSsse3( const preg_class *cls ,
+                                const unsigned char **s ,
+                                const unsigned char *end ,
+                                char *dst , char *dst_end ,
+                                int *prev , int *runs )
+{
+    const unsigned char *p = *s ;
+    unsigned int in , keep ;
+    __m128i v ;
+
+    for( ; end - p >= 16 && dst_end - dst >= 16 ; p += 16 )
+    {
+        v = _mm_loadu_si128( (const __m128i *)p ) ;
+        in = classMaskSsse3( cls , v ) ;
+        *runs += __builtin_popcount( in & ~( ( in << 1 ) | *prev ) ) ;
+        *prev = in >> 15 ;
+        keep = ~in & 0xffff ;
+
+        _mm_storel_epi64( (__m128i *)dst , _mm_shuffle_epi8( v , 
+            _mm_loadl_epi64( (const __m128i *)class_shuffle[ keep & 0xff ] ) ) ) ;
+        dst += __builtin_popcount( keep & 0xff ) ;
+        _mm_storel_epi64( (__m128i *)dst , _mm_shuffle_epi8( 
+            _mm_srli_si128( v , 8 ) , 
+            _mm_loadl_epi64( (const __m128i *)class_shuffle[ keep >> 8 ] ) ) ) ;
+        dst += __builtin_popcount( keep >> 8 ) ;
+    }
+
+    *s = p ;
+    return classCompactScalar( cls , s , end , dst , dst_end , prev , runs ) ;
+}
+
+/**
+ * @fn static unsigned int classMaskAvx2( const preg_class *cls , __m256i v )
+ *
+ * @brief which of 32 bytes are in the class, as a bit mask
+ */
+__attribute__(( target( "avx2" ) ))
+static inline unsigned int classMaskAvx2( const preg_class *cls , __m256i v )
+{
+    const __m256i lo = _mm256_broadcastsi128_si256( 
+        _mm_loadu_si128( (const __m128i *)cls->lo ) ) ;
+    const __m256i hi = _mm256_broadcastsi128_si256( 
+        _mm_loadu_si128( (const __m128i *)cls->hi ) ) ;
+    const __m256i pow2 = _mm256_setr_epi8( 1 , 2 , 4 , 8 , 16 , 32 , 64 , -128 ,
+                                           1 , 2 , 4 , 8 , 16 , 32 , 64 , -128 ,
+                                           1 , 2 , 4 , 8 , 16 , 32 , 64 , -128 ,
+                                           1 , 2 , 4 , 8 , 16 , 32 , 64 , -128 );
+    __m256i t , h ;
+
+    t = _mm256_or_si256( _mm256_shuffle_epi8( lo , v ) ,
+                         _mm256_shuffle_epi8( hi , _mm256_xor_si256( v , 
+                                                _mm256_set1_epi8( -128 ) ) ) );
+    h = _mm256_and_si256( _mm256_srli_epi16( v , 4 ) , _mm256_set1_epi8( 7 ) ) ;
+    t = _mm256_and_si256( t , _mm256_shuffle_epi8( pow2 , h ) ) ;
+    return ~(unsigned int)_mm256_movemask_epi8( 
+        _mm256_cmpeq_epi8( t , _mm256_setzero_si256() ) ) ;
+}
+
+/**
+ * @fn static const unsigned char *classSpanAvx2( const preg_class *cls ,
+ *                                                const unsigned char *s ,
+ *                                                const unsigned char *end ,
+ *                                                int in )
+ *
+ * @brief classSpanScalar, 32 bytes at a time
+ */
+__attribute__(( target( "avx2" ) ))
+static const unsigned char *classSpanAvx2( const preg_class *cls ,
+                                           const unsigned char *s ,
+                                           const unsigned char *end ,
+                                           int in )
+{
+    unsigned int bits ;
+
+    for( ; end - s >= 32 ; s += 32 )
+    {
+        bits = classMaskAvx2( cls , _mm256_loadu_si256( (const __m256i *)s ) );
+        if( !in )
+            bits = ~bits ;
+        if( bits )
+            return s + __builtin_ctz( bits ) ;
+    }
+
+    return classSpanSsse3( cls , s , end , in ) ;
+}
+
+/**
+ * @fn static char *classCompactAvx2( const preg_class *cls ,
+ *                                    const unsigned char **s ,
+ *                                    const unsigned char *end ,
+ *                                    char *dst , char *dst_end ,
+ *                                    int *prev , int *runs )
+ *
+ * @brief classCompactScalar, 32 bytes at a time.  The bytes are still 
+ * packed 8 at a time.  This stops 32 bytes before dst_end.
+ */
+__attribute__(( target( "avx2,popcnt" ) ))
+static char *classCompactAvx2( const preg_class *cls ,
+                               const unsigned char **s ,
+                               const unsigned char *end ,
+                               char *dst , char *dst_end ,
+                               int *prev , int *runs )
+{
+    const unsigned char *p = *s ;
+    unsigned int in , keep , k ;
+    __m256i v ;
+    __m128i half ;
+    int i ;
+
+    for( ; end - p >= 32 && dst_end - dst >= 32 ; p += 32 )
+    {
+        v = _mm256_loadu_si256( (const __m256i *)p ) ;
+        in = classMaskAvx2( cls , v ) ;
+        *runs += __builtin_popcount( in & ~( ( in << 1 ) | *prev ) ) ;
+        *prev = in >> 31 ;
+        if( !in )
+        {   // nothing to delete
+            _mm256_storeu_si256( (__m256i *)dst , v ) ;
+            dst += 32 ;
+            continue ;
+        }
+        keep = ~in ;
+
+        for( i = 0 ; i < 2 ; i++ )
+        {
+            half = i ? _mm256_extracti128_si256( v , 1 ) :
+                       _mm256_castsi256_si128( v ) ;
+            k = ( keep >> ( 16 * i ) ) & 0xff ;
+            _mm_storel_epi64( (__m128i *)dst , _mm_shuffle_epi8( half , 
+                _mm_loadl_epi64( (const __m128i *)class_shuffle[ k ] ) ) ) ;
+            dst += __builtin_popcount( k ) ;
+            k = ( keep >> ( 16 * i + 8 ) ) & 0xff ;
+            _mm_storel_epi64( (__m128i *)dst , _mm_shuffle_epi8( 
+                _mm_srli_si128( half , 8 ) , 
+                _mm_loadl_epi64( (const __m128i *)class_shuffle[ k ] ) ) ) ;
+            dst += __builtin_popcount( k ) ;
+        }
+    }
+
+    *s = p ;
+    return classCompactSsse3( cls , s , end , dst , dst_end , prev , runs ) ;
+}
+
+#endif /* PREG_CLASS_X86 */
+
+/**
+ * @fn static int classInst( const preg_nfa *nfa , int pc , 
+ *                           unsigned char *bits )
+ *
+ * @brief get the bytes that the instruction at pc matches
+ *
+ * @return 1 - if it matches one byte (bits is filled in)
+ * @return 0 - if it is some other instruction
+ */
+static int classInst( const preg_nfa *nfa , int pc , unsigned char *bits )
+{
+    const struct preg_nfa_inst *inst = &nfa->prog[ pc ] ;
+
+    switch( inst->op )
+    {
+    case NFA_BYTE:
+        memset( bits , 0 , 32 ) ;
+        bits[ inst->c >> 3 ] |= 1 << ( inst->c & 7 ) ;
+        return 1 ;
+    case NFA_SET:
+        memcpy( bits , nfa->sets[ inst->x ] , 32 ) ;
+        return 1 ;
+    case NFA_ANY:
+        memset( bits , 0xff , 32 ) ;
+        return 1 ;
+    case NFA_ANYNL:
+        memset( bits , 0xff , 32 ) ;
+        bits[ '\n' >> 3 ] &= ~( 1 << ( '\n' & 7 ) ) ;
+        return 1 ;
+    }
+    return 0 ;
+}
+
+
+/*
+ * Public Functions:
+ */
+
+/**
+ * @fn preg_class *pregClassCompile( const preg_nfa *nfa )
+ *
+ * @brief recognize a pattern that is a single character class, for
+ * pregClassReplace
+ *
+ * @param nfa - the pattern compiled by pregNfaCompile
+ *
+ * @return the class - or NULL if the pattern is something else, or out of
+ * memory
+ *
+ * @details The program of a single class is SAVE 0, the class, SAVE 1,
+ * MATCH.  With a + it is SAVE 0, the class, SPLIT, the class again, LOOP, 
+ * SAVE 1, MATCH, where the SPLIT goes into the loop first unless the + is
+ * lazy.  A lazy + matches a single byte, like no quantifier.
+ *
+ * @note free the result with pregClassFree
+ */
+preg_class *pregClassCompile( const preg_nfa *nfa )
+{
+    const struct preg_nfa_inst *prog ;
+    preg_class *cls ;
+    unsigned char bits[ 32 ] ;
+    int squeeze , c ;
+
+    if( !nfa || nfa->anchored || nfa->ninst < 4 || 
+        !classInst( nfa , 1 , bits ) )
+        return NULL ;
+
+    prog = nfa->prog ;
+    if( nfa->ninst == 4 && prog[ 2 ].op == NFA_SAVE && prog[ 2 ].x == 1 )
+        squeeze = 0 ;
+    else if( nfa->ninst == 7 && prog[ 2 ].op == NFA_SPLIT &&
+             prog[ 2 ].x + prog[ 2 ].y == 8 &&
+             ( prog[ 2 ].x == 3 || prog[ 2 ].x == 5 ) &&
+             prog[ 3 ].op == prog[ 1 ].op && prog[ 3 ].c == prog[ 1 ].c &&
+             prog[ 3 ].x == prog[ 1 ].x && 
+             prog[ 4 ].op == NFA_LOOP && prog[ 4 ].x == 2 && 
+             prog[ 4 ].y == 5 && prog[ 5 ].op == NFA_SAVE && 
+             prog[ 5 ].x == 1 )
+        squeeze = prog[ 2 ].x == 3 ;
+    else
+        return NULL ;
+
+    cls = calloc( 1 , sizeof( preg_class ) ) ;
+    if( !cls )
+        return NULL ;
+
+    memcpy( cls->bits , bits , sizeof( cls->bits ) ) ;
+    for( c = 0 ; c < 256 ; c++ )
+    {
+        if( !CLASS_BIT( cls , c ) )
+            continue ;
+        if( c < 0x80 )
+            cls->lo[ c & 15 ] |= 1 << ( c >> 4 ) ;
+        else
+            cls->hi[ c & 15 ] |= 1 << ( ( c >> 4 ) & 7 ) ;
+    }
+    cls->squeeze = squeeze ;
+
+    cls->span = classSpanScalar ;
+    cls->compact = classCompactScalar ;
+#ifdef PREG_CLASS_X86
+    if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "popcnt" ) )
+    {
+        cls->span = classSpanAvx2 ;
+        cls->compact = classCompactAvx2 ;
+    }
+    else if( __builtin_cpu_supports( "ssse3" ) )
+    {
+        cls->span = classSpanSsse3 ;
+        cls->compact = classCompactSsse3 ;
+    }
+    if( cls->compact != classCompactScalar )
+        pthread_once( &class_shuffle_once , classShuffleInit ) ;
+#endif
+
+    return cls ;
+}
+
+/**
+ * @fn int pregClassReplace( const preg_class *cls , const char *subject , 
+ *                           int length , const char *text , int text_len ,
+ *                           int limit , preg_buffer *result , 
+ *                           int *result_len )
+ *
+ * @brief replace the matches of a single class pattern with text
+ *
+ * @param cls - from pregClassCompile
+ * @param subject - the subject (does not need to be null terminated)
+ * @param length - length of subject
+ * @param text - the replacement (no backreferences)
+ * @param text_len - length of text
+ * @param limit - the most matches to replace, -1 for all of them
+ * @param result - the buffer to build the result in.  It is grown as 
+ * needed (see preg_pool.c).  The result is null terminated.
+ * @param result_len - put the length of the result here
+ *
+ * @return the number of matches that were replaced
+ * @return -1 - if out of memory
+ */
+int pregClassReplace( const preg_class *cls , const char *subject , 
+                      int length , const char *text , int text_len ,
+                      int limit , preg_buffer *result , int *result_len )
+{
+    const unsigned char *s = (const unsigned char *)subject ;
+    const unsigned char *end = s + length ;
+    const unsigned char *p ;
+    char *dst ;
+    int count , used , prev ;
+
+    count = 0 ;
+    used = 0 ;
+
+    if( !text_len && limit == -1 )
+    {   // Deletion.  The result is no longer than the subject.
+        if( !pregBufferGrow( result , length + 1 , 0 ) )
+            return -1 ;
+        prev = 0 ;
+        dst = cls->compact( cls , &s , end , result->data , 
+                            result->data + result->size , &prev , &count ) ;
+        used = dst - result->data ;
+        if( !cls->squeeze )
+            count = length - used ;
+    }
+    else
+    {
+        while( s < end && ( limit == -1 || count < limit ) )
+        {
+            p = cls->span( cls , s , end , 1 ) ;
+            if( p == end )
+                break ;
+            if( !pregBufferGrow( result , used + ( p - s ) + text_len + 1 , 
+                                 used ) )
+                return -1 ;
+            memcpy( result->data + used , s , p - s ) ;
+            used += p - s ;
+            memcpy( result->data + used , text , text_len ) ;
+            used += text_len ;
+            count++ ;
+            s = cls->squeeze ? cls->span( cls , p + 1 , end , 0 ) : p + 1 ;
+        }
+        if( !pregBufferGrow( result , used + ( end - s ) + 1 , used ) )
+            return -1 ;
+        memcpy( result->data + used , s , end - s ) ;
+        used += end - s ;
+    }
+
+    result->data[ used ] = '\0' ;
+    *result_len = used ;
+    return count ;
+}
+
+/**
+ * @fn void pregClassFree( preg_class *cls )
+ *
+ * @brief free a class returned by pregClassCompile.  NULL is ignored.
+ */
+void pregClassFree( preg_class *cls )
+{
+    free( cls ) ;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PREGCLASS_H
+
+#define PREGCLASS_H
+
+/** @file preg_class.h
+ *
+ * @brief headers for replacing the bytes of a single character class 
+ *        without running libpcre
+ */
+
+#include "preg_nfa.h"
+#include "preg_pool.h"
+
+typedef struct preg_class_s preg_class ;
+
+preg_class *pregClassCompile( const preg_nfa *nfa ) ;
+int pregClassReplace( const preg_class *cls , const char *subject , 
+                      int length , const char *text , int text_len ,
+                      int limit , preg_buffer *result , int *result_len ) ;
+void pregClassFree( preg_class *cls ) ;
+
+#endif
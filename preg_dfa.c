@@ -0,0 +1,736 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/** @file preg_dfa.c
+ *
+ * @brief A DFA that is built as it is used.  It is used instead of libpcre
+ *        when only match/no-match or the bounds of the whole match are
+ *        needed.
+ *
+ * @details The program compiled by preg_nfa.c is turned into a DFA one
+ * state at a time: a state is the list of NFA threads that are waiting
+ * for the next byte, in priority order, and the transitions of a state
+ * are only worked out the first time that they are needed.  After that,
+ * matching costs one table lookup per byte of the subject, no matter what
+ * the pattern is, and neither the pcre limits (pregSetLimits) nor the 
+ * mysqld thread stack come into it.
+ *
+ * Bytes that the pattern can't tell apart share a symbol, which keeps the 
+ * tables small.  There are two more symbols: a \\n that is the last byte of
+ * the subject (for $) and the edge of the subject.  Each state also
+ * remembers what kind of byte was read to get there, which, along with
+ * the next symbol, is all that ^, $, \\b, etc. need to know.
+ *
+ * The states are kept with the compiled pattern in the pattern cache, so
+ * they are shared by all threads.  They are read under a read lock, and
+ * the lock is only taken for writing to add a state.  When the states of a
+ * pattern have used PREG_DFA_MAX_MEMORY, or the states of all patterns 
+ * have used PREG_DFA_TOTAL_MEMORY, no more are added and pregDfaExec 
+ * returns PCRE_ERROR_NOMEMORY for subjects that need new ones, so that 
+ * the caller can use libpcre instead.  Memory that is given back when a
+ * pattern leaves the cache can be used by the others again.
+ *
+ * The bounds of the match are found like this: the forward DFA keeps the
+ * threads in the same order as the matcher in preg_nfa.c, so it knows 
+ * where the leftmost-first match ends, and then a DFA of the reversed
+ * pattern is run backwards from there to find the leftmost place it can
+ * start.  libpcre can end a match elsewhere when the body of a repeat can
+ * match an empty string, so bounds are not found for those patterns.
+ *
+ * @notes This file does not depend on mysql.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "preg_dfa.h"
+
+/*
+ * What is on one side of a position in the subject.  The context of a 
+ * state is what was read to get to it.
+ */
+enum preg_dfa_ctx {
+    DFA_CTX_EDGE ,              /* start or end of the subject */
+    DFA_CTX_NL ,                /* \n */
+    DFA_CTX_FINALNL ,           /* \n that is the last byte of the subject */
+    DFA_CTX_WORD ,              /* \w */
+    DFA_CTX_OTHER ,             /* any other byte */
+    DFA_NCTX
+} ;
+
+// Flags of a state
+#define DFA_CTX_MASK    7       /* the preg_dfa_ctx */
+#define DFA_MATCHED     8       /* a match has been found, so no new 
+                                   threads are started */
+#define DFA_MATCH       16      /* a match ends just before the symbol that
+                                   led to this state */
+
+#define DFA_NBUCKETS    64      /* initial size of the hash table */
+
+// Memory used by the states of all of the DFAs (PREG_DFA_TOTAL_MEMORY)
+static size_t preg_dfa_total_memory = 0 ;
+
+struct preg_dfa_state {
+    struct preg_dfa_state *hnext ;  /* next state in the hash bucket */
+    unsigned int hash ;
+    int flags ;
+    int n ;                     /* number of threads */
+    int *pcs ;                  /* threads, highest priority first */
+    struct preg_dfa_state **next ;  /* state after each symbol, or NULL if
+                                       it hasn't been worked out yet */
+} ;
+
+struct preg_dfa_dir {
+    preg_nfa *nfa ;             /* the program to run */
+    int reverse ;               /* reads the subject backwards */
+    int anchored ;              /* only start threads at the beginning */
+    struct preg_dfa_state *start[ DFA_NCTX ] ; /* for each context */
+    struct preg_dfa_state **buckets ;
+    int nbuckets ;
+    int nstates ;
+    // work areas for dfaStep - only used by the writer
+    int *visited ;              /* step that last visited each instruction */
+    int *added ;                /* step that last added each thread */
+    int *stack ;
+    int *pcs ;                  /* the threads of the new state */
+    int step ;
+} ;
+
+struct preg_dfa_s {
+    struct preg_dfa_dir fwd ;   /* finds whether and where a match ends */
+    struct preg_dfa_dir rev ;   /* finds where it starts */
+    int nsyms ;                 /* byte classes + final \n + edge */
+    int sym_of[ 256 ] ;         /* symbol of each byte */
+    int sym_byte[ 258 ] ;       /* a byte with each symbol (-1 for edge) */
+    int sym_ctx[ 258 ] ;        /* preg_dfa_ctx of each symbol */
+    size_t memory ;             /* used by the states */
+    int full ;                  /* PREG_DFA_MAX_MEMORY has been used */
+    pthread_rwlock_t lock ;
+} ;
+
+static int dfaIsWord( int c )
+{
+    return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) ||
+        ( c >= '0' && c <= '9' ) || c == '_' ;
+}
+
+/**
+ * @fn static void dfaSplit( int *classes , int *nclasses , 
+ *                           const unsigned char *set )
+ *
+ * @brief split the byte classes so that none has bytes both in and out of
+ * set
+ */
+static void dfaSplit( int *classes , int *nclasses , const unsigned char *set )
+{
+    int map[ 2 * 256 ] ;
+    int b , key , n ;
+
+    for( key = 0 ; key < 2 * *nclasses ; key++ )
+        map[ key ] = -1 ;
+
+    n = 0 ;
+    for( b = 0 ; b < 256 ; b++ )
+    {
+        key = 2 * classes[ b ] + ( NFA_BIT( set , b ) ? 1 : 0 ) ;
+        if( map[ key ] < 0 )
+            map[ key ] = n++ ;
+        classes[ b ] = map[ key ] ;
+    }
+    *nclasses = n ;
+}
+
+/**
+ * @fn static void dfaSymbols( preg_dfa *dfa )
+ *
+ * @brief work out the symbols: the classes of bytes that the program
+ * can't tell apart, plus the final \n and the edge of the subject
+ */
+static void dfaSymbols( preg_dfa *dfa )
+{
+    const preg_nfa *nfa = dfa->fwd.nfa ;
+    unsigned char set[ 32 ] ;
+    int nclasses , i , b , sym ;
+
+    memset( dfa->sym_of , 0 , sizeof( dfa->sym_of ) ) ;
+    nclasses = 1 ;
+
+    // \n and \w are needed for the contexts
+    memset( set , 0 , sizeof( set ) ) ;
+    set[ '\n' >> 3 ] |= 1 << ( '\n' & 7 ) ;
+    dfaSplit( dfa->sym_of , &nclasses , set ) ;
+    memset( set , 0 , sizeof( set ) ) ;
+    for( b = 0 ; b < 256 ; b++ )
+    {
+        if( dfaIsWord( b ) )
+            set[ b >> 3 ] |= 1 << ( b & 7 ) ;
+    }
+    dfaSplit( dfa->sym_of , &nclasses , set ) ;
+
+    for( i = 0 ; i < nfa->ninst ; i++ )
+    {
+        if( nfa->prog[ i ].op == NFA_BYTE )
+        {
+            memset( set , 0 , sizeof( set ) ) ;
+            b = nfa->prog[ i ].c ;
+            set[ b >> 3 ] |= 1 << ( b & 7 ) ;
+            dfaSplit( dfa->sym_of , &nclasses , set ) ;
+        }
+        else if( nfa->prog[ i ].op == NFA_SET )
+        {
+            dfaSplit( dfa->sym_of , &nclasses , nfa->sets[ nfa->prog[ i ].x ] ) ;
+        }
+    }
+
+    for( b = 255 ; b >= 0 ; b-- )
+    {
+        sym = dfa->sym_of[ b ] ;
+        dfa->sym_byte[ sym ] = b ;
+        dfa->sym_ctx[ sym ] = ( b == '\n' ) ? DFA_CTX_NL :
+            dfaIsWord( b ) ? DFA_CTX_WORD : DFA_CTX_OTHER ;
+    }
+    dfa->sym_byte[ nclasses ] = '\n' ;
+    dfa->sym_ctx[ nclasses ] = DFA_CTX_FINALNL ;
+    dfa->sym_byte[ nclasses + 1 ] = -1 ;
+    dfa->sym_ctx[ nclasses + 1 ] = DFA_CTX_EDGE ;
+    dfa->nsyms = nclasses + 2 ;
+}
+
+/**
+ * @fn static int dfaAssert( int what , int before , int after )
+ *
+ * @brief check an assertion, given the contexts on each side of the 
+ * position
+ */
+static int dfaAssert( int what , int before , int after )
+{
+    switch( what )
+    {
+    case NFA_BOT:
+    case NFA_START:             /* the DFA always starts at 0 */
+        return before == DFA_CTX_EDGE ;
+    case NFA_BOL:
+        return before == DFA_CTX_EDGE ||
+            ( ( before == DFA_CTX_NL || before == DFA_CTX_FINALNL ) &&
+              after != DFA_CTX_EDGE ) ;
+    case NFA_EOT:
+        return after == DFA_CTX_EDGE ;
+    case NFA_EOTNL:
+        return after == DFA_CTX_EDGE || after == DFA_CTX_FINALNL ;
+    case NFA_EOL:
+        return after == DFA_CTX_EDGE || after == DFA_CTX_NL ||
+            after == DFA_CTX_FINALNL ;
+    case NFA_WORDB:
+    case NFA_NWORDB:
+        return ( ( before == DFA_CTX_WORD ) != ( after == DFA_CTX_WORD ) ) ==
+            ( what == NFA_WORDB ) ;
+    }
+    return 0 ;
+}
+
+/**
+ * @fn static unsigned int dfaHash( int flags , const int *pcs , int n )
+ *
+ * @brief hash of the contents of a state
+ */
+static unsigned int dfaHash( int flags , const int *pcs , int n )
+{
+    unsigned int h = 2166136261u ^ (unsigned int)flags ;
+    int i ;
+
+    for( i = 0 ; i < n ; i++ )
+        h = ( h ^ (unsigned int)pcs[ i ] ) * 16777619u ;
+    return h ;
+}
+
+/**
+ * @fn static struct preg_dfa_state *dfaFind( preg_dfa *dfa , 
+ *                                            struct preg_dfa_dir *d ,
+ *                                            int flags , const int *pcs ,
+ *                                            int n )
+ *
+ * @brief find the state with flags and threads, adding it if it is new
+ *
+ * @return the state - or NULL if PREG_DFA_MAX_MEMORY or 
+ * PREG_DFA_TOTAL_MEMORY has been used (or malloc failed).  Called with 
+ * the write lock.
+ */
+static struct preg_dfa_state *dfaFind( preg_dfa *dfa , 
+                                       struct preg_dfa_dir *d ,
+                                       int flags , const int *pcs , int n )
+{
+    struct preg_dfa_state *s , **buckets ;
+    unsigned int hash ;
+    size_t size ;
+    int i ;
+
+    hash = dfaHash( flags , pcs , n ) ;
+    for( s = d->buckets[ hash % d->nbuckets ] ; s ; s = s->hnext )
+    {
+        if( s->hash == hash && s->flags == flags && s->n == n &&
+            !memcmp( s->pcs , pcs , n * sizeof( int ) ) )
+            return s ;
+    }
+
+    // The state, its transitions and its threads are one block
+    size = sizeof( *s ) + dfa->nsyms * sizeof( s ) + n * sizeof( int ) ;
+    if( d->nstates >= 2 * d->nbuckets )
+        size += 2 * d->nbuckets * sizeof( s ) ;
+    if( dfa->full || dfa->memory + size > PREG_DFA_MAX_MEMORY )
+    {
+        dfa->full = 1 ;
+        return NULL ;
+    }
+
+    // Not full for good: other DFAs may give memory back
+    if( __sync_add_and_fetch( &preg_dfa_total_memory , size ) > 
+        PREG_DFA_TOTAL_MEMORY )
+    {
+        __sync_fetch_and_sub( &preg_dfa_total_memory , size ) ;
+        return NULL ;
+    }
+
+    if( d->nstates >= 2 * d->nbuckets )
+    {
+        buckets = calloc( 2 * d->nbuckets , sizeof( s ) ) ;
+        if( !buckets )
+        {
+            __sync_fetch_and_sub( &preg_dfa_total_memory , size ) ;
+            return NULL ;
+        }
+        for( i = 0 ; i < d->nbuckets ; i++ )
+        {
+            while( ( s = d->buckets[ i ] ) )
+            {
+                d->buckets[ i ] = s->hnext ;
+                s->hnext = buckets[ s->hash % ( 2 * d->nbuckets ) ] ;
+                buckets[ s->hash % ( 2 * d->nbuckets ) ] = s ;
+            }
+        }
+        free( d->buckets ) ;
+        d->buckets = buckets ;
+        d->nbuckets *= 2 ;
+    }
+
+    s = calloc( 1 , sizeof( *s ) + dfa->nsyms * sizeof( s ) + 
+                n * sizeof( int ) ) ;
+    if( !s )
+    {
+        __sync_fetch_and_sub( &preg_dfa_total_memory , size ) ;
+        return NULL ;
+    }
+    s->next = (struct preg_dfa_state **)( s + 1 ) ;
+    s->pcs = (int *)( s->next + dfa->nsyms ) ;
+    memcpy( s->pcs , pcs , n * sizeof( int ) ) ;
+    s->n = n ;
+    s->flags = flags ;
+    s->hash = hash ;
+    s->hnext = d->buckets[ hash % d->nbuckets ] ;
+    d->buckets[ hash % d->nbuckets ] = s ;
+    d->nstates++ ;
+    dfa->memory += size ;
+    return s ;
+}
+
+/**
+ * @fn static struct preg_dfa_state *dfaStep( preg_dfa *dfa ,
+ *                                            struct preg_dfa_dir *d , 
+ *                                            struct preg_dfa_state *s ,
+ *                                            int sym )
+ *
+ * @brief work out the state that s goes to on sym.  Called with the write
+ * lock.
+ *
+ * @details This does what one step of pregNfaExec does, without the 
+ * captures: each thread of s is followed, in priority order, through the
+ * instructions that don't read a byte, and the ones that can read sym
+ * are the threads of the new state.  A new thread is started after the
+ * others while no match has been found.  Unless the direction is
+ * reverse (where the longest match is wanted), reaching the match ends 
+ * the step, since the rest of the threads have a lower priority.
+ */
+static struct preg_dfa_state *dfaStep( preg_dfa *dfa , 
+                                       struct preg_dfa_dir *d ,
+                                       struct preg_dfa_state *s , int sym )
+{
+    const struct preg_nfa_inst *prog = d->nfa->prog ;
+    const struct preg_nfa_inst *inst ;
+    int before , after , c , flags , step , start ;
+    int i , n , sp , pc , ok ;
+
+    after = dfa->sym_ctx[ sym ] ;
+    before = s->flags & DFA_CTX_MASK ;
+    if( d->reverse )
+    {
+        before = after ;
+        after = s->flags & DFA_CTX_MASK ;
+    }
+    c = dfa->sym_byte[ sym ] ;
+    flags = dfa->sym_ctx[ sym ] | ( s->flags & DFA_MATCHED ) ;
+    start = !d->anchored && !( s->flags & DFA_MATCHED ) ;
+    step = ++d->step ;
+    n = 0 ;
+
+    for( i = 0 ; i < s->n + start ; i++ )
+    {
+        sp = 0 ;
+        d->stack[ sp++ ] = ( i < s->n ) ? s->pcs[ i ] : 0 ;
+
+        while( sp )
+        {
+            pc = d->stack[ --sp ] ;
+            for( ;; )
+            {
+                inst = &prog[ pc ] ;
+                if( inst->op == NFA_LOOP )
+                {
+                    pc = ( d->visited[ inst->x ] == step ) ? inst->y : inst->x ;
+                    continue ;
+                }
+                if( d->visited[ pc ] == step )
+                    break ;
+                d->visited[ pc ] = step ;
+
+                if( inst->op == NFA_JMP )
+                {
+                    pc = inst->x ;
+                    continue ;
+                }
+                if( inst->op == NFA_SPLIT )
+                {
+                    d->stack[ sp++ ] = inst->y ;
+                    pc = inst->x ;
+                    continue ;
+                }
+                if( inst->op == NFA_SAVE )
+                {
+                    pc++ ;
+                    continue ;
+                }
+                if( inst->op == NFA_ASSERT )
+                {
+                    if( !dfaAssert( inst->x , before , after ) )
+                        break ;
+                    pc++ ;
+                    continue ;
+                }
+                if( inst->op == NFA_MATCH )
+                {
+                    flags |= DFA_MATCH | DFA_MATCHED ;
+                    if( !d->reverse )
+                        goto done ;
+                    break ;
+                }
+
+                switch( inst->op )
+                {
+                case NFA_BYTE:  ok = ( c == inst->c ) ; break ;
+                case NFA_SET:   ok = c >= 0 && 
+                                    NFA_BIT( d->nfa->sets[ inst->x ] , c ) ; break ;
+                case NFA_ANY:   ok = ( c >= 0 ) ; break ;
+                case NFA_ANYNL: ok = c >= 0 && c != '\n' ; break ;
+                default:        ok = 0 ; break ;
+                }
+                if( ok && d->added[ pc + 1 ] != step )
+                {
+                    d->added[ pc + 1 ] = step ;
+                    d->pcs[ n++ ] = pc + 1 ;
+                }
+                break ;
+            }
+        }
+    }
+
+done:
+    return dfaFind( dfa , d , flags , d->pcs , n ) ;
+}
+
+/**
+ * @fn static struct preg_dfa_state *dfaNext( preg_dfa *dfa ,
+ *                                            struct preg_dfa_dir *d , 
+ *                                            struct preg_dfa_state *s ,
+ *                                            int sym )
+ *
+ * @brief the state that s goes to on sym, adding it if necessary.  
+ * Called with the read lock, which is given up while a state is added.
+ * If s is NULL, the start state for the context sym is returned.
+ *
+ * @return the state - or NULL if it could not be added
+ */
+static struct preg_dfa_state *dfaNext( preg_dfa *dfa , 
+                                       struct preg_dfa_dir *d ,
+                                       struct preg_dfa_state *s , int sym )
+{
+    struct preg_dfa_state **slot ;
+    int zero = 0 ;
+
+    slot = s ? &s->next[ sym ] : &d->start[ sym ] ;
+    if( *slot )
+        return *slot ;
+
+    pthread_rwlock_unlock( &dfa->lock ) ;
+    pthread_rwlock_wrlock( &dfa->lock ) ;
+    if( !*slot )
+    {
+        if( s )
+            *slot = dfaStep( dfa , d , s , sym ) ;
+        else
+            *slot = dfaFind( dfa , d , sym , &zero , d->anchored ? 1 : 0 ) ;
+    }
+    s = *slot ;
+    pthread_rwlock_unlock( &dfa->lock ) ;
+    pthread_rwlock_rdlock( &dfa->lock ) ;
+
+    return s ;
+}
+
+/**
+ * @fn static int dfaSymbol( const preg_dfa *dfa , const unsigned char *s ,
+ *                           int length , int i )
+ *
+ * @brief the symbol for byte i of the subject
+ */
+static int dfaSymbol( const preg_dfa *dfa , const unsigned char *s , 
+                      int length , int i )
+{
+    if( i < 0 || i >= length )
+        return dfa->nsyms - 1 ;
+    if( i == length - 1 && s[ i ] == '\n' )
+        return dfa->nsyms - 2 ;
+    return dfa->sym_of[ s[ i ] ] ;
+}
+
+/**
+ * @fn static int dfaDirInit( struct preg_dfa_dir *d , int reverse ,
+ *                            int anchored )
+ *
+ * @brief set up one direction of a DFA, whose nfa is already set
+ *
+ * @return 0 on success, -1 if out of memory
+ */
+static int dfaDirInit( struct preg_dfa_dir *d , int reverse , int anchored )
+{
+    int n = d->nfa->ninst + 1 ;
+
+    d->reverse = reverse ;
+    d->anchored = anchored ;
+    d->nbuckets = DFA_NBUCKETS ;
+    d->buckets = calloc( d->nbuckets , sizeof( struct preg_dfa_state * ) ) ;
+    d->visited = calloc( 4 * n , sizeof( int ) ) ;
+    if( !d->buckets || !d->visited )
+        return -1 ;
+    d->added = d->visited + n ;
+    d->stack = d->added + n ;
+    d->pcs = d->stack + n ;
+    return 0 ;
+}
+
+/**
+ * @fn static void dfaDirFree( struct preg_dfa_dir *d )
+ *
+ * @brief free the states and work areas of one direction of a DFA
+ */
+static void dfaDirFree( struct preg_dfa_dir *d )
+{
+    struct preg_dfa_state *s ;
+    int i ;
+
+    if( d->buckets )
+    {
+        for( i = 0 ; i < d->nbuckets ; i++ )
+        {
+            while( ( s = d->buckets[ i ] ) )
+            {
+                d->buckets[ i ] = s->hnext ;
+                free( s ) ;
+            }
+        }
+        free( d->buckets ) ;
+    }
+    free( d->visited ) ;
+    pregNfaFree( d->nfa ) ;
+}
+
+
+/*
+ * Public Functions:
+ */
+
+/**
+ * @fn preg_dfa *pregDfaCompile( const char *pattern , int options )
+ *
+ * @brief compile a pattern for pregDfaExec
+ *
+ * @param pattern - the pattern, without delimiters or modifiers 
+ * (null terminated)
+ * @param options - the PCRE_* options from the modifiers
+ *
+ * @return the DFA, with no states yet - or NULL if the pattern can't be
+ * run by the DFA.  These are the patterns that pregNfaCompile rejects.
+ *
+ * @note free the returned DFA with pregDfaFree
+ */
+preg_dfa *pregDfaCompile( const char *pattern , int options )
+{
+    preg_dfa *dfa ;
+    char msg[ 128 ] ;
+
+    dfa = calloc( 1 , sizeof( preg_dfa ) ) ;
+    if( !dfa )
+        return NULL ;
+
+    dfa->fwd.nfa = pregNfaCompile( pattern , options , msg , sizeof( msg ) ) ;
+    if( dfa->fwd.nfa )
+        dfa->rev.nfa = pregNfaCompileReverse( pattern , options , msg , 
+                                              sizeof( msg ) ) ;
+    if( !dfa->rev.nfa || 
+        dfaDirInit( &dfa->fwd , 0 , dfa->fwd.nfa->anchored ) ||
+        dfaDirInit( &dfa->rev , 1 , 1 ) ||
+        pthread_rwlock_init( &dfa->lock , NULL ) )
+    {
+        dfaDirFree( &dfa->fwd ) ;
+        dfaDirFree( &dfa->rev ) ;
+        free( dfa ) ;
+        return NULL ;
+    }
+
+    dfaSymbols( dfa ) ;
+    return dfa ;
+}
+
+/**
+ * @fn int pregDfaExec( preg_dfa *dfa , const char *subject , int length ,
+ *                      int *ovector )
+ *
+ * @brief find the first match of a pattern compiled by pregDfaCompile
+ *
+ * @param dfa - the compiled pattern
+ * @param subject - the subject (does not need to be null terminated)
+ * @param length - length of subject
+ * @param ovector - put the start and end of the match here, like 
+ * pcre_exec does.  If this is NULL, the search stops as soon as it is 
+ * known that there is a match.
+ *
+ * @return 1 - if there is a match
+ * @return PCRE_ERROR_NOMATCH - if there isn't
+ * @return PCRE_ERROR_NOMEMORY - if more states are needed and 
+ * PREG_DFA_MAX_MEMORY or PREG_DFA_TOTAL_MEMORY has been used
+ * @return PCRE_ERROR_BADOPTION - if ovector was given but the pattern has a
+ * repeat that can match an empty string, where libpcre might end the match
+ * somewhere else
+ * @return PCRE_ERROR_NULL - if dfa or subject is NULL
+ *
+ * @details The search starts at the beginning of subject.  For the error
+ * returns, the caller should use libpcre (or the NFA) instead.
+ */
+int pregDfaExec( preg_dfa *dfa , const char *subject , int length ,
+                 int *ovector )
+{
+    const unsigned char *s = (const unsigned char *)subject ;
+    struct preg_dfa_state *state ;
+    int pos , end , start , rc ;
+
+    if( !dfa || !subject || length < 0 )
+        return PCRE_ERROR_NULL ;
+    if( ovector && dfa->fwd.nfa->nullable_loops )
+        return PCRE_ERROR_BADOPTION ;
+
+    pthread_rwlock_rdlock( &dfa->lock ) ;
+
+    // Forwards, to find whether (and where) the first match ends
+    end = -1 ;
+    rc = PCRE_ERROR_NOMATCH ;
+    state = dfaNext( dfa , &dfa->fwd , NULL , DFA_CTX_EDGE ) ;
+    for( pos = 0 ; state ; pos++ )
+    {
+        state = dfaNext( dfa , &dfa->fwd , state , 
+                         dfaSymbol( dfa , s , length , pos ) ) ;
+        if( !state )
+            break ;
+        if( state->flags & DFA_MATCH )
+        {
+            end = pos ;
+            if( !ovector )
+                break ;
+        }
+        if( pos >= length || ( !state->n && 
+              ( dfa->fwd.anchored || ( state->flags & DFA_MATCHED ) ) ) )
+            break ;
+    }
+    if( !state )
+        rc = PCRE_ERROR_NOMEMORY ;
+    else if( end >= 0 )
+        rc = 1 ;
+
+    // Then backwards from the end, to find the leftmost start
+    if( rc == 1 && ovector )
+    {
+        start = -1 ;
+        state = dfaNext( dfa , &dfa->rev , NULL , 
+                         dfa->sym_ctx[ dfaSymbol( dfa , s , length , end ) ] ) ;
+        for( pos = end ; state ; pos-- )
+        {
+            state = dfaNext( dfa , &dfa->rev , state , 
+                             dfaSymbol( dfa , s , length , pos - 1 ) ) ;
+            if( !state )
+                break ;
+            if( state->flags & DFA_MATCH )
+                start = pos ;
+            if( pos <= 0 || !state->n )
+                break ;
+        }
+        if( !state )
+            rc = PCRE_ERROR_NOMEMORY ;
+        else if( start < 0 )
+            rc = PCRE_ERROR_INTERNAL ; /* can't happen */
+        else
+        {
+            ovector[ 0 ] = start ;
+            ovector[ 1 ] = end ;
+        }
+    }
+
+    pthread_rwlock_unlock( &dfa->lock ) ;
+    return rc ;
+}
+
+/**
+ * @fn void pregDfaFree( preg_dfa *dfa )
+ *
+ * @brief free a DFA returned by pregDfaCompile, and all of its states.
+ * NULL is ignored.
+ */
+void pregDfaFree( preg_dfa *dfa )
+{
+    if( dfa )
+    {
+        __sync_fetch_and_sub( &preg_dfa_total_memory , dfa->memory ) ;
+        dfaDirFree( &dfa->fwd ) ;
+        dfaDirFree( &dfa->rev ) ;
+        pthread_rwlock_destroy( &dfa->lock ) ;
+        free( dfa ) ;
+    }
+}
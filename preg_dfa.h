@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PREGDFA_H
+
+#define PREGDFA_H
+
+/** @file preg_dfa.h
+ *
+ * @brief headers for the lazily built DFA that PREG_RLIKE and 
+ *        PREG_POSITION use when they don't need capture groups
+ */
+
+#include "preg_nfa.h"
+
+// Memory that the states of the DFA of one pattern may use.  When it has
+// all been used, subjects that need new states are matched by libpcre.
+#define PREG_DFA_MAX_MEMORY ( 256 * 1024 )
+
+// Memory that the states of all of the DFAs may use together.  The 
+// pattern cache can hold thousands of patterns, each with a DFA, so this
+// is what bounds the memory of the DFAs.  It is shared the same way as
+// PREG_DFA_MAX_MEMORY, first come first served.
+#define PREG_DFA_TOTAL_MEMORY ( 64 * 1024 * 1024 )
+
+typedef struct preg_dfa_s preg_dfa ;
+
+preg_dfa *pregDfaCompile( const char *pattern , int options ) ;
+int pregDfaExec( preg_dfa *dfa , const char *subject , int length ,
+                 int *ovector ) ;
+void pregDfaFree( preg_dfa *dfa ) ;
+
+#endif
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/** @file preg_hs.c
+ *
+ * @brief The vectorscan backend.  Scans subjects with vectorscan (or 
+ *        hyperscan) when only match/no-match is needed.
+ *
+ * @details This file is empty unless configure was run with
+ * --with-vectorscan.
+ *
+ * Each pattern is compiled into a vectorscan database as well as by 
+ * libpcre, and the database is kept in the pattern cache along with the
+ * compiled pcre pattern.  Vectorscan only supports part of the pcre syntax
+ * (no backreferences, lookbehind, atomic groups, etc.), so when it can't
+ * compile a pattern, pregHsCompile returns NULL and the pattern is only
+ * ever run by libpcre.  The same happens for the A and D modifiers, which 
+ * vectorscan has no flags for, and for the u modifier.
+ *
+ * Vectorscan needs scratch space to scan with, and the scratch can't be
+ * used by two threads at once.  So each thread keeps one scratch space,
+ * which grows to fit the largest database that the thread has scanned.
+ *
+ * @notes This file does not depend on mysql.
+ */
+
+#ifdef PREG_USE_VECTORSCAN
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hs.h>
+
+// Include the libpcre headers (for the PCRE_* options and errors)
+#ifdef PREG_USE_PCRE2
+#include "preg_pcre2.h"
+#else
+#include "pcre.h"
+#endif
+#include "preg_hs.h"
+
+struct preg_hs_s {
+    hs_database_t *db ;         /* the pattern compiled in block mode */
+};
+
+static pthread_key_t  preg_hs_key ;
+static pthread_once_t preg_hs_once = PTHREAD_ONCE_INIT ;
+static int            preg_hs_key_ok = 0 ;
+
+static void pregHsFreeScratch( void *scratch )
+{
+    hs_free_scratch( (hs_scratch_t *)scratch ) ;
+}
+
+static void pregHsCreateKey( void )
+{
+    preg_hs_key_ok = !pthread_key_create( &preg_hs_key , pregHsFreeScratch ) ;
+}
+
+/**
+ * @fn static hs_scratch_t *pregHsScratch( const hs_database_t *db )
+ *
+ * @brief get the scratch space of the current thread, making sure that it
+ * is big enough for db
+ *
+ * @return the scratch space - or NULL on error
+ */
+static hs_scratch_t *pregHsScratch( const hs_database_t *db )
+{
+    hs_scratch_t *scratch , *old ;
+
+    pthread_once( &preg_hs_once , pregHsCreateKey ) ;
+    if( !preg_hs_key_ok )
+        return NULL ;
+
+    // hs_alloc_scratch only reallocates when scratch is too small for db
+    old = scratch = (hs_scratch_t *)pthread_getspecific( preg_hs_key ) ;
+    if( hs_alloc_scratch( db , &scratch ) != HS_SUCCESS )
+        return NULL ;
+
+    if( scratch != old && pthread_setspecific( preg_hs_key , scratch ) )
+    {
+        hs_free_scratch( scratch ) ;
+        return NULL ;
+    }
+
+    return scratch ;
+}
+
+/**
+ * @fn preg_hs *pregHsCompile( const char *pattern , int options )
+ *
+ * @brief compile a pattern for pregHsMatch
+ *
+ * @param pattern - the pattern, without delimiters or modifiers.  This
+ * must already have been compiled successfully by pcre_compile.
+ * @param options - the pcre_compile options that the pattern was compiled
+ * with
+ *
+ * @return the compiled pattern - or NULL if vectorscan can't run the 
+ * pattern, in which case libpcre should be used.  Free it with pregHsFree.
+ */
+preg_hs *pregHsCompile( const char *pattern , int options )
+{
+    preg_hs *hs ;
+    hs_compile_error_t *error = NULL ;
+    unsigned int flags ;
+    char *expression ;
+
+    // vectorscan doesn't check that subjects are valid UTF-8, as libpcre does
+    if( options & ( PCRE_ANCHORED | PCRE_DOLLAR_ENDONLY | PCRE_UTF8 ) )
+        return NULL ;
+
+    // Only the first match is needed, and empty matches count
+    flags = HS_FLAG_SINGLEMATCH | HS_FLAG_ALLOWEMPTY ;
+    if( options & PCRE_CASELESS )
+        flags |= HS_FLAG_CASELESS ;
+    if( options & PCRE_MULTILINE )
+        flags |= HS_FLAG_MULTILINE ;
+    if( options & PCRE_DOTALL )
+        flags |= HS_FLAG_DOTALL ;
+
+    // There's no flag for x, but vectorscan understands (?x)
+    expression = malloc( strlen( pattern ) + 5 ) ;
+    if( !expression )
+        return NULL ;
+    strcpy( expression , ( options & PCRE_EXTENDED ) ? "(?x)" : "" ) ;
+    strcat( expression , pattern ) ;
+
+    hs = (preg_hs *)malloc( sizeof( preg_hs ) ) ;
+    if( hs && hs_compile( expression , flags , HS_MODE_BLOCK , NULL ,
+                          &hs->db , &error ) != HS_SUCCESS )
+    {
+        hs_free_compile_error( error ) ;
+        free( hs ) ;
+        hs = NULL ;
+    }
+
+    free( expression ) ;
+    return hs ;
+}
+
+/**
+ * @fn static int pregHsOnMatch( unsigned int id , unsigned long long from ,
+ *                               unsigned long long to , unsigned int flags ,
+ *                               void *context )
+ *
+ * @brief the match callback given to hs_scan.  Stops the scan at the first
+ * match.
+ */
+static int pregHsOnMatch( unsigned int id , unsigned long long from ,
+                          unsigned long long to , unsigned int flags ,
+                          void *context )
+{
+    return 1 ;
+}
+
+/**
+ * @fn int pregHsMatch( const preg_hs *hs , const char *subject , int length )
+ *
+ * @brief test whether subject matches a pattern compiled by pregHsCompile
+ *
+ * @return 1 - if subject matches
+ *         0 - if it does not
+ *         a negative PCRE_ERROR_* - if the subject could not be scanned, in
+ *         which case libpcre should be used instead.
+ */
+int pregHsMatch( const preg_hs *hs , const char *subject , int length )
+{
+    hs_scratch_t *scratch ;
+    hs_error_t rc ;
+
+    if( !hs || length < 0 )
+        return PCRE_ERROR_NULL ;
+
+    scratch = pregHsScratch( hs->db ) ;
+    if( !scratch )
+        return PCRE_ERROR_NOMEMORY ;
+
+    rc = hs_scan( hs->db , subject ? subject : "" , (unsigned int)length , 0 ,
+                  scratch , pregHsOnMatch , NULL ) ;
+    if( rc == HS_SCAN_TERMINATED )
+        return 1 ;
+    if( rc == HS_SUCCESS )
+        return 0 ;
+    return PCRE_ERROR_INTERNAL ;
+}
+
+/**
+ * @fn void pregHsFree( preg_hs *hs )
+ *
+ * @brief free a pattern compiled by pregHsCompile.  hs can be NULL.
+ */
+void pregHsFree( preg_hs *hs )
+{
+    if( hs )
+    {
+        hs_free_database( hs->db ) ;
+        free( hs ) ;
+    }
+}
+
+#ifdef __GNUC__
+/*
+ * Don't leave the key's destructor behind when mysqld unloads the library.
+ * The scratch spaces of the threads that are still running are leaked.
+ */
+static void pregHsUnload( void ) __attribute__((destructor)) ;
+static void pregHsUnload( void )
+{
+    if( preg_hs_key_ok )
+        pthread_key_delete( preg_hs_key ) ;
+}
+#endif
+
+#endif /* PREG_USE_VECTORSCAN */
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PREGHS_H
+
+#define PREGHS_H
+
+/** @file preg_hs.h
+ *
+ * @brief headers for the vectorscan (or hyperscan) backend, which is used
+ *        by PREG_RLIKE when only match/no-match is needed
+ *
+ * @details Without --with-vectorscan, pregHsCompile always returns NULL,
+ * so nothing is ever scanned with vectorscan.
+ */
+
+typedef struct preg_hs_s preg_hs ;
+
+#ifdef PREG_USE_VECTORSCAN
+
+preg_hs *pregHsCompile( const char *pattern , int options ) ;
+int pregHsMatch( const preg_hs *hs , const char *subject , int length ) ;
+void pregHsFree( preg_hs *hs ) ;
+
+#else
+
+#define pregHsCompile( pattern , options ) ( (preg_hs *)NULL )
+#define pregHsMatch( hs , subject , length ) ( -1 )
+#define pregHsFree( hs ) ( (void)( hs ) )
+
+#endif /* PREG_USE_VECTORSCAN */
+
+#endif
@@ -0,0 +1,731 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/** @file preg_literal.c
+ *
+ * @brief Substring search for patterns that have no metacharacters, such
+ *        as /ERROR:/ or /foo/i.  These are matched without libpcre.
+ *
+ * @details pregLiteralCompile decides whether a pattern is a plain string
+ * of bytes, and pregLiteralExec finds it with the same results as 
+ * pcre_exec would.  Caseless patterns are folded the way the default 
+ * libpcre tables fold them, which is ASCII letters only.  Patterns with 
+ * the x or u modifiers are left to libpcre.
+ *
+ * pregLiteralRequired finds a string that every match of any other 
+ * pattern has in it, so that subjects without it can be skipped before 
+ * libpcre is run.
+ *
+ * On x86, the search compares 16 (SSE2) or 32 (AVX2) positions at a time
+ * against the first and the last byte of the literal, and only compares 
+ * the rest of it where both match.  AVX2 is used when the cpu has it,
+ * which is checked when a pattern is compiled.  Other cpus and compilers 
+ * use memchr.
+ *
+ * @notes This file does not depend on mysql.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "preg_literal.h"
+
+// PCRE_ERROR_BADOFFSET came along in pcre 8.13
+#ifndef PCRE_ERROR_BADOFFSET
+#define PCRE_ERROR_BADOFFSET (-24)
+#endif
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define PREG_LITERAL_X86
+#include <immintrin.h>
+#endif
+
+typedef const unsigned char *( *preg_literal_find )( const preg_literal *lit ,
+                                                     const unsigned char *s ,
+                                                     size_t n ) ;
+
+struct preg_literal_s {
+    unsigned char *s ;          /* the bytes - lower case if caseless */
+    size_t len ;                /* number of bytes (at least 1) */
+    int caseless ;              /* i modifier */
+    int anchored ;              /* A modifier */
+    unsigned char first_mask ;  /* 0x20 if caseless & s[ 0 ] is a letter */
+    unsigned char last_mask ;   /* 0x20 if caseless & s[ len-1 ] is a letter */
+    preg_literal_find find ;    /* search function for this cpu */
+} ;
+
+static int litIsAlpha( int c )
+{
+    return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) ;
+}
+
+static int litLower( int c )
+{
+    return ( c >= 'A' && c <= 'Z' ) ? c + 'a' - 'A' : c ;
+}
+
+/**
+ * @fn static inline int litEqual( const preg_literal *lit , 
+ *                                 const unsigned char *s )
+ *
+ * @brief does the literal match the len bytes at s?
+ */
+static inline int litEqual( const preg_literal *lit , const unsigned char *s )
+{
+    size_t i ;
+
+    if( !lit->caseless )
+        return !memcmp( s , lit->s , lit->len ) ;
+
+    for( i = 0 ; i < lit->len ; i++ )
+    {
+        if( litLower( s[ i ] ) != lit->s[ i ] )
+            return 0 ;
+    }
+    return 1 ;
+}
+
+/**
+ * @fn static const unsigned char *litFindScalar( const preg_literal *lit , 
+ *                                                const unsigned char *s ,
+ *                                                size_t n )
+ *
+ * @brief find the first match of the literal in the n bytes at s
+ *
+ * @return the match or NULL
+ */
+static const unsigned char *litFindScalar( const preg_literal *lit , 
+                                           const unsigned char *s , size_t n )
+{
+    const unsigned char *p , *end ;
+    int first = lit->s[ 0 ] ;
+
+    if( n < lit->len )
+        return NULL ;
+    end = s + n - lit->len + 1 ;  /* last place the match can start + 1 */
+
+    if( !lit->first_mask )
+    {
+        for( p = s ; p < end ; p++ )
+        {
+            p = memchr( p , first , end - p ) ;
+            if( !p )
+                return NULL ;
+            if( litEqual( lit , p ) )
+                return p ;
+        }
+        return NULL ;
+    }
+
+    for( p = s ; p < end ; p++ )
+    {
+        if( ( *p | 0x20 ) == first && litEqual( lit , p ) )
+            return p ;
+    }
+    return NULL ;
+}
+
+#ifdef PREG_LITERAL_X86
+
+/*
+ * A byte b matches the (lower case) first byte f of a caseless literal 
+ * when ( b | first_mask ) == f, since the mask is only set for letters.
+ */
+
+/**
+ * @fn static const unsigned char *litFindSse2( const preg_literal *lit , 
+ *                                              const unsigned char *s ,
+ *                                              size_t n )
+ *
+ * @brief litFindScalar, 16 positions at a time
+ */
+__attribute__(( target( "sse2" ) ))
+static const unsigned char *litFindSse2( const preg_literal *lit , 
+                                         const unsigned char *s , size_t n )
+{
+    const __m128i first = _mm_set1_epi8( (char)lit->s[ 0 ] ) ;
+    const __m128i last = _mm_set1_epi8( (char)lit->s[ lit->len - 1 ] ) ;
+    const __m128i fmask = _mm_set1_epi8( (char)lit->first_mask ) ;
+    const __m128i lmask = _mm_set1_epi8( (char)lit->last_mask ) ;
+    const size_t len = lit->len ;
+    const unsigned char *p ;
+    __m128i f , l ;
+    unsigned int bits ;
+    size_t i ;
+
+    for( i = 0 ; i + len + 15 <= n ; i += 16 )
+    {
+        f = _mm_loadu_si128( (const __m128i *)( s + i ) ) ;
+        l = _mm_loadu_si128( (const __m128i *)( s + i + len - 1 ) ) ;
+        f = _mm_cmpeq_epi8( _mm_or_si128( f , fmask ) , first ) ;
+        l = _mm_cmpeq_epi8( _mm_or_si128( l , lmask ) , last ) ;
+        bits = (unsigned int)_mm_movemask_epi8( _mm_and_si128( f , l ) ) ;
+        while( bits )
+        {
+            p = s + i + __builtin_ctz( bits ) ;
+            if( litEqual( lit , p ) )
+                return p ;
+            bits &= bits - 1 ;
+        }
+    }
+
+    return litFindScalar( lit , s + i , n - i ) ;
+}
+
+/**
+ * @fn static const unsigned char *litFindAvx2( const preg_literal *lit , 
+ *                                              const unsigned char *s ,
+ *                                              size_t n )
+ *
+ * @brief litFindScalar, 32 positions at a time
+ */
+__attribute__(( target( "avx2" ) ))
+static const unsigned char *litFindAvx2( const preg_literal *lit , 
+                                         const unsigned char *s , size_t n )
+{
+    const __m256i first = _mm256_set1_epi8( (char)lit->s[ 0 ] ) ;
+    const __m256i last = _mm256_set1_epi8( (char)lit->s[ lit->len - 1 ] ) ;
+    const __m256i fmask = _mm256_set1_epi8( (char)lit->first_mask ) ;
+    const __m256i lmask = _mm256_set1_epi8( (char)lit->last_mask ) ;
+    const size_t len = lit->len ;
+    const unsigned char *p ;
+    __m256i f , l ;
+    unsigned int bits ;
+    size_t i ;
+
+    for( i = 0 ; i + len + 31 <= n ; i += 32 )
+    {
+        f = _mm256_loadu_si256( (const __m256i *)( s + i ) ) ;
+        l = _mm256_loadu_si256( (const __m256i *)( s + i + len - 1 ) ) ;
+        f = _mm256_cmpeq_epi8( _mm256_or_si256( f , fmask ) , first ) ;
+        l = _mm256_cmpeq_epi8( _mm256_or_si256( l , lmask ) , last ) ;
+        bits = (unsigned int)_mm256_movemask_epi8( _mm256_and_si256( f , l ) );
+        while( bits )
+        {
+            p = s + i + __builtin_ctz( bits ) ;
+            if( litEqual( lit , p ) )
+                return p ;
+            bits &= bits - 1 ;
+        }
+    }
+
+    return litFindSse2( lit , s + i , n - i ) ;
+}
+
+#endif /* PREG_LITERAL_X86 */
+
+
+/**
+ * @fn static preg_literal *litCreate( const unsigned char *s , size_t n ,
+ *                                     int caseless )
+ *
+ * @brief make a preg_literal for the n bytes at s (n > 0)
+ *
+ * @return the literal, or NULL if out of memory
+ */
+static preg_literal *litCreate( const unsigned char *s , size_t n , 
+                                int caseless )
+{
+    preg_literal *lit ;
+    size_t i ;
+
+    lit = calloc( 1 , sizeof( preg_literal ) ) ;
+    if( !lit )
+        return NULL ;
+    lit->s = malloc( n ) ;
+    if( !lit->s )
+    {
+        free( lit ) ;
+        return NULL ;
+    }
+
+    lit->caseless = caseless ? 1 : 0 ;
+    for( i = 0 ; i < n ; i++ )
+        lit->s[ i ] = lit->caseless ? litLower( s[ i ] ) : s[ i ] ;
+    lit->len = n ;
+    if( lit->caseless && litIsAlpha( lit->s[ 0 ] ) )
+        lit->first_mask = 0x20 ;
+    if( lit->caseless && litIsAlpha( lit->s[ n - 1 ] ) )
+        lit->last_mask = 0x20 ;
+
+    lit->find = litFindScalar ;
+#ifdef PREG_LITERAL_X86
+    if( __builtin_cpu_supports( "avx2" ) )
+        lit->find = litFindAvx2 ;
+    else if( __builtin_cpu_supports( "sse2" ) )
+        lit->find = litFindSse2 ;
+#endif
+
+    return lit ;
+}
+
+/**
+ * @fn static const unsigned char *litSkipTo( const unsigned char *p , 
+ *                                            int close )
+ *
+ * @brief skip past the next close character (or to the end of the pattern)
+ */
+static const unsigned char *litSkipTo( const unsigned char *p , int close )
+{
+    while( *p && *p != close )
+        p++ ;
+    return *p ? p + 1 : p ;
+}
+
+/**
+ * @fn static const unsigned char *litSkipCount( const unsigned char *p )
+ *
+ * @brief skip a {n,m} quantifier
+ *
+ * @param p - the {
+ *
+ * @return the character after the } - or after the { if it isn't a 
+ * quantifier, in which case the rest is literal
+ */
+static const unsigned char *litSkipCount( const unsigned char *p )
+{
+    const unsigned char *q = p + 1 ;
+    int digits = 0 ;
+
+    while( *q == ' ' || *q == ',' || ( *q >= '0' && *q <= '9' ) )
+    {
+        digits += ( *q >= '0' && *q <= '9' ) ;
+        q++ ;
+    }
+    return ( *q == '}' && digits ) ? q + 1 : p + 1 ;
+}
+
+/**
+ * @fn static const unsigned char *litSkipEscape( const unsigned char *p )
+ *
+ * @brief skip an escape sequence
+ *
+ * @param p - the backslash
+ *
+ * @return the character after the escape.  Escapes with arguments that
+ * aren't all skipped leave letters & digits, but those just end up being 
+ * left out of the required string.
+ */
+static const unsigned char *litSkipEscape( const unsigned char *p )
+{
+    int c = *++p ;
+
+    if( !c )
+        return p ;
+    p++ ;
+    if( c == 'c' )
+        return *p ? p + 1 : p ;
+    if( strchr( "gkopxNP" , c ) && *p && strchr( "{<'" , *p ) )
+        return litSkipTo( p + 1 , *p == '{' ? '}' : *p == '<' ? '>' : '\'' ) ;
+    while( ( c == 'g' || c == 'x' || ( c >= '0' && c <= '9' ) ) &&
+           ( ( *p >= '0' && *p <= '9' ) || litIsAlpha( *p ) || *p == '-' ||
+             *p == '+' ) )
+        p++ ;
+    if( ( c == 'p' || c == 'P' ) && *p )
+        p++ ;
+    return p ;
+}
+
+/**
+ * @fn static const unsigned char *litSkipPosix( const unsigned char *p )
+ *
+ * @brief skip a posix class name like [:alpha:] in a character class
+ *
+ * @param p - the [
+ *
+ * @return the character after the name - or after the [ if it isn't the 
+ * start of a name, in which case the [ is just a character in the class 
+ * (as libpcre does it)
+ */
+static const unsigned char *litSkipPosix( const unsigned char *p )
+{
+    const unsigned char *q ;
+
+    for( q = p + 2 ; *q ; q++ )
+    {
+        if( *q == p[ 1 ] && q[ 1 ] == ']' )
+            return q + 2 ;
+        if( *q == ']' || *q == '[' )
+            break ;
+    }
+    return p + 1 ;
+}
+
+/**
+ * @fn static const unsigned char *litSkipClass( const unsigned char *p )
+ *
+ * @brief skip a character class
+ *
+ * @param p - the [
+ *
+ * @return the character after the closing ]
+ */
+static const unsigned char *litSkipClass( const unsigned char *p )
+{
+    p++ ;
+    if( *p == '^' )
+        p++ ;
+    if( *p == ']' )             /* a ] first is part of the class */
+        p++ ;
+    while( *p && *p != ']' )
+    {
+        if( *p == '\\' )
+            p = litSkipEscape( p ) ;
+        else if( *p == '[' && ( p[ 1 ] == ':' || p[ 1 ] == '.' || 
+                                p[ 1 ] == '=' ) )
+            p = litSkipPosix( p ) ;
+        else
+            p++ ;
+    }
+    return *p ? p + 1 : p ;
+}
+
+/**
+ * @fn static const unsigned char *litSkipGroup( const unsigned char *p )
+ *
+ * @brief skip a group, including any groups and classes in it
+ *
+ * @param p - the (
+ *
+ * @return the character after the closing )
+ */
+static const unsigned char *litSkipGroup( const unsigned char *p )
+{
+    int depth = 0 ;
+
+    while( *p )
+    {
+        if( *p == '\\' )
+            p = litSkipEscape( p ) ;
+        else if( *p == '[' )
+            p = litSkipClass( p ) ;
+        else if( *p++ == '(' )
+            depth++ ;
+        else if( p[ -1 ] == ')' && !--depth )
+            break ;
+    }
+    return p ;
+}
+
+/**
+ * @fn static size_t litRequiredRun( const unsigned char *pattern , 
+ *                                   int options , unsigned char *s )
+ *
+ * @brief find the longest string of literal bytes that every match of 
+ * a pattern contains
+ *
+ * @param pattern - the pattern (null terminated, without the x modifier)
+ * @param options - the PCRE_* options from the modifiers
+ * @param s - put the bytes here (at least as long as the pattern)
+ *
+ * @return the number of bytes put in s - 0 if none were found
+ *
+ * @details Only bytes outside of groups, classes and alternatives count,
+ * and not ones followed by a quantifier.  Anything that is not 
+ * understood ends the current string, so this errs towards finding
+ * nothing.  Patterns with verbs ((*ACCEPT), (*UTF) ...), \\Q...\\E, top
+ * level alternatives or top level option settings get nothing at all.
+ */
+static size_t litRequiredRun( const unsigned char *pattern , int options , 
+                              unsigned char *s )
+{
+    const unsigned char *p = pattern ;
+    size_t best = 0 ;           /* length of the longest string so far */
+    size_t start = 0 ;          /* where the current string starts in s */
+    size_t n = 0 ;              /* length of the current string */
+    int c ;
+
+    if( strstr( (const char *)pattern , "(*" ) || 
+        strstr( (const char *)pattern , "\\Q" ) )
+        return 0 ;
+
+    while( *p )
+    {
+        c = *p ;
+        if( c == '|' || ( c == '(' && p[ 1 ] == '?' && 
+                          ( litIsAlpha( p[ 2 ] ) || p[ 2 ] == '-' || 
+                            p[ 2 ] == '^' ) && p[ 2 ] != 'P' && 
+                          p[ 2 ] != 'C' && p[ 2 ] != 'R' ) )
+            return 0 ;
+
+        // Comments and \E aren't there as far as quantifiers are concerned
+        if( c == '(' && p[ 1 ] == '?' && p[ 2 ] == '#' )
+        {
+            p = litSkipTo( p , ')' ) ;
+            continue ;
+        }
+        if( c == '\\' && p[ 1 ] == 'E' )
+        {
+            p += 2 ;
+            continue ;
+        }
+
+        if( c == '?' || c == '*' || c == '+' || c == '{' )
+        {
+            // The quantifier applies to the last character, which may 
+            // be several bytes with the u modifier
+            if( n && ( options & PCRE_UTF8 ) )
+            {
+                while( n > 1 && ( s[ start + n - 1 ] & 0xc0 ) == 0x80 )
+                    n-- ;
+            }
+            if( n )
+                n-- ;
+            p = ( c == '{' ) ? litSkipCount( p ) : p + 1 ;
+        }
+        else if( c == '\\' && p[ 1 ] && !( p[ 1 ] >= '0' && p[ 1 ] <= '9' ) &&
+                 !litIsAlpha( p[ 1 ] ) && 
+                 !( p[ 1 ] >= 0x80 && ( options & PCRE_CASELESS ) ) )
+        {
+            s[ start + n++ ] = p[ 1 ] ;
+            p += 2 ;
+            continue ;
+        }
+        else if( !strchr( "\\[()^$." , c ) && 
+                 !( c >= 0x80 && ( options & PCRE_CASELESS ) ) )
+        {
+            s[ start + n++ ] = (unsigned char)c ;
+            p++ ;
+            continue ;
+        }
+        else if( c == '\\' )
+            p = litSkipEscape( p ) ;
+        else if( c == '[' )
+            p = litSkipClass( p ) ;
+        else if( c == '(' )
+            p = litSkipGroup( p ) ;
+        else
+            p++ ;
+
+        // Anything but a literal byte ends the current string
+        if( n > best )
+        {
+            memmove( s , s + start , n ) ;
+            best = n ;
+        }
+        start = best ;
+        n = 0 ;
+    }
+
+    if( n > best )
+    {
+        memmove( s , s + start , n ) ;
+        best = n ;
+    }
+    return best ;
+}
+
+/*
+ * Public Functions:
+ */
+
+/**
+ * @fn preg_literal *pregLiteralCompile( const char *pattern , int options )
+ *
+ * @brief compile a pattern for pregLiteralExec, if it is a literal
+ *
+ * @param pattern - the pattern, without delimiters or modifiers 
+ * (null terminated)
+ * @param options - the PCRE_* options from the modifiers
+ *
+ * @return the literal - or NULL if the pattern has metacharacters (or 
+ * escapes other than a backslash before punctuation), is empty, or has 
+ * the x or u modifiers.  Also NULL if out of memory.
+ *
+ * @note free the returned literal with pregLiteralFree
+ */
+preg_literal *pregLiteralCompile( const char *pattern , int options )
+{
+    preg_literal *lit ;
+    const unsigned char *p ;
+    unsigned char *s ;
+    size_t n ;
+
+    if( !pattern || !*pattern || ( options & ( PCRE_EXTENDED | PCRE_UTF8 ) ) )
+        return NULL ;
+
+    for( p = (const unsigned char *)pattern ; *p ; p++ )
+    {
+        if( strchr( "^$.[|()?*+{" , *p ) )
+            return NULL ;
+        if( *p == '\\' && ( !p[ 1 ] || p[ 1 ] >= 0x80 ||
+                            ( p[ 1 ] >= '0' && p[ 1 ] <= '9' ) ||
+                            litIsAlpha( p[ 1 ] ) ) )
+            return NULL ;
+        if( *p == '\\' )
+            p++ ;
+    }
+
+    s = malloc( strlen( pattern ) ) ;
+    if( !s )
+        return NULL ;
+    n = 0 ;
+    for( p = (const unsigned char *)pattern ; *p ; p++ )
+    {
+        if( *p == '\\' )
+            p++ ;
+        s[ n++ ] = *p ;
+    }
+
+    lit = litCreate( s , n , options & PCRE_CASELESS ) ;
+    if( lit )
+        lit->anchored = ( options & PCRE_ANCHORED ) ? 1 : 0 ;
+    free( s ) ;
+    return lit ;
+}
+
+/**
+ * @fn preg_literal *pregLiteralRequired( const pcre *re , 
+ *                                        const char *pattern , int options )
+ *
+ * @brief find a string that is in every match of a pattern
+ *
+ * @param re - the pattern compiled by pcre_compile
+ * @param pattern - the pattern, without delimiters or modifiers 
+ * (null terminated)
+ * @param options - the PCRE_* options from the modifiers
+ *
+ * @return the longest string of literal bytes that is outside of all
+ * groups, classes and quantifiers, compiled for pregLiteralExec - or
+ * else the byte libpcre found that every match needs 
+ * (PCRE_INFO_LASTLITERAL).  NULL if there is neither, or out of memory.
+ *
+ * @details A subject without the string can't match, wherever the
+ * search starts, so the caller can skip pcre_exec for it.  Matches 
+ * of the string are never anchored. 
+ *
+ * @note free the returned literal with pregLiteralFree
+ */
+preg_literal *pregLiteralRequired( const pcre *re , const char *pattern , 
+                                   int options )
+{
+    unsigned char *s ;
+    size_t n ;
+    preg_literal *lit = NULL ;
+    int caseless = options & PCRE_CASELESS ;
+    int c ;
+
+    if( !pattern )
+        return NULL ;
+
+    // The u modifier folds more than ASCII letters, and the x modifier
+    // makes white space and comments part of the syntax.
+    if( !( options & PCRE_EXTENDED ) && !( caseless && ( options & PCRE_UTF8 ) ) )
+    {
+        s = malloc( strlen( pattern ) + 1 ) ;
+        if( !s )
+            return NULL ;
+        n = litRequiredRun( (const unsigned char *)pattern , options , s ) ;
+        if( n )
+            lit = litCreate( s , n , caseless ) ;
+        free( s ) ;
+        if( lit || n )
+            return lit ;
+    }
+
+    // The byte may only be caseless because of a (?i) in the pattern, so
+    // letters are always searched for without case
+    if( re && !pcre_fullinfo( re , NULL , PCRE_INFO_LASTLITERAL , &c ) && 
+        c >= 0 && c < 0x80 )
+    {
+        unsigned char b = (unsigned char)c ;
+        lit = litCreate( &b , 1 , litIsAlpha( c ) ) ;
+    }
+
+    return lit ;
+}
+
+/**
+ * @fn int pregLiteralExec( const preg_literal *lit , const char *subject ,
+ *                          int length , int start_offset , int options , 
+ *                          int *ovector , int ovecsize )
+ *
+ * @brief find a literal compiled by pregLiteralCompile
+ *
+ * @details Takes the same arguments and returns the same results as 
+ * pcre_exec.  Of the options, only PCRE_ANCHORED makes a difference, 
+ * since the literal is never empty.
+ */
+int pregLiteralExec( const preg_literal *lit , const char *subject , 
+                     int length , int start_offset , int options , 
+                     int *ovector , int ovecsize )
+{
+    const unsigned char *s = (const unsigned char *)subject ;
+    const unsigned char *p ;
+    size_t n ;
+
+    if( !lit || !subject || length < 0 )
+        return PCRE_ERROR_NULL ;
+    if( start_offset < 0 || start_offset > length )
+        return PCRE_ERROR_BADOFFSET ;
+
+    n = length - start_offset ;
+    s += start_offset ;
+    if( lit->anchored || ( options & PCRE_ANCHORED ) )
+        p = ( n >= lit->len && litEqual( lit , s ) ) ? s : NULL ;
+    else
+        p = lit->find( lit , s , n ) ;
+    if( !p )
+        return PCRE_ERROR_NOMATCH ;
+
+    // Like pcre_exec: 0 if ovector is too small
+    if( ovecsize < 3 )
+        return 0 ;
+    ovector[ 0 ] = (int)( p - (const unsigned char *)subject ) ;
+    ovector[ 1 ] = ovector[ 0 ] + (int)lit->len ;
+    return 1 ;
+}
+
+/**
+ * @fn const char *pregLiteralString( const preg_literal *lit , int *len )
+ *
+ * @brief the bytes of a literal, for the prefilter of a pattern set 
+ * (preg_set.c)
+ *
+ * @param lit - from pregLiteralCompile or pregLiteralRequired
+ * @param len - put the number of bytes here
+ *
+ * @return the bytes, which are lower case if the literal is caseless.
+ * They belong to lit and are not null terminated.
+ */
+const char *pregLiteralString( const preg_literal *lit , int *len )
+{
+    *len = (int)lit->len ;
+    return (const char *)lit->s ;
+}
+
+/**
+ * @fn void pregLiteralFree( preg_literal *lit )
+ *
+ * @brief free a literal returned by pregLiteralCompile.  NULL is ignored.
+ */
+void pregLiteralFree( preg_literal *lit )
+{
+    if( lit )
+    {
+        free( lit->s ) ;
+        free( lit ) ;
+    }
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PREGLITERAL_H
+
+#define PREGLITERAL_H
+
+/** @file preg_literal.h
+ *
+ * @brief headers for the substring search used instead of libpcre for
+ *        patterns that are just a string of literal bytes, and to screen
+ *        subjects for the strings other patterns require
+ */
+
+// Include the libpcre headers (for the PCRE_* options and errors)
+#ifdef PREG_USE_PCRE2
+#include "preg_pcre2.h"
+#else
+#include "pcre.h"
+#endif
+
+typedef struct preg_literal_s preg_literal ;
+
+preg_literal *pregLiteralCompile( const char *pattern , int options ) ;
+int pregLiteralExec( const preg_literal *lit , const char *subject , 
+                     int length , int start_offset , int options , 
+                     int *ovector , int ovecsize ) ;
+preg_literal *pregLiteralRequired( const pcre *re , const char *pattern , 
+                                   int options ) ;
+const char *pregLiteralString( const preg_literal *lit , int *len ) ;
+void pregLiteralFree( preg_literal *lit ) ;
+
+#endif
@@ -0,0 +1,747 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/** @file preg_map.c
+ *
+ * @brief Replace many literal strings in one pass over the subject, with
+ *        an Aho-Corasick automaton built from a JSON object of from:to 
+ *        pairs.  This is PREG_REPLACE_MAP.
+ *
+ * @details The keys are put in a trie, which is turned into a DFA with the
+ * usual Aho-Corasick failure links, so that each byte of the subject is 
+ * one table lookup.  The rows of the table only have a column for each
+ * byte that is used by some key (plus one for all of the others), so that
+ * the table stays small.  The row of each state also has how deep it is in
+ * the trie and the longest key that ends there, and the edges hold the 
+ * offsets of rows rather than state numbers, so that a step is one load.
+ *
+ * Matches are leftmost-longest: of the keys that match at the leftmost
+ * place, the longest is replaced, and the search goes on after it.  A
+ * match is only replaced once the depth of the state shows that no key
+ * can still match at or before where it starts.  The search starts over 
+ * at the end of the match, so keys never overlap.
+ *
+ * When the automaton is in its first state, the subject is skipped to the
+ * next byte that a key starts with.
+ *
+ * @notes This file does not depend on mysql.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "preg_map.h"
+
+// Most entries in the table of the automaton (states * columns).  Maps
+// that need more are refused.
+#define PREG_MAP_MAX_TABLE ( 16 * 1024 * 1024 )
+
+// Columns of a row of the table after the ones for the bytes
+#define MAP_DEPTH( ncolumns ) ( ncolumns )
+#define MAP_OUT( ncolumns ) ( ( ncolumns ) + 1 )
+#define MAP_FINAL( ncolumns ) ( ( ncolumns ) + 2 )
+#define MAP_STRIDE( ncolumns ) ( ( ncolumns ) + 3 )
+
+/*
+ * A from:to pair of the map
+ */
+typedef struct preg_map_pair_s {
+    char *key ;
+    int key_len ;
+    char *value ;
+    int value_len ;
+} preg_map_pair ;
+
+struct preg_map_s {
+    preg_map_pair *pairs ;      /* from the JSON object, in order */
+    int npairs ;
+    unsigned char columns[ 256 ] ;/* column of the table for each byte - 0
+                                   for the bytes that no key uses */
+    int ncolumns ;
+    int *table ;                /* a row of MAP_STRIDE ints for each state:
+                                   the row of the next state for each 
+                                   column, then (MAP_DEPTH) the length of
+                                   the prefix of a key that the state is 
+                                   at, (MAP_OUT) the pair of the longest 
+                                   key that ends there, -1 if none, and
+                                   (MAP_FINAL) 1 if that is the whole 
+                                   prefix and no key goes on from it */
+    int nstates ;
+    unsigned char first[ 256 ] ;/* bytes that a key starts with */
+    int nfirst ;                /* number of them */
+    int first_byte ;            /* the only one, if nfirst is 1 */
+    int shrinks ;               /* no value is longer than its key */
+} ;
+
+/*
+ * State of the JSON parser
+ */
+typedef struct map_parse_s {
+    const char *s ;
+    const char *end ;
+    const char *json ;          /* for the offsets in errors */
+    char *msg ;
+    int msglen ;
+} map_parse ;
+
+/*
+ * Private Functions:
+ */
+
+/**
+ * @fn static void mapSkipSpace( map_parse *mp )
+ *
+ * @brief skip JSON white space
+ */
+static void mapSkipSpace( map_parse *mp )
+{
+    while( mp->s < mp->end && ( *mp->s == ' ' || *mp->s == '\t' ||
+                                *mp->s == '\n' || *mp->s == '\r' ) )
+        mp->s++ ;
+}
+
+/**
+ * @fn static int mapError( map_parse *mp , const char *what )
+ *
+ * @brief put an error about the JSON at the current offset in msg
+ *
+ * @return 0 - always, for the callers to return
+ */
+static int mapError( map_parse *mp , const char *what )
+{
+    if( mp->msglen )
+        snprintf( mp->msg , mp->msglen , "%s at offset %d in map" , what ,
+                  (int)( mp->s - mp->json ) ) ;
+    return 0 ;
+}
+
+/**
+ * @fn static int mapHex( map_parse *mp , unsigned int *u )
+ *
+ * @brief read the 4 hex digits of a \\u escape
+ *
+ * @return 1 - on success
+ * @return 0 - if they aren't there (an error is in msg)
+ */
+static int mapHex( map_parse *mp , unsigned int *u )
+{
+    int i , c ;
+
+    if( mp->end - mp->s < 4 )
+        return mapError( mp , "bad \\u escape" ) ;
+
+    *u = 0 ;
+    for( i = 0 ; i < 4 ; i++ )
+    {
+        c = (unsigned char)*mp->s++ ;
+        if( c >= '0' && c <= '9' )
+            c -= '0' ;
+        else if( c >= 'a' && c <= 'f' )
+            c -= 'a' - 10 ;
+        else if( c >= 'A' && c <= 'F' )
+            c -= 'A' - 10 ;
+        else
+            return mapError( mp , "bad \\u escape" ) ;
+        *u = ( *u << 4 ) | c ;
+    }
+    return 1 ;
+}
+
+/**
+ * @fn static int mapString( map_parse *mp , char **str , int *len )
+ *
+ * @brief read a JSON string
+ *
+ * @param mp - the parser, at the opening quote
+ * @param str - put the string here (malloc'd, null terminated)
+ * @param len - put its length here
+ *
+ * @return 1 - on success
+ * @return 0 - on error (which is in msg)
+ *
+ * @details The string is copied as it is, except for the escapes.  \\u
+ * escapes are written as UTF-8.
+ */
+static int mapString( map_parse *mp , char **str , int *len )
+{
+    const char *p ;
+    char *d ;
+    unsigned int u , lo ;
+
+    if( mp->s >= mp->end || *mp->s != '"' )
+        return mapError( mp , "expected a string" ) ;
+    mp->s++ ;
+
+    // Escapes only make the string shorter, so the rest of the JSON is 
+    // always enough room
+    for( p = mp->s ; p < mp->end && *p != '"' ; p++ )
+    {
+        if( *p == '\\' )
+            p++ ;
+    }
+    if( p >= mp->end )
+        return mapError( mp , "unterminated string" ) ;
+
+    *str = d = malloc( p - mp->s + 1 ) ;
+    if( !d )
+    {
+        if( mp->msglen )
+            snprintf( mp->msg , mp->msglen , "Out of memory" ) ;
+        return 0 ;
+    }
+
+    while( *mp->s != '"' )
+    {
+        if( *mp->s != '\\' )
+        {
+            *d++ = *mp->s++ ;
+            continue ;
+        }
+
+        mp->s++ ;
+        switch( *mp->s++ )
+        {
+        case '"':  *d++ = '"' ;  break ;
+        case '\\': *d++ = '\\' ; break ;
+        case '/':  *d++ = '/' ;  break ;
+        case 'b':  *d++ = '\b' ; break ;
+        case 'f':  *d++ = '\f' ; break ;
+        case 'n':  *d++ = '\n' ; break ;
+        case 'r':  *d++ = '\r' ; break ;
+        case 't':  *d++ = '\t' ; break ;
+        case 'u':
+            if( !mapHex( mp , &u ) )
+                goto fail ;
+            // A surrogate pair is one character
+            if( u >= 0xd800 && u < 0xdc00 && mp->end - mp->s >= 6 &&
+                mp->s[0] == '\\' && mp->s[1] == 'u' )
+            {
+                mp->s += 2 ;
+                if( !mapHex( mp , &lo ) )
+                    goto fail ;
+                if( lo < 0xdc00 || lo >= 0xe000 )
+                {
+                    mapError( mp , "bad surrogate pair" ) ;
+                    goto fail ;
+                }
+                u = 0x10000 + ( ( u - 0xd800 ) << 10 ) + ( lo - 0xdc00 ) ;
+            }
+            if( u < 0x80 )
+                *d++ = u ;
+            else if( u < 0x800 )
+            {
+                *d++ = 0xc0 | ( u >> 6 ) ;
+                *d++ = 0x80 | ( u & 0x3f ) ;
+            }
+            else if( u < 0x10000 )
+            {
+                *d++ = 0xe0 | ( u >> 12 ) ;
+                *d++ = 0x80 | ( ( u >> 6 ) & 0x3f ) ;
+                *d++ = 0x80 | ( u & 0x3f ) ;
+            }
+            else
+            {
+                *d++ = 0xf0 | ( u >> 18 ) ;
+                *d++ = 0x80 | ( ( u >> 12 ) & 0x3f ) ;
+                *d++ = 0x80 | ( ( u >> 6 ) & 0x3f ) ;
+                *d++ = 0x80 | ( u & 0x3f ) ;
+            }
+            break ;
+        default:
+            mp->s-- ;
+            mapError( mp , "bad escape" ) ;
+            goto fail ;
+        }
+    }
+    mp->s++ ;
+
+    *d = '\0' ;
+    *len = d - *str ;
+    return 1 ;
+
+fail:
+    free( *str ) ;
+    *str = NULL ;
+    return 0 ;
+}
+
+/**
+ * @fn static int mapParse( preg_map *map , const char *json , int json_len ,
+ *                          char *msg , int msglen )
+ *
+ * @brief read the pairs of a JSON object of strings into map->pairs
+ *
+ * @return 1 - on success
+ * @return 0 - on error (which is in msg)
+ */
+static int mapParse( preg_map *map , const char *json , int json_len , 
+                     char *msg , int msglen )
+{
+    map_parse mp ;
+    preg_map_pair *pairs ;
+    preg_map_pair *pair ;
+    int size ;
+
+    mp.s = mp.json = json ;
+    mp.end = json + json_len ;
+    mp.msg = msg ;
+    mp.msglen = msglen ;
+
+    mapSkipSpace( &mp ) ;
+    if( mp.s >= mp.end || *mp.s != '{' )
+        return mapError( &mp , "expected a JSON object" ) ;
+    mp.s++ ;
+    mapSkipSpace( &mp ) ;
+
+    size = 0 ;
+    if( mp.s < mp.end && *mp.s == '}' )
+        mp.s++ ;
+    else for( ;; )
+    {
+        if( map->npairs == size )
+        {
+            size = size ? 2 * size : 16 ;
+            pairs = realloc( map->pairs , size * sizeof( preg_map_pair ) ) ;
+            if( !pairs )
+            {
+                if( msglen )
+                    snprintf( msg , msglen , "Out of memory" ) ;
+                return 0 ;
+            }
+            map->pairs = pairs ;
+        }
+        pair = &map->pairs[ map->npairs ] ;
+        memset( pair , 0 , sizeof( *pair ) ) ;
+
+        if( !mapString( &mp , &pair->key , &pair->key_len ) )
+            return 0 ;
+        map->npairs++ ;
+        if( !pair->key_len )
+            return mapError( &mp , "empty key" ) ;
+
+        mapSkipSpace( &mp ) ;
+        if( mp.s >= mp.end || *mp.s != ':' )
+            return mapError( &mp , "expected ':'" ) ;
+        mp.s++ ;
+        mapSkipSpace( &mp ) ;
+        if( !mapString( &mp , &pair->value , &pair->value_len ) )
+            return 0 ;
+
+        mapSkipSpace( &mp ) ;
+        if( mp.s < mp.end && *mp.s == ',' )
+        {
+            mp.s++ ;
+            mapSkipSpace( &mp ) ;
+            continue ;
+        }
+        if( mp.s < mp.end && *mp.s == '}' )
+        {
+            mp.s++ ;
+            break ;
+        }
+        return mapError( &mp , "expected ',' or '}'" ) ;
+    }
+
+    mapSkipSpace( &mp ) ;
+    if( mp.s != mp.end )
+        return mapError( &mp , "text after the object" ) ;
+
+    return 1 ;
+}
+
+/**
+ * @fn static int mapBuild( preg_map *map , char *msg , int msglen )
+ *
+ * @brief build the automaton for the keys of map->pairs
+ *
+ * @return 1 - on success
+ * @return 0 - on error (which is in msg)
+ *
+ * @details When a key is in the map twice, the last value is used.
+ */
+static int mapBuild( preg_map *map , char *msg , int msglen )
+{
+    int *fail , *queue ;
+    int *table ;
+    int maxstates , stride , head , tail ;
+    int i , j , s , t , col , ncol ;
+
+    // A column for each byte that a key uses
+    map->ncolumns = 1 ;
+    maxstates = 1 ;
+    for( i = 0 ; i < map->npairs ; i++ )
+    {
+        for( j = 0 ; j < map->pairs[ i ].key_len ; j++ )
+        {
+            col = (unsigned char)map->pairs[ i ].key[ j ] ;
+            if( !map->columns[ col ] )
+                map->columns[ col ] = map->ncolumns++ ;
+        }
+        if( map->pairs[ i ].key_len > PREG_MAP_MAX_TABLE - maxstates )
+            maxstates = PREG_MAP_MAX_TABLE ;
+        else
+            maxstates += map->pairs[ i ].key_len ;
+    }
+    ncol = map->ncolumns ;
+    stride = MAP_STRIDE( ncol ) ;
+    if( maxstates > PREG_MAP_MAX_TABLE / stride )
+    {
+        if( msglen )
+            snprintf( msg , msglen , "map is too big" ) ;
+        return 0 ;
+    }
+
+    map->table = calloc( (size_t)maxstates * stride , sizeof( int ) ) ;
+    fail = calloc( maxstates , sizeof( int ) ) ;
+    queue = malloc( maxstates * sizeof( int ) ) ;
+    if( !map->table || !fail || !queue )
+    {
+        free( fail ) ;
+        free( queue ) ;
+        if( msglen )
+            snprintf( msg , msglen , "Out of memory" ) ;
+        return 0 ;
+    }
+    table = map->table ;
+
+    // The trie, with state numbers in the columns until the end.  0 is the
+    // first state, so 0 means no edge (yet).
+    map->nstates = 1 ;
+    table[ MAP_OUT( ncol ) ] = -1 ;
+    for( i = 0 ; i < map->npairs ; i++ )
+    {
+        s = 0 ;
+        for( j = 0 ; j < map->pairs[ i ].key_len ; j++ )
+        {
+            col = map->columns[ (unsigned char)map->pairs[ i ].key[ j ] ] ;
+            if( !table[ s * stride + col ] )
+            {
+                t = map->nstates++ ;
+                table[ t * stride + MAP_DEPTH( ncol ) ] = 
+                    table[ s * stride + MAP_DEPTH( ncol ) ] + 1 ;
+                table[ t * stride + MAP_OUT( ncol ) ] = -1 ;
+                table[ s * stride + col ] = t ;
+            }
+            s = table[ s * stride + col ] ;
+        }
+        table[ s * stride + MAP_OUT( ncol ) ] = i ;
+    }
+
+    // The states where a key ends and no other key goes on
+    for( s = 1 ; s < map->nstates ; s++ )
+    {
+        if( table[ s * stride + MAP_OUT( ncol ) ] < 0 )
+            continue ;
+        for( col = 0 ; col < ncol && !table[ s * stride + col ] ; col++ )
+            ;
+        table[ s * stride + MAP_FINAL( ncol ) ] = col == ncol ;
+    }
+
+    // Fill in the missing edges from the failure links, a level at a time,
+    // so that the state that a failure link goes to is always done
+    head = tail = 0 ;
+    for( col = 0 ; col < ncol ; col++ )
+    {
+        if( table[ col ] )
+            queue[ tail++ ] = table[ col ] ;
+    }
+    while( head < tail )
+    {
+        s = queue[ head++ ] ;
+        if( table[ s * stride + MAP_OUT( ncol ) ] < 0 )
+            table[ s * stride + MAP_OUT( ncol ) ] = 
+                table[ fail[ s ] * stride + MAP_OUT( ncol ) ] ;
+        for( col = 0 ; col < ncol ; col++ )
+        {
+            t = table[ s * stride + col ] ;
+            if( t )
+            {
+                fail[ t ] = table[ fail[ s ] * stride + col ] ;
+                queue[ tail++ ] = t ;
+            }
+            else
+                table[ s * stride + col ] = table[ fail[ s ] * stride + col ] ;
+        }
+    }
+    free( fail ) ;
+    free( queue ) ;
+
+    // The bytes that keys start with
+    for( col = 0 ; col < 256 ; col++ )
+    {
+        if( map->columns[ col ] && table[ map->columns[ col ] ] )
+        {
+            map->first[ col ] = 1 ;
+            map->first_byte = col ;
+            map->nfirst++ ;
+        }
+    }
+
+    // The edges go to the rows of the states from now on
+    for( s = 0 ; s < map->nstates ; s++ )
+    {
+        for( col = 0 ; col < ncol ; col++ )
+            table[ s * stride + col ] *= stride ;
+    }
+
+    map->shrinks = 1 ;
+    for( i = 0 ; i < map->npairs ; i++ )
+    {
+        if( map->pairs[ i ].value_len > map->pairs[ i ].key_len )
+            map->shrinks = 0 ;
+    }
+
+    return 1 ;
+}
+
+/**
+ * @fn static int mapSkip( const preg_map *map , const unsigned char *s ,
+ *                         int i , int length )
+ *
+ * @brief find the next byte at or after i that a key starts with
+ *
+ * @return its offset, or length if there isn't one
+ */
+static int mapSkip( const preg_map *map , const unsigned char *s , int i ,
+                    int length )
+{
+    const unsigned char *p ;
+
+    if( map->nfirst == 1 )
+    {
+        p = memchr( s + i , map->first_byte , length - i ) ;
+        return p ? p - s : length ;
+    }
+
+    while( i < length && !map->first[ s[ i ] ] )
+        i++ ;
+    return i ;
+}
+
+
+/*
+ * Public Functions:
+ */
+
+/**
+ * @fn preg_map *pregMapCompile( const char *json , int json_len , 
+ *                               char *msg , int msglen )
+ *
+ * @brief build the automaton for a map of literal replacements
+ *
+ * @param json - a JSON object whose keys are the strings to find and 
+ * whose values are what to replace them with.  For example,
+ * {"&amp;":"&","&lt;":"<"}.  Both must be strings.
+ * @param json_len - length of json
+ * @param msg - put the error here
+ * @param msglen - size of msg
+ *
+ * @return the map, which is freed with pregMapFree
+ * @return NULL - if json isn't an object of strings, a key is empty or 
+ * out of memory (an error is in msg)
+ */
+preg_map *pregMapCompile( const char *json , int json_len , 
+                          char *msg , int msglen )
+{
+    preg_map *map ;
+
+    map = calloc( 1 , sizeof( preg_map ) ) ;
+    if( !map )
+    {
+        if( msglen )
+            snprintf( msg , msglen , "Out of memory" ) ;
+        return NULL ;
+    }
+
+    if( !mapParse( map , json , json_len , msg , msglen ) ||
+        !mapBuild( map , msg , msglen ) )
+    {
+        pregMapFree( map ) ;
+        return NULL ;
+    }
+
+    return map ;
+}
+
+/**
+ * @fn int pregMapReplace( const preg_map *map , const char *subject , 
+ *                         int length , preg_buffer *result , 
+ *                         int *result_len )
+ *
+ * @brief replace the keys of map that are in subject with their values
+ *
+ * @param map - from pregMapCompile
+ * @param subject - the subject (does not need to be null terminated)
+ * @param length - length of subject
+ * @param result - the buffer to build the result in.  It is grown as 
+ * needed (see preg_pool.c).  The result is null terminated.
+ * @param result_len - put the length of the result here
+ *
+ * @return the number of keys that were replaced.  If it is 0, result is
+ * not touched, and the result is the subject.
+ * @return -1 - if out of memory
+ */
+int pregMapReplace( const preg_map *map , const char *subject , int length ,
+                    preg_buffer *result , int *result_len )
+{
+    const unsigned char *s = (const unsigned char *)subject ;
+    const int *table = map->table ;
+    const preg_map_pair *pair ;
+    int ncol = map->ncolumns ;
+    int i , row , last , used , count ;
+    int start , len , best ;    /* the leftmost-longest match so far (start
+                                   is -1 if there isn't one) */
+    int k ;
+
+    i = last = used = count = 0 ;
+    row = 0 ;
+    start = -1 ;
+    len = best = 0 ;
+
+    // When the result can't be longer than the subject, the buffer only
+    // has to grow once
+    if( map->shrinks && !pregBufferGrow( result , length + 1 , 0 ) )
+        return -1 ;
+
+    for( ;; )
+    {
+        if( start >= 0 && 
+            ( i == length || i - table[ row + MAP_DEPTH( ncol ) ] > start ) )
+        {   // Nothing can match at or before start any more
+            pair = &map->pairs[ best ] ;
+            if( !map->shrinks &&
+                !pregBufferGrow( result , used + ( start - last ) + 
+                                 pair->value_len + 1 , used ) )
+                return -1 ;
+            memcpy( result->data + used , subject + last , start - last ) ;
+            used += start - last ;
+            memcpy( result->data + used , pair->value , pair->value_len ) ;
+            used += pair->value_len ;
+            count++ ;
+
+            last = i = start + len ;
+            row = 0 ;
+            start = -1 ;
+            continue ;
+        }
+        if( i == length )
+            break ;
+
+        if( !row )
+        {
+            i = mapSkip( map , s , i , length ) ;
+            if( i == length )
+                break ;
+        }
+        row = table[ row + map->columns[ s[ i++ ] ] ] ;
+
+        if( table[ row + MAP_OUT( ncol ) ] >= 0 )
+        {
+            k = map->pairs[ table[ row + MAP_OUT( ncol ) ] ].key_len ;
+            if( start < 0 || i - k < start || ( i - k == start && k > len ) )
+            {
+                start = i - k ;
+                len = k ;
+                best = table[ row + MAP_OUT( ncol ) ] ;
+
+                // Nothing else can match at or before start, so this is
+                // replaced without reading the next byte (the first state
+                // is at depth 0)
+                if( table[ row + MAP_FINAL( ncol ) ] )
+                    row = 0 ;
+            }
+        }
+    }
+
+    if( !count )
+        return 0 ;
+
+    if( !map->shrinks &&
+        !pregBufferGrow( result , used + ( length - last ) + 1 , used ) )
+        return -1 ;
+    memcpy( result->data + used , subject + last , length - last ) ;
+    used += length - last ;
+    result->data[ used ] = '\0' ;
+    *result_len = used ;
+    return count ;
+}
+
+/**
+ * @fn unsigned long pregMapMaxLength( const preg_map *map , 
+ *                                     unsigned long subject_max ,
+ *                                     unsigned long most )
+ *
+ * @brief the longest result that pregMapReplace can give
+ *
+ * @param map - from pregMapCompile
+ * @param subject_max - the longest subject
+ * @param most - the largest value to return
+ *
+ * @details Each replacement uses up at least the length of its key, so
+ * the result is at most subject_max times the largest ratio of the length
+ * of a value to the length of its key (or subject_max if no value is 
+ * longer than its key).
+ */
+unsigned long pregMapMaxLength( const preg_map *map , 
+                                unsigned long subject_max ,
+                                unsigned long most )
+{
+    double ratio , r , max ;
+    int i ;
+
+    ratio = 1 ;
+    for( i = 0 ; i < map->npairs ; i++ )
+    {
+        r = (double)map->pairs[ i ].value_len / map->pairs[ i ].key_len ;
+        if( r > ratio )
+            ratio = r ;
+    }
+
+    max = subject_max * ratio ;
+    return max < most ? (unsigned long)max : most ;
+}
+
+/**
+ * @fn void pregMapFree( preg_map *map )
+ *
+ * @brief free a map returned by pregMapCompile.  NULL is ignored.
+ */
+void pregMapFree( preg_map *map )
+{
+    int i ;
+
+    if( !map )
+        return ;
+
+    for( i = 0 ; i < map->npairs ; i++ )
+    {
+        free( map->pairs[ i ].key ) ;
+        free( map->pairs[ i ].value ) ;
+    }
+    free( map->pairs ) ;
+    free( map->table ) ;
+    free( map ) ;
+}
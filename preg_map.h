@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef PREGMAP_H
+
+#define PREGMAP_H
+
+/** @file preg_map.h
+ *
+ * @brief headers for replacing many literal strings in one pass
+ *        (PREG_REPLACE_MAP)
+ */
+
+#include "preg_pool.h"
+
+typedef struct preg_map_s preg_map ;
+
+preg_map *pregMapCompile( const char *json , int json_len , 
+                          char *msg , int msglen ) ;
+int pregMapReplace( const preg_map *map , const char *subject , int length ,
+                    preg_buffer *result , int *result_len ) ;
+unsigned long pregMapMaxLength( const preg_map *map , 
+                                unsigned long subject_max ,
+                                unsigned long most ) ;
+void pregMapFree( preg_map *map ) ;
+
+#endif
@@ -0,0 +1,1864 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/** @file preg_nfa.c
+ *
+ * @brief A regular expression matcher that runs in time linear in the
+ *        length of the subject.  It is used for patterns with the L modifier.
+ *
+ * @details Patterns are compiled into a small program for a Thompson NFA,
+ * which is run as a "pike vm": all of the possible matches are advanced
+ * through the subject together, one byte at a time, in the order that a
+ * backtracking matcher would try them.  The result (including the 
+ * captured groups) is the same as what libpcre returns, but the time 
+ * taken is proportional to the length of the subject times the size of the
+ * pattern, no matter what the pattern is.  There is no backtracking and
+ * no recursion, so the pcre match and recursion limits are not needed.
+ *
+ * The price is that the pattern may only use constructs that can be
+ * matched this way.  Backreferences, lookahead and lookbehind
+ * assertions, atomic groups, possessive quantifiers, recursion,
+ * conditionals and the u modifier are rejected when the pattern is
+ * compiled.  Patterns are compiled by libpcre first (see compilePattern),
+ * so the syntax has already been checked and the capture groups are
+ * numbered the same way when this is called.
+ *
+ * @notes This file does not depend on mysql.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+
+#include "preg_nfa.h"
+
+// PCRE_ERROR_BADOFFSET came along in pcre 8.13
+#ifndef PCRE_ERROR_BADOFFSET
+#define PCRE_ERROR_BADOFFSET (-24)
+#endif
+
+/*
+ * The pattern is parsed into a tree, which is then turned into the
+ * program.  The children of CAT and ALT nodes are linked through next.
+ */
+enum preg_nfa_type {
+    NODE_EMPTY , NODE_BYTE , NODE_SET , NODE_ANY , NODE_ANYNL ,
+    NODE_ASSERT , NODE_CAT , NODE_ALT , NODE_REPEAT , NODE_CAPTURE 
+} ;
+
+struct preg_nfa_node {
+    int type ;                  /* preg_nfa_type */
+    int val ;                   /* byte, set, assertion or group number */
+    int child ;                 /* first child or -1 */
+    int last ;                  /* last child or -1 (CAT & ALT) */
+    int next ;                  /* next sibling or -1 */
+    int min , max ;             /* repeat counts (max -1 is unbounded) */
+    int greedy ;                /* repeat as many times as possible first */
+} ;
+
+struct preg_nfa_parser {
+    const char *p ;             /* next character of the pattern */
+    const char *end ;           /* end of the pattern */
+    int options ;               /* PCRE_* options in effect */
+    int quote ;                 /* inside \Q...\E */
+    int depth ;                 /* nesting of parentheses */
+    int ngroups ;               /* capture groups so far */
+    struct preg_nfa_node *nodes ;
+    int nnodes ;
+    int nodes_size ;
+    preg_nfa *nfa ;             /* where the sets go */
+    int sets_size ;
+    char *msg ;
+    int msglen ;
+    int failed ;                /* an error was put in msg */
+} ;
+
+#define NFA_SETBIT( set , c ) ( (set)[ (c) >> 3 ] |= ( 1 << ( (c) & 7 ) ) )
+
+/*
+ * Character types.  These are the ASCII ones that libpcre uses by default.
+ */
+static int nfaIsDigit( int c ) { return c >= '0' && c <= '9' ; }
+static int nfaIsUpper( int c ) { return c >= 'A' && c <= 'Z' ; }
+static int nfaIsLower( int c ) { return c >= 'a' && c <= 'z' ; }
+static int nfaIsAlpha( int c ) { return nfaIsUpper( c ) || nfaIsLower( c ) ; }
+static int nfaIsWord( int c ) 
+{ 
+    return nfaIsAlpha( c ) || nfaIsDigit( c ) || c == '_' ; 
+}
+static int nfaIsSpace( int c ) 
+{
+    return c == ' ' || ( c >= '\t' && c <= '\r' ) ;
+}
+static int nfaIsXDigit( int c )
+{
+    return nfaIsDigit( c ) || ( c >= 'a' && c <= 'f' ) || 
+        ( c >= 'A' && c <= 'F' ) ;
+}
+static int nfaXValue( int c )
+{
+    return nfaIsDigit( c ) ? c - '0' : ( c | 0x20 ) - 'a' + 10 ;
+}
+
+/**
+ * @fn static int nfaFail( struct preg_nfa_parser *ps , const char *what )
+ *
+ * @brief put an error message in ps->msg
+ *
+ * @return -1, so that it can be returned by the parse functions
+ */
+static int nfaFail( struct preg_nfa_parser *ps , const char *what )
+{
+    if( !ps->failed && ps->msglen )
+    {
+        snprintf( ps->msg , ps->msglen , "%s" , what ) ;
+    }
+    ps->failed = 1 ;
+    return -1 ;
+}
+
+/**
+ * @fn static int nfaNode( struct preg_nfa_parser *ps , int type , int val )
+ *
+ * @brief add a node to the tree
+ *
+ * @return the index of the new node or -1 if out of memory
+ */
+static int nfaNode( struct preg_nfa_parser *ps , int type , int val )
+{
+    struct preg_nfa_node *nodes ;
+    struct preg_nfa_node *n ;
+
+    if( ps->nnodes == ps->nodes_size )
+    {
+        if( ps->nodes_size >= PREG_NFA_MAX_INSTS )
+            return nfaFail( ps , "pattern is too large for the L modifier" ) ;
+        nodes = realloc( ps->nodes , 2 * ( ps->nodes_size + 16 ) *
+                         sizeof( struct preg_nfa_node ) ) ;
+        if( !nodes )
+            return nfaFail( ps , "Out of memory" ) ;
+        ps->nodes = nodes ;
+        ps->nodes_size = 2 * ( ps->nodes_size + 16 ) ;
+    }
+
+    n = &ps->nodes[ ps->nnodes ] ;
+    memset( n , 0 , sizeof( *n ) ) ;
+    n->type = type ;
+    n->val = val ;
+    n->child = n->last = n->next = -1 ;
+    return ps->nnodes++ ;
+}
+
+/**
+ * @fn static void nfaAppend( struct preg_nfa_parser *ps , int parent , 
+ *                            int child )
+ *
+ * @brief add child to the end of the children of a CAT or ALT node
+ */
+static void nfaAppend( struct preg_nfa_parser *ps , int parent , int child )
+{
+    struct preg_nfa_node *n = &ps->nodes[ parent ] ;
+
+    if( n->last < 0 )
+        n->child = child ;
+    else
+        ps->nodes[ n->last ].next = child ;
+    n->last = child ;
+}
+
+/**
+ * @fn static int nfaSet( struct preg_nfa_parser *ps , 
+ *                        const unsigned char *set )
+ *
+ * @brief add a set node matching the bytes in set.  If the pattern is
+ * caseless, both cases of the letters in the set are matched.
+ *
+ * @return the index of the new node or -1 on error
+ */
+static int nfaSet( struct preg_nfa_parser *ps , const unsigned char *set )
+{
+    preg_nfa *nfa = ps->nfa ;
+    unsigned char (*sets)[ 32 ] ;
+    unsigned char *s ;
+    int c ;
+
+    if( nfa->nsets == ps->sets_size )
+    {
+        sets = realloc( nfa->sets , 2 * ( ps->sets_size + 4 ) * 32 ) ;
+        if( !sets )
+            return nfaFail( ps , "Out of memory" ) ;
+        nfa->sets = sets ;
+        ps->sets_size = 2 * ( ps->sets_size + 4 ) ;
+    }
+
+    s = nfa->sets[ nfa->nsets ] ;
+    memcpy( s , set , 32 ) ;
+    if( ps->options & PCRE_CASELESS )
+    {
+        for( c = 'A' ; c <= 'Z' ; c++ )
+        {
+            if( NFA_BIT( s , c ) || NFA_BIT( s , c | 0x20 ) )
+            {
+                NFA_SETBIT( s , c ) ;
+                NFA_SETBIT( s , c | 0x20 ) ;
+            }
+        }
+    }
+
+    return nfaNode( ps , NODE_SET , nfa->nsets++ ) ;
+}
+
+/**
+ * @fn static int nfaByte( struct preg_nfa_parser *ps , int c )
+ *
+ * @brief add a node matching the byte c (in either case if caseless)
+ */
+static int nfaByte( struct preg_nfa_parser *ps , int c )
+{
+    unsigned char set[ 32 ] ;
+
+    if( ( ps->options & PCRE_CASELESS ) && nfaIsAlpha( c ) )
+    {
+        memset( set , 0 , sizeof( set ) ) ;
+        NFA_SETBIT( set , c ) ;
+        return nfaSet( ps , set ) ;
+    }
+    return nfaNode( ps , NODE_BYTE , c ) ;
+}
+
+/**
+ * @fn static int nfaClassEscape( int c , unsigned char *set )
+ *
+ * @brief add the bytes of the class escape \\c (\\d \\w \\s ...) to set
+ *
+ * @return 1 if c is a class escape, 0 if it is not
+ */
+static int nfaClassEscape( int c , unsigned char *set )
+{
+    unsigned char bits[ 32 ] ;
+    int i , negate ;
+
+    memset( bits , 0 , sizeof( bits ) ) ;
+    negate = nfaIsUpper( c ) ;
+
+    switch( c | 0x20 )
+    {
+    case 'd':
+        for( i = '0' ; i <= '9' ; i++ )
+            NFA_SETBIT( bits , i ) ;
+        break ;
+    case 'w':
+        for( i = 0 ; i < 256 ; i++ )
+            if( nfaIsWord( i ) )
+                NFA_SETBIT( bits , i ) ;
+        break ;
+    case 's':
+        for( i = 0 ; i < 256 ; i++ )
+            if( nfaIsSpace( i ) )
+                NFA_SETBIT( bits , i ) ;
+        break ;
+    case 'h':
+        NFA_SETBIT( bits , '\t' ) ;
+        NFA_SETBIT( bits , ' ' ) ;
+        NFA_SETBIT( bits , 0xa0 ) ;
+        break ;
+    case 'v':
+        for( i = '\n' ; i <= '\r' ; i++ )
+            NFA_SETBIT( bits , i ) ;
+        NFA_SETBIT( bits , 0x85 ) ;
+        break ;
+    default:
+        return 0 ;
+    }
+
+    for( i = 0 ; i < 32 ; i++ )
+        set[ i ] |= negate ? ~bits[ i ] : bits[ i ] ;
+    return 1 ;
+}
+
+/**
+ * @fn static int nfaPosixClass( struct preg_nfa_parser *ps , 
+ *                               unsigned char *set )
+ *
+ * @brief add the bytes of a posix class ([:alpha:]) at ps->p to set
+ *
+ * @return 1 if there was a posix class at ps->p, 0 if not, -1 on error
+ */
+static int nfaPosixClass( struct preg_nfa_parser *ps , unsigned char *set )
+{
+    static const char *names[] = { "alpha" , "digit" , "alnum" , "upper" , 
+                                   "lower" , "space" , "blank" , "punct" ,
+                                   "cntrl" , "print" , "graph" , "xdigit" ,
+                                   "word" , "ascii" , NULL } ;
+    const char *p = ps->p + 2 ;
+    const char *q ;
+    int negate = 0 ;
+    int i , c , in ;
+    size_t l ;
+
+    if( ps->end - ps->p < 4 || ps->p[ 1 ] != ':' )
+        return 0 ;
+    if( *p == '^' )
+    {
+        negate = 1 ;
+        p++ ;
+    }
+    for( q = p ; q < ps->end - 1 && nfaIsLower( *q ) ; q++ )
+        ;
+    if( q >= ps->end - 1 || q[ 0 ] != ':' || q[ 1 ] != ']' )
+        return 0 ;
+
+    l = q - p ;
+    for( i = 0 ; names[ i ] ; i++ )
+    {
+        if( strlen( names[ i ] ) == l && !strncmp( names[ i ] , p , l ) )
+            break ;
+    }
+    if( !names[ i ] )
+        return nfaFail( ps , "unknown POSIX class name" ) ;
+
+    for( c = 0 ; c < 256 ; c++ )
+    {
+        switch( i )
+        {
+        case 0: in = nfaIsAlpha( c ) ; break ;
+        case 1: in = nfaIsDigit( c ) ; break ;
+        case 2: in = nfaIsAlpha( c ) || nfaIsDigit( c ) ; break ;
+        case 3: in = nfaIsUpper( c ) ; break ;
+        case 4: in = nfaIsLower( c ) ; break ;
+        case 5: in = nfaIsSpace( c ) ; break ;
+        case 6: in = c == ' ' || c == '\t' ; break ;
+        case 7: in = c > ' ' && c < 127 && !nfaIsWord( c ) ; break ;
+        case 8: in = c < ' ' || c == 127 ; break ;
+        case 9: in = c >= ' ' && c < 127 ; break ;
+        case 10: in = c > ' ' && c < 127 ; break ;
+        case 11: in = nfaIsXDigit( c ) ; break ;
+        case 12: in = nfaIsWord( c ) ; break ;
+        default: in = c < 128 ; break ;
+        }
+        // '_' is punctuation, even though it is a word character
+        if( i == 7 && c == '_' )
+            in = 1 ;
+        if( in != negate )
+            NFA_SETBIT( set , c ) ;
+    }
+
+    ps->p = q + 2 ;
+    return 1 ;
+}
+
+/**
+ * @fn static int nfaEscapedByte( struct preg_nfa_parser *ps , int c ,
+ *                                int in_class )
+ *
+ * @brief get the byte for an escape that stands for a single byte.  
+ * ps->p points just after c (the character after the backslash).
+ *
+ * @return the byte - if the escape is one
+ * @return -1 - if it is not
+ * @return -2 - if the escape is not supported (an error is in ps->msg)
+ */
+static int nfaEscapedByte( struct preg_nfa_parser *ps , int c , int in_class )
+{
+    int v , n ;
+
+    switch( c )
+    {
+    case 'n': return '\n' ;
+    case 't': return '\t' ;
+    case 'r': return '\r' ;
+    case 'f': return '\f' ;
+    case 'e': return 0x1b ;
+    case 'a': return 0x07 ;
+    case 'b': return in_class ? '\b' : -1 ;
+    case 'c':
+        if( ps->p >= ps->end )
+        {
+            nfaFail( ps , "\\c at end of pattern" ) ;
+            return -2 ;
+        }
+        c = *ps->p++ ;
+        if( nfaIsLower( c ) )
+            c -= 0x20 ;
+        return c ^ 0x40 ;
+    case 'x':
+        v = 0 ;
+        if( ps->p < ps->end && *ps->p == '{' )
+        {
+            for( n = 1 ; ps->p + n < ps->end && nfaIsXDigit( ps->p[ n ] ) ; n++ )
+                v = v * 16 + nfaXValue( ps->p[ n ] ) ;
+            if( ps->p + n < ps->end && ps->p[ n ] == '}' && n > 1 )
+            {
+                if( v > 255 )
+                {
+                    nfaFail( ps , "character value too large for the L modifier" ) ;
+                    return -2 ;
+                }
+                ps->p += n + 1 ;
+                return v ;
+            }
+            v = 0 ;
+        }
+        for( n = 0 ; n < 2 && ps->p < ps->end && nfaIsXDigit( *ps->p ) ; n++ )
+            v = v * 16 + nfaXValue( *ps->p++ ) ;
+        return v ;
+    case '0': case '1': case '2': case '3': 
+    case '4': case '5': case '6': case '7':
+        if( c != '0' && !in_class )
+            return -1 ;
+        v = c - '0' ;
+        for( n = 0 ; n < 2 && ps->p < ps->end && *ps->p >= '0' && *ps->p <= '7' ; n++ )
+            v = v * 8 + *ps->p++ - '0' ;
+        return v & 0xff ;
+    default:
+        return -1 ;
+    }
+}
+
+/**
+ * @fn static int nfaUnsupportedEscape( struct preg_nfa_parser *ps , int c )
+ *
+ * @brief check for escapes that can not be used with the L modifier
+ *
+ * @return -1 (after setting ps->msg) if \\c is not supported, 0 if it is ok
+ */
+static int nfaUnsupportedEscape( struct preg_nfa_parser *ps , int c )
+{
+    if( nfaIsDigit( c ) || c == 'g' || c == 'k' )
+        return nfaFail( ps , "backreferences are not supported by the L modifier" ) ;
+    if( strchr( "pPXRCKNLlUu" , c ) )
+        return nfaFail( ps , "escape sequence is not supported by the L modifier" ) ;
+    return 0 ;
+}
+
+/**
+ * @fn static int nfaParseClass( struct preg_nfa_parser *ps )
+ *
+ * @brief parse a character class.  ps->p points just after the [
+ *
+ * @return the index of the new node or -1 on error
+ */
+static int nfaParseClass( struct preg_nfa_parser *ps )
+{
+    unsigned char set[ 32 ] ;
+    int negate = 0 ;
+    int first = 1 ;
+    int c , hi , rc , i ;
+
+    memset( set , 0 , sizeof( set ) ) ;
+
+    if( ps->p < ps->end && *ps->p == '^' )
+    {
+        negate = 1 ;
+        ps->p++ ;
+    }
+
+    for( ;; first = 0 )
+    {
+        if( ps->p >= ps->end )
+            return nfaFail( ps , "missing terminating ] for character class" ) ;
+        c = (unsigned char)*ps->p ;
+        if( c == ']' && !first )
+        {
+            ps->p++ ;
+            break ;
+        }
+
+        if( c == '[' )
+        {
+            rc = nfaPosixClass( ps , set ) ;
+            if( rc < 0 )
+                return -1 ;
+            if( rc )
+                continue ;
+        }
+
+        ps->p++ ;
+        if( c == '\\' && ps->p < ps->end )
+        {
+            c = (unsigned char)*ps->p++ ;
+            if( nfaClassEscape( c , set ) )
+                continue ;
+            if( c == 'Q' || c == 'E' )
+                return nfaFail( ps , "\\Q in a class is not supported by the L modifier" ) ;
+            rc = nfaEscapedByte( ps , c , 1 ) ;
+            if( rc == -2 )
+                return -1 ;
+            if( rc < 0 )
+            {
+                if( nfaIsAlpha( c ) && nfaUnsupportedEscape( ps , c ) )
+                    return -1 ;
+                rc = c ;
+            }
+            c = rc ;
+        }
+
+        // A range?
+        if( ps->end - ps->p >= 2 && ps->p[ 0 ] == '-' && ps->p[ 1 ] != ']' )
+        {
+            const char *save = ps->p ;
+
+            ps->p++ ;
+            hi = (unsigned char)*ps->p++ ;
+            if( hi == '\\' && ps->p < ps->end )
+            {
+                hi = (unsigned char)*ps->p++ ;
+                rc = nfaEscapedByte( ps , hi , 1 ) ;
+                if( rc == -2 )
+                    return -1 ;
+                if( rc < 0 )
+                {
+                    unsigned char dummy[ 32 ] ;
+
+                    if( nfaClassEscape( hi , dummy ) )
+                    {   // [a-\d] is a, - and the digits
+                        ps->p = save ;
+                        NFA_SETBIT( set , c ) ;
+                        continue ;
+                    }
+                    if( nfaIsAlpha( hi ) && nfaUnsupportedEscape( ps , hi ) )
+                        return -1 ;
+                    rc = hi ;
+                }
+                hi = rc ;
+            }
+            else if( hi == '[' && ps->p < ps->end && *ps->p == ':' )
+            {   // [a-[:digit:]] is a, - and the digits
+                ps->p = save ;
+                NFA_SETBIT( set , c ) ;
+                continue ;
+            }
+            if( hi < c )
+                return nfaFail( ps , "range out of order in character class" ) ;
+            for( i = c ; i <= hi ; i++ )
+                NFA_SETBIT( set , i ) ;
+            continue ;
+        }
+
+        NFA_SETBIT( set , c ) ;
+    }
+
+    // Case folding is done by nfaSet, so apply it before negating
+    if( negate )
+    {
+        if( ps->options & PCRE_CASELESS )
+        {
+            for( c = 'A' ; c <= 'Z' ; c++ )
+            {
+                if( NFA_BIT( set , c ) || NFA_BIT( set , c | 0x20 ) )
+                {
+                    NFA_SETBIT( set , c ) ;
+                    NFA_SETBIT( set , c | 0x20 ) ;
+                }
+            }
+        }
+        for( i = 0 ; i < 32 ; i++ )
+            set[ i ] = ~set[ i ] ;
+    }
+
+    return nfaSet( ps , set ) ;
+}
+
+static int nfaParseAlt( struct preg_nfa_parser *ps ) ;
+
+/**
+ * @fn static int nfaParseOptions( struct preg_nfa_parser *ps , int *options )
+ *
+ * @brief parse the option letters of (?imsx-imsx) or (?imsx-imsx:...).
+ * ps->p points just after the ?
+ *
+ * @return 0 on success with ps->p at the ) or :, -1 on error
+ */
+static int nfaParseOptions( struct preg_nfa_parser *ps , int *options )
+{
+    int on = 1 ;
+    int bit ;
+
+    for( ; ps->p < ps->end && *ps->p != ')' && *ps->p != ':' ; ps->p++ )
+    {
+        switch( *ps->p )
+        {
+        case '-': on = 0 ; continue ;
+        case 'i': bit = PCRE_CASELESS ; break ;
+        case 'm': bit = PCRE_MULTILINE ; break ;
+        case 's': bit = PCRE_DOTALL ; break ;
+        case 'x': bit = PCRE_EXTENDED ; break ;
+        case 'U': bit = PCRE_UNGREEDY ; break ;
+        case 'J': case 'X': bit = 0 ; break ;
+        default:
+            return nfaFail( ps , "group type is not supported by the L modifier" ) ;
+        }
+        if( on )
+            *options |= bit ;
+        else
+            *options &= ~bit ;
+    }
+    if( ps->p >= ps->end )
+        return nfaFail( ps , "missing )" ) ;
+    return 0 ;
+}
+
+/**
+ * @fn static int nfaParseGroup( struct preg_nfa_parser *ps )
+ *
+ * @brief parse a parenthesized group.  ps->p points just after the (
+ *
+ * @return the index of the new node
+ * @return -1 on error, or if it was only an option setting or a comment
+ * (ps->failed tells which)
+ */
+static int nfaParseGroup( struct preg_nfa_parser *ps )
+{
+    int saved_options = ps->options ;
+    int group = -1 ;            /* capture group number */
+    int node , child ;
+    char close ;
+
+    if( ps->p < ps->end && *ps->p == '*' )
+        return nfaFail( ps , "backtracking control verbs are not supported by the L modifier" ) ;
+
+    if( ps->p < ps->end && *ps->p == '?' )
+    {
+        ps->p++ ;
+        if( ps->p >= ps->end )
+            return nfaFail( ps , "missing )" ) ;
+        switch( *ps->p )
+        {
+        case '#':
+            while( ps->p < ps->end && *ps->p != ')' )
+                ps->p++ ;
+            if( ps->p >= ps->end )
+                return nfaFail( ps , "missing ) after comment" ) ;
+            ps->p++ ;
+            return -1 ;
+        case ':':
+            ps->p++ ;
+            break ;
+        case '=': case '!':
+            return nfaFail( ps , "lookahead assertions are not supported by the L modifier" ) ;
+        case '>':
+            return nfaFail( ps , "atomic groups are not supported by the L modifier" ) ;
+        case '|':
+            return nfaFail( ps , "(?| groups are not supported by the L modifier" ) ;
+        case '(':
+            return nfaFail( ps , "conditional groups are not supported by the L modifier" ) ;
+        case 'C':
+            return nfaFail( ps , "callouts are not supported by the L modifier" ) ;
+        case 'R': case '&': case '+': 
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            return nfaFail( ps , "recursion is not supported by the L modifier" ) ;
+        case 'P':
+            if( ps->p + 1 < ps->end && ps->p[ 1 ] == '=' )
+                return nfaFail( ps , "backreferences are not supported by the L modifier" ) ;
+            if( ps->p + 1 < ps->end && ps->p[ 1 ] == '>' )
+                return nfaFail( ps , "recursion is not supported by the L modifier" ) ;
+            // (?P<name> is parsed like (?<name>
+            ps->p++ ;
+            /* fall through */
+        case '<': case '\'':
+            if( *ps->p == '<' && ps->p + 1 < ps->end && 
+                ( ps->p[ 1 ] == '=' || ps->p[ 1 ] == '!' ) )
+                return nfaFail( ps , "lookbehind assertions are not supported by the L modifier" ) ;
+            if( *ps->p != '<' && *ps->p != '\'' )
+                return nfaFail( ps , "group type is not supported by the L modifier" ) ;
+            close = *ps->p == '<' ? '>' : '\'' ;
+            while( ps->p < ps->end && *ps->p != close )
+                ps->p++ ;
+            if( ps->p >= ps->end )
+                return nfaFail( ps , "syntax error in subpattern name" ) ;
+            ps->p++ ;
+            group = ++ps->ngroups ;
+            break ;
+        case '-':
+            if( ps->p + 1 < ps->end && nfaIsDigit( ps->p[ 1 ] ) )
+                return nfaFail( ps , "recursion is not supported by the L modifier" ) ;
+            // fall through
+        default:
+            if( nfaParseOptions( ps , &ps->options ) )
+                return -1 ;
+            if( *ps->p++ == ')' )
+            {   // (?i) - applies to the rest of the enclosing group
+                return -1 ;
+            }
+            break ;
+        }
+    }
+    else
+    {
+        group = ++ps->ngroups ;
+    }
+
+    if( ++ps->depth > PREG_NFA_MAX_DEPTH )
+        return nfaFail( ps , "parentheses are too deeply nested" ) ;
+
+    child = nfaParseAlt( ps ) ;
+    if( child < 0 )
+        return -1 ;
+    if( ps->p >= ps->end || *ps->p != ')' )
+        return nfaFail( ps , "missing )" ) ;
+    ps->p++ ;
+    ps->depth-- ;
+    ps->options = saved_options ;
+
+    if( group < 0 )
+        return child ;
+
+    node = nfaNode( ps , NODE_CAPTURE , group ) ;
+    if( node >= 0 )
+        ps->nodes[ node ].child = child ;
+    return node ;
+}
+
+/**
+ * @fn static int nfaParseAtom( struct preg_nfa_parser *ps )
+ *
+ * @brief parse one item (a byte, class, group, assertion...)
+ *
+ * @return the index of the new node
+ * @return -1 on error or if nothing that matches was parsed (ps->failed
+ * tells which)
+ */
+static int nfaParseAtom( struct preg_nfa_parser *ps )
+{
+    unsigned char set[ 32 ] ;
+    int c , rc ;
+
+    c = (unsigned char)*ps->p++ ;
+
+    if( ps->quote )
+    {
+        if( c == '\\' && ps->p < ps->end && *ps->p == 'E' )
+        {
+            ps->p++ ;
+            ps->quote = 0 ;
+            return -1 ;
+        }
+        return nfaByte( ps , c ) ;
+    }
+
+    switch( c )
+    {
+    case '(':
+        return nfaParseGroup( ps ) ;
+    case '[':
+        return nfaParseClass( ps ) ;
+    case '.':
+        return nfaNode( ps , ( ps->options & PCRE_DOTALL ) ? 
+                        NODE_ANY : NODE_ANYNL , 0 ) ;
+    case '^':
+        return nfaNode( ps , NODE_ASSERT , ( ps->options & PCRE_MULTILINE ) ?
+                        NFA_BOL : NFA_BOT ) ;
+    case '$':
+        if( ps->options & PCRE_MULTILINE )
+            return nfaNode( ps , NODE_ASSERT , NFA_EOL ) ;
+        return nfaNode( ps , NODE_ASSERT , 
+                        ( ps->options & PCRE_DOLLAR_ENDONLY ) ? 
+                        NFA_EOT : NFA_EOTNL ) ;
+    case '*': case '+': case '?':
+        return nfaFail( ps , "nothing to repeat" ) ;
+    case '\\':
+        break ;
+    default:
+        return nfaByte( ps , c ) ;
+    }
+
+    // escapes
+    if( ps->p >= ps->end )
+        return nfaFail( ps , "\\ at end of pattern" ) ;
+    c = (unsigned char)*ps->p++ ;
+
+    switch( c )
+    {
+    case 'b': return nfaNode( ps , NODE_ASSERT , NFA_WORDB ) ;
+    case 'B': return nfaNode( ps , NODE_ASSERT , NFA_NWORDB ) ;
+    case 'A': return nfaNode( ps , NODE_ASSERT , NFA_BOT ) ;
+    case 'z': return nfaNode( ps , NODE_ASSERT , NFA_EOT ) ;
+    case 'Z': return nfaNode( ps , NODE_ASSERT , NFA_EOTNL ) ;
+    case 'G': return nfaNode( ps , NODE_ASSERT , NFA_START ) ;
+    case 'Q': ps->quote = 1 ; return -1 ;
+    case 'E': return -1 ;
+    }
+
+    memset( set , 0 , sizeof( set ) ) ;
+    if( nfaClassEscape( c , set ) )
+        return nfaSet( ps , set ) ;
+
+    rc = nfaEscapedByte( ps , c , 0 ) ;
+    if( rc == -2 )
+        return -1 ;
+    if( rc >= 0 )
+        return nfaByte( ps , rc ) ;
+
+    if( nfaIsAlpha( c ) || nfaIsDigit( c ) )
+    {
+        if( nfaUnsupportedEscape( ps , c ) )
+            return -1 ;
+    }
+    return nfaByte( ps , c ) ;
+}
+
+/**
+ * @fn static int nfaParseCount( struct preg_nfa_parser *ps , int *min ,
+ *                               int *max )
+ *
+ * @brief parse a {n} {n,} or {n,m} quantifier at ps->p
+ *
+ * @return 1 if there was one (and ps->p is moved past it), 0 if the { is 
+ * just a {
+ */
+static int nfaParseCount( struct preg_nfa_parser *ps , int *min , int *max )
+{
+    const char *p = ps->p + 1 ;
+    long lo = 0 , hi ;
+
+    if( p >= ps->end || !nfaIsDigit( *p ) )
+        return 0 ;
+    while( p < ps->end && nfaIsDigit( *p ) && lo <= 65535 )
+        lo = lo * 10 + *p++ - '0' ;
+    hi = lo ;
+    if( p < ps->end && *p == ',' )
+    {
+        p++ ;
+        hi = -1 ;
+        if( p < ps->end && nfaIsDigit( *p ) )
+        {
+            hi = 0 ;
+            while( p < ps->end && nfaIsDigit( *p ) && hi <= 65535 )
+                hi = hi * 10 + *p++ - '0' ;
+        }
+    }
+    if( p >= ps->end || *p != '}' )
+        return 0 ;
+
+    ps->p = p + 1 ;
+    *min = (int)lo ;
+    *max = (int)hi ;
+    return 1 ;
+}
+
+/**
+ * @fn static void nfaSkipSpace( struct preg_nfa_parser *ps )
+ *
+ * @brief skip white space and comments if the x option is on
+ */
+static void nfaSkipSpace( struct preg_nfa_parser *ps )
+{
+    if( !( ps->options & PCRE_EXTENDED ) || ps->quote )
+        return ;
+
+    while( ps->p < ps->end )
+    {
+        if( nfaIsSpace( (unsigned char)*ps->p ) )
+            ps->p++ ;
+        else if( *ps->p == '#' )
+        {
+            while( ps->p < ps->end && *ps->p != '\n' )
+                ps->p++ ;
+        }
+        else
+            break ;
+    }
+}
+
+/**
+ * @fn static int nfaParseCat( struct preg_nfa_parser *ps )
+ *
+ * @brief parse a sequence of items, up to a | or ) or the end
+ *
+ * @return the index of the new node or -1 on error
+ */
+static int nfaParseCat( struct preg_nfa_parser *ps )
+{
+    int cat , atom , rep ;
+    int min , max ;
+
+    cat = nfaNode( ps , NODE_CAT , 0 ) ;
+    if( cat < 0 )
+        return -1 ;
+
+    for( ;; )
+    {
+        nfaSkipSpace( ps ) ;
+        if( ps->p >= ps->end || 
+            ( !ps->quote && ( *ps->p == '|' || *ps->p == ')' ) ) )
+            break ;
+
+        atom = nfaParseAtom( ps ) ;
+        if( ps->failed )
+            return -1 ;
+        if( atom < 0 )
+            continue ;
+
+        // quantifiers
+        for( ;; )
+        {
+            nfaSkipSpace( ps ) ;
+            if( ps->p >= ps->end || ps->quote )
+                break ;
+            if( *ps->p == '*' )
+            {
+                min = 0 ; max = -1 ; ps->p++ ;
+            }
+            else if( *ps->p == '+' )
+            {
+                min = 1 ; max = -1 ; ps->p++ ;
+            }
+            else if( *ps->p == '?' )
+            {
+                min = 0 ; max = 1 ; ps->p++ ;
+            }
+            else if( *ps->p != '{' || !nfaParseCount( ps , &min , &max ) )
+                break ;
+
+            if( max >= 0 && max < min )
+                return nfaFail( ps , "numbers out of order in {} quantifier" ) ;
+            if( min > 65535 || max > 65535 )
+                return nfaFail( ps , "number too big in {} quantifier" ) ;
+
+            rep = nfaNode( ps , NODE_REPEAT , 0 ) ;
+            if( rep < 0 )
+                return -1 ;
+            ps->nodes[ rep ].child = atom ;
+            ps->nodes[ rep ].min = min ;
+            ps->nodes[ rep ].max = max ;
+            ps->nodes[ rep ].greedy = !( ps->options & PCRE_UNGREEDY ) ;
+            if( ps->p < ps->end && *ps->p == '?' )
+            {
+                ps->nodes[ rep ].greedy = !ps->nodes[ rep ].greedy ;
+                ps->p++ ;
+            }
+            else if( ps->p < ps->end && *ps->p == '+' )
+            {
+                return nfaFail( ps , "possessive quantifiers are not supported by the L modifier" ) ;
+            }
+            atom = rep ;
+        }
+
+        nfaAppend( ps , cat , atom ) ;
+    }
+
+    return cat ;
+}
+
+/**
+ * @fn static int nfaParseAlt( struct preg_nfa_parser *ps )
+ *
+ * @brief parse alternatives separated by |, up to a ) or the end
+ *
+ * @return the index of the new node or -1 on error
+ */
+static int nfaParseAlt( struct preg_nfa_parser *ps )
+{
+    int alt , cat ;
+
+    alt = nfaNode( ps , NODE_ALT , 0 ) ;
+    if( alt < 0 )
+        return -1 ;
+
+    for( ;; )
+    {
+        cat = nfaParseCat( ps ) ;
+        if( cat < 0 )
+            return -1 ;
+        nfaAppend( ps , alt , cat ) ;
+        if( ps->p >= ps->end || *ps->p != '|' )
+            break ;
+        ps->p++ ;
+    }
+
+    return alt ;
+}
+
+/*
+ * Code generation
+ */
+
+struct preg_nfa_compiler {
+    struct preg_nfa_node *nodes ;
+    preg_nfa *nfa ;
+    int prog_size ;
+    long calls ;                /* calls of nfaGen, to catch (?:){9999} */
+    int reverse ;               /* generate the program backwards */
+    char *msg ;
+    int msglen ;
+} ;
+
+/**
+ * @fn static int nfaEmit( struct preg_nfa_compiler *cs , int op , int x ,
+ *                         int y )
+ *
+ * @brief add an instruction to the program
+ *
+ * @return the index of the instruction or -1 if the program is too big
+ */
+static int nfaEmit( struct preg_nfa_compiler *cs , int op , int x , int y )
+{
+    preg_nfa *nfa = cs->nfa ;
+    struct preg_nfa_inst *prog ;
+    struct preg_nfa_inst *inst ;
+
+    if( nfa->ninst == cs->prog_size )
+    {
+        if( cs->prog_size >= PREG_NFA_MAX_INSTS )
+        {
+            snprintf( cs->msg , cs->msglen , 
+                      "pattern is too large for the L modifier" ) ;
+            return -1 ;
+        }
+        prog = realloc( nfa->prog , 2 * ( cs->prog_size + 16 ) *
+                        sizeof( struct preg_nfa_inst ) ) ;
+        if( !prog )
+        {
+            snprintf( cs->msg , cs->msglen , "Out of memory" ) ;
+            return -1 ;
+        }
+        nfa->prog = prog ;
+        cs->prog_size = 2 * ( cs->prog_size + 16 ) ;
+    }
+
+    inst = &nfa->prog[ nfa->ninst ] ;
+    inst->op = op ;
+    inst->c = ( op == NFA_BYTE ) ? x : 0 ;
+    inst->x = x ;
+    inst->y = y ;
+    if( op == NFA_BYTE || op == NFA_SET || op == NFA_ANY ||
+        op == NFA_ANYNL || op == NFA_MATCH )
+    {
+        nfa->nthreads++ ;
+    }
+    return nfa->ninst++ ;
+}
+
+/**
+ * @fn static int nfaNullable( struct preg_nfa_compiler *cs , int node )
+ *
+ * @brief can a node of the tree match an empty string?
+ */
+static int nfaNullable( struct preg_nfa_compiler *cs , int node )
+{
+    struct preg_nfa_node *n = &cs->nodes[ node ] ;
+    int child ;
+
+    switch( n->type )
+    {
+    case NODE_EMPTY:
+    case NODE_ASSERT:
+        return 1 ;
+    case NODE_CAT:
+        for( child = n->child ; child >= 0 ; child = cs->nodes[ child ].next )
+        {
+            if( !nfaNullable( cs , child ) )
+                return 0 ;
+        }
+        return 1 ;
+    case NODE_ALT:
+        for( child = n->child ; child >= 0 ; child = cs->nodes[ child ].next )
+        {
+            if( nfaNullable( cs , child ) )
+                return 1 ;
+        }
+        return 0 ;
+    case NODE_REPEAT:
+        return !n->min || nfaNullable( cs , n->child ) ;
+    case NODE_CAPTURE:
+        return nfaNullable( cs , n->child ) ;
+    }
+    return 0 ;
+}
+
+static int nfaGen( struct preg_nfa_compiler *cs , int node ) ;
+
+/**
+ * @fn static int nfaGenReverseCat( struct preg_nfa_compiler *cs , int node )
+ *
+ * @brief generate the code for the children of a CAT node, last one first
+ *
+ * @return 0 on success, -1 on error
+ */
+static int nfaGenReverseCat( struct preg_nfa_compiler *cs , int node )
+{
+    int *children ;
+    int child , n , rc ;
+
+    n = 0 ;
+    for( child = cs->nodes[ node ].child ; child >= 0 ; 
+         child = cs->nodes[ child ].next )
+        n++ ;
+
+    children = malloc( ( n + 1 ) * sizeof( int ) ) ;
+    if( !children )
+    {
+        snprintf( cs->msg , cs->msglen , "Out of memory" ) ;
+        return -1 ;
+    }
+
+    n = 0 ;
+    for( child = cs->nodes[ node ].child ; child >= 0 ; 
+         child = cs->nodes[ child ].next )
+        children[ n++ ] = child ;
+
+    rc = 0 ;
+    while( n-- && !rc )
+        rc = nfaGen( cs , children[ n ] ) ;
+
+    free( children ) ;
+    return rc ;
+}
+
+/**
+ * @fn static int nfaGen( struct preg_nfa_compiler *cs , int node )
+ *
+ * @brief generate the code for a node of the tree
+ *
+ * @return 0 on success, -1 on error
+ */
+static int nfaGen( struct preg_nfa_compiler *cs , int node )
+{
+    struct preg_nfa_node *n = &cs->nodes[ node ] ;
+    struct preg_nfa_inst *prog ;
+    int child , pc , jumps , split , i ;
+
+    if( ++cs->calls > 10 * PREG_NFA_MAX_INSTS )
+    {
+        snprintf( cs->msg , cs->msglen , 
+                  "pattern is too large for the L modifier" ) ;
+        return -1 ;
+    }
+
+    switch( n->type )
+    {
+    case NODE_EMPTY:
+        return 0 ;
+    case NODE_BYTE:
+        return nfaEmit( cs , NFA_BYTE , n->val , 0 ) < 0 ? -1 : 0 ;
+    case NODE_SET:
+        return nfaEmit( cs , NFA_SET , n->val , 0 ) < 0 ? -1 : 0 ;
+    case NODE_ANY:
+        return nfaEmit( cs , NFA_ANY , 0 , 0 ) < 0 ? -1 : 0 ;
+    case NODE_ANYNL:
+        return nfaEmit( cs , NFA_ANYNL , 0 , 0 ) < 0 ? -1 : 0 ;
+    case NODE_ASSERT:
+        return nfaEmit( cs , NFA_ASSERT , n->val , 0 ) < 0 ? -1 : 0 ;
+
+    case NODE_CAT:
+        if( cs->reverse )
+            return nfaGenReverseCat( cs , node ) ;
+        for( child = n->child ; child >= 0 ; child = cs->nodes[ child ].next )
+        {
+            if( nfaGen( cs , child ) )
+                return -1 ;
+        }
+        return 0 ;
+
+    case NODE_ALT:
+        // The JMP's to the end are chained through x until the end is known
+        jumps = -1 ;
+        for( child = n->child ; child >= 0 ; child = cs->nodes[ child ].next )
+        {
+            if( cs->nodes[ child ].next < 0 )
+            {
+                if( nfaGen( cs , child ) )
+                    return -1 ;
+                break ;
+            }
+            split = nfaEmit( cs , NFA_SPLIT , 0 , 0 ) ;
+            if( split < 0 || nfaGen( cs , child ) )
+                return -1 ;
+            pc = nfaEmit( cs , NFA_JMP , jumps , 0 ) ;
+            if( pc < 0 )
+                return -1 ;
+            jumps = pc ;
+            prog = cs->nfa->prog ;
+            prog[ split ].x = split + 1 ;
+            prog[ split ].y = cs->nfa->ninst ;
+        }
+        prog = cs->nfa->prog ;
+        while( jumps >= 0 )
+        {
+            pc = prog[ jumps ].x ;
+            prog[ jumps ].x = cs->nfa->ninst ;
+            jumps = pc ;
+        }
+        return 0 ;
+
+    case NODE_CAPTURE:
+        if( cs->reverse )
+            return nfaGen( cs , n->child ) ;
+        if( nfaEmit( cs , NFA_SAVE , 2 * n->val , 0 ) < 0 ||
+            nfaGen( cs , n->child ) ||
+            nfaEmit( cs , NFA_SAVE , 2 * n->val + 1 , 0 ) < 0 )
+            return -1 ;
+        return 0 ;
+
+    case NODE_REPEAT:
+        if( ( n->max < 0 || n->max > 1 ) && nfaNullable( cs , n->child ) )
+            cs->nfa->nullable_loops = 1 ;
+        for( i = 0 ; i < n->min ; i++ )
+        {
+            if( nfaGen( cs , n->child ) )
+                return -1 ;
+        }
+        if( n->max < 0 )
+        {   // L: SPLIT body , out ; body: child ; LOOP L , out ; out:
+            split = nfaEmit( cs , NFA_SPLIT , 0 , 0 ) ;
+            if( split < 0 || nfaGen( cs , n->child ) )
+                return -1 ;
+            pc = nfaEmit( cs , NFA_LOOP , split , 0 ) ;
+            if( pc < 0 )
+                return -1 ;
+            prog = cs->nfa->prog ;
+            prog[ pc ].y = cs->nfa->ninst ;
+            prog[ split ].x = n->greedy ? split + 1 : cs->nfa->ninst ;
+            prog[ split ].y = n->greedy ? cs->nfa->ninst : split + 1 ;
+            return 0 ;
+        }
+        // SPLIT body1 , out ; body1: child ; SPLIT body2 , out ; ...
+        // The SPLIT's are chained through y until out is known
+        jumps = -1 ;
+        for( i = n->min ; i < n->max ; i++ )
+        {
+            split = nfaEmit( cs , NFA_SPLIT , 0 , jumps ) ;
+            if( split < 0 || nfaGen( cs , n->child ) )
+                return -1 ;
+            jumps = split ;
+        }
+        prog = cs->nfa->prog ;
+        while( jumps >= 0 )
+        {
+            split = jumps ;
+            jumps = prog[ split ].y ;
+            prog[ split ].x = n->greedy ? split + 1 : cs->nfa->ninst ;
+            prog[ split ].y = n->greedy ? cs->nfa->ninst : split + 1 ;
+        }
+        return 0 ;
+    }
+
+    return 0 ;
+}
+
+/**
+ * @fn static preg_nfa *nfaCompile( const char *pattern , int options ,
+ *                                  int reverse , char *msg , int msglen )
+ *
+ * @brief does the work for pregNfaCompile and pregNfaCompileReverse
+ */
+static preg_nfa *nfaCompile( const char *pattern , int options , int reverse ,
+                             char *msg , int msglen )
+{
+    struct preg_nfa_parser ps ;
+    struct preg_nfa_compiler cs ;
+    preg_nfa *nfa ;
+    int root ;
+
+    if( options & PCRE_UTF8 )
+    {
+        snprintf( msg , msglen , "the u modifier can not be used with the L modifier" ) ;
+        return NULL ;
+    }
+
+    nfa = calloc( 1 , sizeof( preg_nfa ) ) ;
+    if( !nfa )
+    {
+        snprintf( msg , msglen , "Out of memory" ) ;
+        return NULL ;
+    }
+    nfa->anchored = ( options & PCRE_ANCHORED ) ? 1 : 0 ;
+
+    memset( &ps , 0 , sizeof( ps ) ) ;
+    ps.p = pattern ;
+    ps.end = pattern + strlen( pattern ) ;
+    ps.options = options ;
+    ps.nfa = nfa ;
+    ps.msg = msg ;
+    ps.msglen = msglen ;
+
+    root = nfaParseAlt( &ps ) ;
+    if( root >= 0 && ps.p < ps.end )
+    {
+        root = nfaFail( &ps , "unmatched parentheses" ) ;
+    }
+
+    if( root >= 0 )
+    {
+        nfa->ncaps = 2 * ( ps.ngroups + 1 ) ;
+
+        memset( &cs , 0 , sizeof( cs ) ) ;
+        cs.nodes = ps.nodes ;
+        cs.nfa = nfa ;
+        cs.reverse = reverse ;
+        cs.msg = msg ;
+        cs.msglen = msglen ;
+
+        if( nfaEmit( &cs , NFA_SAVE , 0 , 0 ) < 0 || nfaGen( &cs , root ) ||
+            nfaEmit( &cs , NFA_SAVE , 1 , 0 ) < 0 ||
+            nfaEmit( &cs , NFA_MATCH , 0 , 0 ) < 0 )
+        {
+            root = -1 ;
+        }
+        else if( (long)nfa->nthreads * nfa->ncaps > PREG_NFA_MAX_CAPS )
+        {
+            snprintf( msg , msglen , "pattern is too large for the L modifier" ) ;
+            root = -1 ;
+        }
+    }
+
+    free( ps.nodes ) ;
+
+    if( root < 0 )
+    {
+        pregNfaFree( nfa ) ;
+        return NULL ;
+    }
+
+    return nfa ;
+}
+
+
+/*
+ * Public Functions:
+ */
+
+/**
+ * @fn preg_nfa *pregNfaCompile( const char *pattern , int options ,
+ *                               char *msg , int msglen )
+ *
+ * @brief compile a pattern for the linear-time matcher
+ *
+ * @param pattern - the pattern, without delimiters or modifiers 
+ * (null terminated)
+ * @param options - the PCRE_* options from the modifiers
+ * @param msg - put error messages here
+ * @param msglen - size of msg
+ *
+ * @return the compiled pattern - on success
+ * @return NULL - if the pattern uses things that can't be matched in 
+ * linear time, or it is too big.  The reason is put in msg.
+ *
+ * @note free the returned pattern with pregNfaFree
+ */
+preg_nfa *pregNfaCompile( const char *pattern , int options ,
+                          char *msg , int msglen )
+{
+    return nfaCompile( pattern , options , 0 , msg , msglen ) ;
+}
+
+/**
+ * @fn preg_nfa *pregNfaCompileReverse( const char *pattern , int options ,
+ *                                      char *msg , int msglen )
+ *
+ * @brief compile a pattern that matches the reverse of what pattern 
+ * matches
+ *
+ * @details This is pregNfaCompile, except that the program reads the
+ * subject backwards and has no captures.  Assertions are the same, so 
+ * ^ still checks the byte before the position, for example.  This is
+ * used by preg_dfa.c to find where a match starts once its end is known.
+ */
+preg_nfa *pregNfaCompileReverse( const char *pattern , int options ,
+                                 char *msg , int msglen )
+{
+    return nfaCompile( pattern , options , 1 , msg , msglen ) ;
+}
+
+/**
+ * @fn int *pregNfaLengths( const char *pattern , int options ,
+ *                          const preg_nfa *nfa , int groups ,
+ *                          int *min_length )
+ *
+ * @brief find the longest string that each capture group of a pattern can
+ * match, and the shortest match
+ *
+ * @param pattern - the pattern, without delimiters or modifiers
+ * (null terminated)
+ * @param options - the PCRE_* options from the modifiers
+ * @param nfa - pattern compiled by pregNfaCompile, or NULL to compile it
+ * here
+ * @param groups - the number of capture groups in the pattern
+ * @param min_length - put the length of the shortest match here
+ *
+ * @return groups + 1 lengths, the whole match first.  -1 is a group with no
+ * limit on its length.  Free them with free.
+ * @return NULL - if pregNfaCompile can't compile the pattern, or out of
+ * memory
+ *
+ * @details These are limits, not the lengths that a match can actually
+ * have, since assertions are ignored.  Every jump in the program goes
+ * forward except the LOOP at the end of an unbounded repeat, so the
+ * lengths are worked out from the end of a group back to its start.
+ * A group with a repeat in it that can match a byte has no limit.  A
+ * group that appears more than once (because it is in a counted repeat)
+ * gets the longest of them.
+ */
+int *pregNfaLengths( const char *pattern , int options ,
+                     const preg_nfa *nfa , int groups , int *min_length )
+{
+    char msg[ 128 ] ;
+    preg_nfa *compiled ;
+    const struct preg_nfa_inst *inst ;
+    int *lengths ;
+    int *lo , *hi ;             /* shortest & longest from each instruction
+                                   to the end of the group */
+    int open , close , pc , i , a , b , g ;
+
+    compiled = NULL ;
+    if( !nfa )
+    {
+        nfa = compiled = pregNfaCompile( pattern , options , msg ,
+                                         sizeof( msg ) ) ;
+        if( !nfa )
+            return NULL ;
+    }
+
+    lengths = calloc( groups + 1 , sizeof( int ) ) ;
+    lo = malloc( 2 * ( nfa->ninst + 1 ) * sizeof( int ) ) ;
+    if( !lengths || !lo || nfa->ncaps != 2 * ( groups + 1 ) )
+    {
+        free( lengths ) ;
+        free( lo ) ;
+        pregNfaFree( compiled ) ;
+        return NULL ;
+    }
+    hi = lo + nfa->ninst + 1 ;
+    *min_length = 0 ;
+
+    for( open = 0 ; open < nfa->ninst ; open++ )
+    {
+        if( nfa->prog[ open ].op != NFA_SAVE || nfa->prog[ open ].x & 1 )
+            continue ;
+        for( close = open + 1 ; close < nfa->ninst ; close++ )
+        {
+            if( nfa->prog[ close ].op == NFA_SAVE &&
+                nfa->prog[ close ].x == nfa->prog[ open ].x + 1 )
+                break ;
+        }
+        if( close == nfa->ninst )
+            continue ;
+
+        // lo is INT_MAX and hi is -2 where the end can't be reached.  hi is
+        // -1 if there is no limit.
+        lo[ close ] = hi[ close ] = 0 ;
+        for( pc = close - 1 ; pc > open ; pc-- )
+        {
+            inst = &nfa->prog[ pc ] ;
+            switch( inst->op )
+            {
+            case NFA_BYTE:
+            case NFA_SET:
+            case NFA_ANY:
+            case NFA_ANYNL:
+                lo[ pc ] = lo[ pc + 1 ] == INT_MAX ? INT_MAX : lo[ pc + 1 ] + 1 ;
+                hi[ pc ] = hi[ pc + 1 ] < 0 ? hi[ pc + 1 ] : hi[ pc + 1 ] + 1 ;
+                break ;
+            case NFA_SAVE:
+            case NFA_ASSERT:
+                lo[ pc ] = lo[ pc + 1 ] ;
+                hi[ pc ] = hi[ pc + 1 ] ;
+                break ;
+            case NFA_JMP:
+            case NFA_SPLIT:
+                a = inst->x ;
+                b = inst->op == NFA_SPLIT ? inst->y : inst->x ;
+                if( a <= pc || a > close || b <= pc || b > close )
+                {   // not a program that nfaGen makes
+                    lo[ pc ] = 0 ;
+                    hi[ pc ] = -1 ;
+                    break ;
+                }
+                lo[ pc ] = lo[ a ] < lo[ b ] ? lo[ a ] : lo[ b ] ;
+                if( hi[ a ] == -1 || hi[ b ] == -1 )
+                    hi[ pc ] = -1 ;
+                else
+                    hi[ pc ] = hi[ a ] > hi[ b ] ? hi[ a ] : hi[ b ] ;
+                break ;
+            case NFA_LOOP:
+                // Going round again can only make the match longer
+                b = inst->y ;
+                if( b <= pc || b > close )
+                {
+                    lo[ pc ] = 0 ;
+                    hi[ pc ] = -1 ;
+                    break ;
+                }
+                lo[ pc ] = lo[ b ] ;
+                hi[ pc ] = hi[ b ] ;
+                for( i = inst->x ; i < pc && hi[ pc ] != -1 ; i++ )
+                {
+                    if( nfa->prog[ i ].op == NFA_BYTE ||
+                        nfa->prog[ i ].op == NFA_SET ||
+                        nfa->prog[ i ].op == NFA_ANY ||
+                        nfa->prog[ i ].op == NFA_ANYNL )
+                        hi[ pc ] = -1 ;
+                }
+                break ;
+            default:
+                lo[ pc ] = INT_MAX ;
+                hi[ pc ] = -2 ;
+                break ;
+            }
+        }
+
+        g = nfa->prog[ open ].x / 2 ;
+        if( hi[ open + 1 ] == -2 )
+            continue ;
+        if( g == 0 )
+            *min_length = lo[ open + 1 ] ;
+        if( hi[ open + 1 ] == -1 || lengths[ g ] == -1 )
+            lengths[ g ] = -1 ;
+        else if( hi[ open + 1 ] > lengths[ g ] )
+            lengths[ g ] = hi[ open + 1 ] ;
+    }
+
+    free( lo ) ;
+    pregNfaFree( compiled ) ;
+    return lengths ;
+}
+
+/**
+ * @fn void pregNfaFree( preg_nfa *nfa )
+ *
+ * @brief free a pattern returned by pregNfaCompile.  NULL is ignored.
+ */
+void pregNfaFree( preg_nfa *nfa )
+{
+    if( nfa )
+    {
+        free( nfa->prog ) ;
+        free( nfa->sets ) ;
+        free( nfa ) ;
+    }
+}
+
+
+/*
+ * Matching
+ */
+
+struct preg_nfa_list {
+    int n ;                     /* number of threads */
+    int *pc ;                   /* instruction of each thread */
+    int *caps ;                 /* ncaps capture slots for each thread */
+} ;
+
+struct preg_nfa_work {
+    const preg_nfa *nfa ;
+    const unsigned char *subject ;
+    int length ;
+    int start_offset ;
+    int *visited ;              /* step that last visited each instruction */
+    int *stack ;                /* for nfaAddThread - 3 ints per entry */
+    int *cur ;                  /* captures of the thread being added */
+} ;
+
+/**
+ * @fn static int nfaAssert( struct preg_nfa_work *w , int what , int pos )
+ *
+ * @brief check an assertion at a position in the subject
+ */
+static int nfaAssert( struct preg_nfa_work *w , int what , int pos )
+{
+    const unsigned char *s = w->subject ;
+    int len = w->length ;
+
+    switch( what )
+    {
+    case NFA_BOT:
+        return pos == 0 ;
+    case NFA_BOL:
+        return pos == 0 || ( pos < len && s[ pos - 1 ] == '\n' ) ;
+    case NFA_EOT:
+        return pos == len ;
+    case NFA_EOTNL:
+        return pos == len || ( pos == len - 1 && s[ pos ] == '\n' ) ;
+    case NFA_EOL:
+        return pos == len || s[ pos ] == '\n' ;
+    case NFA_WORDB:
+    case NFA_NWORDB:
+        return ( ( pos > 0 && nfaIsWord( s[ pos - 1 ] ) ) != 
+                 ( pos < len && nfaIsWord( s[ pos ] ) ) ) == ( what == NFA_WORDB ) ;
+    case NFA_START:
+        return pos == w->start_offset ;
+    }
+    return 0 ;
+}
+
+/**
+ * @fn static void nfaAddThread( struct preg_nfa_work *w , 
+ *                               struct preg_nfa_list *l , int pc , 
+ *                               int *caps , int pos , int step )
+ *
+ * @brief add the thread at pc, and all of the threads it leads to
+ * without reading a byte, to l
+ *
+ * @param w - the work areas
+ * @param l - the list to add to
+ * @param pc - the instruction of the thread
+ * @param caps - the captures of the thread.  These are changed while
+ * this runs, but are put back the way they were.
+ * @param pos - the position in the subject
+ * @param step - number of the list being built.  Instructions already
+ * visited in this step are skipped, since those threads have already been 
+ * added by threads with a higher priority.
+ *
+ * @details The threads are added in priority order: the order in which
+ * a backtracking matcher would try them.  A stack is used rather than
+ * recursion, so the mysqld thread stack is not a concern.
+ */
+static void nfaAddThread( struct preg_nfa_work *w , struct preg_nfa_list *l ,
+                          int pc , int *caps , int pos , int step )
+{
+    const struct preg_nfa_inst *prog = w->nfa->prog ;
+    const struct preg_nfa_inst *inst ;
+    int ncaps = w->nfa->ncaps ;
+    int *stack = w->stack ;
+    int sp = 0 ;
+
+    // entries are ( pc , -1 , 0 ) or ( 0 , slot , saved value )
+    stack[ sp++ ] = pc ; stack[ sp++ ] = -1 ; stack[ sp++ ] = 0 ;
+
+    while( sp )
+    {
+        sp -= 3 ;
+        if( stack[ sp + 1 ] >= 0 )
+        {
+            caps[ stack[ sp + 1 ] ] = stack[ sp + 2 ] ;
+            continue ;
+        }
+        pc = stack[ sp ] ;
+
+        for( ;; )
+        {
+            inst = &prog[ pc ] ;
+            if( inst->op == NFA_LOOP )
+            {   // Like libpcre, leave a loop after an empty iteration.  
+                // LOOP is not marked, since it can be reached again that way
+                pc = ( w->visited[ inst->x ] == step ) ? inst->y : inst->x ;
+                continue ;
+            }
+            if( w->visited[ pc ] == step )
+                break ;
+            w->visited[ pc ] = step ;
+
+            if( inst->op == NFA_JMP )
+            {
+                pc = inst->x ;
+            }
+            else if( inst->op == NFA_SPLIT )
+            {
+                stack[ sp++ ] = inst->y ; stack[ sp++ ] = -1 ; stack[ sp++ ] = 0 ;
+                pc = inst->x ;
+            }
+            else if( inst->op == NFA_SAVE )
+            {
+                stack[ sp++ ] = 0 ; stack[ sp++ ] = inst->x ; 
+                stack[ sp++ ] = caps[ inst->x ] ;
+                caps[ inst->x ] = pos ;
+                pc++ ;
+            }
+            else if( inst->op == NFA_ASSERT )
+            {
+                if( !nfaAssert( w , inst->x , pos ) )
+                    break ;
+                pc++ ;
+            }
+            else
+            {   // waits for a byte (or is the match)
+                l->pc[ l->n ] = pc ;
+                memcpy( l->caps + l->n * ncaps , caps , ncaps * sizeof( int ) ) ;
+                l->n++ ;
+                break ;
+            }
+        }
+    }
+}
+
+/**
+ * @fn int pregNfaExec( const preg_nfa *nfa , const char *subject , 
+ *                      int length , int start_offset , int options , 
+ *                      int *ovector , int ovecsize )
+ *
+ * @brief match a pattern compiled by pregNfaCompile against a subject
+ *
+ * @param nfa - the compiled pattern
+ * @param subject - the subject (does not need to be null terminated)
+ * @param length - length of subject
+ * @param start_offset - where in subject to start looking for a match
+ * @param options - PCRE_ANCHORED and/or PCRE_NOTEMPTY
+ * @param ovector - put the offsets of the match and groups here
+ * @param ovecsize - number of ints in ovector (a multiple of 3)
+ *
+ * @return the same as pcre_exec: the number of pairs set in ovector if 
+ * the pattern matched, 0 if ovector was too small, PCRE_ERROR_NOMATCH, 
+ * or another PCRE_ERROR_* code
+ *
+ * @details Like pcre_exec, only the first two thirds of ovector are used.
+ * The work areas are allocated for each call, since a compiled pattern is 
+ * shared between threads.
+ */
+int pregNfaExec( const preg_nfa *nfa , const char *subject , int length ,
+                 int start_offset , int options , int *ovector ,
+                 int ovecsize )
+{
+    struct preg_nfa_work w ;
+    struct preg_nfa_list lists[ 2 ] ;
+    struct preg_nfa_list *clist , *nlist , *tmp ;
+    const struct preg_nfa_inst *inst ;
+    int *mem ;                  /* all of the work areas */
+    int *caps ;                 /* captures of a thread */
+    int *best ;                 /* captures of the match */
+    int ncaps , anchored , notempty , matched ;
+    int pos , c , i , step , rc , pairs ;
+
+    if( !nfa || !subject || length < 0 )
+        return PCRE_ERROR_NULL ;
+    if( start_offset < 0 || start_offset > length )
+        return PCRE_ERROR_BADOFFSET ;
+
+    ncaps = nfa->ncaps ;
+    mem = malloc( sizeof( int ) * ( nfa->ninst + 3 * ( nfa->ninst + 1 ) +
+                                    2 * nfa->nthreads * ( ncaps + 1 ) +
+                                    2 * ncaps ) ) ;
+    if( !mem )
+        return PCRE_ERROR_NOMEMORY ;
+
+    w.nfa = nfa ;
+    w.subject = (const unsigned char *)subject ;
+    w.length = length ;
+    w.start_offset = start_offset ;
+    w.visited = mem ;
+    w.stack = w.visited + nfa->ninst ;
+    lists[ 0 ].pc = w.stack + 3 * ( nfa->ninst + 1 ) ;
+    lists[ 0 ].caps = lists[ 0 ].pc + nfa->nthreads ;
+    lists[ 1 ].pc = lists[ 0 ].caps + nfa->nthreads * ncaps ;
+    lists[ 1 ].caps = lists[ 1 ].pc + nfa->nthreads ;
+    w.cur = lists[ 1 ].caps + nfa->nthreads * ncaps ;
+    best = w.cur + ncaps ;
+
+    for( i = 0 ; i < nfa->ninst ; i++ )
+        w.visited[ i ] = -1 ;
+
+    anchored = nfa->anchored || ( options & PCRE_ANCHORED ) ;
+    notempty = options & PCRE_NOTEMPTY ;
+    matched = 0 ;
+    step = 0 ;
+    clist = &lists[ 0 ] ;
+    nlist = &lists[ 1 ] ;
+    clist->n = 0 ;
+
+    for( pos = start_offset ; ; pos++ )
+    {
+        // A new thread starting here has the lowest priority
+        if( !matched && ( pos == start_offset || !anchored ) )
+        {
+            for( i = 0 ; i < ncaps ; i++ )
+                w.cur[ i ] = -1 ;
+            nfaAddThread( &w , clist , 0 , w.cur , pos , step ) ;
+        }
+        if( !clist->n && ( matched || anchored ) )
+            break ;
+
+        c = ( pos < length ) ? w.subject[ pos ] : -1 ;
+        nlist->n = 0 ;
+        ++step ;
+
+        for( i = 0 ; i < clist->n ; i++ )
+        {
+            inst = &nfa->prog[ clist->pc[ i ] ] ;
+            caps = clist->caps + i * ncaps ;
+
+            switch( inst->op )
+            {
+            case NFA_MATCH:
+                if( notempty && caps[ 0 ] == caps[ 1 ] )
+                    continue ;
+                memcpy( best , caps , ncaps * sizeof( int ) ) ;
+                matched = 1 ;
+                // threads with a lower priority are not needed
+                i = clist->n ;
+                continue ;
+            case NFA_BYTE:
+                if( c != inst->c )
+                    continue ;
+                break ;
+            case NFA_SET:
+                if( c < 0 || !NFA_BIT( nfa->sets[ inst->x ] , c ) )
+                    continue ;
+                break ;
+            case NFA_ANY:
+                if( c < 0 )
+                    continue ;
+                break ;
+            case NFA_ANYNL:
+                if( c < 0 || c == '\n' )
+                    continue ;
+                break ;
+            default:
+                continue ;
+            }
+            nfaAddThread( &w , nlist , clist->pc[ i ] + 1 , caps , pos + 1 , 
+                          step ) ;
+        }
+
+        tmp = clist ;
+        clist = nlist ;
+        nlist = tmp ;
+
+        if( pos >= length )
+            break ;
+    }
+
+    if( !matched )
+    {
+        free( mem ) ;
+        return PCRE_ERROR_NOMATCH ;
+    }
+
+    // Like pcre_exec: return 1 + the highest group that was set, or 0 if 
+    // ovector is too small
+    rc = 1 ;
+    for( i = 1 ; i < ncaps / 2 ; i++ )
+    {
+        if( best[ 2 * i + 1 ] >= 0 )
+            rc = i + 1 ;
+    }
+    pairs = ovecsize / 3 ;
+    for( i = 0 ; i < pairs && i < rc ; i++ )
+    {
+        if( best[ 2 * i ] >= 0 && best[ 2 * i + 1 ] >= 0 )
+        {
+            ovector[ 2 * i ] = best[ 2 * i ] ;
+            ovector[ 2 * i + 1 ] = best[ 2 * i + 1 ] ;
+        }
+        else
+        {
+            ovector[ 2 * i ] = ovector[ 2 * i + 1 ] = -1 ;
+        }
+    }
+    if( rc > pairs )
+        rc = 0 ;
+
+    free( mem ) ;
+    return rc ;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PREGNFA_H
+
+#define PREGNFA_H
+
+/** @file preg_nfa.h
+ *
+ * @brief headers for the linear-time matcher used by the L modifier
+ */
+
+// Include the libpcre headers (for the PCRE_* options and errors)
+#ifdef PREG_USE_PCRE2
+#include "preg_pcre2.h"
+#else
+#include "pcre.h"
+#endif
+
+// Limits on the size of patterns compiled for the matcher
+#define PREG_NFA_MAX_INSTS 10000    /* instructions in a compiled pattern */
+#define PREG_NFA_MAX_DEPTH 250      /* nesting of parentheses */
+#define PREG_NFA_MAX_CAPS ( 1 << 20 ) /* ints of capture offsets per step */
+
+typedef struct preg_nfa_s preg_nfa ;
+
+/*
+ * The compiled program.  This is also run by the DFA in preg_dfa.c
+ */
+enum preg_nfa_op {
+    NFA_BYTE ,                  /* match the byte c */
+    NFA_SET ,                   /* match a byte in sets[ x ] */
+    NFA_ANY ,                   /* match any byte */
+    NFA_ANYNL ,                 /* match any byte except \n */
+    NFA_SPLIT ,                 /* continue at x, then try y */
+    NFA_JMP ,                   /* continue at x */
+    NFA_LOOP ,                  /* end of a * loop: continue at x, or at y
+                                   if the loop matched an empty string */
+    NFA_SAVE ,                  /* save the position in capture slot x */
+    NFA_ASSERT ,                /* check assertion x at the position */
+    NFA_MATCH                   /* found a match */
+} ;
+
+/*
+ * Assertions
+ */
+enum preg_nfa_assert {
+    NFA_BOT ,                   /* start of subject: ^ \A */
+    NFA_BOL ,                   /* start of line: ^ with m */
+    NFA_EOT ,                   /* end of subject: \z, $ with D */
+    NFA_EOTNL ,                 /* end or before final newline: \Z $ */
+    NFA_EOL ,                   /* end of line: $ with m */
+    NFA_WORDB ,                 /* \b */
+    NFA_NWORDB ,                /* \B */
+    NFA_START                   /* start offset: \G */
+} ;
+
+struct preg_nfa_inst {
+    int op ;                    /* preg_nfa_op */
+    int c ;                     /* byte for NFA_BYTE */
+    int x ;                     /* set, target, slot or assertion */
+    int y ;                     /* second target of NFA_SPLIT */
+} ;
+
+struct preg_nfa_s {
+    struct preg_nfa_inst *prog ;/* the program - starts at 0 */
+    int ninst ;                 /* number of instructions in prog */
+    unsigned char (*sets)[ 32 ] ; /* byte sets (256 bits each) */
+    int nsets ;                 /* number of sets */
+    int ncaps ;                 /* capture slots: 2 * (groups + 1) */
+    int nthreads ;              /* instructions that wait for a byte */
+    int anchored ;              /* A modifier */
+    int nullable_loops ;        /* has a repeat whose body can match an 
+                                   empty string (see preg_dfa.c) */
+} ;
+
+#define NFA_BIT( set , c ) ( (set)[ (c) >> 3 ] & ( 1 << ( (c) & 7 ) ) )
+
+preg_nfa *pregNfaCompile( const char *pattern , int options ,
+                          char *msg , int msglen ) ;
+preg_nfa *pregNfaCompileReverse( const char *pattern , int options ,
+                                 char *msg , int msglen ) ;
+int pregNfaExec( const preg_nfa *nfa , const char *subject , int length ,
+                 int start_offset , int options , int *ovector ,
+                 int ovecsize ) ;
+int *pregNfaLengths( const char *pattern , int options ,
+                     const preg_nfa *nfa , int groups , int *min_length ) ;
+void pregNfaFree( preg_nfa *nfa ) ;
+
+#endif
@@ -0,0 +1,556 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/** @file preg_pcre2.c
+ *
+ * @brief The PCRE2 backend.  Implements the parts of the libpcre api that
+ *        are used by lib_mysqludf_preg on top of libpcre2.
+ *
+ * @details This file is empty unless configure was run with --with-pcre2.
+ *
+ * Each thread keeps one pcre2_match_data and one pcre2_match_context,
+ * which are reused by every pcre_exec the thread does.  (A UDF instance
+ * is only used by one thread, so this is one of each per instance,
+ * without having to pass them around.)  The match data grows to fit the
+ * largest ovector that the thread has used.  The limits in pcre_extra are
+ * copied to the match context for each call.
+ *
+ * PCRE2 (10.30 and later) keeps its backtracking information on the heap
+ * rather than on the stack, so mysqld:thread_stack no longer limits the
+ * patterns that can be run.
+ *
+ * JIT compiling changes a pcre2_code, and compiled patterns are shared
+ * by all threads through the pattern cache.  So pcre_study JIT compiles a
+ * copy of the pattern, which is kept in the pcre_extra in the same way
+ * that libpcre keeps its JIT code there.
+ *
+ * @notes This file does not depend on mysql.
+ */
+
+#ifdef PREG_USE_PCRE2
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "preg_pcre2.h"
+
+/*
+ * The pcre2 objects that belong to a thread
+ */
+struct preg_pcre2_thread_s {
+    pcre2_match_data *match_data ;      /* reused by every match */
+    uint32_t match_pairs ;              /* ovector pairs in match_data */
+    pcre2_match_context *mcontext ;     /* limits & JIT stack */
+    uint32_t default_match_limit ;      /* libpcre2's defaults */
+    uint32_t default_depth_limit ;
+    char error[ 256 ] ;                 /* last compile error message */
+};
+
+static pthread_key_t  preg_pcre2_key ;
+static pthread_once_t preg_pcre2_once = PTHREAD_ONCE_INIT ;
+static int            preg_pcre2_key_ok = 0 ;
+
+static void pregPcre2FreeThread( void *p )
+{
+    struct preg_pcre2_thread_s *t = (struct preg_pcre2_thread_s *)p ;
+
+    if( t->match_data )
+        pcre2_match_data_free( t->match_data ) ;
+    if( t->mcontext )
+        pcre2_match_context_free( t->mcontext ) ;
+    free( t ) ;
+}
+
+static void pregPcre2CreateKey( void )
+{
+    preg_pcre2_key_ok = !pthread_key_create( &preg_pcre2_key ,
+                                             pregPcre2FreeThread ) ;
+}
+
+/**
+ * @fn static struct preg_pcre2_thread_s *pregPcre2Thread( void )
+ *
+ * @brief get the pcre2 objects of the current thread, creating them if
+ * necessary
+ *
+ * @return the thread's objects - or NULL if out of memory
+ */
+static struct preg_pcre2_thread_s *pregPcre2Thread( void )
+{
+    struct preg_pcre2_thread_s *t ;
+
+    pthread_once( &preg_pcre2_once , pregPcre2CreateKey ) ;
+    if( !preg_pcre2_key_ok )
+        return NULL ;
+
+    t = (struct preg_pcre2_thread_s *)pthread_getspecific( preg_pcre2_key ) ;
+    if( t )
+        return t ;
+
+    t = calloc( 1 , sizeof( *t ) ) ;
+    if( !t )
+        return NULL ;
+
+    t->mcontext = pcre2_match_context_create( NULL ) ;
+    if( !t->mcontext || pthread_setspecific( preg_pcre2_key , t ) )
+    {
+        pregPcre2FreeThread( t ) ;
+        return NULL ;
+    }
+
+    pcre2_config( PCRE2_CONFIG_MATCHLIMIT , &t->default_match_limit ) ;
+    pcre2_config( PCRE2_CONFIG_DEPTHLIMIT , &t->default_depth_limit ) ;
+
+    return t ;
+}
+
+/**
+ * @fn static pcre2_match_data *pregPcre2MatchData(
+ *                             struct preg_pcre2_thread_s *t , uint32_t pairs )
+ *
+ * @brief get the thread's match data, making sure that it can hold at least
+ * pairs offset pairs.
+ */
+static pcre2_match_data *pregPcre2MatchData( struct preg_pcre2_thread_s *t ,
+                                             uint32_t pairs )
+{
+    if( pairs < 1 )
+        pairs = 1 ;
+
+    if( !t->match_data || t->match_pairs < pairs )
+    {
+        if( t->match_data )
+            pcre2_match_data_free( t->match_data ) ;
+        t->match_data = pcre2_match_data_create( pairs , NULL ) ;
+        t->match_pairs = t->match_data ? pairs : 0 ;
+    }
+
+    return t->match_data ;
+}
+
+/**
+ * @fn static int pregPcre2Error( int rc )
+ *
+ * @brief translate a pcre2_match error into the libpcre error that
+ * pregExecErrorString knows about.
+ */
+static int pregPcre2Error( int rc )
+{
+    if( rc <= PCRE2_ERROR_UTF8_ERR1 && rc >= PCRE2_ERROR_UTF8_ERR21 )
+        return PCRE_ERROR_BADUTF8 ;
+
+    switch( rc )
+    {
+    case PCRE2_ERROR_NOMATCH:       return PCRE_ERROR_NOMATCH ;
+    case PCRE2_ERROR_PARTIAL:       return PCRE_ERROR_PARTIAL ;
+    case PCRE2_ERROR_NULL:          return PCRE_ERROR_NULL ;
+    case PCRE2_ERROR_BADOPTION:     return PCRE_ERROR_BADOPTION ;
+    case PCRE2_ERROR_BADMAGIC:      return PCRE_ERROR_BADMAGIC ;
+    case PCRE2_ERROR_NOMEMORY:      return PCRE_ERROR_NOMEMORY ;
+    case PCRE2_ERROR_HEAPLIMIT:     return PCRE_ERROR_NOMEMORY ;
+    case PCRE2_ERROR_MATCHLIMIT:    return PCRE_ERROR_MATCHLIMIT ;
+    case PCRE2_ERROR_DEPTHLIMIT:    return PCRE_ERROR_RECURSIONLIMIT ;
+    case PCRE2_ERROR_CALLOUT:       return PCRE_ERROR_CALLOUT ;
+    case PCRE2_ERROR_BADUTFOFFSET:  return PCRE_ERROR_BADUTF8_OFFSET ;
+    case PCRE2_ERROR_BADOFFSET:     return PCRE_ERROR_BADOFFSET ;
+    case PCRE2_ERROR_RECURSELOOP:   return PCRE_ERROR_RECURSELOOP ;
+    case PCRE2_ERROR_JIT_STACKLIMIT:return PCRE_ERROR_JIT_STACKLIMIT ;
+    case PCRE2_ERROR_DFA_UITEM:     return PCRE_ERROR_DFA_UITEM ;
+    case PCRE2_ERROR_DFA_UCOND:     return PCRE_ERROR_DFA_UCOND ;
+    case PCRE2_ERROR_DFA_WSSIZE:    return PCRE_ERROR_DFA_WSSIZE ;
+    case PCRE2_ERROR_DFA_RECURSE:   return PCRE_ERROR_DFA_RECURSE ;
+    }
+
+    return PCRE_ERROR_INTERNAL ;
+}
+
+
+/*
+ * Public Functions:
+ */
+
+/**
+ * @fn pcre *pregPcre2Compile( const char *pattern , int options ,
+ *                             const char **error , int *erroffset ,
+ *                             const unsigned char *tables )
+ *
+ * @brief pcre_compile - compile a NULL terminated pattern
+ *
+ * @details On error, *error points to a buffer that belongs to the
+ * thread.  It is valid until the thread's next compile.  tables is
+ * ignored.
+ */
+pcre *pregPcre2Compile( const char *pattern , int options ,
+                        const char **error , int *erroffset ,
+                        const unsigned char *tables )
+{
+    struct preg_pcre2_thread_s *t ;
+    pcre2_code *re ;
+    int errorcode ;
+    PCRE2_SIZE offset ;
+
+    re = pcre2_compile( (PCRE2_SPTR)pattern , PCRE2_ZERO_TERMINATED ,
+                        (uint32_t)options , &errorcode , &offset , NULL ) ;
+    if( !re )
+    {
+        *erroffset = (int)offset ;
+        *error = "out of memory" ;
+        t = pregPcre2Thread() ;
+        if( t )
+        {
+            pcre2_get_error_message( errorcode , (PCRE2_UCHAR *)t->error ,
+                                     sizeof( t->error ) ) ;
+            *error = t->error ;
+        }
+    }
+
+    return re ;
+}
+
+/**
+ * @fn pcre_extra *pregPcre2Study( const pcre *re , int options ,
+ *                                 const char **error )
+ *
+ * @brief pcre_study - JIT compile a copy of the pattern if
+ * PCRE_STUDY_JIT_COMPILE is given.
+ *
+ * @return NULL - if there is nothing to add to the pattern.  PCRE2 does
+ * the rest of what pcre_study did when it compiles a pattern.
+ */
+pcre_extra *pregPcre2Study( const pcre *re , int options ,
+                            const char **error )
+{
+    pcre_extra *extra ;
+    pcre2_code *jit ;
+
+    *error = NULL ;
+    if( !( options & PCRE_STUDY_JIT_COMPILE ) )
+        return NULL ;
+
+    jit = pcre2_code_copy( re ) ;
+    if( !jit )
+    {
+        *error = "out of memory" ;
+        return NULL ;
+    }
+
+    if( pcre2_jit_compile( jit , PCRE2_JIT_COMPLETE ) )
+    {   // no JIT support - not an error
+        pcre2_code_free( jit ) ;
+        return NULL ;
+    }
+
+    extra = calloc( 1 , sizeof( *extra ) ) ;
+    if( !extra )
+    {
+        pcre2_code_free( jit ) ;
+        *error = "out of memory" ;
+        return NULL ;
+    }
+
+    extra->flags = PCRE_EXTRA_STUDY_DATA | PCRE_EXTRA_EXECUTABLE_JIT ;
+    extra->study_data = jit ;
+
+    return extra ;
+}
+
+/**
+ * @fn void pregPcre2FreeStudy( pcre_extra *extra )
+ *
+ * @brief pcre_free_study
+ */
+void pregPcre2FreeStudy( pcre_extra *extra )
+{
+    if( !extra )
+        return ;
+    if( extra->study_data )
+        pcre2_code_free( (pcre2_code *)extra->study_data ) ;
+    free( extra ) ;
+}
+
+/**
+ * @fn int pregPcre2Exec( const pcre *re , const pcre_extra *extra ,
+ *                        const char *subject , int length ,
+ *                        int start_offset , int options ,
+ *                        int *ovector , int ovecsize )
+ *
+ * @brief pcre_exec - run a match with the thread's match data
+ *
+ * @details Returns the same things as pcre_exec, including 0 when ovector
+ * is too small to hold all of the captured substrings.  Unset groups
+ * are -1 in ovector.
+ */
+int pregPcre2Exec( const pcre *re , const pcre_extra *extra ,
+                   const char *subject , int length , int start_offset ,
+                   int options , int *ovector , int ovecsize )
+{
+    struct preg_pcre2_thread_s *t ;
+    pcre2_match_data *md ;
+    const pcre2_code *code = re ;
+    PCRE2_SIZE *ov ;
+    uint32_t pairs ;
+    int rc ;
+    int i ;
+
+    if( !re || !subject || length < 0 )
+        return PCRE_ERROR_NULL ;
+
+    t = pregPcre2Thread() ;
+    if( !t )
+        return PCRE_ERROR_NOMEMORY ;
+
+    pairs = ovecsize > 0 ? (uint32_t)( ovecsize / 3 ) : 0 ;
+    md = pregPcre2MatchData( t , pairs ) ;
+    if( !md )
+        return PCRE_ERROR_NOMEMORY ;
+
+    pcre2_set_match_limit( t->mcontext ,
+            ( extra && ( extra->flags & PCRE_EXTRA_MATCH_LIMIT ) ) ?
+            (uint32_t)extra->match_limit : t->default_match_limit ) ;
+    pcre2_set_depth_limit( t->mcontext ,
+            ( extra && ( extra->flags & PCRE_EXTRA_MATCH_LIMIT_RECURSION ) ) ?
+            (uint32_t)extra->match_limit_recursion : t->default_depth_limit ) ;
+
+    // The JIT can't do anchoring at match time - use the interpreter
+    if( extra && ( extra->flags & PCRE_EXTRA_EXECUTABLE_JIT ) &&
+        extra->study_data && !( options & PCRE2_ANCHORED ) )
+    {
+        code = (const pcre2_code *)extra->study_data ;
+        pcre2_jit_stack_assign( t->mcontext ,
+                                (pcre2_jit_callback)extra->jit_callback ,
+                                extra->jit_callback_data ) ;
+    }
+
+    rc = pcre2_match( code , (PCRE2_SPTR)subject , (PCRE2_SIZE)length ,
+                      (PCRE2_SIZE)start_offset , (uint32_t)options ,
+                      md , t->mcontext ) ;
+    if( rc < 0 )
+        return pregPcre2Error( rc ) ;
+
+    // As with pcre_exec, 0 means that ovector was too small
+    if( (uint32_t)rc > pairs )
+        rc = 0 ;
+
+    ov = pcre2_get_ovector_pointer( md ) ;
+    for( i = 0 ; i < (int)pairs * 2 && i < (rc ? rc : (int)pairs) * 2 ; i++ )
+        ovector[ i ] = ( ov[ i ] == PCRE2_UNSET ) ? -1 : (int)ov[ i ] ;
+
+    return rc ;
+}
+
+/**
+ * @fn int pregPcre2DfaExec( const pcre *re , const pcre_extra *extra ,
+ *                           const char *subject , int length ,
+ *                           int start_offset , int options ,
+ *                           int *ovector , int ovecsize ,
+ *                           int *workspace , int wscount )
+ *
+ * @brief pcre_dfa_exec - run a DFA match with the thread's match data
+ *
+ * @details Returns the same things as pcre_dfa_exec: the number of 
+ * matches found at the first position that matches, longest first, or 0
+ * when ovector is too small for all of them.  The JIT is not used.
+ */
+int pregPcre2DfaExec( const pcre *re , const pcre_extra *extra ,
+                      const char *subject , int length , int start_offset ,
+                      int options , int *ovector , int ovecsize ,
+                      int *workspace , int wscount )
+{
+    struct preg_pcre2_thread_s *t ;
+    pcre2_match_data *md ;
+    PCRE2_SIZE *ov ;
+    uint32_t pairs ;
+    int rc ;
+    int i ;
+
+    if( !re || !subject || length < 0 || !workspace )
+        return PCRE_ERROR_NULL ;
+
+    t = pregPcre2Thread() ;
+    if( !t )
+        return PCRE_ERROR_NOMEMORY ;
+
+    pairs = ovecsize > 0 ? (uint32_t)( ovecsize / 2 ) : 0 ;
+    md = pregPcre2MatchData( t , pairs ) ;
+    if( !md )
+        return PCRE_ERROR_NOMEMORY ;
+
+    pcre2_set_match_limit( t->mcontext ,
+            ( extra && ( extra->flags & PCRE_EXTRA_MATCH_LIMIT ) ) ?
+            (uint32_t)extra->match_limit : t->default_match_limit ) ;
+    pcre2_set_depth_limit( t->mcontext ,
+            ( extra && ( extra->flags & PCRE_EXTRA_MATCH_LIMIT_RECURSION ) ) ?
+            (uint32_t)extra->match_limit_recursion : t->default_depth_limit ) ;
+
+    rc = pcre2_dfa_match( re , (PCRE2_SPTR)subject , (PCRE2_SIZE)length ,
+                          (PCRE2_SIZE)start_offset , (uint32_t)options ,
+                          md , t->mcontext , workspace , (PCRE2_SIZE)wscount ) ;
+    if( rc < 0 )
+        return pregPcre2Error( rc ) ;
+
+    if( (uint32_t)rc > pairs )
+        rc = 0 ;
+
+    ov = pcre2_get_ovector_pointer( md ) ;
+    for( i = 0 ; i < (int)pairs * 2 && i < (rc ? rc : (int)pairs) * 2 ; i++ )
+        ovector[ i ] = ( ov[ i ] == PCRE2_UNSET ) ? -1 : (int)ov[ i ] ;
+
+    return rc ;
+}
+
+/**
+ * @fn int pregPcre2Fullinfo( const pcre *re , const pcre_extra *extra ,
+ *                            int what , void *where )
+ *
+ * @brief pcre_fullinfo - only handles int sized results (such as
+ * PCRE_INFO_CAPTURECOUNT), and PCRE_INFO_OPTIONS, which is an unsigned 
+ * long as in libpcre.  PCRE_INFO_LASTLITERAL is -1 if PCRE2 didn't
+ * record a last code unit.  PCRE_INFO_FIRSTTABLE is a pointer, which PCRE2
+ * works out when the pattern is compiled rather than when it is studied.
+ */
+int pregPcre2Fullinfo( const pcre *re , const pcre_extra *extra ,
+                       int what , void *where )
+{
+    uint32_t value = 0 ;
+    int rc ;
+
+    if( what == PCRE_INFO_FIRSTTABLE )
+        return pcre2_pattern_info( re , PCRE2_INFO_FIRSTBITMAP , where ) ;
+
+    if( what == PCRE_INFO_OPTIONS )
+    {
+        rc = pcre2_pattern_info( re , PCRE2_INFO_ALLOPTIONS , &value ) ;
+        if( rc == 0 )
+            *(unsigned long *)where = value ;
+        return rc ;
+    }
+
+    if( what == PCRE_INFO_LASTLITERAL )
+    {
+        rc = pcre2_pattern_info( re , PCRE2_INFO_LASTCODETYPE , &value ) ;
+        if( rc == 0 && value == 0 )
+        {
+            *(int *)where = -1 ;
+            return 0 ;
+        }
+    }
+
+    rc = pcre2_pattern_info( re , (uint32_t)what , &value ) ;
+    if( rc == 0 )
+        *(int *)where = (int)value ;
+
+    return rc ;
+}
+
+/**
+ * @fn int pregPcre2GetStringNumber( const pcre *re , const char *name )
+ *
+ * @brief pcre_get_stringnumber - number of a named capture group
+ */
+int pregPcre2GetStringNumber( const pcre *re , const char *name )
+{
+    int rc ;
+
+    rc = pcre2_substring_number_from_name( re , (PCRE2_SPTR)name ) ;
+
+    return rc < 0 ? PCRE_ERROR_NOSUBSTRING : rc ;
+}
+
+/**
+ * @fn int pregPcre2GetSubstring( const char *subject , int *ovector ,
+ *                                int stringcount , int stringnumber ,
+ *                                const char **stringptr )
+ *
+ * @brief pcre_get_substring - copy a captured substring
+ *
+ * @return the length of the substring, which is put in a NULL terminated
+ * string that is allocated with malloc.
+ */
+int pregPcre2GetSubstring( const char *subject , int *ovector ,
+                           int stringcount , int stringnumber ,
+                           const char **stringptr )
+{
+    char *s ;
+    int l ;
+
+    if( stringnumber < 0 || stringnumber >= stringcount )
+        return PCRE_ERROR_NOSUBSTRING ;
+
+    l = ovector[ stringnumber * 2 + 1 ] - ovector[ stringnumber * 2 ] ;
+    if( ovector[ stringnumber * 2 ] < 0 )
+        l = 0 ;
+
+    s = malloc( l + 1 ) ;
+    if( !s )
+        return PCRE_ERROR_NOMEMORY ;
+
+    if( l )
+        memcpy( s , subject + ovector[ stringnumber * 2 ] , l ) ;
+    s[ l ] = '\0' ;
+
+    *stringptr = s ;
+    return l ;
+}
+
+/**
+ * @fn pcre_jit_stack *pregPcre2JitStackAlloc( int startsize , int maxsize )
+ *
+ * @brief pcre_jit_stack_alloc
+ */
+pcre_jit_stack *pregPcre2JitStackAlloc( int startsize , int maxsize )
+{
+    return pcre2_jit_stack_create( (PCRE2_SIZE)startsize ,
+                                   (PCRE2_SIZE)maxsize , NULL ) ;
+}
+
+/**
+ * @fn void pregPcre2AssignJitStack( pcre_extra *extra ,
+ *                                   pcre_jit_callback callback , void *data )
+ *
+ * @brief pcre_assign_jit_stack - the callback is given to the thread's
+ * match context for each match that uses the JIT.
+ */
+void pregPcre2AssignJitStack( pcre_extra *extra , pcre_jit_callback callback ,
+                              void *data )
+{
+    extra->jit_callback = callback ;
+    extra->jit_callback_data = data ;
+}
+
+#ifdef __GNUC__
+/*
+ * Don't leave the key's destructor behind when mysqld unloads the library.
+ * The objects of the threads that are still running are leaked.
+ */
+static void pregPcre2Unload( void ) __attribute__((destructor)) ;
+static void pregPcre2Unload( void )
+{
+    if( preg_pcre2_key_ok )
+        pthread_key_delete( preg_pcre2_key ) ;
+}
+#endif
+
+#endif /* PREG_USE_PCRE2 */
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PREGPCRE2_H
+
+#define PREGPCRE2_H
+
+/** @file preg_pcre2.h
+ *
+ * @brief the parts of the libpcre api that are used by lib_mysqludf_preg,
+ *        implemented on top of libpcre2.
+ *
+ * @details This is used instead of pcre.h when configure is run with
+ * --with-pcre2 (which defines PREG_USE_PCRE2).  Include it with:
+ *
+ * @code
+ * #ifdef PREG_USE_PCRE2
+ * #include "preg_pcre2.h"
+ * #else
+ * #include <pcre.h>
+ * #endif
+ * @endcode
+ *
+ * The functions are renamed with #define's so that they don't clash with
+ * a libpcre that might be loaded into mysqld as well.
+ */
+
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+
+typedef pcre2_code pcre ;
+typedef pcre2_jit_stack pcre_jit_stack ;
+typedef pcre_jit_stack *(*pcre_jit_callback)( void * ) ;
+
+/*
+ * Same fields as the libpcre pcre_extra, plus the JIT stack callback,
+ * which PCRE2 keeps in the match context instead.
+ */
+typedef struct pcre_extra {
+    unsigned long flags ;               /* PCRE_EXTRA_* bits */
+    void *study_data ;                  /* JIT compiled copy of the pattern */
+    unsigned long match_limit ;
+    void *callout_data ;                /* not used */
+    const unsigned char *tables ;       /* not used */
+    unsigned long match_limit_recursion ; /* PCRE2 depth limit */
+    unsigned char **mark ;              /* not used */
+    void *executable_jit ;              /* not used */
+    pcre_jit_callback jit_callback ;    /* from pcre_assign_jit_stack */
+    void *jit_callback_data ;
+} pcre_extra ;
+
+/* pcre_extra flags */
+#define PCRE_EXTRA_STUDY_DATA             0x0001
+#define PCRE_EXTRA_MATCH_LIMIT            0x0002
+#define PCRE_EXTRA_MATCH_LIMIT_RECURSION  0x0010
+#define PCRE_EXTRA_EXECUTABLE_JIT         0x0040
+
+/* compile & exec options */
+#define PCRE_CASELESS           PCRE2_CASELESS
+#define PCRE_MULTILINE          PCRE2_MULTILINE
+#define PCRE_DOTALL             PCRE2_DOTALL
+#define PCRE_EXTENDED           PCRE2_EXTENDED
+#define PCRE_ANCHORED           PCRE2_ANCHORED
+#define PCRE_DOLLAR_ENDONLY     PCRE2_DOLLAR_ENDONLY
+#define PCRE_UNGREEDY           PCRE2_UNGREEDY
+#define PCRE_UTF8               PCRE2_UTF
+#define PCRE_NOTEMPTY           PCRE2_NOTEMPTY
+// PCRE2 always treats unknown escapes as errors, which is what X did
+#define PCRE_EXTRA              0
+
+#define PCRE_STUDY_JIT_COMPILE  0x0001
+
+#define PCRE_INFO_OPTIONS       PCRE2_INFO_ALLOPTIONS
+#define PCRE_INFO_CAPTURECOUNT  PCRE2_INFO_CAPTURECOUNT
+#define PCRE_INFO_BACKREFMAX    PCRE2_INFO_BACKREFMAX
+#define PCRE_INFO_LASTLITERAL   PCRE2_INFO_LASTCODEUNIT
+#define PCRE_INFO_FIRSTTABLE    PCRE2_INFO_FIRSTBITMAP
+
+/* pcre_exec errors - PCRE2 errors are translated to these */
+#define PCRE_ERROR_NOMATCH          (-1)
+#define PCRE_ERROR_NULL             (-2)
+#define PCRE_ERROR_BADOPTION        (-3)
+#define PCRE_ERROR_BADMAGIC         (-4)
+#define PCRE_ERROR_UNKNOWN_OPCODE   (-5)
+#define PCRE_ERROR_NOMEMORY         (-6)
+#define PCRE_ERROR_NOSUBSTRING      (-7)
+#define PCRE_ERROR_MATCHLIMIT       (-8)
+#define PCRE_ERROR_CALLOUT          (-9)
+#define PCRE_ERROR_BADUTF8         (-10)
+#define PCRE_ERROR_BADUTF8_OFFSET  (-11)
+#define PCRE_ERROR_PARTIAL         (-12)
+#define PCRE_ERROR_INTERNAL        (-14)
+#define PCRE_ERROR_DFA_UITEM       (-16)
+#define PCRE_ERROR_DFA_UCOND       (-17)
+#define PCRE_ERROR_DFA_WSSIZE      (-19)
+#define PCRE_ERROR_DFA_RECURSE     (-20)
+#define PCRE_ERROR_RECURSIONLIMIT  (-21)
+#define PCRE_ERROR_BADOFFSET       (-24)
+#define PCRE_ERROR_RECURSELOOP     (-26)
+#define PCRE_ERROR_JIT_STACKLIMIT  (-27)
+
+#define pcre_compile            pregPcre2Compile
+#define pcre_study              pregPcre2Study
+#define pcre_exec               pregPcre2Exec
+#define pcre_dfa_exec           pregPcre2DfaExec
+#define pcre_fullinfo           pregPcre2Fullinfo
+#define pcre_get_stringnumber   pregPcre2GetStringNumber
+#define pcre_get_substring      pregPcre2GetSubstring
+#define pcre_free(p)            pcre2_code_free( (pcre2_code *)(p) )
+#define pcre_free_study         pregPcre2FreeStudy
+#define pcre_jit_stack_alloc    pregPcre2JitStackAlloc
+#define pcre_jit_stack_free     pcre2_jit_stack_free
+#define pcre_assign_jit_stack   pregPcre2AssignJitStack
+
+pcre *pregPcre2Compile( const char *pattern , int options ,
+                        const char **error , int *erroffset ,
+                        const unsigned char *tables ) ;
+pcre_extra *pregPcre2Study( const pcre *re , int options ,
+                            const char **error ) ;
+int pregPcre2Exec( const pcre *re , const pcre_extra *extra ,
+                   const char *subject , int length , int start_offset ,
+                   int options , int *ovector , int ovecsize ) ;
+int pregPcre2DfaExec( const pcre *re , const pcre_extra *extra ,
+                      const char *subject , int length , int start_offset ,
+                      int options , int *ovector , int ovecsize ,
+                      int *workspace , int wscount ) ;
+int pregPcre2Fullinfo( const pcre *re , const pcre_extra *extra ,
+                       int what , void *where ) ;
+int pregPcre2GetStringNumber( const pcre *re , const char *name ) ;
+int pregPcre2GetSubstring( const char *subject , int *ovector ,
+                           int stringcount , int stringnumber ,
+                           const char **stringptr ) ;
+void pregPcre2FreeStudy( pcre_extra *extra ) ;
+pcre_jit_stack *pregPcre2JitStackAlloc( int startsize , int maxsize ) ;
+void pregPcre2AssignJitStack( pcre_extra *extra , pcre_jit_callback callback ,
+                              void *data ) ;
+
+#endif
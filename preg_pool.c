@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/** @file preg_pool.c
+ *
+ * @brief Per-thread pools of the buffers that strings are returned in.
+ *
+ * @details Strings are built in mysql's result buffer when they fit, and
+ * are moved to a buffer from the pool when they don't (see preg_buffer).
+ * Buffers are given back to the pool of the thread that is running when
+ * they are no longer needed, so the next call in the same connection
+ * finds one without malloc'ing.  Each thread keeps at most 
+ * PREG_POOL_THREAD_BUFFERS buffers, and all of the pools together keep 
+ * at most PREG_POOL_MAX_BYTES.  Buffers that don't fit are freed.
+ *
+ * The pools of threads that exit are freed by the thread key's 
+ * destructor.  All of the pools are also kept on a list, so that they can
+ * be freed when the library is unloaded, since the destructor can't be 
+ * run after that.
+ *
+ * @notes This file does not depend on mysql.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "preg_pool.h"
+
+typedef struct preg_pool_s {
+    int count ;                 /* number of buffers in the pool */
+    char *data[ PREG_POOL_THREAD_BUFFERS ] ;
+    unsigned long size[ PREG_POOL_THREAD_BUFFERS ] ;
+    struct preg_pool_s *prev ;  /* list of all pools */
+    struct preg_pool_s *next ;
+} preg_pool ;
+
+static pthread_once_t preg_pool_once = PTHREAD_ONCE_INIT ;
+static pthread_key_t preg_pool_key ;
+static int preg_pool_key_ok = 0 ;
+static pthread_mutex_t preg_pool_lock = PTHREAD_MUTEX_INITIALIZER ;
+static preg_pool *preg_pool_list = NULL ;
+static preg_pool_stats preg_pool_counters ;
+
+
+/**
+ * @fn static void pregPoolDestroy( void *p )
+ *
+ * @brief free a thread's pool and the buffers in it
+ */
+static void pregPoolDestroy( void *p )
+{
+    preg_pool *pool = (preg_pool *)p ;
+    int i ;
+
+    pthread_mutex_lock( &preg_pool_lock ) ;
+    if( pool->prev )
+        pool->prev->next = pool->next ;
+    else
+        preg_pool_list = pool->next ;
+    if( pool->next )
+        pool->next->prev = pool->prev ;
+    pthread_mutex_unlock( &preg_pool_lock ) ;
+
+    for( i = 0 ; i < pool->count ; i++ )
+    {
+        __sync_fetch_and_sub( &preg_pool_counters.pooled_bytes , 
+                              pool->size[ i ] ) ;
+        free( pool->data[ i ] ) ;
+    }
+    free( pool ) ;
+}
+
+static void pregPoolCreateKey( void )
+{
+    preg_pool_key_ok = !pthread_key_create( &preg_pool_key , pregPoolDestroy );
+}
+
+/**
+ * @fn static void pregPoolUnload( void )
+ *
+ * @brief free all of the pools when the library is unloaded
+ */
+static void __attribute__((destructor)) pregPoolUnload( void )
+{
+    if( !preg_pool_key_ok )
+        return ;
+
+    pthread_key_delete( preg_pool_key ) ;
+    preg_pool_key_ok = 0 ;
+    while( preg_pool_list )
+        pregPoolDestroy( preg_pool_list ) ;
+}
+
+/**
+ * @fn static preg_pool *pregPoolThread( int create )
+ *
+ * @brief find the pool of this thread
+ *
+ * @param create - create the pool if the thread doesn't have one yet
+ *
+ * @return the pool - NULL if there is none
+ */
+static preg_pool *pregPoolThread( int create )
+{
+    preg_pool *pool ;
+
+    pthread_once( &preg_pool_once , pregPoolCreateKey ) ;
+    if( !preg_pool_key_ok )
+        return NULL ;
+
+    pool = (preg_pool *)pthread_getspecific( preg_pool_key ) ;
+    if( pool || !create )
+        return pool ;
+
+    pool = calloc( 1 , sizeof( preg_pool ) ) ;
+    if( !pool )
+        return NULL ;
+    if( pthread_setspecific( preg_pool_key , pool ) )
+    {
+        free( pool ) ;
+        return NULL ;
+    }
+
+    pthread_mutex_lock( &preg_pool_lock ) ;
+    pool->next = preg_pool_list ;
+    if( preg_pool_list )
+        preg_pool_list->prev = pool ;
+    preg_pool_list = pool ;
+    pthread_mutex_unlock( &preg_pool_lock ) ;
+
+    return pool ;
+}
+
+
+/*
+ * Public Functions:
+ */
+
+/**
+ * @fn char *pregPoolGet( unsigned long size , unsigned long *got )
+ *
+ * @brief get a buffer from this thread's pool, or malloc one
+ *
+ * @param size - the least number of bytes that are needed
+ * @param got - put the size of the buffer here
+ *
+ * @return the buffer - give it back with pregPoolPut
+ * @return NULL - if out of memory
+ *
+ * @details The smallest buffer in the pool that is big enough is used.
+ */
+char *pregPoolGet( unsigned long size , unsigned long *got )
+{
+    preg_pool *pool ;
+    char *data ;
+    int i , best = -1 ;
+
+    __sync_fetch_and_add( &preg_pool_counters.gets , 1 ) ;
+
+    pool = pregPoolThread( 0 ) ;
+    if( pool )
+    {
+        for( i = 0 ; i < pool->count ; i++ )
+        {
+            if( pool->size[ i ] >= size && 
+                ( best < 0 || pool->size[ i ] < pool->size[ best ] ) )
+                best = i ;
+        }
+    }
+
+    if( best >= 0 )
+    {
+        data = pool->data[ best ] ;
+        *got = pool->size[ best ] ;
+        pool->count-- ;
+        pool->data[ best ] = pool->data[ pool->count ] ;
+        pool->size[ best ] = pool->size[ pool->count ] ;
+        __sync_fetch_and_add( &preg_pool_counters.hits , 1 ) ;
+        __sync_fetch_and_sub( &preg_pool_counters.pooled_bytes , *got ) ;
+        return data ;
+    }
+
+    if( size < PREG_POOL_MIN_SIZE )
+        size = PREG_POOL_MIN_SIZE ;
+    data = malloc( size ) ;
+    *got = data ? size : 0 ;
+
+    return data ;
+}
+
+/**
+ * @fn void pregPoolPut( char *data , unsigned long size )
+ *
+ * @brief give a buffer from pregPoolGet back to this thread's pool
+ *
+ * @param data - the buffer.  May be NULL.
+ * @param size - its size
+ *
+ * @details The buffer is freed if the pool is full or if keeping it 
+ * would put more than PREG_POOL_MAX_BYTES in the pools.
+ */
+void pregPoolPut( char *data , unsigned long size )
+{
+    preg_pool *pool ;
+
+    if( !data )
+        return ;
+
+    __sync_fetch_and_add( &preg_pool_counters.puts , 1 ) ;
+
+    pool = pregPoolThread( 1 ) ;
+    if( pool && pool->count < PREG_POOL_THREAD_BUFFERS )
+    {
+        if( __sync_add_and_fetch( &preg_pool_counters.pooled_bytes , size )
+            <= PREG_POOL_MAX_BYTES )
+        {
+            pool->data[ pool->count ] = data ;
+            pool->size[ pool->count ] = size ;
+            pool->count++ ;
+            return ;
+        }
+        __sync_fetch_and_sub( &preg_pool_counters.pooled_bytes , size ) ;
+    }
+
+    __sync_fetch_and_add( &preg_pool_counters.drops , 1 ) ;
+    free( data ) ;
+}
+
+/**
+ * @fn void pregPoolStats( preg_pool_stats *stats )
+ *
+ * @brief get the counters for the pools of all threads
+ */
+void pregPoolStats( preg_pool_stats *stats )
+{
+    stats->gets = __sync_fetch_and_add( &preg_pool_counters.gets , 0 ) ;
+    stats->hits = __sync_fetch_and_add( &preg_pool_counters.hits , 0 ) ;
+    stats->puts = __sync_fetch_and_add( &preg_pool_counters.puts , 0 ) ;
+    stats->drops = __sync_fetch_and_add( &preg_pool_counters.drops , 0 ) ;
+    stats->pooled_bytes = 
+        __sync_fetch_and_add( &preg_pool_counters.pooled_bytes , 0 ) ;
+}
+
+/**
+ * @fn void pregBufferInit( preg_buffer *buffer , char *data , 
+ *                          unsigned long size )
+ *
+ * @brief start a buffer out in memory that doesn't belong to the pool
+ *
+ * @param buffer - the buffer
+ * @param data - memory to use until more is needed (mysql's result 
+ * buffer).  May be NULL.
+ * @param size - bytes available at data
+ */
+void pregBufferInit( preg_buffer *buffer , char *data , unsigned long size )
+{
+    buffer->data = data ;
+    buffer->size = data ? size : 0 ;
+    buffer->pooled = 0 ;
+}
+
+/**
+ * @fn int pregBufferGrow( preg_buffer *buffer , unsigned long size , 
+ *                         unsigned long used )
+ *
+ * @brief make sure that a buffer has at least size bytes
+ *
+ * @param buffer - the buffer
+ * @param size - bytes needed
+ * @param used - bytes at the start of the buffer to keep
+ *
+ * @return 1 - on success
+ * @return 0 - if out of memory.  The buffer is left as it was.
+ *
+ * @details Buffers grow to at least twice their size, so that a string
+ * that is built a piece at a time isn't copied for every piece.  A buffer
+ * that is still in memory that doesn't belong to the pool is moved to a
+ * buffer from the pool.
+ */
+int pregBufferGrow( preg_buffer *buffer , unsigned long size , 
+                    unsigned long used )
+{
+    char *data ;
+    unsigned long got ;
+
+    if( size <= buffer->size )
+        return 1 ;
+
+    if( size < 2 * buffer->size )
+        size = 2 * buffer->size ;
+
+    if( buffer->pooled )
+    {
+        data = realloc( buffer->data , size ) ;
+        if( !data )
+            return 0 ;
+        got = size ;
+    }
+    else
+    {
+        data = pregPoolGet( size , &got ) ;
+        if( !data )
+            return 0 ;
+        if( used )
+            memcpy( data , buffer->data , used ) ;
+    }
+
+    buffer->data = data ;
+    buffer->size = got ;
+    buffer->pooled = 1 ;
+    return 1 ;
+}
+
+/**
+ * @fn void pregBufferRelease( preg_buffer *buffer )
+ *
+ * @brief give a buffer's memory back to the pool if it came from there
+ */
+void pregBufferRelease( preg_buffer *buffer )
+{
+    if( buffer->pooled )
+        pregPoolPut( buffer->data , buffer->size ) ;
+    pregBufferInit( buffer , NULL , 0 ) ;
+}
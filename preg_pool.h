@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PREGPOOL_H
+
+#define PREGPOOL_H
+
+/** @file preg_pool.h
+ *
+ * @brief headers for the per-thread pools of buffers that strings are
+ *        returned in
+ */
+
+// Most buffers that are kept by the pools of all threads together 
+#define PREG_POOL_MAX_BYTES ( 64 * 1024 * 1024 )
+
+// Most buffers that are kept by the pool of each thread
+#define PREG_POOL_THREAD_BUFFERS 4
+
+// Buffers from the pool are at least this big
+#define PREG_POOL_MIN_SIZE 4096
+
+/*
+ * A buffer that a string is built in.  It starts out as memory that 
+ * belongs to someone else (mysql's result buffer) and is moved to a buffer
+ * from the pool when it has to grow.
+ */
+typedef struct preg_buffer_s {
+    char *data ;                /* where the string is */
+    unsigned long size ;        /* bytes available at data */
+    int pooled ;                /* data is from pregPoolGet */
+} preg_buffer ;
+
+/*
+ * Counters for the pools of all threads.
+ */
+typedef struct preg_pool_stats_s {
+    unsigned long gets ;        /* buffers that were asked for */
+    unsigned long hits ;        /* ... and were found in a pool */
+    unsigned long puts ;        /* buffers that were given back */
+    unsigned long drops ;       /* ... and were freed, since the pool or
+                                   PREG_POOL_MAX_BYTES was full */
+    unsigned long pooled_bytes ;/* bytes in the pools now */
+} preg_pool_stats ;
+
+char *pregPoolGet( unsigned long size , unsigned long *got ) ;
+void pregPoolPut( char *data , unsigned long size ) ;
+void pregPoolStats( preg_pool_stats *stats ) ;
+
+void pregBufferInit( preg_buffer *buffer , char *data , unsigned long size ) ;
+int pregBufferGrow( preg_buffer *buffer , unsigned long size , 
+                    unsigned long used ) ;
+void pregBufferRelease( preg_buffer *buffer ) ;
+
+#endif
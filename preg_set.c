@@ -0,0 +1,892 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/** @file preg_set.c
+ *
+ * @brief Match a subject against a set of patterns at once, and find the
+ *        first one that matches.  This is PREG_CLASSIFY, and 
+ *        PREG_SET_MATCH for sets from PREG_COMPILE_SET.
+ *
+ * @details Most patterns have a string that every match contains (the 
+ * pattern itself if it is a literal, else preg_cache_entry.required).  
+ * These strings are put in one Aho-Corasick automaton, the prefilter, 
+ * which finds all of them that are in the subject in a single pass.
+ * Only the patterns whose string was found, and the patterns that don't
+ * have one, are then run, in order, until one matches.  They are run the
+ * same way as PREG_RLIKE runs a pattern (vectorscan, the lazy DFA, then 
+ * libpcre), since only match/no-match is needed.
+ *
+ * The prefilter ignores case: the strings are put in it in lower case, 
+ * and upper case letters have the same column of the table as lower case
+ * ones.  A string that does have to match with case may then be "found" 
+ * when it isn't there, but that only means that the pattern is run.
+ * The subject isn't scanned until the first pattern that has a string is
+ * reached, so a set whose first patterns match often doesn't pay for it.
+ *
+ * A set can also be kept in a BLOB (PREG_COMPILE_SET) and loaded back from
+ * it (PREG_SET_MATCH).  The BLOB has the patterns and labels, not the
+ * compiled patterns: those depend on the version of libpcre and on the 
+ * machine, and the BLOB may be used by another server.  The patterns are
+ * compiled again when it is loaded, through the pattern cache.  The BLOB
+ * is:
+ *
+ * @code
+ * "PREGSET" version(1 byte) count(4) hash(4)
+ * then for each pattern: length(4) pattern length(4) label
+ * @endcode
+ *
+ * The numbers are little endian.  The hash is of everything after the 
+ * header, and a label length of 0xFFFFFFFF is a NULL label.
+ *
+ * @notes This file does not depend on mysql.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "preg_set.h"
+#include "preg_utils.h"
+#include "from_php.h"
+
+// Most entries in the table of the prefilter (states * columns).  Sets 
+// that need more are matched without the prefilter.
+#define PREG_SET_MAX_TABLE ( 4 * 1024 * 1024 )
+
+// Columns of a row of the table after the ones for the bytes
+#define SET_OUT( ncolumns ) ( ncolumns )
+#define SET_SUFFIX( ncolumns ) ( ( ncolumns ) + 1 )
+#define SET_STRIDE( ncolumns ) ( ( ncolumns ) + 2 )
+
+// The start of a BLOB from pregSetBlobFinish
+#define SET_BLOB_MAGIC "PREGSET"
+#define SET_BLOB_MAGIC_LEN 7
+#define SET_BLOB_VERSION 1
+#define SET_BLOB_HEADER 16      /* magic, version, count & hash */
+
+// Label length of a NULL label
+#define SET_BLOB_NULL_LABEL 0xFFFFFFFFUL
+
+// Longest BLOB (a LONGBLOB)
+#define SET_BLOB_MAX 0xFFFFFFFFUL
+
+/*
+ * A pattern of the set
+ */
+typedef struct preg_set_pattern_s {
+    preg_cache_entry *pce ;     /* the compiled pattern - NULL if it was 
+                                   NULL, and then it never matches */
+    pcre_extra *extra ;         /* study data - NULL if not studied.  
+                                   Belongs to pce if it is pce->extra */
+    const char *key ;           /* a string every match contains (belongs 
+                                   to pce) - NULL if there isn't one */
+    int key_len ;               /* length of key */
+    int next ;                  /* next pattern whose key ends at the same
+                                   state of the prefilter, -1 if none */
+} preg_set_pattern ;
+
+struct preg_set_s {
+    preg_set_pattern *patterns ;/* in order */
+    int npatterns ;
+    int nkeys ;                 /* number of patterns with a key */
+    unsigned char columns[ 256 ] ;/* column of the table for each byte - 0
+                                   for the bytes that no key uses */
+    int ncolumns ;
+    int *table ;                /* a row of SET_STRIDE ints for each state:
+                                   the row of the next state for each 
+                                   column, then (SET_OUT) the first pattern
+                                   whose key ends there, -1 if none, and
+                                   (SET_SUFFIX) the row of the longest 
+                                   suffix of the state where a key ends, 0
+                                   if none.  NULL if there is no prefilter */
+    int nstates ;
+    unsigned char first[ 256 ] ;/* bytes that a key starts with */
+    unsigned char *found ;      /* for each pattern, was its key found in
+                                   the subject? */
+    int *ovector ;              /* for all of the patterns */
+    int ovecsize ;
+    char *blob ;                /* copy of the BLOB the set was loaded 
+                                   from - NULL if it was not loaded */
+    unsigned long blob_len ;    /* length of blob */
+    unsigned long blob_hash ;   /* hash from the header of blob */
+    const char **labels ;       /* label of each pattern (in blob) */
+    int *label_lens ;
+} ;
+
+
+/*
+ * Private Functions:
+ */
+
+/**
+ * @fn static int setLower( int c )
+ *
+ * @brief the lower case of an ASCII letter, else c
+ */
+static int setLower( int c )
+{
+    return ( c >= 'A' && c <= 'Z' ) ? c + 'a' - 'A' : c ;
+}
+
+/**
+ * @fn static void setPut32( unsigned char *p , unsigned long n )
+ *
+ * @brief write a 4 byte little endian number
+ */
+static void setPut32( unsigned char *p , unsigned long n )
+{
+    p[ 0 ] = n & 0xff ;
+    p[ 1 ] = ( n >> 8 ) & 0xff ;
+    p[ 2 ] = ( n >> 16 ) & 0xff ;
+    p[ 3 ] = ( n >> 24 ) & 0xff ;
+}
+
+/**
+ * @fn static unsigned long setGet32( const unsigned char *p )
+ *
+ * @brief read a 4 byte little endian number
+ */
+static unsigned long setGet32( const unsigned char *p )
+{
+    return (unsigned long)p[ 0 ] | ( (unsigned long)p[ 1 ] << 8 ) |
+        ( (unsigned long)p[ 2 ] << 16 ) | ( (unsigned long)p[ 3 ] << 24 ) ;
+}
+
+/**
+ * @fn static unsigned long setBlobHash( const char *s , unsigned long len )
+ *
+ * @brief hash the patterns & labels of a BLOB (32 bits)
+ */
+static unsigned long setBlobHash( const char *s , unsigned long len )
+{
+    unsigned long hash = 5381 ;
+    const unsigned char *p = (const unsigned char *)s ;
+
+    while( len-- > 0 )
+        hash = ( ( hash << 5 ) + hash + *p++ ) & 0xFFFFFFFFUL ;
+
+    return hash ;
+}
+
+/**
+ * @fn static int setBuild( preg_set *set )
+ *
+ * @brief build the prefilter for the keys of set->patterns
+ *
+ * @return 1 - on success, or if the prefilter would be too big (then
+ * set->table is NULL)
+ * @return 0 - if out of memory
+ */
+static int setBuild( preg_set *set )
+{
+    preg_set_pattern *p ;
+    int *fail , *queue ;
+    int *table ;
+    int maxstates , stride , head , tail ;
+    int i , j , s , t , f , col , ncol ;
+
+    // A column for each byte that a key uses, with upper case letters in
+    // the column of their lower case
+    set->ncolumns = 1 ;
+    maxstates = 1 ;
+    for( i = 0 ; i < set->npatterns ; i++ )
+    {
+        p = &set->patterns[ i ] ;
+        for( j = 0 ; j < p->key_len ; j++ )
+        {
+            col = setLower( (unsigned char)p->key[ j ] ) ;
+            if( !set->columns[ col ] )
+                set->columns[ col ] = set->ncolumns++ ;
+        }
+        if( p->key_len > PREG_SET_MAX_TABLE - maxstates )
+            maxstates = PREG_SET_MAX_TABLE ;
+        else
+            maxstates += p->key_len ;
+    }
+    for( col = 'A' ; col <= 'Z' ; col++ )
+        set->columns[ col ] = set->columns[ setLower( col ) ] ;
+
+    ncol = set->ncolumns ;
+    stride = SET_STRIDE( ncol ) ;
+    if( !set->nkeys || maxstates > PREG_SET_MAX_TABLE / stride )
+        return 1 ;
+
+    set->table = calloc( (size_t)maxstates * stride , sizeof( int ) ) ;
+    fail = calloc( maxstates , sizeof( int ) ) ;
+    queue = malloc( maxstates * sizeof( int ) ) ;
+    if( !set->table || !fail || !queue )
+    {
+        free( fail ) ;
+        free( queue ) ;
+        return 0 ;
+    }
+    table = set->table ;
+
+    // The trie, with state numbers in the columns until the end.  0 is the
+    // first state, so 0 means no edge (yet).
+    set->nstates = 1 ;
+    table[ SET_OUT( ncol ) ] = -1 ;
+    for( i = 0 ; i < set->npatterns ; i++ )
+    {
+        p = &set->patterns[ i ] ;
+        if( !p->key )
+            continue ;
+        s = 0 ;
+        for( j = 0 ; j < p->key_len ; j++ )
+        {
+            col = set->columns[ (unsigned char)p->key[ j ] ] ;
+            if( !table[ s * stride + col ] )
+            {
+                t = set->nstates++ ;
+                table[ t * stride + SET_OUT( ncol ) ] = -1 ;
+                table[ s * stride + col ] = t ;
+            }
+            s = table[ s * stride + col ] ;
+        }
+        p->next = table[ s * stride + SET_OUT( ncol ) ] ;
+        table[ s * stride + SET_OUT( ncol ) ] = i ;
+    }
+
+    // Fill in the missing edges and the suffixes from the failure links, a
+    // level at a time, so that the state that a failure link goes to is 
+    // always done
+    head = tail = 0 ;
+    for( col = 0 ; col < ncol ; col++ )
+    {
+        if( table[ col ] )
+            queue[ tail++ ] = table[ col ] ;
+    }
+    while( head < tail )
+    {
+        s = queue[ head++ ] ;
+        f = fail[ s ] ;
+        if( f )
+            table[ s * stride + SET_SUFFIX( ncol ) ] = 
+                table[ f * stride + SET_OUT( ncol ) ] >= 0 ? f :
+                table[ f * stride + SET_SUFFIX( ncol ) ] ;
+        for( col = 0 ; col < ncol ; col++ )
+        {
+            t = table[ s * stride + col ] ;
+            if( t )
+            {
+                fail[ t ] = table[ f * stride + col ] ;
+                queue[ tail++ ] = t ;
+            }
+            else
+                table[ s * stride + col ] = table[ f * stride + col ] ;
+        }
+    }
+    free( fail ) ;
+    free( queue ) ;
+
+    // The bytes that keys start with
+    for( col = 0 ; col < 256 ; col++ )
+    {
+        if( set->columns[ col ] && table[ set->columns[ col ] ] )
+            set->first[ col ] = 1 ;
+    }
+
+    // The edges and suffixes go to the rows of the states from now on
+    for( s = 0 ; s < set->nstates ; s++ )
+    {
+        for( col = 0 ; col < ncol ; col++ )
+            table[ s * stride + col ] *= stride ;
+        table[ s * stride + SET_SUFFIX( ncol ) ] *= stride ;
+    }
+
+    return 1 ;
+}
+
+/**
+ * @fn static void setScan( preg_set *set , const unsigned char *s , 
+ *                          int length )
+ *
+ * @brief run the prefilter over a subject, and set set->found for the
+ * patterns whose key is in it
+ */
+static void setScan( preg_set *set , const unsigned char *s , int length )
+{
+    const int *table = set->table ;
+    int ncol = set->ncolumns ;
+    int left = set->nkeys ;     /* keys not found yet */
+    int i , row , r , k ;
+
+    memset( set->found , 0 , set->npatterns ) ;
+
+    i = row = 0 ;
+    while( i < length )
+    {
+        if( !row )
+        {
+            while( i < length && !set->first[ s[ i ] ] )
+                i++ ;
+            if( i == length )
+                break ;
+        }
+        row = table[ row + set->columns[ s[ i++ ] ] ] ;
+
+        r = table[ row + SET_OUT( ncol ) ] >= 0 ? row : 
+            table[ row + SET_SUFFIX( ncol ) ] ;
+        for( ; r ; r = table[ r + SET_SUFFIX( ncol ) ] )
+        {
+            for( k = table[ r + SET_OUT( ncol ) ] ; k >= 0 ; 
+                 k = set->patterns[ k ].next )
+            {
+                if( !set->found[ k ] )
+                {
+                    set->found[ k ] = 1 ;
+                    if( !--left )
+                        return ;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @fn static int setMatchPattern( preg_set *set , preg_set_pattern *p ,
+ *                                 const char *subject , int length ,
+ *                                 int *workspace , int wscount )
+ *
+ * @brief does a pattern of the set match the subject?
+ *
+ * @return 1 - if it does
+ * @return 0 - if it doesn't, or libpcre gave an error
+ *
+ * @details This goes through the same steps as PREG_RLIKE.
+ */
+static int setMatchPattern( preg_set *set , preg_set_pattern *p ,
+                            const char *subject , int length ,
+                            int *workspace , int wscount )
+{
+    preg_cache_entry *pce = p->pce ;
+    pcre_extra extra ;
+    int rc ;
+
+    // Only match/no-match is needed, so vectorscan can be used when it
+    // was able to compile the pattern.  libpcre is used if it fails.
+    if( pregCacheHs( pce ) && 
+        ( rc = pregHsMatch( pce->hs , subject , length ) ) >= 0 )
+        return rc ;
+
+    // Next best is the DFA, unless it has run out of memory
+    if( pregCacheDfa( pce ) )
+    {
+        rc = pregDfaExec( pce->dfa , subject , length , NULL ) ;
+        if( rc >= 0 || rc == PCRE_ERROR_NOMATCH )
+            return rc > 0 ;
+    }
+
+    pregInitExtra( &extra , p->extra ) ;
+    rc = pregMatch( pce->re , &extra , pce->nfa , pce->literal , 
+                    pregCacheStart( pce ) , 
+                    pce->longest ? workspace : NULL , wscount ,
+                    subject , length , 0 , 0 , set->ovector , set->ovecsize ) ;
+
+    // pcre_exec ran out of stack or gave up backtracking.  Try 
+    // pcre_dfa_exec, which doesn't recurse or backtrack.
+    if( ( rc == PCRE_ERROR_RECURSIONLIMIT || rc == PCRE_ERROR_MATCHLIMIT ) &&
+        !pce->nfa && !pce->longest && workspace )
+    {
+        rc = pregExecLongest( pce->re , &extra , subject , length , 0 , 0 , 
+                              set->ovector , set->ovecsize , 
+                              workspace , wscount ) ;
+    }
+
+    // 0 is a match that didn't fit in the offsets vector
+    return rc >= 0 ;
+}
+
+
+/*
+ * Public Functions:
+ */
+
+/**
+ * @fn preg_set *pregSetCompile( preg_cache_entry **pces , int count , 
+ *                               int jit , char *msg , int msglen )
+ *
+ * @brief make a set of compiled patterns, and build its prefilter
+ *
+ * @param pces - the patterns, in the order they are tried.  The set takes
+ * over the references to them, even on error.  A NULL pattern never 
+ * matches.
+ * @param count - number of patterns
+ * @param jit - 1 to study & JIT compile the patterns (for sets that are 
+ * used for many subjects), 0 to run them as they are
+ * @param msg - put the error here
+ * @param msglen - size of msg
+ *
+ * @return the set, which is freed with pregSetFree
+ * @return NULL - if out of memory (an error is in msg)
+ */
+preg_set *pregSetCompile( preg_cache_entry **pces , int count , int jit ,
+                          char *msg , int msglen )
+{
+    preg_set *set ;
+    preg_set_pattern *p ;
+    preg_cache_entry *pce ;
+    const char *error ;         /* from pcre_study */
+    int i , n ;
+
+    set = calloc( 1 , sizeof( preg_set ) ) ;
+    if( set )
+    {
+        set->patterns = calloc( count ? count : 1 , 
+                                sizeof( preg_set_pattern ) ) ;
+        set->found = calloc( count ? count : 1 , 1 ) ;
+    }
+    if( !set || !set->patterns || !set->found )
+    {
+        for( i = 0 ; i < count ; i++ )
+        {
+            if( pces[ i ] )
+                pregCacheRelease( pces[ i ] ) ;
+        }
+        pregSetFree( set ) ;
+        if( msglen )
+            snprintf( msg , msglen , "Out of memory" ) ;
+        return NULL ;
+    }
+    set->npatterns = count ;
+
+    set->ovecsize = 3 ;
+    for( i = 0 ; i < count ; i++ )
+    {
+        p = &set->patterns[ i ] ;
+        p->pce = pce = pces[ i ] ;
+        p->next = -1 ;
+        if( !pce )
+            continue ;
+
+        if( pce->extra )
+        {   // studied when compiled (S modifier)
+            p->extra = pce->extra ;
+        }
+        else if( jit && !pce->nfa && !pce->literal )
+        {   // L modifier & literal patterns are never run by pcre_exec
+            p->extra = pregStudy( pce->re , 1 , &error ) ;
+        }
+
+        if( pce->literal )
+            p->key = pregLiteralString( pce->literal , &p->key_len ) ;
+        else if( pregCacheRequired( pce ) )
+            p->key = pregLiteralString( pce->required , &p->key_len ) ;
+        if( p->key )
+            set->nkeys++ ;
+
+        n = ( pce->capture_count + 1 ) * 3 ;
+        if( n > set->ovecsize )
+            set->ovecsize = n ;
+    }
+
+    set->ovector = malloc( sizeof( int ) * set->ovecsize ) ;
+    if( !set->ovector || !setBuild( set ) )
+    {
+        pregSetFree( set ) ;
+        if( msglen )
+            snprintf( msg , msglen , "Out of memory" ) ;
+        return NULL ;
+    }
+
+    return set ;
+}
+
+/**
+ * @fn int pregSetMatch( preg_set *set , const char *subject , int length ,
+ *                       int *workspace , int wscount )
+ *
+ * @brief find the first pattern of a set that matches a subject
+ *
+ * @param set - from pregSetCompile
+ * @param subject - the subject (does not need to be null terminated)
+ * @param length - length of subject
+ * @param workspace - for pcre_dfa_exec, for patterns with the F modifier
+ * and those that hit the pcre_exec limits.  NULL if there isn't one.
+ * @param wscount - number of ints in workspace
+ *
+ * @return the number of the first pattern that matches (0 is the first)
+ * @return -1 - if none of them do
+ *
+ * @details The set is changed while matching, so it can't be used by 
+ * more than one thread at a time.
+ */
+int pregSetMatch( preg_set *set , const char *subject , int length ,
+                  int *workspace , int wscount )
+{
+    preg_set_pattern *p ;
+    int scanned = 0 ;           /* has the prefilter been run? */
+    int i ;
+
+    for( i = 0 ; i < set->npatterns ; i++ )
+    {
+        p = &set->patterns[ i ] ;
+        if( !p->pce )
+            continue ;
+
+        if( p->key )
+        {
+            if( !set->table )
+            {   // no prefilter - look for this key alone
+                if( pregRequiredMissing( pregCacheRequired( p->pce ) , 
+                                         subject , length , 0 ) )
+                    continue ;
+            }
+            else
+            {
+                if( !scanned )
+                {
+                    setScan( set , (const unsigned char *)subject , length ) ;
+                    scanned = 1 ;
+                }
+                if( !set->found[ i ] )
+                    continue ;
+            }
+        }
+
+        if( setMatchPattern( set , p , subject , length , 
+                             workspace , wscount ) )
+            return i ;
+    }
+
+    return -1 ;
+}
+
+/**
+ * @fn void pregSetFree( preg_set *set )
+ *
+ * @brief free a set returned by pregSetCompile, and release its patterns.
+ * NULL is ignored.
+ */
+void pregSetFree( preg_set *set )
+{
+    preg_set_pattern *p ;
+    int i ;
+
+    if( !set )
+        return ;
+
+    for( i = 0 ; set->patterns && i < set->npatterns ; i++ )
+    {
+        p = &set->patterns[ i ] ;
+        if( p->extra && p->extra != p->pce->extra )
+            pcre_free_study( p->extra ) ;
+        if( p->pce )
+            pregCacheRelease( p->pce ) ;
+    }
+    free( set->patterns ) ;
+    free( set->found ) ;
+    free( set->ovector ) ;
+    free( set->table ) ;
+    free( set->blob ) ;
+    free( set->labels ) ;
+    free( set->label_lens ) ;
+    free( set ) ;
+}
+
+/**
+ * @fn void pregSetBlobInit( preg_set_blob *blob )
+ *
+ * @brief start a BLOB without any patterns
+ */
+void pregSetBlobInit( preg_set_blob *blob )
+{
+    pregBufferInit( &blob->buffer , NULL , 0 ) ;
+    blob->length = 0 ;
+    blob->count = 0 ;
+}
+
+/**
+ * @fn int pregSetBlobAdd( preg_set_blob *blob , const char *pattern , 
+ *                         int pattern_len , const char *label , 
+ *                         int label_len )
+ *
+ * @brief add a pattern & its label to the end of a BLOB
+ *
+ * @param blob - from pregSetBlobInit
+ * @param pattern - the pattern (does not need to be null terminated)
+ * @param pattern_len - length of pattern
+ * @param label - what pregSetLabel returns for the pattern (may be NULL)
+ * @param label_len - length of label
+ *
+ * @return 1 - on success
+ * @return 0 - if out of memory, or the BLOB would be too big
+ */
+int pregSetBlobAdd( preg_set_blob *blob , const char *pattern , 
+                    int pattern_len , const char *label , int label_len )
+{
+    unsigned long start ;       /* where the pattern goes */
+    unsigned long need ;        /* length of the BLOB with it */
+    unsigned char *p ;
+
+    if( !label )
+        label_len = 0 ;
+    start = blob->length ? blob->length : SET_BLOB_HEADER ;
+    need = start + 8 + (unsigned long)pattern_len + 
+        (unsigned long)label_len ;
+    if( need > SET_BLOB_MAX || blob->count >= SET_BLOB_MAX )
+        return 0 ;
+    if( !pregBufferGrow( &blob->buffer , need , blob->length ) )
+        return 0 ;
+
+    p = (unsigned char *)blob->buffer.data + start ;
+    setPut32( p , pattern_len ) ;
+    memcpy( p + 4 , pattern , pattern_len ) ;
+    p += 4 + pattern_len ;
+    setPut32( p , label ? (unsigned long)label_len : SET_BLOB_NULL_LABEL ) ;
+    if( label_len )
+        memcpy( p + 4 , label , label_len ) ;
+
+    blob->length = need ;
+    blob->count++ ;
+    return 1 ;
+}
+
+/**
+ * @fn const char *pregSetBlobFinish( preg_set_blob *blob , 
+ *                                    unsigned long *length )
+ *
+ * @brief write the header of a BLOB
+ *
+ * @param blob - from pregSetBlobInit & pregSetBlobAdd.  More patterns can
+ * be added after this, and then it is finished again.
+ * @param length - put the length of the BLOB here
+ *
+ * @return the BLOB, which belongs to blob
+ * @return NULL - if out of memory
+ */
+const char *pregSetBlobFinish( preg_set_blob *blob , unsigned long *length )
+{
+    unsigned char *p ;
+
+    if( !blob->length )
+    {   // no patterns
+        if( !pregBufferGrow( &blob->buffer , SET_BLOB_HEADER , 0 ) )
+            return NULL ;
+        blob->length = SET_BLOB_HEADER ;
+    }
+
+    p = (unsigned char *)blob->buffer.data ;
+    memcpy( p , SET_BLOB_MAGIC , SET_BLOB_MAGIC_LEN ) ;
+    p[ SET_BLOB_MAGIC_LEN ] = SET_BLOB_VERSION ;
+    setPut32( p + 8 , blob->count ) ;
+    setPut32( p + 12 , setBlobHash( blob->buffer.data + SET_BLOB_HEADER , 
+                                    blob->length - SET_BLOB_HEADER ) ) ;
+
+    *length = blob->length ;
+    return blob->buffer.data ;
+}
+
+/**
+ * @fn void pregSetBlobRelease( preg_set_blob *blob )
+ *
+ * @brief free the memory of a BLOB.  It is then empty, as from 
+ * pregSetBlobInit.
+ */
+void pregSetBlobRelease( preg_set_blob *blob )
+{
+    pregBufferRelease( &blob->buffer ) ;
+    pregSetBlobInit( blob ) ;
+}
+
+/**
+ * @fn preg_set *pregSetLoad( const char *blob , unsigned long length , 
+ *                            int jit , char *msg , int msglen )
+ *
+ * @brief make a set from a BLOB from pregSetBlobFinish
+ *
+ * @param blob - the BLOB.  It is copied.
+ * @param length - length of blob
+ * @param jit - as for pregSetCompile
+ * @param msg - put the error here
+ * @param msglen - size of msg
+ *
+ * @return the set, which is freed with pregSetFree
+ * @return NULL - if blob is not a set, or a pattern doesn't compile, or 
+ * out of memory (an error is in msg)
+ */
+preg_set *pregSetLoad( const char *blob , unsigned long length , int jit ,
+                       char *msg , int msglen )
+{
+    preg_cache_entry **pces = NULL ;/* the compiled patterns */
+    const char **labels = NULL ;
+    int *label_lens = NULL ;
+    char error[ 255 ] ;         /* from compileRegex */
+    char *copy = NULL ;         /* of blob */
+    const unsigned char *p , *end ;
+    unsigned long count ;       /* number of patterns */
+    unsigned long hash ;
+    unsigned long n ;
+    const char *pattern ;
+    int pattern_len ;
+    preg_set *set ;
+    int i = 0 ;
+
+    if( length < SET_BLOB_HEADER || 
+        memcmp( blob , SET_BLOB_MAGIC , SET_BLOB_MAGIC_LEN ) ||
+        blob[ SET_BLOB_MAGIC_LEN ] != SET_BLOB_VERSION )
+    {
+        snprintf( msg , msglen , "not a pattern set" ) ;
+        return NULL ;
+    }
+
+    count = setGet32( (const unsigned char *)blob + 8 ) ;
+    hash = setGet32( (const unsigned char *)blob + 12 ) ;
+    if( count > ( length - SET_BLOB_HEADER ) / 8 ||
+        setBlobHash( blob + SET_BLOB_HEADER , 
+                     length - SET_BLOB_HEADER ) != hash )
+    {
+        snprintf( msg , msglen , "corrupt pattern set" ) ;
+        return NULL ;
+    }
+
+    copy = malloc( length ) ;
+    pces = calloc( count ? count : 1 , sizeof( preg_cache_entry * ) ) ;
+    labels = calloc( count ? count : 1 , sizeof( const char * ) ) ;
+    label_lens = calloc( count ? count : 1 , sizeof( int ) ) ;
+    if( !copy || !pces || !labels || !label_lens )
+    {
+        snprintf( msg , msglen , "Out of memory" ) ;
+        goto fail ;
+    }
+    memcpy( copy , blob , length ) ;
+
+    p = (const unsigned char *)copy + SET_BLOB_HEADER ;
+    end = (const unsigned char *)copy + length ;
+    for( i = 0 ; i < (int)count ; i++ )
+    {
+        if( end - p < 4 || 
+            ( n = setGet32( p ) ) > (unsigned long)( end - p - 4 ) )
+            break ;
+        pattern = (const char *)p + 4 ;
+        pattern_len = (int)n ;
+        p += 4 + n ;
+
+        if( end - p < 4 )
+            break ;
+        n = setGet32( p ) ;
+        if( n == SET_BLOB_NULL_LABEL )
+        {   // labels[ i ] stays NULL
+            n = 0 ;
+        }
+        else if( n > (unsigned long)( end - p - 4 ) )
+        {
+            break ;
+        }
+        else
+        {
+            labels[ i ] = (const char *)p + 4 ;
+            label_lens[ i ] = (int)n ;
+        }
+        p += 4 + n ;
+
+        if( !pattern_len )
+            strcpy( error , "Empty pattern" ) ;
+        else
+            pces[ i ] = compileRegex( pattern , pattern_len , 
+                                      error , sizeof( error ) ) ;
+        if( !pces[ i ] )
+        {
+            snprintf( msg , msglen , "pattern %d: %s" , i + 1 , error ) ;
+            goto fail ;
+        }
+    }
+    if( i < (int)count || p != end )
+    {
+        snprintf( msg , msglen , "corrupt pattern set" ) ;
+        goto fail ;
+    }
+
+    set = pregSetCompile( pces , count , jit , msg , msglen ) ;
+    free( pces ) ;
+    pces = NULL ;
+    if( !set )
+        goto fail ;
+
+    set->blob = copy ;
+    set->blob_len = length ;
+    set->blob_hash = hash ;
+    set->labels = labels ;
+    set->label_lens = label_lens ;
+    return set ;
+
+fail:
+    if( pces )
+    {
+        while( i-- > 0 )
+            pregCacheRelease( pces[ i ] ) ;
+        free( pces ) ;
+    }
+    free( copy ) ;
+    free( labels ) ;
+    free( label_lens ) ;
+    return NULL ;
+}
+
+/**
+ * @fn int pregSetLoadedFrom( const preg_set *set , const char *blob , 
+ *                            unsigned long length )
+ *
+ * @brief is a set the one that pregSetLoad would return for a BLOB?
+ *
+ * @return 1 - if set was loaded from the same BLOB
+ * @return 0 - if not, or it was not loaded from a BLOB
+ *
+ * @details The hashes are compared first, so that a different BLOB is 
+ * usually found without comparing all of it.
+ */
+int pregSetLoadedFrom( const preg_set *set , const char *blob , 
+                       unsigned long length )
+{
+    if( !set->blob || length != set->blob_len )
+        return 0 ;
+
+    if( setGet32( (const unsigned char *)blob + 12 ) != set->blob_hash )
+        return 0 ;
+
+    return !memcmp( blob , set->blob , length ) ;
+}
+
+/**
+ * @fn const char *pregSetLabel( const preg_set *set , int i , int *len )
+ *
+ * @brief the label of a pattern of a set that was loaded from a BLOB
+ *
+ * @param set - from pregSetLoad
+ * @param i - the pattern (from pregSetMatch)
+ * @param len - put the length of the label here
+ *
+ * @return the label, which belongs to set (not null terminated)
+ * @return NULL - if the label is NULL, or the set was not loaded from a 
+ * BLOB
+ */
+const char *pregSetLabel( const preg_set *set , int i , int *len )
+{
+    if( !set->labels || i < 0 || i >= set->npatterns || !set->labels[ i ] )
+        return NULL ;
+
+    *len = set->label_lens[ i ] ;
+    return set->labels[ i ] ;
+}
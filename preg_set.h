@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PREGSET_H
+
+#define PREGSET_H
+
+/** @file preg_set.h
+ *
+ * @brief headers for matching a subject against a set of patterns at 
+ *        once (PREG_CLASSIFY), and for sets that are kept as BLOBs
+ *        (PREG_COMPILE_SET & PREG_SET_MATCH)
+ */
+
+#include "preg_cache.h"
+#include "preg_pool.h"
+
+typedef struct preg_set_s preg_set ;
+
+/*
+ * A set of patterns & labels being written as a BLOB (PREG_COMPILE_SET),
+ * for pregSetLoad to read back
+ */
+typedef struct preg_set_blob_s {
+    preg_buffer buffer ;        /* the BLOB, header first */
+    unsigned long length ;      /* bytes of buffer that are used */
+    unsigned long count ;       /* patterns in it */
+} preg_set_blob ;
+
+preg_set *pregSetCompile( preg_cache_entry **pces , int count , int jit ,
+                          char *msg , int msglen ) ;
+int pregSetMatch( preg_set *set , const char *subject , int length ,
+                  int *workspace , int wscount ) ;
+void pregSetFree( preg_set *set ) ;
+
+void pregSetBlobInit( preg_set_blob *blob ) ;
+int pregSetBlobAdd( preg_set_blob *blob , const char *pattern , 
+                    int pattern_len , const char *label , int label_len ) ;
+const char *pregSetBlobFinish( preg_set_blob *blob , unsigned long *length ) ;
+void pregSetBlobRelease( preg_set_blob *blob ) ;
+preg_set *pregSetLoad( const char *blob , unsigned long length , int jit ,
+                       char *msg , int msglen ) ;
+int pregSetLoadedFrom( const preg_set *set , const char *blob , 
+                       unsigned long length ) ;
+const char *pregSetLabel( const preg_set *set , int i , int *len ) ;
+
+#endif
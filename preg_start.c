@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/** @file preg_start.c
+ *
+ * @brief Skip ahead to the bytes that a match can start with, using the
+ *        table that libpcre works out when a pattern is studied
+ *        (PCRE_INFO_FIRSTTABLE).
+ *
+ * @details libpcre uses the table itself, but looks at the subject one 
+ * byte at a time.  pregStartFind looks at 16 (SSSE3) or 32 (AVX2) bytes 
+ * at a time, by looking up the low 4 bits of each byte with a shuffle in
+ * one of two tables (bytes below 0x80 and the rest), which gives the set
+ * of high 4 bits that go with them, and testing the byte's own high bits
+ * against that.  This works for any set of bytes.  Other cpus and 
+ * compilers use the table one byte at a time.
+ *
+ * Tables that let through more than half of the bytes aren't worth 
+ * scanning for, and patterns with \\G or the u modifier are left alone 
+ * since the start of the search makes a difference to them.
+ *
+ * @notes This file does not depend on mysql.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "preg_start.h"
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define PREG_START_X86
+#include <immintrin.h>
+#endif
+
+// Tables with more bytes than this are not used
+#define PREG_START_MAX_BYTES 128
+
+typedef const unsigned char *( *preg_start_find )( const preg_start *start ,
+                                                   const unsigned char *s ,
+                                                   const unsigned char *end );
+
+struct preg_start_s {
+    unsigned char bits[ 32 ] ;  /* bit ( c & 7 ) of bits[ c / 8 ] is set if
+                                   a match can start with c */
+    unsigned char lo[ 16 ] ;    /* bit h of lo[ c & 15 ] is set if a match
+                                   can start with c, c < 0x80, c >> 4 == h */
+    unsigned char hi[ 16 ] ;    /* the same for c >= 0x80, h = c >> 4 & 7 */
+    preg_start_find find ;      /* search function for this cpu */
+} ;
+
+/**
+ * @fn static const unsigned char *startFindScalar( const preg_start *start ,
+ *                                                  const unsigned char *s ,
+ *                                                  const unsigned char *end )
+ *
+ * @brief find the first byte from s to end that a match can start with
+ *
+ * @return the byte or NULL
+ */
+static const unsigned char *startFindScalar( const preg_start *start , 
+                                             const unsigned char *s ,
+                                             const unsigned char *end )
+{
+    for( ; s < end ; s++ )
+    {
+        if( start->bits[ *s >> 3 ] & ( 1 << ( *s & 7 ) ) )
+            return s ;
+    }
+    return NULL ;
+}
+
+#ifdef PREG_START_X86
+
+/**
+ * @fn static const unsigned char *startFindSsse3( const preg_start *start ,
+ *                                                 const unsigned char *s ,
+ *                                                 const unsigned char *end )
+ *
+ * @brief startFindScalar, 16 bytes at a time
+ */
+__attribute__(( target( "ssse3" ) ))
+static const unsigned char *startFindSsse3( const preg_start *start , 
+                                            const unsigned char *s ,
+                                            const unsigned char *end )
+{
+    const __m128i lo = _mm_loadu_si128( (const __m128i *)start->lo ) ;
+    const __m128i hi = _mm_loadu_si128( (const __m128i *)start->hi ) ;
+    const __m128i pow2 = _mm_setr_epi8( 1 , 2 , 4 , 8 , 16 , 32 , 64 , -128 ,
+                                        1 , 2 , 4 , 8 , 16 , 32 , 64 , -128 ) ;
+    const __m128i top = _mm_set1_epi8( -128 ) ;
+    const __m128i seven = _mm_set1_epi8( 7 ) ;
+    const __m128i zero = _mm_setzero_si128() ;
+    __m128i v , t , h ;
+    unsigned int bits ;
+
+    for( ; end - s >= 16 ; s += 16 )
+    {
+        v = _mm_loadu_si128( (const __m128i *)s ) ;
+        // pshufb gives 0 for an index with the top bit set, so each byte
+        // is only looked up in the table for its half
+        t = _mm_or_si128( _mm_shuffle_epi8( lo , v ) ,
+                          _mm_shuffle_epi8( hi , _mm_xor_si128( v , top ) ) );
+        h = _mm_and_si128( _mm_srli_epi16( v , 4 ) , seven ) ;
+        t = _mm_and_si128( t , _mm_shuffle_epi8( pow2 , h ) ) ;
+        bits = ~(unsigned int)_mm_movemask_epi8( _mm_cmpeq_epi8( t , zero ) )
+               & 0xffff ;
+        if( bits )
+            return s + __builtin_ctz( bits ) ;
+    }
+
+    return startFindScalar( start , s , end ) ;
+}
+
+/**
+ * @fn static const unsigned char *startFindAvx2( const preg_start *start ,
+ *                                                const unsigned char *s ,
+ *                                                const unsigned char *end )
+ *
+ * @brief startFindScalar, 32 bytes at a time
+ */
+__attribute__(( target( "avx2" ) ))
+static const unsigned char *startFindAvx2( const preg_start *start , 
+                                           const unsigned char *s ,
+                                           const unsigned char *end )
+{
+    const __m256i lo = _mm256_broadcastsi128_si256( 
+        _mm_loadu_si128( (const __m128i *)start->lo ) ) ;
+    const __m256i hi = _mm256_broadcastsi128_si256( 
+        _mm_loadu_si128( (const __m128i *)start->hi ) ) ;
+    const __m256i pow2 = _mm256_setr_epi8( 1 , 2 , 4 , 8 , 16 , 32 , 64 , -128 ,
+                                           1 , 2 , 4 , 8 , 16 , 32 , 64 , -128 ,
+                                           1 , 2 , 4 , 8 , 16 , 32 , 64 , -128 ,
+                                           1 , 2 , 4 , 8 , 16 , 32 , 64 , -128 );
+    const __m256i top = _mm256_set1_epi8( -128 ) ;
+    const __m256i seven = _mm256_set1_epi8( 7 ) ;
+    const __m256i zero = _mm256_setzero_si256() ;
+    __m256i v , t , h ;
+    unsigned int bits ;
+
+    for( ; end - s >= 32 ; s += 32 )
+    {
+        v = _mm256_loadu_si256( (const __m256i *)s ) ;
+        t = _mm256_or_si256( _mm256_shuffle_epi8( lo , v ) ,
+                             _mm256_shuffle_epi8( hi , 
+                                                  _mm256_xor_si256( v , top ) ) );
+        h = _mm256_and_si256( _mm256_srli_epi16( v , 4 ) , seven ) ;
+        t = _mm256_and_si256( t , _mm256_shuffle_epi8( pow2 , h ) ) ;
+        bits = ~(unsigned int)_mm256_movemask_epi8( 
+            _mm256_cmpeq_epi8( t , zero ) ) ;
+        if( bits )
+            return s + __builtin_ctz( bits ) ;
+    }
+
+    return startFindSsse3( start , s , end ) ;
+}
+
+#endif /* PREG_START_X86 */
+
+
+/*
+ * Public Functions:
+ */
+
+/**
+ * @fn preg_start *pregStartCompile( const pcre *re , 
+ *                                   const pcre_extra *extra , 
+ *                                   const char *pattern , int options )
+ *
+ * @brief get the bytes a match of a pattern can start with, for 
+ * pregStartFind
+ *
+ * @param re - the compiled pattern
+ * @param extra - the results of studying it, or NULL.  With libpcre (not
+ * PCRE2) the pattern is studied here if it is NULL, since the table is
+ * part of the study data.
+ * @param pattern - the pattern, without delimiters or modifiers 
+ * (null terminated)
+ * @param options - the PCRE_* options from the modifiers
+ *
+ * @return the bytes - or NULL if the pattern is anchored (the A modifier,
+ * or libpcre found that it can only match at the start), libpcre has no 
+ * table for the pattern (it can match an empty string ...), the table 
+ * has too many bytes in it, the pattern uses \\G or the u modifier, or 
+ * out of memory.
+ *
+ * @details PCRE2 has a table for anchored patterns too, but a match of 
+ * one can't be looked for further on, so it isn't used.
+ *
+ * @note free the result with pregStartFree
+ */
+preg_start *pregStartCompile( const pcre *re , const pcre_extra *extra ,
+                              const char *pattern , int options )
+{
+    preg_start *start = NULL ;
+    const unsigned char *table = NULL ;
+    pcre_extra *study = NULL ;
+    const char *error ;
+    unsigned long info = 0 ;    /* PCRE_INFO_OPTIONS */
+    int n = 0 ;
+    int c ;
+
+    if( !re || !pattern || ( options & ( PCRE_UTF8 | PCRE_ANCHORED ) ) || 
+        strstr( pattern , "\\G" ) || strstr( pattern , "(*UTF" ) )
+        return NULL ;
+
+    if( pcre_fullinfo( re , NULL , PCRE_INFO_OPTIONS , &info ) ||
+        ( info & PCRE_ANCHORED ) )
+        return NULL ;
+
+#ifndef PREG_USE_PCRE2
+    if( !extra )
+        extra = study = pcre_study( re , 0 , &error ) ;
+#else
+    (void)error ;
+#endif
+
+    if( !pcre_fullinfo( re , extra , PCRE_INFO_FIRSTTABLE , &table ) && 
+        table )
+    {
+        for( c = 0 ; c < 256 ; c++ )
+            n += ( table[ c >> 3 ] >> ( c & 7 ) ) & 1 ;
+    }
+
+    if( n && n <= PREG_START_MAX_BYTES )
+        start = calloc( 1 , sizeof( preg_start ) ) ;
+    if( start )
+    {
+        memcpy( start->bits , table , sizeof( start->bits ) ) ;
+        for( c = 0 ; c < 256 ; c++ )
+        {
+            if( !( ( table[ c >> 3 ] >> ( c & 7 ) ) & 1 ) )
+                continue ;
+            if( c < 0x80 )
+                start->lo[ c & 15 ] |= 1 << ( c >> 4 ) ;
+            else
+                start->hi[ c & 15 ] |= 1 << ( ( c >> 4 ) & 7 ) ;
+        }
+
+        start->find = startFindScalar ;
+#ifdef PREG_START_X86
+        if( __builtin_cpu_supports( "avx2" ) )
+            start->find = startFindAvx2 ;
+        else if( __builtin_cpu_supports( "ssse3" ) )
+            start->find = startFindSsse3 ;
+#endif
+    }
+
+    if( study )
+        pcre_free_study( study ) ;
+    return start ;
+}
+
+/**
+ * @fn int pregStartFind( const preg_start *start , const char *subject , 
+ *                        int length , int start_offset )
+ *
+ * @brief find where a match can start
+ *
+ * @return the offset of the first byte at or after start_offset that a
+ * match can start with, or -1 if there is none (or the arguments are bad)
+ */
+int pregStartFind( const preg_start *start , const char *subject , 
+                   int length , int start_offset )
+{
+    const unsigned char *s = (const unsigned char *)subject ;
+    const unsigned char *p ;
+
+    if( !start || !subject || start_offset < 0 || start_offset > length )
+        return -1 ;
+
+    p = start->find( start , s + start_offset , s + length ) ;
+    return p ? (int)( p - s ) : -1 ;
+}
+
+/**
+ * @fn void pregStartFree( preg_start *start )
+ *
+ * @brief free a preg_start returned by pregStartCompile.  NULL is ignored.
+ */
+void pregStartFree( preg_start *start )
+{
+    free( start ) ;
+}
@@ -33,6 +33,8 @@
  */
 
 #include <pthread.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "preg_utils.h"
 #include "ghfcns.h"
@@ -42,38 +44,20 @@
 #endif
 
 /**
- * @fn void pregSetLimits( pcre_extra *extra  ) 
+ * @fn static size_t pregGetThreadStack( size_t *thread_stack_avail )
  *
  * @brief
- *     sets safe match/recursion limits in a pcre extra
- * that should be low enough to prevent stack overflow
- * crashes.
+ *     finds the size of the current thread's stack and how much of it
+ * is still available
  *
- * @param extra - a pointer to the pcre_extra struct to set
- *
- * @details This function sets safe limits as determined by
- * calculating the currently available stack space for the
- * this thread, it will also set the flags required to make
- * pcre_exec honour the limits
+ * @param thread_stack_avail - put the number of available bytes here
  *
+ * @return the size of the thread's stack in bytes
  */
-void pregSetLimits(pcre_extra *extra)
+static size_t pregGetThreadStack(size_t *thread_stack_avail_ret)
 {
-    /*
-     * A match_limit_recursion of 100000 is way too high for this context
-     * MySQL's default thread stack size is 256K on 64bit (192K on 32bit)
-     *  - https://dev.mysql.com/doc/refman/5.5/en/server-system-variables.html#sysvar_thread_stack
-     * man pcrestack(3) suggests a rule of thumb of 500 bytes per recursion.  Assuming _no_ other
-     * stack usage that suggests a maximum safe limit of ~512 (64-bit) or ~384 (32-bit)
-     * but better - get the stack size & usage and base the limit on the *available* stack space
-     * if deeper recusrsion is needed then users can increase MySQL's thread_stack variable to
-     * raise the limit
-     *                                                - Travers Carter <tcarter@noggin.com.au>
-     */
-
     size_t          thread_stack_size=0;
     size_t          thread_stack_avail=0;
-    size_t          pcre_frame_size=0;
 
 #ifdef HAVE_PTHREAD
 #ifdef HAVE_PTHREAD_GETATTR_NP
@@ -146,6 +130,53 @@ void pregSetLimits(pcre_extra *extra)
         thread_stack_avail = thread_stack_size*0.75;
     }
 
+    *thread_stack_avail_ret = thread_stack_avail;
+    return thread_stack_size;
+}
+
+/**
+ * @fn void pregComputeLimits( pcre_extra *extra  ) 
+ *
+ * @brief
+ *     calculates safe match/recursion limits for a pcre extra
+ * that should be low enough to prevent stack overflow
+ * crashes.
+ *
+ * @param extra - a pointer to the pcre_extra struct to set
+ *
+ * @details This function sets safe limits as determined by
+ * calculating the currently available stack space for the
+ * this thread, it will also set the flags required to make
+ * pcre_exec honour the limits.  This is slow (glibc reads 
+ * /proc/self/maps for the main thread), so use pregSetLimits, which
+ * remembers the results for each thread.
+ *
+ */
+void pregComputeLimits(pcre_extra *extra)
+{
+    /*
+     * A match_limit_recursion of 100000 is way too high for this context
+     * MySQL's default thread stack size is 256K on 64bit (192K on 32bit)
+     *  - https://dev.mysql.com/doc/refman/5.5/en/server-system-variables.html#sysvar_thread_stack
+     * man pcrestack(3) suggests a rule of thumb of 500 bytes per recursion.  Assuming _no_ other
+     * stack usage that suggests a maximum safe limit of ~512 (64-bit) or ~384 (32-bit)
+     * but better - get the stack size & usage and base the limit on the *available* stack space
+     * if deeper recusrsion is needed then users can increase MySQL's thread_stack variable to
+     * raise the limit
+     *                                                - Travers Carter <tcarter@noggin.com.au>
+     */
+
+    size_t          thread_stack_avail=0;
+    int             pcre_frame_size=0;
+
+#ifdef PREG_USE_PCRE2
+    // PCRE2 backtracks on the heap, so the stack doesn't limit it
+    extra->match_limit           = 100000;
+    extra->flags |= PCRE_EXTRA_MATCH_LIMIT;
+    return;
+#endif
+
+    pregGetThreadStack(&thread_stack_avail);
 
     // PCRE >= 8.30 has a magic call preg_exec(NULL, NULL, NULL, -1, ....) to determine the stack requirements
     // (returned as a negative number), but errors are also negative (currently down to -25)
@@ -162,12 +193,376 @@ void pregSetLimits(pcre_extra *extra)
 
     // TODO: Fix (or justify?) the 100,000 magic number here (taken from "from_php.c" but pcre defaults to 10,000,000!
     extra->match_limit           = 100000;
-    extra->match_limit_recursion = (thread_stack_avail-4096)/pcre_frame_size;
+    extra->match_limit_recursion = 1;
+    if (thread_stack_avail > 4096 + (size_t)pcre_frame_size) {
+        extra->match_limit_recursion = (thread_stack_avail-4096)/pcre_frame_size;
+    }
 
     // Force the limits to be honoured....
     extra->flags |= PCRE_EXTRA_MATCH_LIMIT | PCRE_EXTRA_MATCH_LIMIT_RECURSION;
 }
 
+/*
+ * The recursion limit of each thread, as calculated by pregComputeLimits.
+ * It is kept in the thread specific value itself (plus one, so that 0 means
+ * not calculated yet), so there is nothing to free.
+ */
+static pthread_key_t  preg_limits_key;
+static pthread_once_t preg_limits_once = PTHREAD_ONCE_INIT;
+static int            preg_limits_key_ok = 0;
+
+static void pregCreateLimitsKey(void)
+{
+    preg_limits_key_ok = !pthread_key_create(&preg_limits_key, NULL);
+}
+
+/**
+ * @fn void pregSetLimits( pcre_extra *extra  ) 
+ *
+ * @brief
+ *     sets safe match/recursion limits in a pcre extra
+ * that should be low enough to prevent stack overflow
+ * crashes.
+ *
+ * @param extra - a pointer to the pcre_extra struct to set
+ *
+ * @details The limits are calculated by pregComputeLimits the first time
+ * this is called by a thread and are remembered for the thread's later
+ * calls.  mysqld calls the UDF's at about the same stack depth each time,
+ * so the stack available to pcre does not change much between calls.
+ *
+ */
+void pregSetLimits(pcre_extra *extra)
+{
+    uintptr_t       limit = 0;
+
+#ifdef PREG_USE_PCRE2
+    pregComputeLimits(extra);
+    return;
+#endif
+
+    pthread_once(&preg_limits_once, pregCreateLimitsKey);
+    if (preg_limits_key_ok) {
+        limit = (uintptr_t)pthread_getspecific(preg_limits_key);
+    }
+
+    if (!limit) {
+        pregComputeLimits(extra);
+        if (preg_limits_key_ok) {
+            pthread_setspecific(preg_limits_key,
+                                (void *)(uintptr_t)(extra->match_limit_recursion + 1));
+        }
+        return;
+    }
+
+    extra->match_limit           = 100000;
+    extra->match_limit_recursion = limit - 1;
+
+    // Force the limits to be honoured....
+    extra->flags |= PCRE_EXTRA_MATCH_LIMIT | PCRE_EXTRA_MATCH_LIMIT_RECURSION;
+}
+
+/**
+ * @fn void pregInitExtra( pcre_extra *extra , const pcre_extra *study )
+ *
+ * @brief
+ *     prepares a pcre_extra for a call to pcre_exec
+ *
+ * @param extra - a pointer to the pcre_extra struct to set
+ * @param study - results of pcre_study for the pattern or NULL
+ *
+ * @details This function copies the results of studying the pattern 
+ * (if any) into extra and then sets safe limits using pregSetLimits.
+ * The study results themselves are not modified, so they can be shared.
+ */
+void pregInitExtra(pcre_extra *extra, const pcre_extra *study)
+{
+    if (study) {
+        *extra = *study;
+    } else {
+        memset(extra, 0, sizeof(*extra));
+    }
+
+    pregSetLimits(extra);
+}
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+
+// The smallest JIT stack that is worth allocating.  pcre uses 32K of the
+// machine stack when no JIT stack is assigned.
+#define PREG_JIT_STACK_MIN (32*1024)
+
+static pthread_key_t  preg_jit_stack_key;
+static pthread_once_t preg_jit_stack_once = PTHREAD_ONCE_INIT;
+static int            preg_jit_stack_key_ok = 0;
+
+static void pregFreeJitStack(void *stack)
+{
+    pcre_jit_stack_free((pcre_jit_stack *)stack);
+}
+
+static void pregCreateJitStackKey(void)
+{
+    preg_jit_stack_key_ok = !pthread_key_create(&preg_jit_stack_key, 
+                                                pregFreeJitStack);
+}
+
+/**
+ * @fn static pcre_jit_stack *pregGetJitStack( void *data )
+ *
+ * @brief
+ *     returns the JIT stack of the current thread.  This is the callback
+ * given to pcre_assign_jit_stack, so it is called by pcre_exec.
+ *
+ * @param data - not used
+ *
+ * @return the JIT stack - or NULL if one can't be allocated, in which case
+ * pcre uses 32K of the machine stack.
+ *
+ * @details The JIT does not recurse on the machine stack, so
+ * match_limit_recursion does not protect it.  Instead, each thread gets
+ * its own pcre_jit_stack the first time that it runs a JIT compiled 
+ * pattern.  The stack can grow to the size of the thread's own stack 
+ * (mysqld:thread_stack), so patterns that work with the interpreter
+ * also work with the JIT.  The stack is freed when the thread exits.
+ */
+static pcre_jit_stack *pregGetJitStack(void *data)
+{
+    pcre_jit_stack *stack;
+    size_t          thread_stack_size;
+    size_t          thread_stack_avail;
+
+    pthread_once(&preg_jit_stack_once, pregCreateJitStackKey);
+    if (!preg_jit_stack_key_ok) {
+        return NULL;
+    }
+
+    stack = (pcre_jit_stack *)pthread_getspecific(preg_jit_stack_key);
+    if (!stack) {
+        thread_stack_size = pregGetThreadStack(&thread_stack_avail);
+        if (thread_stack_size < PREG_JIT_STACK_MIN) {
+            thread_stack_size = PREG_JIT_STACK_MIN;
+        }
+
+        stack = pcre_jit_stack_alloc(PREG_JIT_STACK_MIN, thread_stack_size);
+        if (stack && pthread_setspecific(preg_jit_stack_key, stack)) {
+            pcre_jit_stack_free(stack);
+            stack = NULL;
+        }
+    }
+
+    return stack;
+}
+
+#endif /* PCRE_STUDY_JIT_COMPILE */
+
+#ifdef __GNUC__
+/*
+ * The JIT stack key's destructor is in this library, so it must not be
+ * called for threads that exit after the library has been unloaded.  The
+ * stacks of the threads that are still running are leaked.
+ */
+static void pregUtilsUnload(void) __attribute__((destructor));
+static void pregUtilsUnload(void)
+{
+    if (preg_limits_key_ok) {
+        pthread_key_delete(preg_limits_key);
+    }
+#ifdef PCRE_STUDY_JIT_COMPILE
+    if (preg_jit_stack_key_ok) {
+        pthread_key_delete(preg_jit_stack_key);
+    }
+#endif
+}
+#endif
+
+/**
+ * @fn pcre_extra *pregStudy( const pcre *re , int jit , const char **error )
+ *
+ * @brief
+ *     studies a compiled pattern, optionally JIT compiling it
+ *
+ * @param re - the compiled pattern
+ * @param jit - if non-zero, JIT compile the pattern (when available)
+ * @param error - put the error message here if the study fails
+ *
+ * @return the results of pcre_study, to be freed with pcre_free_study.
+ * @return NULL - if there was nothing to learn or on error (see error)
+ *
+ * @details JIT compiled patterns get the thread's JIT stack (see
+ * pregGetJitStack) from a callback, so the results can be used by
+ * any thread.  When the JIT is not available, pcre_study just leaves it 
+ * out and the pattern is run by the interpreter.
+ */
+pcre_extra *pregStudy(const pcre *re, int jit, const char **error)
+{
+    pcre_extra *study;
+    int         options = 0;
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+    if (jit) {
+        options |= PCRE_STUDY_JIT_COMPILE;
+    }
+#endif
+
+    *error = NULL;
+    study = pcre_study(re, options, error);
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+    if (study && (study->flags & PCRE_EXTRA_EXECUTABLE_JIT)) {
+        pcre_assign_jit_stack(study, pregGetJitStack, NULL);
+    }
+#endif
+
+    return study;
+}
+
+/**
+ * @fn int pregExec( const pcre *re , pcre_extra *extra , 
+ *                   const char *subject , int length , int start_offset ,
+ *                   int options , int *ovector , int ovecsize )
+ *
+ * @brief
+ *     runs pcre_exec, falling back to the interpreter if the JIT fails
+ *
+ * @details Takes the same arguments and returns the same results as
+ * pcre_exec.  If a JIT compiled pattern runs out of JIT stack, the match
+ * is run again by the interpreter, which is protected by the
+ * match_limit_recursion set by pregSetLimits.
+ */
+int pregExec(const pcre *re, pcre_extra *extra, const char *subject,
+             int length, int start_offset, int options, 
+             int *ovector, int ovecsize)
+{
+    int rc;
+
+    rc = pcre_exec(re, extra, subject, length, start_offset, options,
+                   ovector, ovecsize);
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+    if (rc == PCRE_ERROR_JIT_STACKLIMIT && extra) {
+        extra->flags &= ~PCRE_EXTRA_EXECUTABLE_JIT;
+        rc = pcre_exec(re, extra, subject, length, start_offset, options,
+                       ovector, ovecsize);
+        extra->flags |= PCRE_EXTRA_EXECUTABLE_JIT;
+    }
+#endif
+
+    return rc;
+}
+
+/**
+ * @fn int pregExecLongest( const pcre *re , pcre_extra *extra , 
+ *                          const char *subject , int length , 
+ *                          int start_offset , int options , int *ovector ,
+ *                          int ovecsize , int *workspace , int wscount )
+ *
+ * @brief
+ *     runs pcre_dfa_exec, but returns what pcre_exec would for a pattern 
+ *     without capture groups
+ *
+ * @param workspace - the workspace for pcre_dfa_exec 
+ * @param wscount - number of ints in workspace
+ *
+ * @return 1 - if there is a match.  ovector[0] and ovector[1] are the
+ * offsets of the longest match at the first position that matches.  The
+ * other groups are unset (-1).
+ * @return < 0 - the error from pcre_dfa_exec (see pregExecErrorString)
+ *
+ * @details pcre_dfa_exec doesn't recurse (except for assertions) or 
+ * backtrack, so it doesn't hit match_limit_recursion where pcre_exec 
+ * would.  It can't handle backreferences, and returns PCRE_ERROR_DFA_UITEM
+ * for them.
+ */
+int pregExecLongest(const pcre *re, pcre_extra *extra, const char *subject,
+                    int length, int start_offset, int options, 
+                    int *ovector, int ovecsize, int *workspace, int wscount)
+{
+    int rc;
+    int i;
+
+    rc = pcre_dfa_exec(re, extra, subject, length, start_offset, options,
+                       ovector, ovecsize >= 2 ? 2 : 0, workspace, wscount);
+    if (rc < 0) {
+        return rc;
+    }
+
+    for (i = 2; i < (ovecsize / 3) * 2; i++) {
+        ovector[i] = -1;
+    }
+    return 1;
+}
+
+/**
+ * @fn int pregMatch( const pcre *re , pcre_extra *extra , 
+ *                    const preg_nfa *nfa , const preg_literal *literal ,
+ *                    const preg_start *start , int *workspace , int wscount ,
+ *                    const char *subject , int length , int start_offset ,
+ *                    int options , int *ovector , int ovecsize )
+ *
+ * @brief
+ *     runs the substring search if the pattern is a literal, the
+ *     linear-time matcher if the pattern has one, pregExecLongest if 
+ *     given a workspace, else pregExec
+ *
+ * @details Takes the same arguments and returns the same results as
+ * pcre_exec, plus nfa, which is the pattern compiled by pregNfaCompile
+ * for patterns with the L modifier (or NULL), literal, which is the 
+ * pattern compiled by pregLiteralCompile (or NULL), start, which is 
+ * the bytes a match can start with from pregStartCompile (or NULL), and 
+ * the workspace for patterns with the F modifier (or NULL).  Unless the
+ * search is anchored, it starts at the first of those bytes.
+ */
+int pregMatch(const pcre *re, pcre_extra *extra, const preg_nfa *nfa,
+              const preg_literal *literal, const preg_start *start,
+              int *workspace, int wscount,
+              const char *subject, int length, int start_offset, int options,
+              int *ovector, int ovecsize)
+{
+    if (literal) {
+        return pregLiteralExec(literal, subject, length, start_offset,
+                               options, ovector, ovecsize);
+    }
+    if (start && subject && start_offset >= 0 && start_offset <= length &&
+        !(options & PCRE_ANCHORED)) {
+        start_offset = pregStartFind(start, subject, length, start_offset);
+        if (start_offset < 0) {
+            return PCRE_ERROR_NOMATCH;
+        }
+    }
+    if (nfa) {
+        return pregNfaExec(nfa, subject, length, start_offset, options,
+                           ovector, ovecsize);
+    }
+    if (workspace) {
+        return pregExecLongest(re, extra, subject, length, start_offset,
+                               options, ovector, ovecsize, workspace, wscount);
+    }
+    return pregExec(re, extra, subject, length, start_offset, options,
+                    ovector, ovecsize);
+}
+
+/**
+ * @fn int pregRequiredMissing( const preg_literal *required , 
+ *                              const char *subject , int length , 
+ *                              int start_offset )
+ *
+ * @brief
+ *     checks a subject for the string that every match of a pattern 
+ *     contains (preg_cache_entry.required)
+ *
+ * @return 1 - if the string is not in the subject after start_offset, so
+ * the pattern can't match there
+ * @return 0 - if it is, or required is NULL
+ */
+int pregRequiredMissing(const preg_literal *required, const char *subject,
+                        int length, int start_offset)
+{
+    return required &&
+        pregLiteralExec(required, subject, length, start_offset, 0, 
+                        NULL, 0) == PCRE_ERROR_NOMATCH;
+}
+
 static const char *_pregExecErrorString[] = {
     "NO_ERROR",
     "PCRE_ERROR_NOMATCH",
@@ -195,6 +590,8 @@ static const char *_pregExecErrorString[] = {
     "PCRE_ERROR_BADNEWLINE",
     "PCRE_ERROR_BADOFFSET",
     "PCRE_ERROR_SHORTUTF8",
+    "PCRE_ERROR_RECURSELOOP",
+    "PCRE_ERROR_JIT_STACKLIMIT, try increasing mysqld:thread_stack",
     "UNKOWN_ERROR",
 };
 
@@ -216,9 +613,9 @@ static const char *_pregExecErrorString[] = {
 const char *pregExecErrorString(int pcre_errno) {
     if (pcre_errno >= 0) {
         return _pregExecErrorString[0];
-    } else if (pcre_errno >= -25) {
+    } else if (pcre_errno >= -27) {
         return _pregExecErrorString[-pcre_errno];
     } else {
-        return _pregExecErrorString[26];
+        return _pregExecErrorString[28];
     }
 }
@@ -27,10 +27,38 @@
 #define PREGUTILS_H
 
 // Include the libpcre headers
+#ifdef PREG_USE_PCRE2
+#include "preg_pcre2.h"
+#else
 #include "pcre.h"
+#endif
+#include "preg_nfa.h"
+#include "preg_literal.h"
+#include "preg_start.h"
 //#include "from_php.h"
 
+// pcre_free_study came along with the JIT in pcre 8.20
+#ifndef PCRE_STUDY_JIT_COMPILE
+#define pcre_free_study pcre_free
+#endif
+
+void pregComputeLimits(pcre_extra *extra);
 void pregSetLimits(pcre_extra *extra);
+void pregInitExtra(pcre_extra *extra, const pcre_extra *study);
+pcre_extra *pregStudy(const pcre *re, int jit, const char **error);
+int pregExec(const pcre *re, pcre_extra *extra, const char *subject,
+             int length, int start_offset, int options, 
+             int *ovector, int ovecsize);
+int pregExecLongest(const pcre *re, pcre_extra *extra, const char *subject,
+                    int length, int start_offset, int options, 
+                    int *ovector, int ovecsize, int *workspace, int wscount);
+int pregMatch(const pcre *re, pcre_extra *extra, const preg_nfa *nfa,
+              const preg_literal *literal, const preg_start *start,
+              int *workspace, int wscount,
+              const char *subject, int length, int start_offset, int options,
+              int *ovector, int ovecsize);
+int pregRequiredMissing(const preg_literal *required, const char *subject,
+                        int length, int start_offset);
 const char *pregExecErrorString(int pcre_errno);
 
 
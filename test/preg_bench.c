@@ -0,0 +1,689 @@
+/*
+ * Copyright (C) 2007-2013 Rich Waters <raw@goodhumans.net>
+ *
+ * This file is part of lib_mysqludf_preg.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/** @file preg_bench.c
+ *
+ * @brief Microbenchmarks for the per-row work done by the UDF's
+ *
+ * @details This is built without mysql (GH_PREG_NO_MYSQL) and is run
+ * with 'make bench'.  It reports the time per row of each step, both
+ * on the main thread and on a new thread, since glibc finds the stack of
+ * the main thread in a much slower way.
+ *
+ * Usage: preg_bench [ rows ]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "preg_utils.h"
+#include "preg_pool.h"
+#include "preg_class.h"
+#include "preg_map.h"
+#include "preg_set.h"
+#include "from_php.h"
+
+#define PREG_BENCH_ROWS 100000
+
+static long preg_bench_rows = PREG_BENCH_ROWS ;
+
+/**
+ * @fn static double benchNow( void )
+ *
+ * @brief the current time in seconds
+ */
+static double benchNow( void )
+{
+    struct timeval tv ;
+
+    gettimeofday( &tv , NULL ) ;
+    return tv.tv_sec + tv.tv_usec / 1e6 ;
+}
+
+/**
+ * @fn static void benchReport( const char *name , double start )
+ *
+ * @brief print the time per row since start
+ */
+static void benchReport( const char *name , double start )
+{
+    printf( "%-32s %10.1f ns/row\n" , name ,
+            ( benchNow() - start ) * 1e9 / preg_bench_rows ) ;
+}
+
+/**
+ * @fn static void *benchLimits( void *label )
+ *
+ * @brief time the calculation of the pcre limits with and without the
+ * per-thread cache
+ */
+static void *benchLimits( void *label )
+{
+    pcre_extra extra ;
+    double start ;
+    long i ;
+    char name[ 64 ] ;
+
+    printf( "%s:\n" , (char *)label ) ;
+
+    start = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        memset( &extra , 0 , sizeof( extra ) ) ;
+        pregComputeLimits( &extra ) ;
+    }
+    snprintf( name , sizeof( name ) , "  pregComputeLimits" ) ;
+    benchReport( name , start ) ;
+
+    start = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        memset( &extra , 0 , sizeof( extra ) ) ;
+        pregSetLimits( &extra ) ;
+    }
+    snprintf( name , sizeof( name ) , "  pregSetLimits (limit %lu)" ,
+              extra.match_limit_recursion ) ;
+    benchReport( name , start ) ;
+
+    return NULL ;
+}
+
+/**
+ * @fn static void benchLiteral( const char *pattern , int options )
+ *
+ * @brief time finding a literal pattern near the end of a 4K subject,
+ * with libpcre (studied & JIT compiled when possible) and with 
+ * pregLiteralExec
+ */
+static void benchLiteral( const char *pattern , int options )
+{
+    char subject[ 4096 ] ;
+    int ovector[ 3 ] ;
+    pcre *re ;
+    pcre_extra *study ;
+    pcre_extra extra ;
+    preg_literal *lit ;
+    const char *error ;
+    int erroffset ;
+    double start ;
+    long i ;
+    char name[ 64 ] ;
+
+    memset( subject , 'x' , sizeof( subject ) ) ;
+    memcpy( subject + sizeof( subject ) - 100 , "error: " , 7 ) ;
+
+    re = pcre_compile( pattern , options , &error , &erroffset , NULL ) ;
+    lit = pregLiteralCompile( pattern , options ) ;
+    if( !re || !lit )
+    {
+        printf( "  %s: compile failed\n" , pattern ) ;
+        return ;
+    }
+    study = pregStudy( re , 1 , &error ) ;
+
+    start = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        pregInitExtra( &extra , study ) ;
+        pregExec( re , &extra , subject , sizeof( subject ) , 0 , 0 ,
+                  ovector , 3 ) ;
+    }
+    snprintf( name , sizeof( name ) , "  pregExec /%s/" , pattern ) ;
+    benchReport( name , start ) ;
+
+    start = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        pregLiteralExec( lit , subject , sizeof( subject ) , 0 , 0 ,
+                         ovector , 3 ) ;
+    }
+    snprintf( name , sizeof( name ) , "  pregLiteralExec /%s/" , pattern ) ;
+    benchReport( name , start ) ;
+
+    if( study )
+        pcre_free_study( study ) ;
+    pcre_free( re ) ;
+    pregLiteralFree( lit ) ;
+}
+
+/**
+ * @fn static void benchRequired( const char *pattern )
+ *
+ * @brief time rejecting a 4K subject that doesn't have the string the
+ * pattern requires, with libpcre (studied & JIT compiled when possible) 
+ * and with pregRequiredMissing
+ */
+static void benchRequired( const char *pattern )
+{
+    char subject[ 4096 ] ;
+    int ovector[ 30 ] ;
+    pcre *re ;
+    pcre_extra *study ;
+    pcre_extra extra ;
+    preg_literal *required ;
+    const char *error ;
+    int erroffset ;
+    double start ;
+    long i ;
+    char name[ 64 ] ;
+
+    for( i = 0 ; i + 32 < (long)sizeof( subject ) ; i += 32 )
+        memcpy( subject + i , "user=1234 action=logout status=0" , 32 ) ;
+    memset( subject + i , ' ' , sizeof( subject ) - i ) ;
+
+    re = pcre_compile( pattern , 0 , &error , &erroffset , NULL ) ;
+    required = re ? pregLiteralRequired( re , pattern , 0 ) : NULL ;
+    if( !required )
+    {
+        printf( "  %s: no required string\n" , pattern ) ;
+        if( re )
+            pcre_free( re ) ;
+        return ;
+    }
+    study = pregStudy( re , 1 , &error ) ;
+
+    start = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        pregInitExtra( &extra , study ) ;
+        pregExec( re , &extra , subject , sizeof( subject ) , 0 , 0 ,
+                  ovector , 30 ) ;
+    }
+    snprintf( name , sizeof( name ) , "  pregExec" ) ;
+    benchReport( name , start ) ;
+
+    start = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        pregRequiredMissing( required , subject , sizeof( subject ) , 0 ) ;
+    }
+    snprintf( name , sizeof( name ) , "  pregRequiredMissing" ) ;
+    benchReport( name , start ) ;
+
+    if( study )
+        pcre_free_study( study ) ;
+    pcre_free( re ) ;
+    pregLiteralFree( required ) ;
+}
+
+/**
+ * @fn static void benchStart( const char *pattern )
+ *
+ * @brief time finding a pattern whose first byte is in a class near the 
+ * end of a 4K subject, with pregMatch with and without the bytes from 
+ * pregStartCompile.  The pattern is studied, but not JIT compiled.
+ */
+static void benchStart( const char *pattern )
+{
+    char subject[ 4096 ] ;
+    int ovector[ 30 ] ;
+    pcre *re ;
+    pcre_extra *study ;
+    pcre_extra extra ;
+    preg_start *start ;
+    const char *error ;
+    int erroffset ;
+    double t ;
+    long i ;
+    char name[ 64 ] ;
+
+    for( i = 0 ; i + 8 <= (long)sizeof( subject ) ; i += 8 )
+        memcpy( subject + i , "qrstuvw " , 8 ) ;
+    memcpy( subject + sizeof( subject ) - 100 , "x1234" , 5 ) ;
+
+    re = pcre_compile( pattern , 0 , &error , &erroffset , NULL ) ;
+    study = re ? pregStudy( re , 0 , &error ) : NULL ;
+    start = re ? pregStartCompile( re , study , pattern , 0 ) : NULL ;
+    if( !start )
+    {
+        printf( "  %s: no start bytes\n" , pattern ) ;
+        if( study )
+            pcre_free_study( study ) ;
+        if( re )
+            pcre_free( re ) ;
+        return ;
+    }
+
+    t = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        pregInitExtra( &extra , study ) ;
+        pregMatch( re , &extra , NULL , NULL , NULL , NULL , 0 , subject ,
+                   sizeof( subject ) , 0 , 0 , ovector , 30 ) ;
+    }
+    snprintf( name , sizeof( name ) , "  pregMatch" ) ;
+    benchReport( name , t ) ;
+
+    t = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        pregInitExtra( &extra , study ) ;
+        pregMatch( re , &extra , NULL , NULL , start , NULL , 0 , subject ,
+                   sizeof( subject ) , 0 , 0 , ovector , 30 ) ;
+    }
+    snprintf( name , sizeof( name ) , "  pregMatch with start bytes" ) ;
+    benchReport( name , t ) ;
+
+    if( study )
+        pcre_free_study( study ) ;
+    pcre_free( re ) ;
+    pregStartFree( start ) ;
+}
+
+/**
+ * @fn static void benchClass( const char *pattern )
+ *
+ * @brief time deleting the bytes in a class from a 4K subject, with a
+ * pregExec loop (studied & JIT compiled when possible) and with 
+ * pregClassReplace
+ */
+static void benchClass( const char *pattern )
+{
+    char subject[ 4096 ] ;
+    char result[ 255 ] ;
+    int ovector[ 3 ] ;
+    pcre *re ;
+    pcre_extra *study ;
+    pcre_extra extra ;
+    preg_nfa *nfa ;
+    preg_class *cls ;
+    preg_buffer buffer ;
+    const char *error ;
+    int erroffset ;
+    int offset , used , len ;
+    double t ;
+    long i ;
+
+    for( i = 0 ; i + 16 <= (long)sizeof( subject ) ; i += 16 )
+        memcpy( subject + i , "(555) 123-4567, " , 16 ) ;
+
+    re = pcre_compile( pattern , 0 , &error , &erroffset , NULL ) ;
+    nfa = re ? pregNfaCompile( pattern , 0 , NULL , 0 ) : NULL ;
+    cls = nfa ? pregClassCompile( nfa ) : NULL ;
+    if( !cls )
+    {
+        printf( "  %s: not a class\n" , pattern ) ;
+        if( nfa )
+            pregNfaFree( nfa ) ;
+        if( re )
+            pcre_free( re ) ;
+        return ;
+    }
+    study = pregStudy( re , 1 , &error ) ;
+    pregBufferInit( &buffer , result , sizeof( result ) ) ;
+
+    t = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        pregInitExtra( &extra , study ) ;
+        offset = used = 0 ;
+        pregBufferGrow( &buffer , sizeof( subject ) + 1 , 0 ) ;
+        while( pregExec( re , &extra , subject , sizeof( subject ) , offset ,
+                         0 , ovector , 3 ) > 0 )
+        {
+            memcpy( buffer.data + used , subject + offset ,
+                    ovector[0] - offset ) ;
+            used += ovector[0] - offset ;
+            offset = ovector[1] ;
+        }
+        memcpy( buffer.data + used , subject + offset ,
+                sizeof( subject ) - offset ) ;
+    }
+    benchReport( "  pregExec loop" , t ) ;
+
+    t = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        pregClassReplace( cls , subject , sizeof( subject ) , "" , 0 , -1 ,
+                          &buffer , &len ) ;
+    }
+    benchReport( "  pregClassReplace" , t ) ;
+
+    pregBufferRelease( &buffer ) ;
+    if( study )
+        pcre_free_study( study ) ;
+    pcre_free( re ) ;
+    pregNfaFree( nfa ) ;
+    pregClassFree( cls ) ;
+}
+
+/**
+ * @fn static void benchMap( void )
+ *
+ * @brief time replacing 16 HTML entities in a 4K subject, with a pass of 
+ * pregLiteralExec for each one (like nested PREG_REPLACE's) and with one
+ * pass of pregMapReplace
+ */
+static void benchMap( void )
+{
+    static const char *entities[][ 2 ] = {
+        { "&amp;" , "&" } , { "&lt;" , "<" } , { "&gt;" , ">" } ,
+        { "&quot;" , "\"" } , { "&apos;" , "'" } , { "&nbsp;" , " " } ,
+        { "&copy;" , "(c)" } , { "&reg;" , "(r)" } , { "&trade;" , "(tm)" } ,
+        { "&hellip;" , "..." } , { "&mdash;" , "--" } , { "&ndash;" , "-" } ,
+        { "&lsquo;" , "'" } , { "&rsquo;" , "'" } , { "&ldquo;" , "\"" } ,
+        { "&rdquo;" , "\"" }
+    } ;
+    const char *line = "The quick brown fox &amp; the lazy dog &lt;b&gt;. " ;
+    int n = sizeof( entities ) / sizeof( entities[0] ) ;
+    char subject[ 4096 ] ;
+    char json[ 1024 ] ;
+    char result[ 255 ] ;
+    char *bufs[ 2 ] ;
+    int ovector[ 3 ] ;
+    preg_literal *lits[ 16 ] ;
+    preg_map *map ;
+    preg_buffer buffer ;
+    char msg[ 255 ] ;
+    int offset , used , len , k , j ;
+    double t ;
+    long i ;
+
+    for( i = 0 ; i < (long)sizeof( subject ) ; i++ )
+        subject[ i ] = line[ i % strlen( line ) ] ;
+
+    j = snprintf( json , sizeof( json ) , "{" ) ;
+    for( k = 0 ; k < n ; k++ )
+    {
+        lits[ k ] = pregLiteralCompile( entities[ k ][ 0 ] , 0 ) ;
+        j += snprintf( json + j , sizeof( json ) - j , "%s\"%s\":\"%s%s\"" , 
+                       k ? "," : "" , entities[ k ][ 0 ] , 
+                       entities[ k ][ 1 ][ 0 ] == '"' ? "\\" : "" ,
+                       entities[ k ][ 1 ] ) ;
+    }
+    snprintf( json + j , sizeof( json ) - j , "}" ) ;
+    map = pregMapCompile( json , strlen( json ) , msg , sizeof( msg ) ) ;
+    bufs[ 0 ] = malloc( sizeof( subject ) ) ;
+    bufs[ 1 ] = malloc( sizeof( subject ) ) ;
+    if( !map || !bufs[ 0 ] || !bufs[ 1 ] )
+    {
+        printf( "  map failed: %s\n" , map ? "out of memory" : msg ) ;
+        pregMapFree( map ) ;
+        free( bufs[ 0 ] ) ;
+        free( bufs[ 1 ] ) ;
+        return ;
+    }
+
+    t = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        memcpy( bufs[ 0 ] , subject , sizeof( subject ) ) ;
+        len = sizeof( subject ) ;
+        for( k = 0 ; k < n ; k++ )
+        {   // The replacements are never longer than the entities
+            offset = used = 0 ;
+            while( pregLiteralExec( lits[ k ] , bufs[ k & 1 ] , len , offset ,
+                                    0 , ovector , 3 ) > 0 )
+            {
+                memcpy( bufs[ ~k & 1 ] + used , bufs[ k & 1 ] + offset ,
+                        ovector[0] - offset ) ;
+                used += ovector[0] - offset ;
+                memcpy( bufs[ ~k & 1 ] + used , entities[ k ][ 1 ] ,
+                        strlen( entities[ k ][ 1 ] ) ) ;
+                used += strlen( entities[ k ][ 1 ] ) ;
+                offset = ovector[1] ;
+            }
+            memcpy( bufs[ ~k & 1 ] + used , bufs[ k & 1 ] + offset ,
+                    len - offset ) ;
+            len = used + len - offset ;
+        }
+    }
+    benchReport( "  pregLiteralExec pass per key" , t ) ;
+
+    pregBufferInit( &buffer , result , sizeof( result ) ) ;
+    t = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        pregMapReplace( map , subject , sizeof( subject ) , &buffer , &len ) ;
+    }
+    benchReport( "  pregMapReplace" , t ) ;
+
+    pregBufferRelease( &buffer ) ;
+    for( k = 0 ; k < n ; k++ )
+        pregLiteralFree( lits[ k ] ) ;
+    pregMapFree( map ) ;
+    free( bufs[ 0 ] ) ;
+    free( bufs[ 1 ] ) ;
+}
+
+/**
+ * @fn static void benchSet( void )
+ *
+ * @brief time finding the first of 40 patterns that matches a log line,
+ * by running each pattern in turn (like a CASE of PREG_RLIKE's) and with
+ * pregSetMatch
+ */
+static void benchSet( void )
+{
+    static const char *words[] = {
+        "timeout" , "refused" , "denied" , "forbidden" , "not found" , 
+        "unreachable" , "reset by peer" , "broken pipe" , "disk full" , 
+        "quota" , "out of memory" , "segfault" , "deadlock" , "lock wait" ,
+        "too many connections" , "syntax error" , "duplicate entry" , 
+        "checksum" , "corrupt" , "truncated" , "overflow" , "underflow" ,
+        "certificate" , "handshake" , "expired" , "revoked" , "throttled" ,
+        "rate limit" , "backoff" , "retrying" , "failover" , "replica lag" ,
+        "split brain" , "fenced" , "evicted" , "oom killer" , "panic" ,
+        "assertion" , "deprecated" , "shutdown"
+    } ;
+    const char *line = "2013-06-01 12:00:00 host=db7 pid=4242 replication "
+                       "worker stopped: evicted=1 after 3 attempts, "
+                       "continuing with the next batch of 512 rows" ;
+    int n = sizeof( words ) / sizeof( words[0] ) ;
+    int len = strlen( line ) ;
+    preg_cache_entry *pces[ 40 ] ;
+    preg_cache_entry *chain[ 40 ] ;
+    pcre_extra *studies[ 40 ] ;
+    pcre_extra extra ;
+    int ovector[ 3 ] ;
+    int workspace[ 100 ] ;
+    preg_set *set ;
+    char pattern[ 64 ] ;
+    char msg[ 255 ] ;
+    const char *error ;
+    int k , found ;
+    double t ;
+    long i ;
+
+    for( k = 0 ; k < n ; k++ )
+    {   // half of them have more to them than the word
+        snprintf( pattern , sizeof( pattern ) , k % 2 ? "/%s=\\d+/" : "/%s/i" ,
+                  words[ k ] ) ;
+        pces[ k ] = compileRegex( pattern , strlen( pattern ) , 
+                                  msg , sizeof( msg ) ) ;
+        chain[ k ] = compileRegex( pattern , strlen( pattern ) , 
+                                   msg , sizeof( msg ) ) ;
+        studies[ k ] = chain[ k ] && !chain[ k ]->literal ? 
+            pregStudy( chain[ k ]->re , 1 , &error ) : NULL ;
+    }
+    set = pregSetCompile( pces , n , 1 , msg , sizeof( msg ) ) ;
+    if( !set )
+    {
+        printf( "  set failed: %s\n" , msg ) ;
+        return ;
+    }
+
+    t = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        for( k = 0 ; k < n ; k++ )
+        {
+            if( pregRequiredMissing( chain[ k ]->required , line , len , 0 ) )
+                continue ;
+            pregInitExtra( &extra , studies[ k ] ) ;
+            if( pregMatch( chain[ k ]->re , &extra , chain[ k ]->nfa ,
+                           chain[ k ]->literal , chain[ k ]->start , NULL , 0 ,
+                           line , len , 0 , 0 , ovector , 3 ) >= 0 )
+                break ;
+        }
+    }
+    benchReport( "  a pattern at a time" , t ) ;
+    found = k ;
+
+    t = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        k = pregSetMatch( set , line , len , workspace , 100 ) ;
+    }
+    benchReport( "  pregSetMatch" , t ) ;
+    if( k != found )
+        printf( "  pregSetMatch found %d instead of %d\n" , k , found ) ;
+
+    pregSetFree( set ) ;
+    for( k = 0 ; k < n ; k++ )
+    {
+        if( studies[ k ] )
+            pcre_free_study( studies[ k ] ) ;
+        if( chain[ k ] )
+            pregCacheRelease( chain[ k ] ) ;
+    }
+}
+
+/**
+ * @fn static void benchCompile( const char *regex )
+ *
+ * @brief time compiling a pattern that isn't in the pattern cache, as a
+ * pattern that is different for every row is, with pcre_compile and with
+ * compileRegex
+ */
+static void benchCompile( const char *regex )
+{
+    preg_cache_entry *pce ;
+    const char *pattern ;
+    const char *error ;
+    char msg[ 256 ] ;
+    pcre *re ;
+    int erroffset ;
+    double t ;
+    long i ;
+
+    // pcre_compile gets the pattern without its delimiters
+    pattern = strndup( regex + 1 , strrchr( regex , '/' ) - regex - 1 ) ;
+
+    t = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        re = pcre_compile( pattern , 0 , &error , &erroffset , NULL ) ;
+        pcre_free( re ) ;
+    }
+    benchReport( "  pcre_compile" , t ) ;
+
+    t = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        pce = compileRegex( regex , strlen( regex ) , msg , sizeof( msg ) ) ;
+        pregCacheRelease( pce ) ;
+        pregCacheFlush() ;
+    }
+    benchReport( "  compileRegex (cache miss)" , t ) ;
+
+    free( (char *)pattern ) ;
+}
+
+/**
+ * @fn static void benchPool( void )
+ *
+ * @brief time getting a return buffer for a 1K string, as the 1MB that
+ * was malloc'd for every UDF call in a statement, and from the pool,
+ * and print the pool's counters
+ */
+static void benchPool( void )
+{
+    char result[ 255 ] ;
+    preg_buffer buffer ;
+    char * volatile p ;         /* so that malloc isn't optimized away */
+    preg_pool_stats stats ;
+    double t ;
+    long i ;
+
+    t = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        p = malloc( 1024000 ) ;
+        memset( p , 'x' , 1024 ) ;
+        free( p ) ;
+    }
+    benchReport( "  malloc 1MB" , t ) ;
+
+    t = benchNow() ;
+    for( i = 0 ; i < preg_bench_rows ; i++ )
+    {
+        pregBufferInit( &buffer , result , sizeof( result ) ) ;
+        pregBufferGrow( &buffer , 1024 , 0 ) ;
+        memset( buffer.data , 'x' , 1024 ) ;
+        pregBufferRelease( &buffer ) ;
+    }
+    benchReport( "  pregBufferGrow from the pool" , t ) ;
+
+    pregPoolStats( &stats ) ;
+    printf( "  pool: %lu of %lu gets were hits, %lu of %lu puts dropped\n" ,
+            stats.hits , stats.gets , stats.drops , stats.puts ) ;
+}
+
+int main( int argc , char **argv )
+{
+    pthread_t thread ;
+
+    if( argc > 1 )
+        preg_bench_rows = atol( argv[1] ) ;
+    if( preg_bench_rows <= 0 )
+        preg_bench_rows = PREG_BENCH_ROWS ;
+
+    benchLimits( "main thread" ) ;
+
+    if( !pthread_create( &thread , NULL , benchLimits , "new thread" ) )
+        pthread_join( thread , NULL ) ;
+
+    printf( "literal patterns (4K subject):\n" ) ;
+    benchLiteral( "error:" , 0 ) ;
+    benchLiteral( "ERROR:" , PCRE_CASELESS ) ;
+
+    printf( "required string missing, /user=(\\d+) action=login/ "
+            "(4K subject):\n" ) ;
+    benchRequired( "user=(\\d+) action=login" ) ;
+
+    printf( "start bytes, /[xyz]\\d+/ (4K subject):\n" ) ;
+    benchStart( "[xyz]\\d+" ) ;
+
+    printf( "deleting a class, /[^0-9]/ (4K subject):\n" ) ;
+    benchClass( "[^0-9]" ) ;
+
+    printf( "replacing 16 HTML entities (4K subject):\n" ) ;
+    benchMap() ;
+
+    printf( "first of 40 patterns that matches (150 byte subject):\n" ) ;
+    benchSet() ;
+
+    printf( "compiling /user=(\\d+) action=[a-z]+/ (not cached):\n" ) ;
+    benchCompile( "/user=(\\d+) action=[a-z]+/" ) ;
+
+    printf( "return buffers (1K string):\n" ) ;
+    benchPool() ;
+
+    return 0 ;
+}
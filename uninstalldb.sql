@@ -10,6 +10,10 @@ DROP FUNCTION IF EXISTS preg_offset ;
 DROP FUNCTION IF EXISTS lib_mysqludf_preg_info ;
 DROP FUNCTION IF EXISTS preg_capture ;
 DROP FUNCTION IF EXISTS preg_check ;
+DROP FUNCTION IF EXISTS preg_classify ;
+DROP FUNCTION IF EXISTS preg_compile_set ;
 DROP FUNCTION IF EXISTS preg_position ;
 DROP FUNCTION IF EXISTS preg_rlike ;
-DROP FUNCTION IF EXISTS preg_replace ;
\ No newline at end of file
+DROP FUNCTION IF EXISTS preg_replace ;
+DROP FUNCTION IF EXISTS preg_replace_map ;
+DROP FUNCTION IF EXISTS preg_set_match ;
\ No newline at end of file